@@ -0,0 +1,63 @@
+#ifndef BOOT_TRACE_HPP
+#define BOOT_TRACE_HPP
+
+#include <Arduino.h>
+
+// Milestones between power-on and the first reading going out, in the order they usually happen.
+// Most of them overlap: sensors are read and buffered while WiFi associates and the server is found.
+enum class BootPhase : uint8_t
+{
+    SensorsReady,       // First reading from the sensors, usable or not
+    WiFiConnected,
+    ServerFound,        // Stored or discovered
+    UUIDReady,          // Stored or requested
+    WebSocketConnected,
+    FirstSample,        // A reading, summary or history block queued for the server
+    Count
+};
+
+// When each phase was first reached, in ms since Begin(). Later reconnects don't move them.
+class BootTrace
+{
+private:
+    unsigned long bootTime = 0;
+    unsigned long times[(size_t)BootPhase::Count];
+    uint8_t reachedMask = 0;
+
+public:
+    void Begin()
+    {
+        bootTime = millis();
+        reachedMask = 0;
+    }
+
+    // True only the first time phase is reached
+    bool Mark(BootPhase phase)
+    {
+        if (IsReached(phase))
+            return false;
+
+        times[(size_t)phase] = millis() - bootTime;
+        reachedMask |= 1 << (uint8_t)phase;
+        return true;
+    }
+
+    bool IsReached(BootPhase phase) const { return (reachedMask & (1 << (uint8_t)phase)) != 0; }
+    unsigned long GetTime(BootPhase phase) const { return IsReached(phase) ? times[(size_t)phase] : 0; }
+
+    static const char* PhaseName(BootPhase phase)
+    {
+        switch (phase)
+        {
+            case BootPhase::SensorsReady: return "sensors";
+            case BootPhase::WiFiConnected: return "wifi";
+            case BootPhase::ServerFound: return "server";
+            case BootPhase::UUIDReady: return "uuid";
+            case BootPhase::WebSocketConnected: return "websocket";
+            case BootPhase::FirstSample: return "first_sample";
+            default: return "unknown";
+        }
+    }
+};
+
+#endif
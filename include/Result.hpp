@@ -2,25 +2,176 @@
 #define RESULT_HPP
 
 #include <stdlib.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+struct ResultValueTag { };
+struct ResultErrorTag { };
+
+// Value and error share storage; a Result always holds exactly one of them.
+// Types that are trivially copyable get a trivial (and constexpr-friendly) Result.
+template <typename T, typename E, bool = std::is_trivially_copyable_v<T> && std::is_trivially_copyable_v<E>>
+class ResultStorage
+{
+protected:
+    union
+    {
+        T value;
+        E error;
+    };
+    bool hasValue;
+
+    template <typename... Args>
+    constexpr ResultStorage(ResultValueTag, Args&&... args) : value(std::forward<Args>(args)...), hasValue(true) {}
+
+    template <typename... Args>
+    constexpr ResultStorage(ResultErrorTag, Args&&... args) : error(std::forward<Args>(args)...), hasValue(false) {}
+};
 
 template <typename T, typename E>
-class Result {
-public:
-    Result(const T& value, const E& error) : resultValue(value), resultError(error) {}
-    Result(const T& value) : resultValue(value) {}
-    Result(const E& error) : resultError(error) {}
+class ResultStorage<T, E, false>
+{
+protected:
+    union
+    {
+        T value;
+        E error;
+    };
+    bool hasValue;
+
+    template <typename... Args>
+    ResultStorage(ResultValueTag, Args&&... args) : value(std::forward<Args>(args)...), hasValue(true) {}
 
-    bool HasValue() const { return resultValue.has_value(); }
-    bool HasError() const { return resultError.has_value(); }
+    template <typename... Args>
+    ResultStorage(ResultErrorTag, Args&&... args) : error(std::forward<Args>(args)...), hasValue(false) {}
 
-    T& GetValue() { return resultValue.value(); }
-    const T& GetValue() const { return resultValue.value(); }
-    E& GetError() { return resultError.value(); }
-    const E& GetError() const { return resultError.value(); }
+    ResultStorage(const ResultStorage& other) : hasValue(other.hasValue)
+    {
+        if (hasValue)
+            new (&value) T(other.value);
+        else
+            new (&error) E(other.error);
+    }
 
+    ResultStorage(ResultStorage&& other) : hasValue(other.hasValue)
+    {
+        if (hasValue)
+            new (&value) T(std::move(other.value));
+        else
+            new (&error) E(std::move(other.error));
+    }
+
+    ResultStorage& operator=(const ResultStorage& other)
+    {
+        if (this != &other)
+        {
+            Destroy();
+            new (this) ResultStorage(other);
+        }
+        return *this;
+    }
+
+    ResultStorage& operator=(ResultStorage&& other)
+    {
+        if (this != &other)
+        {
+            Destroy();
+            new (this) ResultStorage(std::move(other));
+        }
+        return *this;
+    }
+
+    ~ResultStorage() { Destroy(); }
+
+    void Destroy()
+    {
+        if (hasValue)
+            value.~T();
+        else
+            error.~E();
+    }
+};
+
+template <typename T, typename E>
+class [[nodiscard]] Result : private ResultStorage<T, E>
+{
 private:
-    std::optional<T> resultValue;
-    std::optional<E> resultError;
+    static_assert(!std::is_same_v<T, E>, "Result value and error types must differ");
+
+    using Storage = ResultStorage<T, E>;
+    using Storage::value;
+    using Storage::error;
+    using Storage::hasValue;
+
+    // Reading the wrong side is a programming error, not something to recover from
+    constexpr void Expect(bool condition) const
+    {
+        if (!condition)
+            abort();
+    }
+
+public:
+    typedef T ValueType;
+    typedef E ErrorType;
+
+    constexpr Result(const T& value) : Storage(ResultValueTag(), value) {}
+    constexpr Result(T&& value) : Storage(ResultValueTag(), std::move(value)) {}
+    constexpr Result(const E& error) : Storage(ResultErrorTag(), error) {}
+    constexpr Result(E&& error) : Storage(ResultErrorTag(), std::move(error)) {}
+
+    constexpr bool HasValue() const { return hasValue; }
+    constexpr bool HasError() const { return !hasValue; }
+
+    constexpr T& GetValue() & { Expect(hasValue); return value; }
+    constexpr const T& GetValue() const & { Expect(hasValue); return value; }
+    constexpr T&& GetValue() && { Expect(hasValue); return std::move(value); }
+
+    constexpr E& GetError() & { Expect(!hasValue); return error; }
+    constexpr const E& GetError() const & { Expect(!hasValue); return error; }
+    constexpr E&& GetError() && { Expect(!hasValue); return std::move(error); }
+
+    template <typename U>
+    constexpr T ValueOr(U&& fallback) const & { return hasValue ? value : static_cast<T>(std::forward<U>(fallback)); }
+
+    template <typename U>
+    constexpr T ValueOr(U&& fallback) && { return hasValue ? std::move(value) : static_cast<T>(std::forward<U>(fallback)); }
+
+    // Map(f): Result<T, E> -> Result<f(T), E>
+    template <typename F>
+    constexpr auto Map(F&& f) const & -> Result<std::invoke_result_t<F, const T&>, E>
+    {
+        if (hasValue)
+            return std::forward<F>(f)(value);
+        return error;
+    }
+
+    template <typename F>
+    constexpr auto Map(F&& f) && -> Result<std::invoke_result_t<F, T&&>, E>
+    {
+        if (hasValue)
+            return std::forward<F>(f)(std::move(value));
+        return std::move(error);
+    }
+
+    // AndThen(f): Result<T, E> -> f(T), where f returns a Result<U, E>
+    template <typename F>
+    constexpr auto AndThen(F&& f) const & -> std::invoke_result_t<F, const T&>
+    {
+        static_assert(std::is_same_v<typename std::invoke_result_t<F, const T&>::ErrorType, E>, "AndThen must keep the error type");
+        if (hasValue)
+            return std::forward<F>(f)(value);
+        return error;
+    }
+
+    template <typename F>
+    constexpr auto AndThen(F&& f) && -> std::invoke_result_t<F, T&&>
+    {
+        static_assert(std::is_same_v<typename std::invoke_result_t<F, T&&>::ErrorType, E>, "AndThen must keep the error type");
+        if (hasValue)
+            return std::forward<F>(f)(std::move(value));
+        return std::move(error);
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,40 @@
+#ifndef SAMPLE_DEMAND_HPP
+#define SAMPLE_DEMAND_HPP
+
+#include <Arduino.h>
+
+// When a reader should go to its sensor. Until a consumer asks for a reading by a deadline, the
+// reader free-runs on its own timer. After that it reads once, lead ms before the deadline, unless
+// its last read was taken within maxAge of the deadline and still counts.
+class SampleDemand
+{
+private:
+    bool isRequested = false;
+    unsigned long deadline = 0;
+    unsigned long maxAge = 0;
+
+public:
+    void Request(unsigned long newDeadline, unsigned long newMaxAge)
+    {
+        isRequested = true;
+        deadline = newDeadline;
+        maxAge = newMaxAge;
+    }
+
+    void Release() { isRequested = false; }
+    bool IsRequested() const { return isRequested; }
+
+    bool IsDue(unsigned long lastReadTime, unsigned long lead) const
+    {
+        if (!isRequested)
+            return true;
+
+        // A read taken lead ms early has to count, or it would be repeated on every pass
+        unsigned long budget = max(maxAge, lead);
+        bool isNear = (long)(millis() + lead - deadline) >= 0;
+        bool isFresh = (long)(lastReadTime + budget - deadline) >= 0;
+        return isNear && !isFresh;
+    }
+};
+
+#endif
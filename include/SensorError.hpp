@@ -0,0 +1,16 @@
+#ifndef SENSOR_ERROR_HPP
+#define SENSOR_ERROR_HPP
+
+#include <stdint.h>
+
+enum class SensorError : uint8_t
+{
+    NotReady,
+    Stale,          // Only returned where a current value is required
+    Timeout,        // The sensor didn't answer
+    Checksum,       // It answered, but garbled
+    OutOfRange,     // Outside what the sensor can measure, or pinned to a rail of the ADC
+    Stuck           // Hasn't moved for longer than the real quantity ever stays still
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef SENSOR_HEALTH_HPP
+#define SENSOR_HEALTH_HPP
+
+#include <Arduino.h>
+#include <SensorError.hpp>
+
+// Goes with every value in a sample. Ok and Stale values are sent; the others are dropped and only
+// the flag goes out.
+enum class SampleQuality : uint8_t
+{
+    Ok,
+    Stale,          // The last good value, standing in for a read that just failed
+    Timeout,
+    Checksum,
+    OutOfRange,
+    Stuck           // No longer set by this firmware, still understood on the wire
+};
+
+inline bool IsUsable(SampleQuality quality) { return quality == SampleQuality::Ok || quality == SampleQuality::Stale; }
+
+inline SensorError ErrorOf(SampleQuality quality)
+{
+    switch (quality)
+    {
+        case SampleQuality::Stale: return SensorError::Stale;
+        case SampleQuality::Timeout: return SensorError::Timeout;
+        case SampleQuality::Checksum: return SensorError::Checksum;
+        case SampleQuality::OutOfRange: return SensorError::OutOfRange;
+        case SampleQuality::Stuck: return SensorError::Stuck;
+        default: return SensorError::NotReady;
+    }
+}
+
+inline const char* QualityName(SampleQuality quality)
+{
+    switch (quality)
+    {
+        case SampleQuality::Ok: return "ok";
+        case SampleQuality::Stale: return "stale";
+        case SampleQuality::Timeout: return "timeout";
+        case SampleQuality::Checksum: return "checksum";
+        case SampleQuality::OutOfRange: return "out_of_range";
+        default: return "stuck";
+    }
+}
+
+// Error counters of one sensor since boot
+struct SensorHealth
+{
+    unsigned long reads = 0;
+    unsigned long timeouts = 0;
+    unsigned long checksumErrors = 0;
+    unsigned long outOfRange = 0;
+    unsigned long stuck = 0;                // Times it was found stuck, not reads while it was
+    uint8_t consecutiveFailures = 0;
+
+    void AddFailure(SampleQuality quality)
+    {
+        if (quality == SampleQuality::Timeout) timeouts++;
+        else if (quality == SampleQuality::Checksum) checksumErrors++;
+        else if (quality == SampleQuality::OutOfRange) outOfRange++;
+
+        if (consecutiveFailures < UINT8_MAX)
+            consecutiveFailures++;
+    }
+};
+
+// Both channels of a sensor keeping exactly the same values for longer than timeout. Only a hint for
+// the health log: a dark, dry night or a climate-controlled room is just as flat as a dead sensor.
+class StuckDetector
+{
+private:
+    unsigned long timeout;
+    float last[2] = { NAN, NAN };
+    unsigned long lastChangeTime = 0;
+    bool isStuck = false;
+
+public:
+    StuckDetector(unsigned long timeout) : timeout(timeout) { }
+
+    // True when the values have just gone flat for timeout
+    bool Add(float first, float second)
+    {
+        if (first != last[0] || second != last[1])
+        {
+            last[0] = first;
+            last[1] = second;
+            lastChangeTime = millis();
+            isStuck = false;
+            return false;
+        }
+
+        if (isStuck || millis() - lastChangeTime < timeout)
+            return false;
+
+        isStuck = true;
+        return true;
+    }
+
+    bool IsStuck() { return isStuck; }
+};
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef VERSION_H
+#define VERSION_H
+
+// Compared against the server's firmware manifest; CI can override it with -D FIRMWARE_VERSION=\"x.y.z\"
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "0.1.0"
+#endif
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef AGGREGATOR_HPP
+#define AGGREGATOR_HPP
+
+#include <Arduino.h>
+#include <Logger.hpp>
+#include <SensorReader.hpp>
+
+#define AGGREGATOR_MIN_WINDOW 10000UL
+#define AGGREGATOR_MAX_WINDOW 3600000UL
+
+// Streaming count/min/max/mean/variance of one channel. The mean and variance use Welford's update,
+// so a window needs no sample storage and doesn't lose precision to a running sum of squares.
+struct ChannelStats
+{
+    unsigned int count = 0;
+    float min = 0.0f;
+    float max = 0.0f;
+    float mean = 0.0f;
+    float m2 = 0.0f;    // Sum of squared differences from the mean
+
+    void Add(float value)
+    {
+        if (count == 0)
+        {
+            min = value;
+            max = value;
+        }
+        else
+        {
+            if (value < min) min = value;
+            if (value > max) max = value;
+        }
+
+        count++;
+        float delta = value - mean;
+        mean += delta / count;
+        m2 += delta * (value - mean);
+    }
+
+    // Population variance, so the server can rebuild m2 (variance * count) and merge windows
+    float GetVariance() const { return count == 0 ? 0.0f : m2 / count; }
+    float GetStdDev() const { return sqrtf(GetVariance()); }
+};
+
+struct WindowSummary
+{
+    unsigned long start;
+    unsigned long length;
+    unsigned int samples = 0;
+
+    ChannelStats temperature;
+    ChannelStats humidity;
+    ChannelStats soilMoisture;
+    ChannelStats lightLevel;
+
+    // A channel's own count leaves out the values that were flagged unusable
+    unsigned int GetSampleCount() const { return samples; }
+};
+
+// Folds readings into tumbling windows of a fixed length and keeps the last closed one until it's sent.
+// A window length of 0 turns aggregation off.
+class WindowedAggregator
+{
+private:
+    unsigned long windowLength = 0;
+
+    WindowSummary window;
+    WindowSummary summary;
+    bool hasSummary = false;
+
+    void Reset(unsigned long start)
+    {
+        window = WindowSummary();
+        window.start = start;
+        window.length = windowLength;
+    }
+
+public:
+    WindowedAggregator() { }
+
+    static bool IsValidWindow(unsigned long length)
+    {
+        return length == 0 || (length >= AGGREGATOR_MIN_WINDOW && length <= AGGREGATOR_MAX_WINDOW);
+    }
+
+    // Drops the window that is open, since its samples were taken for a different length
+    void SetWindowLength(unsigned long length)
+    {
+        windowLength = length;
+        Reset(millis());
+    }
+
+    unsigned long GetWindowLength() { return windowLength; }
+    bool IsEnabled() { return windowLength != 0; }
+
+    void Add(const SensorReadings& readings)
+    {
+        window.samples++;
+        if (IsUsable(readings.temperatureQuality)) window.temperature.Add(readings.temperature);
+        if (IsUsable(readings.humidityQuality)) window.humidity.Add(readings.humidity);
+        if (IsUsable(readings.soilMoistureQuality)) window.soilMoisture.Add(readings.soilMoisture);
+        if (IsUsable(readings.lightLevelQuality)) window.lightLevel.Add(readings.lightLevel);
+    }
+
+    void Update()
+    {
+        if (!IsEnabled() || millis() - window.start < windowLength)
+            return;
+
+        if (window.GetSampleCount() > 0)
+        {
+            if (hasSummary)
+                LOG_WARN("Summary of the window at %lu was never sent, replacing it", summary.start);
+
+            summary = window;
+            hasSummary = true;
+        }
+
+        // Windows stay on the same boundaries even if Update() runs late
+        unsigned long elapsed = millis() - window.start;
+        Reset(window.start + elapsed - elapsed % windowLength);
+    }
+
+    bool HasSummary() { return hasSummary; }
+    const WindowSummary& GetSummary() { return summary; }
+    void ClearSummary() { hasSummary = false; }
+
+    const WindowSummary& GetOpenWindow() { return window; }
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef ALERT_ENGINE_HPP
+#define ALERT_ENGINE_HPP
+
+#include <Arduino.h>
+#include <AlertRule.hpp>
+#include <Logger.hpp>
+#include <Preferences.hpp>
+#include <SensorReader.hpp>
+
+struct AlertEvent
+{
+    uint8_t index;
+    AlertRule rule;
+    bool isFiring;          // Otherwise it just cleared
+    float value;
+    unsigned long at;
+};
+
+// Checks the rules stored in Preferences against every new reading. A rule fires once its condition
+// has held for minDuration and clears when the value comes back past the threshold by hysteresis.
+// The latest change of each rule waits here until it's sent.
+class AlertEngine
+{
+private:
+    struct RuleState
+    {
+        bool isConditionMet;
+        bool isFiring;
+        bool isUnsent;
+        unsigned long conditionSince;
+        float value;
+        unsigned long changedAt;
+    };
+
+    PreferencesManager& preferences;
+    RuleState states[ALERT_MAX_RULES] = { };
+
+    static float ValueOf(const SensorReadings& readings, AlertChannel channel)
+    {
+        switch (channel)
+        {
+            case AlertChannel::Temperature: return readings.temperature;
+            case AlertChannel::Humidity: return readings.humidity;
+            case AlertChannel::SoilMoisture: return readings.soilMoisture;
+            default: return readings.lightLevel;
+        }
+    }
+
+    void Change(uint8_t index, bool isFiring, float value)
+    {
+        RuleState& state = states[index];
+        state.isFiring = isFiring;
+        state.isUnsent = true;
+        state.value = value;
+        state.changedAt = millis();
+
+        if (isFiring)
+            LOG_WARN("Alert %d fired: %s at %f", index, ChannelName(preferences.GetAlertRule(index).channel), value);
+        else
+            LOG_INFO("Alert %d cleared: %s at %f", index, ChannelName(preferences.GetAlertRule(index).channel), value);
+    }
+
+public:
+    AlertEngine(PreferencesManager& preferences) : preferences(preferences) { }
+
+    static const char* ChannelName(AlertChannel channel)
+    {
+        switch (channel)
+        {
+            case AlertChannel::Temperature: return "temperature";
+            case AlertChannel::Humidity: return "humidity";
+            case AlertChannel::SoilMoisture: return "soil_moisture";
+            default: return "light_level";
+        }
+    }
+
+    // Takes the names above, or with dashes like the get-* commands
+    static bool ParseChannel(const char* name, AlertChannel& channel)
+    {
+        const AlertChannel channels[] = { AlertChannel::Temperature, AlertChannel::Humidity, AlertChannel::SoilMoisture, AlertChannel::LightLevel };
+        for (AlertChannel candidate : channels)
+        {
+            const char* candidateName = ChannelName(candidate);
+            size_t i = 0;
+            for (; name[i] != '\0' && (name[i] == candidateName[i] || (name[i] == '-' && candidateName[i] == '_')); i++) { }
+
+            if (name[i] == '\0' && candidateName[i] == '\0')
+            {
+                channel = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Evaluate(const SensorReadings& readings)
+    {
+        for (uint8_t i = 0; i < ALERT_MAX_RULES; i++)
+        {
+            AlertRule rule = preferences.GetAlertRule(i);
+            float value = ValueOf(readings, rule.channel);
+            if (!rule.isEnabled || isnan(value))
+                continue;
+
+            RuleState& state = states[i];
+            bool isAbove = rule.condition == AlertCondition::Above;
+
+            if (state.isFiring)
+            {
+                if (isAbove ? value <= rule.threshold - rule.hysteresis : value >= rule.threshold + rule.hysteresis)
+                {
+                    state.isConditionMet = false;
+                    Change(i, false, value);
+                }
+                continue;
+            }
+
+            if (!(isAbove ? value > rule.threshold : value < rule.threshold))
+            {
+                state.isConditionMet = false;
+                continue;
+            }
+
+            if (!state.isConditionMet)
+            {
+                state.isConditionMet = true;
+                state.conditionSince = millis();
+            }
+
+            if (millis() - state.conditionSince >= rule.minDuration * 1000UL)
+                Change(i, true, value);
+        }
+    }
+
+    // Forgets what a rule was doing, after it's been changed or removed
+    void Reset(uint8_t index)
+    {
+        if (index < ALERT_MAX_RULES)
+            states[index] = RuleState();
+    }
+
+    bool IsFiring(uint8_t index) { return index < ALERT_MAX_RULES && states[index].isFiring; }
+
+    // The oldest change that hasn't been sent yet
+    bool GetUnsent(AlertEvent& event)
+    {
+        int oldest = -1;
+        for (uint8_t i = 0; i < ALERT_MAX_RULES; i++)
+        {
+            if (states[i].isUnsent && (oldest < 0 || (long)(states[i].changedAt - states[oldest].changedAt) < 0))
+                oldest = i;
+        }
+
+        if (oldest < 0)
+            return false;
+
+        const RuleState& state = states[oldest];
+        event = AlertEvent { (uint8_t)oldest, preferences.GetAlertRule(oldest), state.isFiring, state.value, state.changedAt };
+        return true;
+    }
+
+    void MarkSent(uint8_t index)
+    {
+        if (index < ALERT_MAX_RULES)
+            states[index].isUnsent = false;
+    }
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef ALERTRULE_HPP
+#define ALERTRULE_HPP
+
+#include <stdint.h>
+
+#define ALERT_MAX_RULES 8
+
+enum class AlertChannel : uint8_t
+{
+    Temperature,
+    Humidity,
+    SoilMoisture,
+    LightLevel
+};
+
+enum class AlertCondition : uint8_t
+{
+    Above,
+    Below
+};
+
+struct AlertRule
+{
+    bool isEnabled;
+    AlertChannel channel;
+    AlertCondition condition;
+    uint16_t minDuration;   // Seconds the condition has to hold before the rule fires
+    float threshold;
+    float hysteresis;       // How far back past the threshold the value has to go to clear the alert
+};
+
+#endif
@@ -4,56 +4,145 @@
 #include <Arduino.h>
 #include <Result.hpp>
 
-#define MAX_COMMAND_LENGTH 32
+enum class CommandErrorCode : uint8_t
+{
+    NothingSupplied,
+    UnknownCommand,
+    WrongArgumentCount,
+    UnassignedHandler,
+    NotAllowed,
+    Busy,
+    Failed
+};
 
-typedef Result<bool, const char*> CommandResult;
-typedef CommandResult (*CommandHandler)(int argc, char** argv);
+// Where a command line came from. The serial port can run everything, the server only commands
+// marked Remote.
+enum class CommandSource : uint8_t
+{
+    Serial,
+    Server
+};
 
-#define OK CommandResult(true)
-#define ERR(error) CommandResult(error)
+enum class CommandAccess : uint8_t
+{
+    SerialOnly,
+    Remote
+};
 
-char errorBuf[128];
+// Small enough to return by value; the text is only put together when it gets printed
+struct CommandError
+{
+    CommandErrorCode code;
+    PGM_P message;
+    uint8_t expectedArgs;
+    uint8_t receivedArgs;
 
+    size_t Describe(char* buffer, size_t size) const
+    {
+        switch (code)
+        {
+            case CommandErrorCode::NothingSupplied:
+                return snprintf_P(buffer, size, PSTR("Nothing supplied"));
+            case CommandErrorCode::UnknownCommand:
+                return snprintf_P(buffer, size, PSTR("Unknown command"));
+            case CommandErrorCode::WrongArgumentCount:
+                return snprintf_P(buffer, size, PSTR("Wrong argument count: expected %u, got %u"), expectedArgs, receivedArgs);
+            case CommandErrorCode::UnassignedHandler:
+                return snprintf_P(buffer, size, PSTR("Unassigned handler"));
+            case CommandErrorCode::NotAllowed:
+                return snprintf_P(buffer, size, PSTR("Only allowed from the serial port"));
+            case CommandErrorCode::Busy:
+                return snprintf_P(buffer, size, PSTR("Too many commands waiting"));
+            default:
+                strncpy_P(buffer, message, size - 1);
+                buffer[size - 1] = '\0';
+                return strlen(buffer);
+        }
+    }
+
+    // For results sent to the server
+    const char* GetCodeName() const
+    {
+        switch (code)
+        {
+            case CommandErrorCode::NothingSupplied: return "nothing_supplied";
+            case CommandErrorCode::UnknownCommand: return "unknown_command";
+            case CommandErrorCode::WrongArgumentCount: return "wrong_argument_count";
+            case CommandErrorCode::UnassignedHandler: return "unassigned_handler";
+            case CommandErrorCode::NotAllowed: return "not_allowed";
+            case CommandErrorCode::Busy: return "busy";
+            default: return "failed";
+        }
+    }
+};
+
+typedef Result<bool, CommandError> CommandResult;
+
+#define OK CommandResult(true)
+#define ERR(error) CommandResult(CommandError { CommandErrorCode::Failed, PSTR(error), 0, 0 })
+#define COMMAND_ERROR(code) CommandResult(CommandError { (code), nullptr, 0, 0 })
+
+// Handlers get the object they operate on (usually the Probe) instead of reaching for globals
+template <typename Context>
 class Command {
+public:
+    typedef CommandResult (*Handler)(Context& context, int argc, char** argv);
+
 private:
-    char name[MAX_COMMAND_LENGTH];
-    unsigned int argCount;
-    CommandHandler handler;
+    PGM_P name;
+    unsigned int minArgCount;
+    unsigned int maxArgCount;
+    Handler handler;
+    CommandAccess access;
 
 public:
     Command() { }
 
-    Command(const char* name, unsigned int argCount, CommandHandler handler) 
+    // name must be a flash string, e.g. PSTR("wifi-set")
+    Command(PGM_P name, unsigned int argCount, Handler handler, CommandAccess access = CommandAccess::SerialOnly) 
+        : Command(name, argCount, argCount, handler, access)
+    {
+    }
+
+    // Takes from minArgCount to maxArgCount arguments; the handler sorts out which form it got
+    Command(PGM_P name, unsigned int minArgCount, unsigned int maxArgCount, Handler handler, CommandAccess access = CommandAccess::SerialOnly)
     {
-        strncpy(this->name, name, MAX_COMMAND_LENGTH);
-        this->argCount = argCount;
+        this->name = name;
+        this->minArgCount = minArgCount;
+        this->maxArgCount = maxArgCount;
         this->handler = handler;
+        this->access = access;
     }
 
-    CommandResult ExecuteCommand(unsigned int argc, char** argv) 
+    CommandResult ExecuteCommand(Context& context, unsigned int argc, char** argv, CommandSource source = CommandSource::Serial) 
     {
-        if (argc != argCount)
+        if (!Accepts(argc))
         {
-            sprintf(errorBuf, "Wrong argument count: expected %d, got %d", argCount, argc);
-            return ERR(errorBuf);
+            unsigned int expected = argc < minArgCount ? minArgCount : maxArgCount;
+            return CommandResult(CommandError { CommandErrorCode::WrongArgumentCount, nullptr, (uint8_t)expected, (uint8_t)argc });
         }
 
+        if (source == CommandSource::Server && access != CommandAccess::Remote)
+            return COMMAND_ERROR(CommandErrorCode::NotAllowed);
+
         if (handler == nullptr)
-            return ERR("Unassigned handler");
+            return COMMAND_ERROR(CommandErrorCode::UnassignedHandler);
 
-        return handler(argc, argv);
+        return handler(context, argc, argv);
     }
 
-    char* GetName()
+    PGM_P GetName()
     {
         return name;
     }
+
+    bool Accepts(unsigned int argc) { return argc >= minArgCount && argc <= maxArgCount; }
 };
 
-template <size_t maxCommands, size_t bufferSize = 128>
+template <size_t maxCommands, typename Context, size_t bufferSize = 128>
 class CommandExecutor {
 private:
-    Command commands[maxCommands];
+    Command<Context> commands[maxCommands];
     unsigned int commandCount = 0;
 
     char buffer[bufferSize];
@@ -63,16 +152,17 @@ public:
     { 
     }
 
-    void AddCommand(Command&& command)
+    void AddCommand(Command<Context>&& command)
     {
         if (commandCount >= maxCommands)
             return;
         commands[commandCount++] = command;
     }
 
-    CommandResult ExecuteCommand(const char* line)
+    CommandResult ExecuteCommand(Context& context, const char* line, CommandSource source = CommandSource::Serial)
     {
-        strncpy(buffer, line, bufferSize);
+        strncpy(buffer, line, bufferSize - 1);
+        buffer[bufferSize - 1] = '\0';
 
         char* token = strtok(buffer, " ");
         unsigned int argc = 0;
@@ -88,17 +178,26 @@ public:
         {
             const char* commandName = argv[0];
 
+            // A name can be added more than once with different argument counts
+            Command<Context>* namesake = nullptr;
             for (unsigned int i = 0; i < commandCount; i++)
             {
-                Command& command = commands[i];
-                if (strcmp(command.GetName(), commandName) == 0)
-                    return command.ExecuteCommand(argc - 1, &argv[1]);
+                Command<Context>& command = commands[i];
+                if (strcmp_P(commandName, command.GetName()) != 0)
+                    continue;
+
+                if (command.Accepts(argc - 1))
+                    return command.ExecuteCommand(context, argc - 1, &argv[1], source);
+                if (namesake == nullptr)
+                    namesake = &command;
             }
 
-            return ERR("Unknown command");
+            if (namesake != nullptr)
+                return namesake->ExecuteCommand(context, argc - 1, &argv[1], source);
+            return COMMAND_ERROR(CommandErrorCode::UnknownCommand);
         }
 
-        return ERR("Nothing supplied");
+        return COMMAND_ERROR(CommandErrorCode::NothingSupplied);
     }
 };
 
@@ -0,0 +1,84 @@
+#ifndef REMOTE_COMMAND_QUEUE_HPP
+#define REMOTE_COMMAND_QUEUE_HPP
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Command.hpp>
+
+#define REMOTE_COMMAND_SLOTS 4
+#define REMOTE_COMMAND_ID_SIZE 40       // Fits a UUID
+#define REMOTE_COMMAND_LINE_SIZE 128
+#define REMOTE_COMMAND_OUTPUT_VALUES 12
+#define REMOTE_COMMAND_OUTPUT_SIZE (JSON_OBJECT_SIZE(REMOTE_COMMAND_OUTPUT_VALUES) + 128)    // And room for copied strings
+
+// A command line from the server, and once it has run, what came of it. It stays queued until the
+// result is handed to the Sender, so a full outbox delays the answer instead of losing it.
+struct RemoteCommand
+{
+    char id[REMOTE_COMMAND_ID_SIZE];
+    char line[REMOTE_COMMAND_LINE_SIZE];
+    unsigned long receivedAt;
+    bool isDone;
+    bool isOk;
+    CommandError error;
+    unsigned long took;         // From arrival to the end of the handler
+    JsonObject output;          // What the handler reported, as names and values; null until it runs
+};
+
+// Commands from the server wait here and run one per pass of the loop, so a burst of them can't
+// hold up sampling.
+class RemoteCommandQueue
+{
+private:
+    RemoteCommand slots[REMOTE_COMMAND_SLOTS];
+    unsigned int first = 0;
+    unsigned int count = 0;
+
+    // Only the command at the front runs, and it stays there until its result is sent, so it's the
+    // only one with output
+    StaticJsonDocument<REMOTE_COMMAND_OUTPUT_SIZE> output;
+
+public:
+    // False when the queue is full or the command doesn't fit
+    bool Push(const char* id, const char* line)
+    {
+        if (count == REMOTE_COMMAND_SLOTS || strlen(id) >= REMOTE_COMMAND_ID_SIZE || strlen(line) >= REMOTE_COMMAND_LINE_SIZE)
+            return false;
+
+        RemoteCommand& command = slots[(first + count++) % REMOTE_COMMAND_SLOTS];
+        strcpy(command.id, id);
+        strcpy(command.line, line);
+        command.receivedAt = millis();
+        command.isDone = false;
+        command.isOk = false;
+        command.took = 0;
+        command.output = JsonObject();
+        return true;
+    }
+
+    RemoteCommand* Peek() { return count == 0 ? nullptr : &slots[first]; }
+
+    // An empty object for the command at the front to write its output into
+    JsonObject BeginOutput()
+    {
+        RemoteCommand& command = slots[first];
+        command.output = output.to<JsonObject>();
+        return command.output;
+    }
+
+    void Pop()
+    {
+        if (count == 0)
+            return;
+
+        slots[first].output = JsonObject();
+        output.clear();
+        first = (first + 1) % REMOTE_COMMAND_SLOTS;
+        count--;
+    }
+
+    bool IsEmpty() { return count == 0; }
+    unsigned int GetCount() { return count; }
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef CONFIG_OVERLAY_HPP
+#define CONFIG_OVERLAY_HPP
+
+#include <stdint.h>
+
+#define CONFIG_MAX_VALUES 16        // Spare slots, so new settings don't move what's saved after them
+
+// The settings that were changed at runtime. Anything not in setMask follows the firmware's default.
+struct ConfigOverlay
+{
+    uint16_t setMask;
+    uint32_t values[CONFIG_MAX_VALUES];
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef CONFIG_REGISTRY_HPP
+#define CONFIG_REGISTRY_HPP
+
+#include <Arduino.h>
+#include <Preferences.hpp>
+#include <Result.hpp>
+
+enum class ConfigError : uint8_t
+{
+    UnknownName,
+    OutOfRange
+};
+
+struct ConfigEntry
+{
+    PGM_P name;
+    PGM_P unit;             // Printed right after the value, e.g. " ms"
+    uint32_t min;
+    uint32_t max;
+    uint32_t defaultValue;
+    bool isRemote;          // Whether the server may change it
+};
+
+// Named, bounded settings on top of the overlay in Preferences. Key is an enum indexing entries, so
+// code asks for settings by key and the serial commands by name. Set() doesn't save or apply
+// anything; the owner does both once it's happy with the change.
+template <typename Key>
+class ConfigRegistry
+{
+private:
+    PreferencesManager& preferences;
+    const ConfigEntry* entries;
+    uint8_t count;
+
+public:
+    ConfigRegistry(PreferencesManager& preferences, const ConfigEntry* entries, uint8_t count)
+        : preferences(preferences), entries(entries), count(min(count, (uint8_t)CONFIG_MAX_VALUES))
+    {
+
+    }
+
+    uint8_t GetCount() { return count; }
+    const ConfigEntry& GetEntry(Key key) { return entries[(uint8_t)key]; }
+
+    Result<Key, ConfigError> Find(const char* name)
+    {
+        for (uint8_t i = 0; i < count; i++)
+        {
+            if (strcmp_P(name, entries[i].name) == 0)
+                return (Key)i;
+        }
+        return ConfigError::UnknownName;
+    }
+
+    uint32_t Get(Key key)
+    {
+        uint32_t value;
+        if (preferences.GetConfigValue((uint8_t)key, value) && value >= GetEntry(key).min && value <= GetEntry(key).max)
+            return value;
+        return GetEntry(key).defaultValue;
+    }
+
+    bool IsSet(Key key)
+    {
+        uint32_t value;
+        return preferences.GetConfigValue((uint8_t)key, value);
+    }
+
+    Result<uint32_t, ConfigError> Set(Key key, uint32_t value)
+    {
+        const ConfigEntry& entry = GetEntry(key);
+        if (value < entry.min || value > entry.max)
+            return ConfigError::OutOfRange;
+
+        preferences.SetConfigValue((uint8_t)key, value);
+        return value;
+    }
+
+    void Reset(Key key) { preferences.ClearConfigValue((uint8_t)key); }
+};
+
+#endif
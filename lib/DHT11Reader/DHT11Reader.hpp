@@ -2,6 +2,20 @@
 #define DHT_READER_HPP
 
 #include <DHTesp.h>
+#include <Logger.hpp>
+#include <Result.hpp>
+#include <SensorError.hpp>
+#include <SensorHealth.hpp>
+#include <SampleDemand.hpp>
+
+#define DHT_MAX_BACKOFF 30000UL         // Retries slow down to this while reads keep failing
+#define DHT_STALE_TIMEOUT 10000UL       // How long the last good reading stands in for failed ones
+#define DHT_STUCK_TIMEOUT 3600000UL     // It only resolves 1 oC and 1%, so an hour before it's even logged
+#define DHT_MIN_TEMPERATURE 0.0f
+#define DHT_MAX_TEMPERATURE 60.0f
+#define DHT_MIN_HUMIDITY 0.0f
+#define DHT_MAX_HUMIDITY 100.0f
+#define DHT_READ_LEAD 50UL              // The start signal alone holds the line low for 18 ms
 
 class DHT11Reader
 {
@@ -10,12 +24,41 @@ private:
 
     int pin;
 
-    float temperature;
-    float humidity;
+    float temperature = NAN;
+    float humidity = NAN;
+
+    bool hasRead = false;
+    bool hasValue = false;
+    SampleQuality lastFailure = SampleQuality::Timeout;
+    bool isOutageLogged = false;
+    SensorHealth health;
+    StuckDetector stuck = StuckDetector(DHT_STUCK_TIMEOUT);
+    SampleDemand demand;
+
+    unsigned long lastUpdateTime = 0;
+    unsigned long lastGoodTime = 0;
+
+    // The sampling period, doubled for every failure in a row after the first
+    unsigned long GetRetryInterval()
+    {
+        unsigned long interval = dht.getMinimumSamplingPeriod();
+        for (uint8_t i = 1; i < health.consecutiveFailures && interval < DHT_MAX_BACKOFF; i++)
+            interval *= 2;
+        return min(interval, DHT_MAX_BACKOFF);
+    }
 
-    bool isReady;
+    void Fail(SampleQuality quality)
+    {
+        health.AddFailure(quality);
+        lastFailure = quality;
 
-    unsigned long lastUpdateTime;
+        // A single failed read is common on a DHT11; only say something once it costs a value
+        if (!isOutageLogged && !IsUsable(GetQuality()))
+        {
+            LOG_WARN("DHT11 failing (%s), %d reads in a row", QualityName(quality), health.consecutiveFailures);
+            isOutageLogged = true;
+        }
+    }
 
 public:
     DHT11Reader() { }
@@ -32,20 +75,84 @@ public:
 
     void Update()
     {
-        if (millis() - lastUpdateTime > (unsigned long)dht.getMinimumSamplingPeriod())
+        if (hasRead && (!demand.IsDue(lastUpdateTime, DHT_READ_LEAD) || millis() - lastUpdateTime <= GetRetryInterval()))
+            return;
+
+        hasRead = true;
+        lastUpdateTime = millis();
+        health.reads++;
+
+        TempAndHumidity values = dht.getTempAndHumidity();
+        DHTesp::DHT_ERROR_t status = dht.getStatus();
+        if (status != DHTesp::ERROR_NONE)
         {
-            temperature = dht.getTemperature();
-            humidity = dht.getHumidity();
+            Fail(status == DHTesp::ERROR_CHECKSUM ? SampleQuality::Checksum : SampleQuality::Timeout);
+            return;
+        }
 
-            isReady = true;
-            lastUpdateTime = millis();
+        if (isnan(values.temperature) || isnan(values.humidity) ||
+            values.temperature < DHT_MIN_TEMPERATURE || values.temperature > DHT_MAX_TEMPERATURE ||
+            values.humidity < DHT_MIN_HUMIDITY || values.humidity > DHT_MAX_HUMIDITY)
+        {
+            Fail(SampleQuality::OutOfRange);
+            return;
         }
+
+        if (isOutageLogged)
+            LOG_INFO("DHT11 back after %d failed reads", health.consecutiveFailures);
+        isOutageLogged = false;
+        health.consecutiveFailures = 0;
+
+        temperature = values.temperature;
+        humidity = values.humidity;
+        hasValue = true;
+        lastGoodTime = millis();
+
+        if (stuck.Add(temperature, humidity))
+        {
+            health.stuck++;
+            LOG_INFO("DHT11 hasn't changed in %lu min", DHT_STUCK_TIMEOUT / 60000);
+        }
+    }
+
+    // Read once, just before deadline, instead of every sampling period
+    void RequestBy(unsigned long deadline, unsigned long maxAge) { demand.Request(deadline, maxAge); }
+    void FreeRun() { demand.Release(); }
+
+    // Has been read at least once, successfully or not
+    bool IsReady() { return hasRead; }
+    unsigned long GetLastUpdateTime() { return lastUpdateTime; }
+
+    SampleQuality GetQuality()
+    {
+        if (health.consecutiveFailures > 0)
+            return hasValue && millis() - lastGoodTime < DHT_STALE_TIMEOUT ? SampleQuality::Stale : lastFailure;
+        return SampleQuality::Ok;
     }
 
-    bool IsReady() { return isReady; }
+    const SensorHealth& GetHealth() { return health; }
 
-    float GetTemperature() { return temperature; }
-    float GetHumidity() { return humidity; }
+    Result<float, SensorError> GetTemperature()
+    {
+        if (!hasRead)
+            return SensorError::NotReady;
+
+        SampleQuality quality = GetQuality();
+        if (!IsUsable(quality))
+            return ErrorOf(quality);
+        return temperature;
+    }
+
+    Result<float, SensorError> GetHumidity()
+    {
+        if (!hasRead)
+            return SensorError::NotReady;
+
+        SampleQuality quality = GetQuality();
+        if (!IsUsable(quality))
+            return ErrorOf(quality);
+        return humidity;
+    }
 };
 
 #endif
\ No newline at end of file
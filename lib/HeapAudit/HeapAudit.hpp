@@ -0,0 +1,73 @@
+#ifndef HEAP_AUDIT_HPP
+#define HEAP_AUDIT_HPP
+
+#include <Arduino.h>
+#include <Logger.hpp>
+
+#define HEAP_AUDIT_WARMUP_TIME 30000     // Connecting, discovery and the first sends are allowed to allocate
+#define HEAP_AUDIT_MIN_FREE_HEAP 12288
+#define HEAP_AUDIT_MIN_FREE_BLOCK 6144   // Roughly what the WebSocket library needs to reconnect
+
+class HeapAudit
+{
+private:
+    uint32_t loopStartHeap = 0;
+
+    uint32_t lowestFreeHeap = UINT32_MAX;
+    uint32_t lowestFreeBlock = UINT32_MAX;
+    uint8_t highestFragmentation = 0;
+
+    unsigned long auditedLoops = 0;
+    unsigned long allocatingLoops = 0;
+    uint32_t heldBytes = 0;
+
+    bool isOverBudget = false;
+
+public:
+    HeapAudit() { }
+
+    void BeginLoop()
+    {
+        loopStartHeap = ESP.getFreeHeap();
+    }
+
+    // Counts loop passes that return with less free heap than they started with. After the warm-up
+    // period every one of those is an allocation in a steady-state path (or a leak).
+    void EndLoop()
+    {
+        uint32_t freeHeap = ESP.getFreeHeap();
+        uint32_t freeBlock = ESP.getMaxFreeBlockSize();
+        uint8_t fragmentation = ESP.getHeapFragmentation();
+
+        lowestFreeHeap = min(lowestFreeHeap, freeHeap);
+        lowestFreeBlock = min(lowestFreeBlock, freeBlock);
+        highestFragmentation = max(highestFragmentation, fragmentation);
+
+        if (millis() < HEAP_AUDIT_WARMUP_TIME)
+            return;
+
+        auditedLoops++;
+        if (freeHeap < loopStartHeap)
+        {
+            allocatingLoops++;
+            heldBytes += loopStartHeap - freeHeap;
+        }
+
+        bool overBudget = freeHeap < HEAP_AUDIT_MIN_FREE_HEAP || freeBlock < HEAP_AUDIT_MIN_FREE_BLOCK;
+        if (overBudget && !isOverBudget)
+            LOG_WARN("Heap over budget: %u B free, largest block %u B, %u%% fragmented", freeHeap, freeBlock, fragmentation);
+        isOverBudget = overBudget;
+    }
+
+    void PrintStats()
+    {
+        LOG_INFO("Heap: %u B free, largest block %u B, %u%% fragmented", ESP.getFreeHeap(), ESP.getMaxFreeBlockSize(), ESP.getHeapFragmentation());
+        LOG_INFO("Heap low-water: %u B free, largest block %u B, %u%% fragmented", lowestFreeHeap, lowestFreeBlock, highestFragmentation);
+        LOG_INFO("Steady state: %lu of %lu loops allocated, %u B held", allocatingLoops, auditedLoops, heldBytes);
+    }
+
+    unsigned long GetAllocatingLoops() { return allocatingLoops; }
+    bool IsOverBudget() { return isOverBudget; }
+};
+
+#endif
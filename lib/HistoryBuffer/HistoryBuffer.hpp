@@ -0,0 +1,96 @@
+#ifndef HISTORY_BUFFER_HPP
+#define HISTORY_BUFFER_HPP
+
+#include <Arduino.h>
+#include <Logger.hpp>
+#include <SensorReader.hpp>
+#include <TimeSeriesCodec.hpp>
+
+#define HISTORY_BLOCK_SIZE 256
+#define HISTORY_BLOCK_COUNT 8
+
+// Readings that couldn't be sent, compressed into a ring of blocks. Slow-moving data packs a couple
+// of hundred samples into a block, so the ring rides out the best part of an hour offline. When it's
+// full the oldest block goes. When the server asks for batches, every reading goes through here.
+class HistoryBuffer
+{
+private:
+    uint8_t blocks[HISTORY_BLOCK_COUNT][HISTORY_BLOCK_SIZE];
+    size_t lengths[HISTORY_BLOCK_COUNT];
+    unsigned int oldest = 0;
+    unsigned int count = 0;     // Blocks in use, the last one still being written to
+
+    TimeSeriesEncoder encoder;
+    unsigned long droppedSamples = 0;
+
+    unsigned int IndexOf(unsigned int position) { return (oldest + position) % HISTORY_BLOCK_COUNT; }
+
+    void OpenBlock()
+    {
+        if (count == HISTORY_BLOCK_COUNT)
+        {
+            TimeSeriesDecoder decoder;
+            if (decoder.Begin(blocks[oldest], lengths[oldest]))
+                droppedSamples += decoder.GetCount();
+            LOG_WARN("History is full, dropping the oldest block");
+
+            oldest = IndexOf(1);
+            count--;
+        }
+
+        unsigned int index = IndexOf(count++);
+        encoder.Begin(blocks[index], HISTORY_BLOCK_SIZE);
+        lengths[index] = encoder.GetSize();
+    }
+
+public:
+    HistoryBuffer() { }
+
+    void Add(const SensorReadings& readings)
+    {
+        if (count == 0 || !encoder.Append(readings))
+        {
+            OpenBlock();
+            encoder.Append(readings);
+        }
+
+        lengths[IndexOf(count - 1)] = encoder.GetSize();
+    }
+
+    bool IsEmpty() { return count == 0; }
+    unsigned int GetBlockCount() { return count; }
+
+    // The oldest block, which may be the one still being written to; Pop() it once it's sent
+    const uint8_t* PeekBlock(size_t& length)
+    {
+        if (count == 0)
+            return nullptr;
+
+        length = lengths[oldest];
+        return blocks[oldest];
+    }
+
+    void PopBlock()
+    {
+        if (count == 0)
+            return;
+
+        oldest = IndexOf(1);
+        count--;
+    }
+
+    unsigned long GetPendingSamples()
+    {
+        unsigned long pending = 0;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            const uint8_t* block = blocks[IndexOf(i)];
+            pending += block[2] | (block[3] << 8);     // Sample count from the block header
+        }
+        return pending;
+    }
+
+    unsigned long GetDroppedSamples() { return droppedSamples; }
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef LINK_TELEMETRY_HPP
+#define LINK_TELEMETRY_HPP
+
+#include <Arduino.h>
+
+#define LINK_RTT_SAMPLES 64
+#define LINK_RTT_EWMA_WEIGHT 8      // Like TCP's smoothed RTT, each sample moves the average by 1/8
+#define LINK_RSSI_EWMA_WEIGHT 8
+
+// Ping round trips: a smoothed average that runs forever, and percentiles over the last report
+// period (the most recent LINK_RTT_SAMPLES of it)
+class RoundTripStats
+{
+private:
+    uint16_t samples[LINK_RTT_SAMPLES];
+    unsigned int count = 0;
+    unsigned int next = 0;
+
+    float average = 0.0f;
+    bool hasAverage = false;
+
+    unsigned long periodMax = 0;
+    unsigned long periodSamples = 0;
+    unsigned long periodLost = 0;
+
+public:
+    void Add(unsigned long rtt)
+    {
+        samples[next] = rtt > UINT16_MAX ? UINT16_MAX : rtt;
+        next = (next + 1) % LINK_RTT_SAMPLES;
+        if (count < LINK_RTT_SAMPLES)
+            count++;
+
+        average = hasAverage ? average + ((float)rtt - average) / LINK_RTT_EWMA_WEIGHT : (float)rtt;
+        hasAverage = true;
+
+        periodMax = max(periodMax, rtt);
+        periodSamples++;
+    }
+
+    void AddLost() { periodLost++; }
+
+    // Nearest-rank percentile of the period's samples, 0 without any
+    unsigned long Percentile(unsigned int percent) const
+    {
+        if (count == 0)
+            return 0;
+
+        uint16_t sorted[LINK_RTT_SAMPLES];
+        memcpy(sorted, samples, count * sizeof(uint16_t));
+        for (unsigned int i = 1; i < count; i++)
+        {
+            uint16_t value = sorted[i];
+            unsigned int j = i;
+            for (; j > 0 && sorted[j - 1] > value; j--)
+                sorted[j] = sorted[j - 1];
+            sorted[j] = value;
+        }
+
+        unsigned int rank = (percent * count + 99) / 100;
+        return sorted[rank == 0 ? 0 : rank - 1];
+    }
+
+    float GetAverage() const { return average; }
+    unsigned long GetMax() const { return periodMax; }
+    unsigned long GetSampleCount() const { return periodSamples; }
+    unsigned long GetLostCount() const { return periodLost; }
+
+    void ResetPeriod()
+    {
+        count = 0;
+        next = 0;
+        periodMax = 0;
+        periodSamples = 0;
+        periodLost = 0;
+    }
+};
+
+// Received signal strength in dBm, sampled while connected
+class SignalStats
+{
+private:
+    int32_t last = 0;
+    int32_t periodMin = 0;
+    int32_t periodMax = 0;
+    float average = 0.0f;
+    bool hasAverage = false;
+    bool hasPeriod = false;
+
+public:
+    void Add(int32_t rssi)
+    {
+        last = rssi;
+        average = hasAverage ? average + ((float)rssi - average) / LINK_RSSI_EWMA_WEIGHT : (float)rssi;
+        hasAverage = true;
+
+        periodMin = hasPeriod ? min(periodMin, rssi) : rssi;
+        periodMax = hasPeriod ? max(periodMax, rssi) : rssi;
+        hasPeriod = true;
+    }
+
+    bool HasSamples() const { return hasAverage; }
+    int32_t GetLast() const { return last; }
+    float GetAverage() const { return average; }
+    int32_t GetMin() const { return periodMin; }
+    int32_t GetMax() const { return periodMax; }
+
+    void ResetPeriod() { hasPeriod = false; }
+};
+
+// One link report. Counters and state times are totals since boot, so the server can difference them.
+struct LinkReport
+{
+    unsigned long uptime;
+
+    const SignalStats* signal;
+    const RoundTripStats* roundTrip;
+
+    unsigned long webSocketConnects;
+    unsigned long wifiConnects;
+    unsigned long wifiDisconnectedTime;
+    unsigned long wifiConnectingTime;
+    unsigned long wifiConnectedTime;
+
+    unsigned long pendingSamples;   // Waiting in the history for the server
+
+    unsigned long awakeTime;
+    unsigned long modemSleepTime;
+    unsigned long lightSleepTime;
+    uint32_t meanCurrent;           // Estimated, in µA
+};
+
+#endif
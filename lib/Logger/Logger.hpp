@@ -2,46 +2,341 @@
 #define LOGGER_HPP
 
 #include <Arduino.h>
-#include <cstdarg>
+#include <type_traits>
 
-#define LOG_BUFFER_SIZE 512
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE  4
+
+// Records below this level are compiled out entirely (set with -D LOG_LEVEL=...)
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_QUEUE_SIZE
+#define LOG_QUEUE_SIZE 16
+#endif
+
+#define LOG_MAX_ARGS 4
+#define LOG_STRING_CAPACITY 48
+#define LOG_LINE_SIZE 192
+#define LOG_SPEC_SIZE 16
+
+enum class LogArgType : uint8_t
+{
+    Int,
+    UInt,
+    Float,
+    String
+};
+
+union LogArgValue
+{
+    int32_t i;
+    uint32_t u;
+    float f;
+    uint8_t stringOffset;
+};
+
+// Formatting is deferred: a record only holds the flash-resident format string and the raw
+// arguments. String arguments are copied, since the caller's buffer may be gone by the time
+// the record gets printed.
+struct LogRecord
+{
+    uint32_t timestamp;
+    PGM_P format;
+    LogArgValue args[LOG_MAX_ARGS];
+    LogArgType argTypes[LOG_MAX_ARGS];
+    uint8_t level;
+    uint8_t argCount;
+    uint8_t stringsUsed;
+    char strings[LOG_STRING_CAPACITY];
+};
 
-// FIXME: Using this results in a linker error for some reason
 class Logger
 {
 private:
-    static char buffer[LOG_BUFFER_SIZE];
+    inline static LogRecord records[LOG_QUEUE_SIZE];
+    inline static unsigned int head = 0;
+    inline static unsigned int count = 0;
+
+    inline static unsigned long droppedTotal = 0;
+    inline static unsigned long droppedPending = 0;
 
-    static void PrintMessage(const char* severity, const char* format, va_list args)
+    inline static char line[LOG_LINE_SIZE];
+    inline static size_t lineLength = 0;
+    inline static size_t lineOffset = 0;
+
+    static PGM_P LevelName(uint8_t level)
     {
-        vsnprintf(buffer, LOG_BUFFER_SIZE, format, args);
-        Serial.printf("[%s] %s\n", severity, buffer);
+        switch (level)
+        {
+            case LOG_LEVEL_DEBUG: return PSTR("DEBUG");
+            case LOG_LEVEL_INFO: return PSTR("INFO");
+            case LOG_LEVEL_WARN: return PSTR("WARN");
+            default: return PSTR("ERROR");
+        }
+    }
+
+    // Reads with strnlen_P and memcpy_P, which work on both flash and RAM pointers
+    static void PackString(LogRecord& record, LogArgValue& value, const char* string)
+    {
+        uint8_t offset = record.stringsUsed;
+        size_t space = LOG_STRING_CAPACITY - offset;
+
+        // Out of room: the last byte always terminates the string that filled the area
+        if (space == 0)
+        {
+            value.stringOffset = LOG_STRING_CAPACITY - 1;
+            return;
+        }
+        value.stringOffset = offset;
+
+        if (string == nullptr)
+            string = "(null)";
+
+        size_t length = strnlen_P(string, space - 1);
+        memcpy_P(record.strings + offset, string, length);
+        record.strings[offset + length] = '\0';
+        record.stringsUsed += length + 1;
+    }
+
+    template <typename T>
+    static void PackArgument(LogRecord& record, const T& arg)
+    {
+        uint8_t index = record.argCount++;
+        LogArgValue& value = record.args[index];
+
+        if constexpr (std::is_same_v<T, const __FlashStringHelper*>)
+        {
+            record.argTypes[index] = LogArgType::String;
+            PackString(record, value, reinterpret_cast<PGM_P>(arg));
+        }
+        else if constexpr (std::is_same_v<std::decay_t<T>, char*> || std::is_same_v<std::decay_t<T>, const char*>)
+        {
+            record.argTypes[index] = LogArgType::String;
+            PackString(record, value, arg);
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            record.argTypes[index] = LogArgType::Float;
+            value.f = (float)arg;
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            record.argTypes[index] = LogArgType::Int;
+            value.i = (int32_t)arg;
+        }
+        else
+        {
+            static_assert(std::is_integral_v<T>, "Unsupported log argument type");
+
+            if constexpr (std::is_signed_v<T>)
+            {
+                record.argTypes[index] = LogArgType::Int;
+                value.i = (int32_t)arg;
+            }
+            else
+            {
+                record.argTypes[index] = LogArgType::UInt;
+                value.u = (uint32_t)arg;
+            }
+        }
+    }
+
+    // Formats a single conversion, casting the stored argument to whatever the length modifier asks for
+    static int FormatArgument(char* out, size_t size, const char* spec, size_t specLength, const LogRecord& record, uint8_t index)
+    {
+        char conversion = spec[specLength - 1];
+        const LogArgValue& value = record.args[index];
+        LogArgType type = record.argTypes[index];
+
+        if (conversion == 's')
+            return snprintf(out, size, spec, type == LogArgType::String ? record.strings + value.stringOffset : "?");
+
+        if (conversion == 'f' || conversion == 'F' || conversion == 'e' || conversion == 'E' || conversion == 'g' || conversion == 'G')
+        {
+            double number = type == LogArgType::Float ? value.f : type == LogArgType::Int ? value.i : value.u;
+            return snprintf(out, size, spec, number);
+        }
+
+        bool isLong = memchr(spec, 'l', specLength) != nullptr;
+        bool isSize = memchr(spec, 'z', specLength) != nullptr;
+        bool isSigned = conversion == 'd' || conversion == 'i';
+
+        int32_t signedValue = type == LogArgType::Float ? (int32_t)value.f : value.i;
+        uint32_t unsignedValue = type == LogArgType::Float ? (uint32_t)value.f : value.u;
+
+        if (conversion == 'c')
+            return snprintf(out, size, spec, (int)signedValue);
+        if (isSize)
+            return snprintf(out, size, spec, (size_t)unsignedValue);
+        if (isLong && isSigned)
+            return snprintf(out, size, spec, (long)signedValue);
+        if (isLong)
+            return snprintf(out, size, spec, (unsigned long)unsignedValue);
+        if (isSigned)
+            return snprintf(out, size, spec, (int)signedValue);
+        return snprintf(out, size, spec, (unsigned int)unsignedValue);
+    }
+
+    static size_t FormatRecord(const LogRecord& record, char* out, size_t size)
+    {
+        char format[LOG_LINE_SIZE];
+        strncpy_P(format, record.format, LOG_LINE_SIZE - 1);
+        format[LOG_LINE_SIZE - 1] = '\0';
+
+        int written = snprintf_P(out, size, PSTR("[%lu] [%S] "), (unsigned long)record.timestamp, LevelName(record.level));
+        size_t length = written < 0 ? 0 : min((size_t)written, size - 1);
+        uint8_t argIndex = 0;
+
+        for (const char* c = format; *c != '\0' && length < size - 2; c++)
+        {
+            if (*c != '%')
+            {
+                out[length++] = *c;
+                continue;
+            }
+
+            if (c[1] == '%')
+            {
+                out[length++] = '%';
+                c++;
+                continue;
+            }
+
+            // Extract "%[flags][width][.precision][length]conversion"
+            char spec[LOG_SPEC_SIZE];
+            size_t specLength = 0;
+            spec[specLength++] = *c++;
+            while (*c != '\0' && specLength < LOG_SPEC_SIZE - 1)
+            {
+                spec[specLength++] = *c;
+                if (strchr("diouxXcsfFeEgG", *c) != nullptr)
+                    break;
+                c++;
+            }
+            spec[specLength] = '\0';
+
+            if (*c == '\0')
+                break;
+
+            if (argIndex >= record.argCount)
+                continue;
+
+            written = FormatArgument(out + length, size - 1 - length, spec, specLength, record, argIndex++);
+            if (written > 0)
+                length = min(length + (size_t)written, size - 2);
+        }
+
+        out[length++] = '\n';
+        out[length] = '\0';
+        return length;
+    }
+
+    static bool PrepareLine()
+    {
+        if (count == 0)
+        {
+            if (droppedPending == 0)
+                return false;
+
+            // Records are dropped from the newest end, so report the gap after what survived
+            int written = snprintf(line, LOG_LINE_SIZE, "[%lu] [WARN] %lu log records dropped\n", millis(), droppedPending);
+            lineLength = min((size_t)written, (size_t)LOG_LINE_SIZE - 1);
+            lineOffset = 0;
+            droppedPending = 0;
+            return true;
+        }
+
+        lineLength = FormatRecord(records[head], line, LOG_LINE_SIZE);
+        lineOffset = 0;
+        head = (head + 1) % LOG_QUEUE_SIZE;
+        count--;
+        return true;
     }
 
 public:
-    static void Log(const char* format, ...)
+    template <typename... Args>
+    static void Write(uint8_t level, PGM_P format, const Args&... args)
     {
-        va_list args;
-        va_start(args, format);
-        PrintMessage("INFO", format, args);
-        va_end(args);
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "Too many log arguments");
+
+        if (count == LOG_QUEUE_SIZE)
+        {
+            droppedTotal++;
+            droppedPending++;
+            return;
+        }
+
+        LogRecord& record = records[(head + count) % LOG_QUEUE_SIZE];
+        record.timestamp = millis();
+        record.format = format;
+        record.level = level;
+        record.argCount = 0;
+        record.stringsUsed = 0;
+        (PackArgument(record, args), ...);
+
+        count++;
     }
 
-    static void Warn(const char* format, ...)
+    // Drains as much as the UART can take without blocking. Call once per loop pass.
+    static void Update()
     {
-        va_list args;
-        va_start(args, format);
-        PrintMessage("WARN", format, args);
-        va_end(args);
+        while (true)
+        {
+            if (lineOffset >= lineLength && !PrepareLine())
+                return;
+
+            int space = Serial.availableForWrite();
+            if (space <= 0)
+                return;
+
+            size_t chunk = min((size_t)space, lineLength - lineOffset);
+            Serial.write((const uint8_t*)line + lineOffset, chunk);
+            lineOffset += chunk;
+        }
     }
 
-    static void Error(const char* format, ...)
+    // Blocks until everything queued has been written out, e.g. before a restart
+    static void Flush()
     {
-        va_list args;
-        va_start(args, format);
-        PrintMessage("ERROR", format, args);
-        va_end(args);
+        while (lineOffset < lineLength || count > 0 || droppedPending > 0)
+        {
+            Update();
+            yield();
+        }
+        Serial.flush();
     }
+
+    static unsigned int GetQueuedCount() { return count; }
+    static unsigned long GetDroppedCount() { return droppedTotal; }
 };
 
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) Logger::Write(LOG_LEVEL_DEBUG, PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) do { } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) Logger::Write(LOG_LEVEL_INFO, PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) do { } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(format, ...) Logger::Write(LOG_LEVEL_WARN, PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_WARN(format, ...) do { } while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) Logger::Write(LOG_LEVEL_ERROR, PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...) do { } while (0)
+#endif
+
 #endif
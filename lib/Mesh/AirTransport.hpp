@@ -0,0 +1,181 @@
+#ifndef AIR_TRANSPORT_HPP
+#define AIR_TRANSPORT_HPP
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <MeshTransport.hpp>
+
+#define AIR_MAX_NODES 4096
+#define AIR_INBOX_SLOTS 16          // A frame from each of a gateway's leaves in the same simulated step
+#define AIR_SENT_SLOTS 4
+
+// MeshTransport between the probes of one process, for the native build and the fleet simulator.
+// Every begun instance is on the same air: a frame reaches the node with its MAC if that node is on
+// the same channel and has room in its inbox, which is also what decides the acknowledgement.
+// Frames and results are held until the receiver's and sender's next Update(), like the radio does.
+// A frame between nodes with different keys is lost, the way one that doesn't decrypt is.
+class AirTransport : public MeshTransport
+{
+private:
+    struct Frame
+    {
+        uint8_t mac[MESH_MAC_SIZE];
+        uint8_t length;
+        uint8_t data[MESH_MAX_PAYLOAD];
+    };
+
+    struct Sent
+    {
+        uint8_t mac[MESH_MAC_SIZE];
+        bool isDelivered;
+    };
+
+    static inline AirTransport* nodes[AIR_MAX_NODES] = { };
+    static inline unsigned int nodeCount = 0;
+
+    ESP8266WiFiClass& wifi;
+    uint8_t mac[MESH_MAC_SIZE];
+    uint8_t channel = 0;
+    bool isBegun = false;
+    uint8_t key[MESH_KEY_SIZE] = { };
+    bool hasKey = false;
+
+    Frame inbox[AIR_INBOX_SLOTS];
+    unsigned int inboxHead = 0;
+    unsigned int inboxCount = 0;
+    Sent sent[AIR_SENT_SLOTS];
+    unsigned int sentHead = 0;
+    unsigned int sentCount = 0;
+    unsigned long overflows = 0;
+
+    static AirTransport* Find(const uint8_t* mac, uint8_t channel)
+    {
+        for (unsigned int i = 0; i < nodeCount; i++)
+        {
+            if (nodes[i]->channel == channel && memcmp(nodes[i]->mac, mac, MESH_MAC_SIZE) == 0)
+                return nodes[i];
+        }
+        return nullptr;
+    }
+
+    bool HasSameKey(const AirTransport& other)
+    {
+        return hasKey == other.hasKey && (!hasKey || memcmp(key, other.key, MESH_KEY_SIZE) == 0);
+    }
+
+    bool Deliver(const uint8_t* from, const uint8_t* data, size_t length)
+    {
+        if (inboxCount == AIR_INBOX_SLOTS)
+        {
+            overflows++;
+            return false;
+        }
+
+        Frame& frame = inbox[(inboxHead + inboxCount++) % AIR_INBOX_SLOTS];
+        memcpy(frame.mac, from, MESH_MAC_SIZE);
+        memcpy(frame.data, data, length);
+        frame.length = length;
+        return true;
+    }
+
+public:
+    static inline unsigned long framesSent = 0;
+    static inline unsigned long framesDelivered = 0;
+
+    // mac defaults to the one the WiFi reports, which isn't unique across a simulated fleet
+    AirTransport(ESP8266WiFiClass& wifi, const uint8_t* mac = nullptr) : wifi(wifi)
+    {
+        if (mac != nullptr)
+            memcpy(this->mac, mac, MESH_MAC_SIZE);
+        else
+            wifi.macAddress(this->mac);
+    }
+
+    ~AirTransport() { End(); }
+
+    bool Begin(uint8_t newChannel) override
+    {
+        End();
+        if (nodeCount == AIR_MAX_NODES)
+            return false;
+
+        channel = newChannel != 0 ? newChannel : wifi.channel();
+        nodes[nodeCount++] = this;
+        isBegun = true;
+        return true;
+    }
+
+    void End() override
+    {
+        if (!isBegun)
+            return;
+
+        for (unsigned int i = 0; i < nodeCount; i++)
+        {
+            if (nodes[i] == this)
+            {
+                nodes[i] = nodes[--nodeCount];
+                break;
+            }
+        }
+        isBegun = false;
+    }
+
+    bool Send(const uint8_t* to, const uint8_t* data, size_t length) override
+    {
+        if (!isBegun || length > MESH_MAX_PAYLOAD)
+            return false;
+
+        framesSent++;
+        AirTransport* receiver = Find(to, channel);
+        bool isDelivered = receiver != nullptr && HasSameKey(*receiver) && receiver->Deliver(mac, data, length);
+        if (isDelivered)
+            framesDelivered++;
+
+        if (sentCount == AIR_SENT_SLOTS)
+        {
+            overflows++;
+            return true;
+        }
+        Sent& result = sent[(sentHead + sentCount++) % AIR_SENT_SLOTS];
+        memcpy(result.mac, to, MESH_MAC_SIZE);
+        result.isDelivered = isDelivered;
+        return true;
+    }
+
+    void SetKey(const uint8_t* newKey) override
+    {
+        hasKey = newKey != nullptr;
+        if (hasKey)
+            memcpy(key, newKey, MESH_KEY_SIZE);
+    }
+
+    bool AddPeer(const uint8_t* mac) override { return isBegun; }
+
+    void Update() override
+    {
+        while (inboxCount > 0)
+        {
+            const Frame& frame = inbox[inboxHead];
+            if (receiveHandler)
+                receiveHandler(frame.mac, frame.data, frame.length);
+            inboxHead = (inboxHead + 1) % AIR_INBOX_SLOTS;
+            inboxCount--;
+        }
+
+        while (sentCount > 0)
+        {
+            const Sent& result = sent[sentHead];
+            if (sentHandler)
+                sentHandler(result.mac, result.isDelivered);
+            sentHead = (sentHead + 1) % AIR_SENT_SLOTS;
+            sentCount--;
+        }
+    }
+
+    void GetMAC(uint8_t* out) override { memcpy(out, mac, MESH_MAC_SIZE); }
+    uint8_t GetChannel() override { return isBegun ? channel : wifi.channel(); }
+    unsigned long GetOverflows() override { return overflows; }
+};
+
+#endif
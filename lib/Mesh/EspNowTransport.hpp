@@ -0,0 +1,177 @@
+#ifndef ESPNOW_TRANSPORT_HPP
+#define ESPNOW_TRANSPORT_HPP
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <espnow.h>
+#include <MeshTransport.hpp>
+
+#define ESPNOW_RECEIVE_SLOTS 6
+#define ESPNOW_SENT_SLOTS 4
+
+// MeshTransport over the SDK's ESP-NOW. Its callbacks run in the WiFi task, so they only copy into
+// rings that Update() empties on the loop; what doesn't fit is counted and lost. There is one radio,
+// so only one instance can be begun.
+class EspNowTransport : public MeshTransport
+{
+private:
+    struct Received
+    {
+        uint8_t mac[MESH_MAC_SIZE];
+        uint8_t length;
+        uint8_t data[MESH_MAX_PAYLOAD];
+    };
+
+    struct Sent
+    {
+        uint8_t mac[MESH_MAC_SIZE];
+        bool isDelivered;
+    };
+
+    static inline EspNowTransport* instance = nullptr;
+
+    ESP8266WiFiClass& wifi;
+    bool isBegun = false;
+    uint8_t channel = 0;
+    uint8_t key[MESH_KEY_SIZE];
+    bool hasKey = false;
+
+    Received received[ESPNOW_RECEIVE_SLOTS];
+    volatile unsigned int receivedHead = 0;     // Written by the callback
+    volatile unsigned int receivedTail = 0;     // Written by Update()
+    Sent sent[ESPNOW_SENT_SLOTS];
+    volatile unsigned int sentHead = 0;
+    volatile unsigned int sentTail = 0;
+    volatile unsigned long overflows = 0;
+
+    static void OnReceive(uint8_t* mac, uint8_t* data, uint8_t length)
+    {
+        EspNowTransport* self = instance;
+        unsigned int head = self->receivedHead;
+        if (head - self->receivedTail == ESPNOW_RECEIVE_SLOTS || length > MESH_MAX_PAYLOAD)
+        {
+            self->overflows++;
+            return;
+        }
+
+        Received& frame = self->received[head % ESPNOW_RECEIVE_SLOTS];
+        memcpy(frame.mac, mac, MESH_MAC_SIZE);
+        memcpy(frame.data, data, length);
+        frame.length = length;
+        self->receivedHead = head + 1;
+    }
+
+    static void OnSent(uint8_t* mac, uint8_t status)
+    {
+        EspNowTransport* self = instance;
+        unsigned int head = self->sentHead;
+        if (head - self->sentTail == ESPNOW_SENT_SLOTS)
+        {
+            self->overflows++;
+            return;
+        }
+
+        Sent& result = self->sent[head % ESPNOW_SENT_SLOTS];
+        memcpy(result.mac, mac, MESH_MAC_SIZE);
+        result.isDelivered = status == 0;
+        self->sentHead = head + 1;
+    }
+
+public:
+    EspNowTransport(ESP8266WiFiClass& wifi) : wifi(wifi) { }
+
+    bool Begin(uint8_t newChannel) override
+    {
+        if (isBegun)
+            End();
+        if (instance != nullptr)
+            return false;
+
+        // ESP-NOW runs on the station interface, associated or not
+        if (wifi.getMode() == WIFI_OFF)
+            wifi.mode(WIFI_STA);
+        if (newChannel != 0)
+            wifi_set_channel(newChannel);
+
+        if (esp_now_init() != 0)
+            return false;
+        esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
+
+        instance = this;
+        esp_now_register_recv_cb(OnReceive);
+        esp_now_register_send_cb(OnSent);
+        channel = newChannel;
+        isBegun = true;
+        return true;
+    }
+
+    void End() override
+    {
+        if (!isBegun)
+            return;
+
+        esp_now_unregister_recv_cb();
+        esp_now_unregister_send_cb();
+        esp_now_deinit();
+        instance = nullptr;
+        isBegun = false;
+    }
+
+    bool Send(const uint8_t* mac, const uint8_t* data, size_t length) override
+    {
+        if (!isBegun || length > MESH_MAX_PAYLOAD)
+            return false;
+
+        uint8_t peer[MESH_MAC_SIZE];
+        memcpy(peer, mac, MESH_MAC_SIZE);
+        if (!AddPeer(peer))
+            return false;
+
+        return esp_now_send(peer, const_cast<uint8_t*>(data), length) == 0;
+    }
+
+    void SetKey(const uint8_t* newKey) override
+    {
+        hasKey = newKey != nullptr;
+        if (hasKey)
+            memcpy(key, newKey, MESH_KEY_SIZE);
+    }
+
+    // With a key, a frame that claims an added peer's MAC but wasn't encrypted with it doesn't get in
+    bool AddPeer(const uint8_t* mac) override
+    {
+        if (!isBegun)
+            return false;
+
+        uint8_t peer[MESH_MAC_SIZE];
+        memcpy(peer, mac, MESH_MAC_SIZE);
+        if (esp_now_is_peer_exist(peer))
+            return true;
+        return esp_now_add_peer(peer, ESP_NOW_ROLE_COMBO, channel, hasKey ? key : nullptr, hasKey ? MESH_KEY_SIZE : 0) == 0;
+    }
+
+    void Update() override
+    {
+        while (receivedTail != receivedHead)
+        {
+            const Received& frame = received[receivedTail % ESPNOW_RECEIVE_SLOTS];
+            if (receiveHandler)
+                receiveHandler(frame.mac, frame.data, frame.length);
+            receivedTail = receivedTail + 1;
+        }
+
+        while (sentTail != sentHead)
+        {
+            const Sent& result = sent[sentTail % ESPNOW_SENT_SLOTS];
+            if (sentHandler)
+                sentHandler(result.mac, result.isDelivered);
+            sentTail = sentTail + 1;
+        }
+    }
+
+    void GetMAC(uint8_t* mac) override { wifi.macAddress(mac); }
+    uint8_t GetChannel() override { return wifi.channel(); }
+    unsigned long GetOverflows() override { return overflows; }
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef MESH_FRAME_HPP
+#define MESH_FRAME_HPP
+
+#include <Arduino.h>
+#include <SensorReader.hpp>
+
+#define MESH_PROTOCOL_VERSION 1
+#define MESH_UUID_SIZE 16
+#define MESH_UUID_TEXT_SIZE 37      // 8-4-4-4-12 hex digits and the terminator
+#define MESH_NO_VALUE INT16_MIN
+
+enum class MeshFrameType : uint8_t
+{
+    Sample = 1
+};
+
+// One reading from a leaf, 37 bytes where the JSON for it is about 140. Values are hundredths, so
+// they survive the trip to two decimals. The leaf's clock means nothing to the gateway, so the frame
+// says how old the reading is instead of when it was taken.
+struct __attribute__((packed)) MeshSampleFrame
+{
+    uint8_t type;
+    uint8_t version;
+    uint16_t sequence;
+    uint8_t uuid[MESH_UUID_SIZE];
+    uint32_t age;
+    int16_t values[4];          // Temperature, humidity, soil moisture, light level; MESH_NO_VALUE when unusable
+    uint8_t quality[4];         // SampleQuality of each
+    uint8_t reserved;
+};
+
+class MeshCodec
+{
+private:
+    static int16_t EncodeValue(float value, SampleQuality quality)
+    {
+        if (!IsUsable(quality) || isnan(value))
+            return MESH_NO_VALUE;
+        return (int16_t)constrain(lroundf(value * 100.0f), (long)MESH_NO_VALUE + 1, (long)INT16_MAX);
+    }
+
+    static float DecodeValue(int16_t value) { return value == MESH_NO_VALUE ? NAN : value / 100.0f; }
+
+    static int HexDigit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+public:
+    // Only the 36-character form the server hands out
+    static bool PackUUID(const char* text, uint8_t* uuid)
+    {
+        unsigned int byte = 0;
+        for (unsigned int i = 0; i < MESH_UUID_TEXT_SIZE - 1; i++)
+        {
+            if (i == 8 || i == 13 || i == 18 || i == 23)
+            {
+                if (text[i] != '-')
+                    return false;
+                continue;
+            }
+
+            int high = HexDigit(text[i]);
+            int low = high < 0 ? -1 : HexDigit(text[++i]);
+            if (low < 0)
+                return false;
+            uuid[byte++] = high << 4 | low;
+        }
+        return text[MESH_UUID_TEXT_SIZE - 1] == '\0';
+    }
+
+    static void UnpackUUID(const uint8_t* uuid, char* text)
+    {
+        for (unsigned int i = 0; i < MESH_UUID_SIZE; i++)
+        {
+            text += sprintf(text, "%02x", uuid[i]);
+            if (i == 3 || i == 5 || i == 7 || i == 9)
+                *text++ = '-';
+        }
+    }
+
+    static void EncodeSample(const SensorReadings& readings, const uint8_t* uuid, uint16_t sequence, MeshSampleFrame& frame)
+    {
+        frame.type = (uint8_t)MeshFrameType::Sample;
+        frame.version = MESH_PROTOCOL_VERSION;
+        frame.sequence = sequence;
+        memcpy(frame.uuid, uuid, MESH_UUID_SIZE);
+        frame.age = millis() - readings.sampledAt;
+        frame.values[0] = EncodeValue(readings.temperature, readings.temperatureQuality);
+        frame.values[1] = EncodeValue(readings.humidity, readings.humidityQuality);
+        frame.values[2] = EncodeValue(readings.soilMoisture, readings.soilMoistureQuality);
+        frame.values[3] = EncodeValue(readings.lightLevel, readings.lightLevelQuality);
+        frame.quality[0] = (uint8_t)readings.temperatureQuality;
+        frame.quality[1] = (uint8_t)readings.humidityQuality;
+        frame.quality[2] = (uint8_t)readings.soilMoistureQuality;
+        frame.quality[3] = (uint8_t)readings.lightLevelQuality;
+        frame.reserved = 0;
+    }
+
+    // False for anything that isn't a sample frame of this version. sampledAt comes out on this
+    // probe's clock.
+    static bool DecodeSample(const uint8_t* data, size_t length, MeshSampleFrame& frame, SensorReadings& readings)
+    {
+        if (length != sizeof(MeshSampleFrame))
+            return false;
+        memcpy(&frame, data, sizeof(frame));
+        if (frame.type != (uint8_t)MeshFrameType::Sample || frame.version != MESH_PROTOCOL_VERSION)
+            return false;
+        for (uint8_t quality : frame.quality)
+        {
+            if (quality > (uint8_t)SampleQuality::Stuck)
+                return false;
+        }
+
+        readings.temperature = DecodeValue(frame.values[0]);
+        readings.humidity = DecodeValue(frame.values[1]);
+        readings.soilMoisture = DecodeValue(frame.values[2]);
+        readings.lightLevel = DecodeValue(frame.values[3]);
+        readings.temperatureQuality = (SampleQuality)frame.quality[0];
+        readings.humidityQuality = (SampleQuality)frame.quality[1];
+        readings.soilMoistureQuality = (SampleQuality)frame.quality[2];
+        readings.lightLevelQuality = (SampleQuality)frame.quality[3];
+        readings.sampledAt = millis() - frame.age;
+        return true;
+    }
+};
+
+#endif
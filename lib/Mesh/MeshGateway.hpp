@@ -0,0 +1,254 @@
+#ifndef MESH_GATEWAY_HPP
+#define MESH_GATEWAY_HPP
+
+#include <Arduino.h>
+#include <MeshTransport.hpp>
+#include <MeshFrame.hpp>
+#include <MeshSettings.hpp>
+
+#define MESH_PENDING_SLOTS 32
+#define MESH_RELAY_BATCH 8          // Readings of one leaf per upstream message
+#define MESH_RELAY_DELAY 10000      // Longest a reading waits for others of its leaf to go up with, from when it was taken
+#define MESH_LEAF_IDLE_TIMEOUT 600000   // A leaf not heard from for this long leaves the table
+
+struct MeshLeafEntry
+{
+    uint8_t mac[MESH_MAC_SIZE];
+    char uuid[MESH_UUID_TEXT_SIZE];
+    uint16_t lastSequence;
+    unsigned long lastSeen;
+    unsigned long received;
+    unsigned long duplicates;
+};
+
+// Readings of one leaf, oldest first, on their way upstream
+struct MeshRelayBatch
+{
+    const char* uuid;
+    SensorReadings readings[MESH_RELAY_BATCH];
+    unsigned int count;
+};
+
+struct MeshGatewayStats
+{
+    unsigned long received = 0;
+    unsigned long invalid = 0;      // Not a sample frame, or not this version
+    unsigned long duplicates = 0;   // Retransmissions the leaf sent after a lost acknowledgement
+    unsigned long strangers = 0;    // From a MAC that isn't allowed, or didn't fit the table
+    unsigned long dropped = 0;      // Pushed out of the pending readings by newer ones
+    unsigned long relayed = 0;
+    unsigned long batches = 0;
+};
+
+// Collects the readings of up to MESH_MAX_LEAVES allowed leaves and hands them out in batches per
+// leaf, so the gateway's one WebSocket carries a message per few readings instead of a connection per
+// probe. When the server can't keep up, the oldest readings go first.
+class MeshGateway
+{
+private:
+    struct Pending
+    {
+        uint8_t leaf;
+        SensorReadings readings;
+    };
+
+    MeshLeafEntry leaves[MESH_MAX_LEAVES];
+    unsigned int leafCount = 0;
+
+    uint8_t allowed[MESH_MAX_LEAVES][MESH_MAC_SIZE];
+    unsigned int allowedCount = 0;
+
+    Pending pending[MESH_PENDING_SLOTS];    // Oldest first
+    unsigned int pendingCount = 0;
+
+    MeshGatewayStats stats;
+
+    int FindLeaf(const uint8_t* mac)
+    {
+        for (unsigned int i = 0; i < leafCount; i++)
+        {
+            if (memcmp(leaves[i].mac, mac, MESH_MAC_SIZE) == 0)
+                return i;
+        }
+        return -1;
+    }
+
+    bool IsAllowed(const uint8_t* mac)
+    {
+        for (unsigned int i = 0; i < allowedCount; i++)
+        {
+            if (memcmp(allowed[i], mac, MESH_MAC_SIZE) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    void RemovePending(unsigned int position)
+    {
+        for (unsigned int i = position; i + 1 < pendingCount; i++)
+            pending[i] = pending[i + 1];
+        pendingCount--;
+    }
+
+    bool HasPending(unsigned int leaf)
+    {
+        for (unsigned int i = 0; i < pendingCount; i++)
+        {
+            if (pending[i].leaf == leaf)
+                return true;
+        }
+        return false;
+    }
+
+    // Takes the leaf's pending readings with it
+    void RemoveLeaf(unsigned int index)
+    {
+        for (unsigned int i = 0; i < pendingCount; )
+        {
+            if (pending[i].leaf == index)
+            {
+                RemovePending(i);
+                continue;
+            }
+            if (pending[i].leaf > index)
+                pending[i].leaf--;
+            i++;
+        }
+
+        for (unsigned int i = index; i + 1 < leafCount; i++)
+            leaves[i] = leaves[i + 1];
+        leafCount--;
+    }
+
+public:
+    // Only frames from these MACs are relayed. Leaves that aren't on the list any more are dropped from
+    // the table, along with their readings.
+    void SetAllowed(const uint8_t (*macs)[MESH_MAC_SIZE], unsigned int count)
+    {
+        allowedCount = min(count, (unsigned int)MESH_MAX_LEAVES);
+        memcpy(allowed, macs, allowedCount * MESH_MAC_SIZE);
+
+        for (unsigned int i = leafCount; i-- > 0; )
+        {
+            if (!IsAllowed(leaves[i].mac))
+                RemoveLeaf(i);
+        }
+    }
+
+    // Forgets leaves that went quiet, once their last readings are gone
+    void Expire()
+    {
+        for (unsigned int i = leafCount; i-- > 0; )
+        {
+            if (millis() - leaves[i].lastSeen > MESH_LEAF_IDLE_TIMEOUT && !HasPending(i))
+                RemoveLeaf(i);
+        }
+    }
+
+    // From the transport's receive handler
+    void Receive(const uint8_t* mac, const uint8_t* data, size_t length)
+    {
+        if (!IsAllowed(mac))
+        {
+            stats.strangers++;
+            return;
+        }
+
+        MeshSampleFrame frame;
+        SensorReadings readings;
+        if (!MeshCodec::DecodeSample(data, length, frame, readings))
+        {
+            stats.invalid++;
+            return;
+        }
+
+        int index = FindLeaf(mac);
+        if (index < 0 && leafCount == MESH_MAX_LEAVES)
+        {
+            stats.strangers++;
+            return;
+        }
+
+        if (index < 0)
+        {
+            index = leafCount++;
+            MeshLeafEntry& leaf = leaves[index];
+            memcpy(leaf.mac, mac, MESH_MAC_SIZE);
+            leaf.lastSequence = frame.sequence - 1;
+            leaf.received = 0;
+            leaf.duplicates = 0;
+        }
+
+        // A leaf that restarted counts from 1 again, so only a repeat of the last one is a duplicate
+        MeshLeafEntry& leaf = leaves[index];
+        leaf.lastSeen = millis();
+        if (frame.sequence == leaf.lastSequence)
+        {
+            leaf.duplicates++;
+            stats.duplicates++;
+            return;
+        }
+        leaf.lastSequence = frame.sequence;
+        MeshCodec::UnpackUUID(frame.uuid, leaf.uuid);
+        leaf.received++;
+        stats.received++;
+
+        if (pendingCount == MESH_PENDING_SLOTS)
+        {
+            RemovePending(0);
+            stats.dropped++;
+        }
+        pending[pendingCount++] = Pending { (uint8_t)index, readings };
+    }
+
+    // The next batch to relay: the readings of whichever leaf has waited longest, once it has a full
+    // batch, its oldest has waited MESH_RELAY_DELAY or the pending readings are half full, so many
+    // leaves don't push each other out before their batches fill. Nothing is taken until PopBatch().
+    bool PeekBatch(MeshRelayBatch& batch)
+    {
+        if (pendingCount == 0)
+            return false;
+
+        uint8_t leaf = pending[0].leaf;
+        batch.uuid = leaves[leaf].uuid;
+        batch.count = 0;
+        for (unsigned int i = 0; i < pendingCount && batch.count < MESH_RELAY_BATCH; i++)
+        {
+            if (pending[i].leaf == leaf)
+                batch.readings[batch.count++] = pending[i].readings;
+        }
+
+        return batch.count == MESH_RELAY_BATCH || millis() - pending[0].readings.sampledAt >= MESH_RELAY_DELAY ||
+            pendingCount >= MESH_PENDING_SLOTS / 2;
+    }
+
+    void PopBatch(const MeshRelayBatch& batch)
+    {
+        if (pendingCount == 0)
+            return;
+
+        uint8_t leaf = pending[0].leaf;
+        unsigned int removed = 0;
+        for (unsigned int i = 0; i < pendingCount && removed < batch.count; )
+        {
+            if (pending[i].leaf == leaf)
+            {
+                RemovePending(i);
+                removed++;
+            }
+            else
+                i++;
+        }
+        stats.relayed += removed;
+        stats.batches++;
+    }
+
+    bool HasPending() { return pendingCount > 0; }
+    unsigned int GetPendingCount() { return pendingCount; }
+    unsigned int GetLeafCount() { return leafCount; }
+    unsigned int GetAllowedCount() { return allowedCount; }
+    const MeshLeafEntry& GetLeaf(unsigned int index) { return leaves[index]; }
+    const MeshGatewayStats& GetStats() { return stats; }
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef MESH_LEAF_HPP
+#define MESH_LEAF_HPP
+
+#include <Arduino.h>
+#include <MeshTransport.hpp>
+#include <MeshFrame.hpp>
+
+#define MESH_LEAF_MAX_MISSES 5      // Unacknowledged frames in a row before the gateway counts as gone
+
+struct MeshLeafStats
+{
+    unsigned long sent = 0;
+    unsigned long delivered = 0;
+    unsigned long missed = 0;       // The gateway's radio never acknowledged it
+    unsigned long refused = 0;      // The transport wouldn't take it
+};
+
+// The sending side of a probe with no WiFi of its own: every reading goes to the gateway as one
+// frame, and nothing is kept when it doesn't arrive.
+class MeshLeaf
+{
+private:
+    MeshTransport& transport;
+    uint8_t gateway[MESH_MAC_SIZE] = { };
+    uint8_t uuid[MESH_UUID_SIZE] = { };
+    uint16_t sequence = 0;
+    uint8_t misses = 0;
+    MeshLeafStats stats;
+
+public:
+    MeshLeaf(MeshTransport& transport) : transport(transport) { }
+
+    // False when uuid isn't one the server hands out
+    bool Begin(const uint8_t* gatewayMAC, const char* uuidText)
+    {
+        if (!MeshCodec::PackUUID(uuidText, uuid))
+            return false;
+        memcpy(gateway, gatewayMAC, MESH_MAC_SIZE);
+        misses = 0;
+        return true;
+    }
+
+    bool Send(const SensorReadings& readings)
+    {
+        MeshSampleFrame frame;
+        MeshCodec::EncodeSample(readings, uuid, ++sequence, frame);
+        if (!transport.Send(gateway, (const uint8_t*)&frame, sizeof(frame)))
+        {
+            stats.refused++;
+            return false;
+        }
+
+        stats.sent++;
+        return true;
+    }
+
+    // From the transport's sent handler
+    void OnSent(const uint8_t* mac, bool isDelivered)
+    {
+        if (memcmp(mac, gateway, MESH_MAC_SIZE) != 0)
+            return;
+
+        if (isDelivered)
+        {
+            stats.delivered++;
+            misses = 0;
+        }
+        else
+        {
+            stats.missed++;
+            if (misses < MESH_LEAF_MAX_MISSES)
+                misses++;
+        }
+    }
+
+    bool IsGatewayReachable() { return misses < MESH_LEAF_MAX_MISSES; }
+    const uint8_t* GetGateway() { return gateway; }
+    const MeshLeafStats& GetStats() { return stats; }
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef MESH_SETTINGS_HPP
+#define MESH_SETTINGS_HPP
+
+#include <stdint.h>
+#include <string.h>
+#include <MeshTransport.hpp>
+
+#define MESH_MAX_LEAVES 10          // As many encrypted peers as ESP-NOW takes in station mode
+
+enum class MeshRole : uint8_t
+{
+    Off,
+    Gateway,        // Connects to the server as usual and relays what its leaves send
+    Leaf            // Never joins the WiFi, sends its readings to the gateway
+};
+
+struct MeshSettings
+{
+    MeshRole role;
+    uint8_t gatewayMAC[MESH_MAC_SIZE];      // Leaf only
+    uint8_t channel;                        // Leaf only; the gateway's WiFi channel
+    uint8_t allowedCount;                   // Gateway only: the leaves it relays, by MAC
+    uint8_t allowed[MESH_MAX_LEAVES][MESH_MAC_SIZE];
+    bool hasKey;                            // Every probe of the mesh needs the same key
+    uint8_t key[MESH_KEY_SIZE];
+
+    int FindAllowed(const uint8_t* mac) const
+    {
+        for (unsigned int i = 0; i < allowedCount && i < MESH_MAX_LEAVES; i++)
+        {
+            if (memcmp(allowed[i], mac, MESH_MAC_SIZE) == 0)
+                return i;
+        }
+        return -1;
+    }
+
+    // False when the list is full
+    bool Allow(const uint8_t* mac)
+    {
+        if (FindAllowed(mac) >= 0)
+            return true;
+        if (allowedCount >= MESH_MAX_LEAVES)
+            return false;
+        memcpy(allowed[allowedCount++], mac, MESH_MAC_SIZE);
+        return true;
+    }
+
+    void Deny(const uint8_t* mac)
+    {
+        int index = FindAllowed(mac);
+        if (index < 0)
+            return;
+        memmove(allowed[index], allowed[index + 1], (allowedCount - index - 1) * MESH_MAC_SIZE);
+        allowedCount--;
+    }
+};
+
+inline const char* MeshRoleName(MeshRole role)
+{
+    switch (role)
+    {
+        case MeshRole::Gateway: return "gateway";
+        case MeshRole::Leaf: return "leaf";
+        default: return "off";
+    }
+}
+
+#endif
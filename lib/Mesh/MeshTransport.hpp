@@ -0,0 +1,90 @@
+#ifndef MESH_TRANSPORT_HPP
+#define MESH_TRANSPORT_HPP
+
+#include <Arduino.h>
+#include <ctype.h>
+#include <functional>
+
+#define MESH_MAC_SIZE 6
+#define MESH_MAX_PAYLOAD 250        // What ESP-NOW carries in one frame
+#define MESH_KEY_SIZE 16
+
+// A connectionless link between nearby probes: frames of up to MESH_MAX_PAYLOAD bytes, addressed by
+// MAC, with an acknowledgement from the peer's radio and nothing more. Received frames and send
+// results are handed over from Update(), never from the radio's own context.
+class MeshTransport
+{
+public:
+    typedef std::function<void(const uint8_t* mac, const uint8_t* data, size_t length)> ReceiveHandler;
+    typedef std::function<void(const uint8_t* mac, bool isDelivered)> SentHandler;
+
+protected:
+    ReceiveHandler receiveHandler;
+    SentHandler sentHandler;
+
+public:
+    virtual ~MeshTransport() { }
+
+    // channel 0 stays on whatever channel the station is on
+    virtual bool Begin(uint8_t channel) = 0;
+    virtual void End() = 0;
+
+    // False when the frame couldn't be handed to the radio; whether it arrived comes later, to the
+    // sent handler
+    virtual bool Send(const uint8_t* mac, const uint8_t* data, size_t length) = 0;
+
+    // Frames to and from peers added after this are encrypted with key, MESH_KEY_SIZE bytes; nullptr
+    // sends them in the clear
+    virtual void SetKey(const uint8_t* key) = 0;
+
+    // Lets frames from mac in, decrypted with the key. Send() adds the peers it sends to itself.
+    virtual bool AddPeer(const uint8_t* mac) = 0;
+
+    virtual void Update() = 0;
+
+    virtual void GetMAC(uint8_t* mac) = 0;
+    virtual uint8_t GetChannel() = 0;
+
+    // Frames and send results that arrived faster than Update() took them, and were lost
+    virtual unsigned long GetOverflows() = 0;
+
+    void SetReceiveHandler(ReceiveHandler handler) { receiveHandler = handler; }
+    void SetSentHandler(SentHandler handler) { sentHandler = handler; }
+
+    static bool ParseMAC(const char* text, uint8_t* mac)
+    {
+        unsigned int bytes[MESH_MAC_SIZE];
+        char end;
+        if (sscanf(text, "%2x:%2x:%2x:%2x:%2x:%2x%c", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5], &end) != MESH_MAC_SIZE)
+            return false;
+
+        for (unsigned int i = 0; i < MESH_MAC_SIZE; i++)
+            mac[i] = bytes[i];
+        return true;
+    }
+
+    // 32 hex digits
+    static bool ParseKey(const char* text, uint8_t* key)
+    {
+        if (strlen(text) != MESH_KEY_SIZE * 2)
+            return false;
+
+        for (unsigned int i = 0; i < MESH_KEY_SIZE; i++)
+        {
+            char digits[3] = { text[i * 2], text[i * 2 + 1], '\0' };
+            unsigned int byte;
+            if (!isxdigit(digits[0]) || !isxdigit(digits[1]) || sscanf(digits, "%2x", &byte) != 1)
+                return false;
+            key[i] = byte;
+        }
+        return true;
+    }
+
+    // text needs 18 bytes
+    static void FormatMAC(const uint8_t* mac, char* text)
+    {
+        sprintf(text, "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+};
+
+#endif
@@ -7,4 +7,14 @@ struct HTTPCredentials
     char uuid[64];
 };
 
+struct ServerAddress
+{
+    char ip[sizeof(HTTPCredentials::ip)];
+};
+
+struct ProbeUUID
+{
+    char uuid[sizeof(HTTPCredentials::uuid)];
+};
+
 #endif
\ No newline at end of file
@@ -3,94 +3,129 @@
 
 #include <ESP8266HTTPClient.h>
 #include <ArduinoJson.h>
-#include <iostream>
 #include <EEPROM.h>
-#include <WiFiClient.h>
 
 #include <Preferences.hpp>
+#include <Logger.hpp>
+#include <Result.hpp>
+#include <HTTPCredentials.hpp>
+#include <SecureTransport.hpp>
 
-#define API_PORT "8000"
-#define API_URL(address, path) ("http://" + (address) + ":" + (API_PORT) + (path))
+#define API_PORT 8000
+#define API_URL_SIZE 96
+#define API_TIMEOUT 5000
+#define DISCOVERY_TIMEOUT 300       // Per address; a server on the LAN answers well within it
 
-class MyHTTPClient 
+enum class HTTPError : uint8_t
+{
+    ServerNotFound,
+    InProgress,         // Discovery hasn't been through the whole subnet yet
+    NoServerIP,
+    RequestFailed,      // Never got a reply (connection refused, timeout...)
+    BadStatus,          // Got a reply, but not a 2xx one
+    InvalidResponse
+};
+
+class MyHTTPClient
 {
 private:
-    WiFiClient wifiClient;
+    PreferencesManager& preferences;
+    SecureTransport& transport;
     HTTPClient httpClient;
+    uint16_t port = API_PORT;
+    unsigned int nextHost = 1;      // Where discovery carries on
 
 public:
-    MyHTTPClient()
+    MyHTTPClient(PreferencesManager& preferences, SecureTransport& transport) : preferences(preferences), transport(transport)
     {
 
     }
 
-    void Begin(String address, String apiEndpoint) 
+    void Begin(const char* address, const char* apiEndpoint, uint16_t timeout = API_TIMEOUT)
     {
-        httpClient.begin(wifiClient, API_URL(address, apiEndpoint));
+        char url[API_URL_SIZE];
+        WiFiClient& client = transport.BeginRequest(url, sizeof(url), address, port, apiEndpoint);
+        httpClient.useHTTP10(true);     // No chunked responses, so replies can be parsed straight off the stream
+        httpClient.setTimeout(timeout);
+        httpClient.begin(client, url);
     }
 
-    void End() 
+    void SetPort(uint16_t newPort) { port = newPort; }
+
+    void End()
     {
         httpClient.end();
     }
 
-    void ClearStoredCredentials() 
+    void ClearStoredCredentials()
     {
         preferences.ClearHTTPCredentials();
         preferences.Save();
     }
 
-    bool FindServer(String currIP, String& ip)
+    bool IsDiscovering() { return nextHost > 1; }
+
+    // Tries one address of the subnet per call, so the caller's loop keeps running during the scan.
+    // InProgress until the server answers or every address has been tried.
+    Result<ServerAddress, HTTPError> FindServer(IPAddress localIP)
     {
-        IPAddress ipAddress;
-        ipAddress.fromString(currIP);
-       
-        for (int i = 1; i < 255; i++)
+        if (nextHost == localIP[3])
+            nextHost++;
+        if (nextHost > 254)
         {
-            String ip_ = String(ipAddress[0]) + "." + String(ipAddress[1]) + "." + String(ipAddress[2]) + "." + String(i);
+            nextHost = 1;
+            return HTTPError::ServerNotFound;
+        }
 
-            Serial.printf("Trying %s...\n", ip_.c_str());
+        ServerAddress address;
+        snprintf_P(address.ip, sizeof(address.ip), PSTR("%u.%u.%u.%u"), localIP[0], localIP[1], localIP[2], nextHost++);
 
-            Begin(ip_, "/api/");
-            int httpResponseCode = httpClient.GET();
-            End();
+        LOG_DEBUG("Trying %s...", address.ip);
 
-            if (httpResponseCode >= 200 && httpResponseCode < 300) 
-            {
-                Serial.printf("Found server at %s!\n", ip_.c_str());
-                ip = ip_;
-                return true;
-            }
+        Begin(address.ip, "/api/", DISCOVERY_TIMEOUT);
+        int httpResponseCode = httpClient.GET();
+        End();
+
+        if (httpResponseCode >= 200 && httpResponseCode < 300)
+        {
+            LOG_INFO("Found server at %s!", address.ip);
+            nextHost = 1;
+            return address;
         }
-        return false;
+        return HTTPError::InProgress;
     }
 
-    bool RequestUUID(String& uuid)
+    Result<ProbeUUID, HTTPError> RequestUUID()
     {
-        auto credentials = preferences.GetHTTPCredentials();
-        Begin(credentials.ip, "/api/probe/create/");
-        int httpResponseCode = httpClient.POST("");
+        auto serverIP = preferences.GetServerIP();
+        if (serverIP.HasError())
+            return HTTPError::NoServerIP;
 
-        if (httpResponseCode >= 200 && httpResponseCode < 300) 
-        {
-            String response = httpClient.getString();
-            DynamicJsonDocument jsonResponse(1024);
-            deserializeJson(jsonResponse, response);
-
-            String probeId = jsonResponse["probe_id"];
-            End();
+        Begin(serverIP.GetValue(), "/api/probe/create/");
+        int httpResponseCode = httpClient.POST(nullptr, 0);
 
-            Serial.println("Obtained UUID: " + probeId);
-            uuid = probeId;
-            return true;
-        }
-        else
+        if (httpResponseCode < 200 || httpResponseCode >= 300)
         {
-            Serial.printf("Couldn't obtain UUID. You need to enter it manually using server-info {ip} {uuid}\n(error code %d)\n", httpResponseCode);
+            LOG_ERROR("Couldn't obtain UUID. You need to enter it manually using server-info {ip} {uuid} (error code %d)", httpResponseCode);
             End();
-            return false;
+            return httpResponseCode < 0 ? HTTPError::RequestFailed : HTTPError::BadStatus;
         }
+
+        StaticJsonDocument<JSON_OBJECT_SIZE(1) + 64> jsonResponse;
+        DeserializationError jsonError = deserializeJson(jsonResponse, httpClient.getStream());
+        End();
+
+        const char* probeId = jsonResponse["probe_id"] | "";
+        if (jsonError || probeId[0] == '\0')
+            return HTTPError::InvalidResponse;
+
+        ProbeUUID uuid;
+        strncpy(uuid.uuid, probeId, sizeof(uuid.uuid) - 1);
+        uuid.uuid[sizeof(uuid.uuid) - 1] = '\0';
+
+        LOG_INFO("Obtained UUID: %s", uuid.uuid);
+        return uuid;
     }
 };
 
-#endif
\ No newline at end of file
+#endif
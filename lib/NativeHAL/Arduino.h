@@ -0,0 +1,226 @@
+#ifndef NATIVE_HAL_ARDUINO_H
+#define NATIVE_HAL_ARDUINO_H
+
+// Just enough of the Arduino/ESP8266 core to build the probe on a Linux box.
+// There is deliberately no String class: steady-state code must not use it.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Flash strings live in ordinary memory here
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper*>(p))
+
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_dword(address) (*(const uint32_t*)(address))
+#define strncpy_P strncpy
+#define strcpy_P strcpy
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strlen_P strlen
+#define memcpy_P memcpy
+#define sprintf_P sprintf
+#define vsnprintf_P vsnprintf
+
+// The ESP8266 one reads a %S argument from flash; it's an ordinary %s here
+int snprintf_P(char* buffer, size_t size, PGM_P format, ...);
+
+// Not strnlen, which GCC warns about once it sees a literal shorter than the bound
+inline size_t strnlen_P(PGM_P string, size_t size)
+{
+    size_t length = 0;
+    while (length < size && string[length] != '\0')
+        length++;
+    return length;
+}
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define LED_BUILTIN 2
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+template <typename T>
+T constrain(T value, T low, T high) { return value < low ? low : (value > high ? high : value); }
+
+class Print
+{
+public:
+    virtual ~Print() { }
+
+    virtual size_t write(uint8_t c) = 0;
+
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        size_t written = 0;
+        while (size-- > 0)
+            written += write(*buffer++);
+        return written;
+    }
+
+    size_t write(const char* text) { return text == nullptr ? 0 : write((const uint8_t*)text, strlen(text)); }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() { }
+
+    size_t print(const char* text) { return write(text); }
+    size_t print(const __FlashStringHelper* text) { return write((const char*)text); }
+    size_t println(const char* text = "") { return write(text) + write("\n"); }
+    size_t println(const __FlashStringHelper* text) { return println((const char*)text); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        return length <= 0 ? 0 : write((const uint8_t*)buffer, min((size_t)length, sizeof(buffer) - 1));
+    }
+};
+
+class Stream : public Print
+{
+protected:
+    unsigned long timeout = 1000;
+
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+
+    size_t readBytes(char* buffer, size_t length)
+    {
+        size_t count = 0;
+        while (count < length && available() > 0)
+            buffer[count++] = (char)read();
+        return count;
+    }
+
+    size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+};
+
+// Writes go to stdout; input comes from stdin (non-blocking) or from Inject()
+class HardwareSerial : public Stream
+{
+private:
+    char input[256];
+    size_t inputHead = 0;
+    size_t inputTail = 0;
+    bool echo = true;
+    bool readStdin = false;
+
+    void PollStdin();
+
+public:
+    void begin(unsigned long baud);
+    void end() { }
+
+    int available() override;
+    int read() override;
+    int peek() override;
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+    void flush() override { fflush(stdout); }
+
+    void Inject(const char* text);
+    void SetEcho(bool echo) { this->echo = echo; }
+
+    explicit operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress
+{
+private:
+    uint8_t octets[4] = { 0, 0, 0, 0 };
+
+public:
+    IPAddress() { }
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets { a, b, c, d } { }
+
+    bool fromString(const char* address)
+    {
+        unsigned int a, b, c, d;
+        if (sscanf(address, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+            return false;
+        octets[0] = a; octets[1] = b; octets[2] = c; octets[3] = d;
+        return true;
+    }
+
+    uint8_t operator[](int index) const { return octets[index]; }
+    uint8_t& operator[](int index) { return octets[index]; }
+
+    bool operator==(const IPAddress& other) const { return memcmp(octets, other.octets, 4) == 0; }
+    bool operator!=(const IPAddress& other) const { return !(*this == other); }
+
+    bool isSet() const { return octets[0] != 0 || octets[1] != 0 || octets[2] != 0 || octets[3] != 0; }
+};
+
+// Heap figures are derived from what the process has allocated through the wrapped malloc
+class EspClass
+{
+public:
+    uint32_t getFreeHeap();
+    uint32_t getMaxFreeBlockSize();
+    uint8_t getHeapFragmentation() { return 0; }
+    uint32_t getChipId() { return 0x00C0FFEE; }
+    uint32_t getCycleCount() { return (uint32_t)(micros() * 80); }
+    uint32_t getFreeSketchSpace() { return 1024 * 1024; }
+    uint32_t getSketchSize() { return 400 * 1024; }
+
+    // 512 bytes that survive restart() but not power loss
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+    const char* getResetReason() { return "Power On"; }
+    void restart();
+    void reset() { restart(); }
+};
+
+extern EspClass ESP;
+
+#endif
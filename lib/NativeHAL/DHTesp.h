@@ -0,0 +1,115 @@
+#ifndef NATIVE_HAL_DHTESP_H
+#define NATIVE_HAL_DHTESP_H
+
+#include <Arduino.h>
+#include <NativeHAL.hpp>
+
+struct TempAndHumidity
+{
+    float temperature;
+    float humidity;
+};
+
+// Returns a slow synthetic drift unless a reading is forced with SetReading()/SetStatus() or a
+// trace is being replayed (NativeHAL::UseTrace).
+// Like the real library, a bus transaction only happens once per minimum sampling period.
+class DHTesp
+{
+public:
+    typedef enum
+    {
+        AUTO_DETECT,
+        DHT11,
+        DHT22,
+        AM2302,
+        RHT03
+    } DHT_MODEL_t;
+
+    typedef enum
+    {
+        ERROR_NONE = 0,
+        ERROR_TIMEOUT,
+        ERROR_CHECKSUM
+    } DHT_ERROR_t;
+
+private:
+    DHT_MODEL_t model = DHT11;
+    DHT_ERROR_t status = ERROR_NONE;
+    DHT_ERROR_t forcedStatus = ERROR_NONE;
+
+    TempAndHumidity values = { NAN, NAN };
+    bool hasForcedReading = false;
+    TempAndHumidity forcedReading = { 0, 0 };
+
+    unsigned long lastReadTime = 0;
+    bool hasRead = false;
+    unsigned long readCount = 0;
+
+    void ReadSensor()
+    {
+        if (hasRead && millis() - lastReadTime < (unsigned long)getMinimumSamplingPeriod())
+            return;
+
+        hasRead = true;
+        lastReadTime = millis();
+        readCount++;
+        status = forcedStatus;
+
+        if (status != ERROR_NONE)
+        {
+            values = { NAN, NAN };
+            return;
+        }
+
+        if (hasForcedReading)
+        {
+            values = forcedReading;
+            return;
+        }
+
+        NativeHAL::TraceSample sample;
+        if (NativeHAL::GetTraceSample(sample))
+        {
+            status = isnan(sample.temperature) ? ERROR_TIMEOUT : ERROR_NONE;
+            values = status == ERROR_NONE ? TempAndHumidity { sample.temperature, sample.humidity } : TempAndHumidity { NAN, NAN };
+            return;
+        }
+
+        float phase = (float)millis() / 600000.0f * 2.0f * (float)M_PI;
+        values.temperature = roundf(22.0f + 2.0f * sinf(phase));
+        values.humidity = roundf(55.0f - 5.0f * sinf(phase));
+    }
+
+public:
+    void setup(uint8_t pin, DHT_MODEL_t model = AUTO_DETECT) { this->model = model == AUTO_DETECT ? DHT11 : model; }
+
+    float getTemperature() { ReadSensor(); return values.temperature; }
+    float getHumidity() { ReadSensor(); return values.humidity; }
+    TempAndHumidity getTempAndHumidity() { ReadSensor(); return values; }
+
+    DHT_ERROR_t getStatus() { return status; }
+    const char* getStatusString()
+    {
+        switch (status)
+        {
+            case ERROR_TIMEOUT: return "TIMEOUT";
+            case ERROR_CHECKSUM: return "CHECKSUM";
+            default: return "OK";
+        }
+    }
+
+    int getMinimumSamplingPeriod() { return model == DHT11 ? 1000 : 2000; }
+    DHT_MODEL_t getModel() { return model; }
+
+    void SetReading(float temperature, float humidity)
+    {
+        forcedReading = { temperature, humidity };
+        hasForcedReading = true;
+    }
+
+    void ClearReading() { hasForcedReading = false; }
+    void SetStatus(DHT_ERROR_t status) { forcedStatus = status; }
+    unsigned long GetReadCount() { return readCount; }
+};
+
+#endif
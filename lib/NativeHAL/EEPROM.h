@@ -0,0 +1,50 @@
+#ifndef NATIVE_HAL_EEPROM_H
+#define NATIVE_HAL_EEPROM_H
+
+#include <Arduino.h>
+
+#define NATIVE_EEPROM_SIZE 4096
+
+// Starts out erased (0xFF), like a fresh flash sector
+class EEPROMClass
+{
+private:
+    uint8_t data[NATIVE_EEPROM_SIZE];
+    size_t size = 0;
+
+    unsigned long commitCount = 0;
+
+public:
+    EEPROMClass() { memset(data, 0xFF, sizeof(data)); }
+
+    void begin(size_t size) { this->size = min(size, (size_t)NATIVE_EEPROM_SIZE); }
+    bool commit() { commitCount++; return true; }
+    bool end() { commit(); size = 0; return true; }
+
+    uint8_t read(int address) { return data[address]; }
+    void write(int address, uint8_t value) { data[address] = value; }
+
+    template <typename T>
+    T& get(int address, T& value)
+    {
+        memcpy((void*)&value, data + address, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    const T& put(int address, const T& value)
+    {
+        memcpy(data + address, (const void*)&value, sizeof(T));
+        return value;
+    }
+
+    uint8_t* getDataPtr() { return data; }
+    size_t length() { return size; }
+
+    void Erase() { memset(data, 0xFF, sizeof(data)); }
+    unsigned long GetCommitCount() { return commitCount; }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef NATIVE_HAL_ESP8266HTTPCLIENT_H
+#define NATIVE_HAL_ESP8266HTTPCLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <NativeHAL.hpp>
+
+#define HTTPC_ERROR_CONNECTION_FAILED   (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED       (-4)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_NO_STREAM           (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER      (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM        (-8)
+#define HTTPC_ERROR_ENCODING            (-9)
+#define HTTPC_ERROR_STREAM_WRITE        (-10)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_PARTIAL_CONTENT 206
+#define HTTP_CODE_NOT_FOUND 404
+
+// Requests are answered in-process by NativeHAL::httpServer, once the client has connected
+class HTTPClient
+{
+private:
+    WiFiClient* client = nullptr;
+    char url[NATIVE_HTTP_URL_SIZE] = "";
+    char headers[NATIVE_HTTP_HEADER_SIZE] = "";
+    NativeHAL::HTTPResponse response;
+
+    int Send(const char* method, const uint8_t* body, size_t bodyLength)
+    {
+        if (client == nullptr)
+            return HTTPC_ERROR_NOT_CONNECTED;
+
+        // "scheme://host:port/path"
+        char host[64] = "";
+        unsigned int port = 80;
+        const char* start = strstr(url, "://");
+        start = start == nullptr ? url : start + 3;
+        if (sscanf(start, "%63[^:/]:%u", host, &port) < 1 || !client->connect(host, (uint16_t)port))
+            return HTTPC_ERROR_CONNECTION_FAILED;
+
+        NativeHAL::HTTPRequest request { method, url, headers, body, bodyLength };
+        response = NativeHAL::HTTPResponse();
+
+        int code = NativeHAL::httpServer.Handle(request, response);
+        // HTTP/1.0 style: the server closes once the body is sent, connected() stays true while it's unread
+        if (code > 0)
+        {
+            client->SetReceived(response.body, response.length);
+            client->SetConnected(false);
+        }
+        return code;
+    }
+
+public:
+    bool begin(WiFiClient& client, const char* url)
+    {
+        this->client = &client;
+        strncpy(this->url, url, sizeof(this->url) - 1);
+        this->url[sizeof(this->url) - 1] = '\0';
+        headers[0] = '\0';
+        return true;
+    }
+
+    void end()
+    {
+        if (client != nullptr)
+            client->stop();
+        client = nullptr;
+    }
+
+    void useHTTP10(bool) { }
+    void setReuse(bool) { }
+    void setTimeout(uint16_t) { }
+    void setUserAgent(const char*) { }
+
+    void addHeader(const char* name, const char* value)
+    {
+        size_t used = strlen(headers);
+        snprintf(headers + used, sizeof(headers) - used, "%s: %s\r\n", name, value);
+    }
+
+    int GET() { return Send("GET", nullptr, 0); }
+    int POST(const uint8_t* payload, size_t size) { return Send("POST", payload, size); }
+    int POST(const char* payload) { return Send("POST", (const uint8_t*)payload, payload == nullptr ? 0 : strlen(payload)); }
+
+    int getSize() { return response.contentLength >= 0 ? (int)response.contentLength : (int)response.length; }
+    bool connected() { return client != nullptr && client->connected(); }
+
+    WiFiClient& getStream() { return *client; }
+    WiFiClient* getStreamPtr() { return client; }
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef NATIVE_HAL_ESP8266WIFI_H
+#define NATIVE_HAL_ESP8266WIFI_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+typedef enum
+{
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL,
+    WL_SCAN_COMPLETED,
+    WL_CONNECTED,
+    WL_CONNECT_FAILED,
+    WL_CONNECTION_LOST,
+    WL_WRONG_PASSWORD,
+    WL_DISCONNECTED
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+typedef enum
+{
+    WIFI_NONE_SLEEP = 0,
+    WIFI_LIGHT_SLEEP = 1,
+    WIFI_MODEM_SLEEP = 2
+} WiFiSleepType_t;
+
+// Associates after a fixed delay. The access point can be taken away with SetAvailable(false).
+class ESP8266WiFiClass
+{
+private:
+    wl_status_t currentStatus = WL_DISCONNECTED;
+    unsigned long connectStartTime = 0;
+    unsigned long associationTime = 500;
+
+    char ssid[33] = "";
+    bool isAvailable = true;
+
+    IPAddress address = IPAddress(192, 168, 1, 50);
+    int32_t rssi = -60;
+
+    WiFiMode_t currentMode = WIFI_STA;
+    WiFiSleepType_t sleepType = WIFI_MODEM_SLEEP;
+    uint8_t listenInterval = 0;
+
+public:
+    wl_status_t begin(const char* ssid, const char* password)
+    {
+        strncpy(this->ssid, ssid, sizeof(this->ssid) - 1);
+        currentStatus = WL_IDLE_STATUS;
+        connectStartTime = millis();
+        return currentStatus;
+    }
+
+    bool disconnect(bool wifiOff = false)
+    {
+        currentStatus = WL_DISCONNECTED;
+        if (wifiOff)
+            currentMode = WIFI_OFF;
+        return true;
+    }
+
+    wl_status_t status()
+    {
+        if (currentStatus == WL_IDLE_STATUS && millis() - connectStartTime >= associationTime)
+            currentStatus = isAvailable ? WL_CONNECTED : WL_NO_SSID_AVAIL;
+        if (currentStatus == WL_CONNECTED && !isAvailable)
+            currentStatus = WL_DISCONNECTED;
+        return currentStatus;
+    }
+
+    bool isConnected() { return status() == WL_CONNECTED; }
+
+    IPAddress localIP() { return currentStatus == WL_CONNECTED ? address : IPAddress(); }
+    int32_t RSSI() { return currentStatus == WL_CONNECTED ? rssi : 31; }
+    int32_t channel() { return 6; }
+
+    bool mode(WiFiMode_t mode) { currentMode = mode; return true; }
+    WiFiMode_t getMode() { return currentMode; }
+
+    bool setSleepMode(WiFiSleepType_t type, uint8_t listenInterval = 0)
+    {
+        sleepType = type;
+        this->listenInterval = listenInterval;
+        return true;
+    }
+    WiFiSleepType_t getSleepMode() { return sleepType; }
+    uint8_t getListenInterval() { return listenInterval; }
+
+    bool setAutoReconnect(bool) { return true; }
+    bool persistent(bool) { return true; }
+
+    uint8_t* macAddress(uint8_t* mac)
+    {
+        const uint8_t fake[6] = { 0x5C, 0xCF, 0x7F, address[2], address[3], 0x01 };
+        memcpy(mac, fake, sizeof(fake));
+        return mac;
+    }
+
+    void SetAvailable(bool available) { isAvailable = available; }
+    void SetAssociationTime(unsigned long time) { associationTime = time; }
+    void SetLocalIP(IPAddress address) { this->address = address; }
+    void SetRSSI(int32_t rssi) { this->rssi = rssi; }
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
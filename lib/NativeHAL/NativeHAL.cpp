@@ -0,0 +1,1120 @@
+#include <NativeHAL.hpp>
+#include <EEPROM.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266HTTPClient.h>
+#include <WebSocketsClient.h>
+#include <Updater.h>
+#include <bearssl/bearssl_hash.h>
+
+#include <chrono>
+#include <malloc.h>
+#include <new>
+#include <poll.h>
+#include <unistd.h>
+
+#define NATIVE_HEAP_SIZE (80 * 1024)
+#define NATIVE_TRACE_LINE_SIZE 160
+#define NATIVE_RTC_USER_MEMORY_SIZE 512
+#define NATIVE_FIRMWARE_VERSION_SIZE 16
+#define NATIVE_MAX_SCHEDULED_LINES 16
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+ESP8266WiFiClass WiFi;
+EspClass ESP;
+UpdaterClass Update;
+
+namespace NativeHAL
+{
+    HTTPServerStandIn httpServer;
+    WebSocketServerStandIn webSocketServer;
+    TLSServerStandIn tlsServer;
+
+    static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    static bool isManualClock = false;
+    static unsigned long long manualMicros = 0;
+
+    static AllocationStats allocationStats = { 0, 0, 0, 0 };
+    static bool restartRequested = false;
+    static uint32_t rtcUserMemory[NATIVE_RTC_USER_MEMORY_SIZE / 4];
+
+    void UseManualClock(bool manual)
+    {
+        if (manual && !isManualClock)
+            manualMicros = micros();
+        isManualClock = manual;
+    }
+
+    bool IsManualClock() { return isManualClock; }
+
+    void AdvanceMillis(unsigned long ms) { manualMicros += (unsigned long long)ms * 1000ULL; }
+
+    AllocationStats GetAllocationStats() { return allocationStats; }
+
+    void ResetAllocationStats()
+    {
+        allocationStats.allocations = 0;
+        allocationStats.frees = 0;
+        allocationStats.peakBytes = allocationStats.liveBytes;
+    }
+
+    bool IsRestartRequested() { return restartRequested; }
+
+    static bool HostMatches(const char* url, const char* host)
+    {
+        const char* start = strstr(url, "://");
+        start = start == nullptr ? url : start + 3;
+        size_t length = strlen(host);
+        return strncmp(start, host, length) == 0 && (start[length] == ':' || start[length] == '/');
+    }
+
+    static const char* PathOf(const char* url)
+    {
+        const char* start = strstr(url, "://");
+        start = start == nullptr ? url : start + 3;
+        const char* path = strchr(start, '/');
+        return path == nullptr ? "/" : path;
+    }
+
+    static bool HandleFirmwareRequest(const HTTPRequest& request, const char* path, HTTPResponse& response, int& code);
+
+    void UseDefaultServer(const char* serverIP)
+    {
+        static char ip[16];
+        static unsigned long issuedUUIDs = 0;
+        strncpy(ip, serverIP, sizeof(ip) - 1);
+        strncpy(tlsServer.host, serverIP, sizeof(tlsServer.host) - 1);
+
+        httpServer.handler = [](const HTTPRequest& request, HTTPResponse& response) {
+            if (!HostMatches(request.url, ip))
+                return HTTPC_ERROR_CONNECTION_FAILED;
+
+            const char* path = PathOf(request.url);
+            int code;
+            if (HandleFirmwareRequest(request, path, response, code))
+                return code;
+
+            if (strcmp(request.method, "GET") == 0 && strcmp(path, "/api/") == 0)
+            {
+                response.Set("{}");
+                return 200;
+            }
+
+            if (strcmp(request.method, "POST") == 0 && strcmp(path, "/api/probe/create/") == 0)
+            {
+                char body[96];
+                snprintf(body, sizeof(body), "{\"probe_id\":\"00000000-0000-4000-8000-%012lx\"}", ++issuedUUIDs);
+                response.Set(body);
+                return 201;
+            }
+
+            return HTTP_CODE_NOT_FOUND;
+        };
+    }
+
+    static bool HasElapsed(unsigned long time) { return (long)(millis() - time) >= 0; }
+
+    // ---- Latency histogram ----
+
+    unsigned long LatencyHistogram::BucketOf(unsigned long ms)
+    {
+        if (ms < NATIVE_LATENCY_EXACT_MS)
+            return ms;
+        return min(NATIVE_LATENCY_EXACT_MS + (ms - NATIVE_LATENCY_EXACT_MS) / 10, (unsigned long)NATIVE_LATENCY_BUCKETS - 1);
+    }
+
+    unsigned long LatencyHistogram::LowerBoundOf(unsigned long bucket)
+    {
+        if (bucket < NATIVE_LATENCY_EXACT_MS)
+            return bucket;
+        return NATIVE_LATENCY_EXACT_MS + (bucket - NATIVE_LATENCY_EXACT_MS) * 10;
+    }
+
+    void LatencyHistogram::Add(unsigned long ms)
+    {
+        buckets[BucketOf(ms)]++;
+        count++;
+        maximum = max(maximum, ms);
+    }
+
+    unsigned long LatencyHistogram::Percentile(float percent) const
+    {
+        if (count == 0)
+            return 0;
+
+        unsigned long target = (unsigned long)ceilf(percent / 100.0f * (float)count);
+        unsigned long seen = 0;
+        for (unsigned long bucket = 0; bucket < NATIVE_LATENCY_BUCKETS; bucket++)
+        {
+            seen += buckets[bucket];
+            if (seen >= max(target, 1UL))
+                return min(LowerBoundOf(bucket), maximum);
+        }
+        return maximum;
+    }
+
+    // ---- WebSocket server ----
+
+    static size_t WireSizeOf(size_t length)
+    {
+        return length + (length < 126 ? 6 : 8);    // Client frames carry a 4 byte mask
+    }
+
+    bool WebSocketServerStandIn::Accept(WebSocketsClient& client, const uint8_t* payload, size_t length, bool isBinary)
+    {
+        size_t wireSize = WireSizeOf(length);
+        if (inFlightCount == NATIVE_WS_IN_FLIGHT || client.BytesInFlight() + wireSize > receiveWindow || length >= NATIVE_WS_FRAME_SIZE)
+        {
+            framesRefused++;
+            return false;
+        }
+
+        InFlightFrame& frame = inFlight[(inFlightHead + inFlightCount) % NATIVE_WS_IN_FLIGHT];
+        frame.client = &client;
+        frame.deliverAt = millis() + readDelay;
+        frame.length = length;
+        frame.isBinary = isBinary;
+        memcpy(frame.payload, payload, length);
+        frame.payload[length] = '\0';
+
+        inFlightCount++;
+        client.BytesInFlight() += wireSize;
+        bytesSent += wireSize;
+
+        // Without a read delay the frame is handled before sendTXT() returns, as it always was
+        if (!isDelivering)
+            Update();
+        return true;
+    }
+
+    void WebSocketServerStandIn::Deliver(InFlightFrame& frame)
+    {
+        framesReceived++;
+        bytesReceived += WireSizeOf(frame.length);
+
+        const char* sampledAt = frame.isBinary ? nullptr : strstr((const char*)frame.payload, "\"sampled_at\":");
+        if (sampledAt != nullptr)
+            latency.Add(millis() - strtoul(sampledAt + strlen("\"sampled_at\":"), nullptr, 10));
+
+        if (!frame.isBinary && strstr((const char*)frame.payload, "\"type\":\"hello\"") != nullptr)
+        {
+            hellosReceived++;
+            if (helloReply[0] != '\0')
+                frame.client->DeliverText(helloReply);
+        }
+
+        if (!frame.isBinary && strstr((const char*)frame.payload, "\"type\":\"result\"") != nullptr)
+            CountResult((const char*)frame.payload);
+
+        if (onFrame)
+            onFrame(*frame.client, frame.payload, frame.length, frame.isBinary);
+    }
+
+    void WebSocketServerStandIn::ApplyFaults()
+    {
+        if (isRestarting && HasElapsed(restartAt))
+        {
+            isRestarting = false;
+            isUp = true;
+        }
+
+        for (unsigned int i = 0; i < faultCount; i++)
+        {
+            Fault& fault = faults[i];
+            if (fault.finished || !HasElapsed(fault.at))
+                continue;
+
+            if (!fault.started)
+            {
+                fault.started = true;
+                switch (fault.type)
+                {
+                    case Fault::Disconnect: DropConnections(); break;
+                    case Fault::Restart: Restart(fault.duration); break;
+                    case Fault::SlowReads: readDelay = fault.readDelay; break;
+                }
+            }
+
+            if (fault.type != Fault::SlowReads || HasElapsed(fault.at + fault.duration))
+            {
+                fault.finished = true;
+                if (fault.type == Fault::SlowReads)
+                    readDelay = 0;
+            }
+        }
+    }
+
+    void WebSocketServerStandIn::SendCommands()
+    {
+        for (unsigned int i = 0; i < commandCount; i++)
+        {
+            RemoteCommandSchedule& command = commands[i];
+            if (command.isSent || !HasElapsed(command.at))
+                continue;
+
+            char text[NATIVE_WS_COMMAND_SIZE + 48];
+            snprintf(text, sizeof(text), "{\"type\":\"command\",\"id\":\"%u\",\"line\":\"%s\"}", i + 1, command.line);
+            command.isSent = true;
+            command.sentAt = millis();
+            commandsSent += Broadcast(text);
+        }
+    }
+
+    void WebSocketServerStandIn::CountResult(const char* payload)
+    {
+        const char* id = strstr(payload, "\"id\":\"");
+        unsigned long index = id == nullptr ? 0 : strtoul(id + strlen("\"id\":\""), nullptr, 10);
+        if (index >= 1 && index <= commandCount)
+            commandLatency.Add(millis() - commands[index - 1].sentAt);
+
+        if (strstr(payload, "\"ok\":true") != nullptr)
+            resultsOk++;
+        else
+            resultsFailed++;
+    }
+
+    void WebSocketServerStandIn::Register(WebSocketsClient& client)
+    {
+        for (unsigned int i = 0; i < clientCount; i++)
+        {
+            if (clients[i] == &client)
+                return;
+        }
+        if (clientCount < NATIVE_WS_MAX_CLIENTS)
+            clients[clientCount++] = &client;
+    }
+
+    void WebSocketServerStandIn::Unregister(WebSocketsClient& client)
+    {
+        for (unsigned int i = 0; i < clientCount; i++)
+        {
+            if (clients[i] == &client)
+            {
+                clients[i] = clients[--clientCount];
+                return;
+            }
+        }
+    }
+
+    unsigned int WebSocketServerStandIn::Broadcast(const char* text)
+    {
+        unsigned int delivered = 0;
+        for (unsigned int i = 0; i < clientCount; i++)
+        {
+            if (clients[i]->DeliverText(text))
+                delivered++;
+            else
+                commandsUndelivered++;
+        }
+        return delivered;
+    }
+
+    bool WebSocketServerStandIn::ScheduleCommand(unsigned long at, const char* line)
+    {
+        if (commandCount == NATIVE_MAX_REMOTE_COMMANDS || strlen(line) >= NATIVE_WS_COMMAND_SIZE || strchr(line, '"') != nullptr)
+            return false;
+
+        RemoteCommandSchedule& command = commands[commandCount++];
+        command.at = at;
+        strcpy(command.line, line);
+        command.isSent = false;
+        command.sentAt = 0;
+        return true;
+    }
+
+    void WebSocketServerStandIn::Update()
+    {
+        ApplyFaults();
+        SendCommands();
+
+        isDelivering = true;
+        while (inFlightCount > 0 && HasElapsed(inFlight[inFlightHead].deliverAt))
+        {
+            static InFlightFrame frame;     // The handler may send, which can reuse the slot
+            frame = inFlight[inFlightHead];
+            inFlightHead = (inFlightHead + 1) % NATIVE_WS_IN_FLIGHT;
+            inFlightCount--;
+            size_t& clientBytes = frame.client->BytesInFlight();
+            clientBytes -= min(clientBytes, WireSizeOf(frame.length));
+            Deliver(frame);
+        }
+        isDelivering = false;
+    }
+
+    void WebSocketServerStandIn::DropConnections()
+    {
+        connectionEpoch++;
+        framesDropped += inFlightCount;
+        inFlightCount = 0;      // Clients reset their own byte count when they reconnect
+    }
+
+    void WebSocketServerStandIn::Restart(unsigned long downtime)
+    {
+        DropConnections();
+        tlsServer.sessionEpoch++;
+        isUp = false;
+        isRestarting = true;
+        restartAt = millis() + downtime;
+    }
+
+    bool WebSocketServerStandIn::ScheduleFault(const char* spec)
+    {
+        if (faultCount == NATIVE_MAX_FAULTS)
+            return false;
+
+        Fault fault = { Fault::Disconnect, 0, 0, 0, false, false };
+        const char* at = strchr(spec, '@');
+        if (at == nullptr)
+            return false;
+
+        size_t nameLength = at - spec;
+        if (nameLength == strlen("disconnect") && strncmp(spec, "disconnect", nameLength) == 0)
+            fault.type = Fault::Disconnect;
+        else if (nameLength == strlen("restart") && strncmp(spec, "restart", nameLength) == 0)
+            fault.type = Fault::Restart;
+        else if (nameLength == strlen("slow") && strncmp(spec, "slow", nameLength) == 0)
+            fault.type = Fault::SlowReads;
+        else
+            return false;
+
+        char* end;
+        fault.at = strtoul(at + 1, &end, 10);
+        if (fault.type != Fault::Disconnect)
+        {
+            if (*end != '+')
+                return false;
+            fault.duration = strtoul(end + 1, &end, 10);
+        }
+        if (fault.type == Fault::SlowReads)
+        {
+            if (*end != ':')
+                return false;
+            fault.readDelay = strtoul(end + 1, &end, 10);
+        }
+        if (*end != '\0')
+            return false;
+
+        faults[faultCount++] = fault;
+        return true;
+    }
+
+    bool WebSocketServerStandIn::SetHelloReply(const char* spec)
+    {
+        char encoding[16] = "";
+        unsigned long interval = 0;
+        unsigned int batch = 0;
+        if (sscanf(spec, "%15[^:]:%lu:%u", encoding, &interval, &batch) != 3)
+            return false;
+
+        snprintf(helloReply, sizeof(helloReply), "{\"type\":\"hello\",\"encoding\":\"%s\",\"interval\":%lu,\"batch\":%u}",
+            encoding, interval, batch);
+        return true;
+    }
+
+    void WebSocketServerStandIn::PrintReport()
+    {
+        unsigned long lost = framesOffered - framesReceived - inFlightCount;
+        printf("---- delivery report ----\n");
+        printf("frames:      %lu offered, %lu delivered, %lu refused, %lu dropped in flight, %u still in flight\n",
+            framesOffered, framesReceived, framesRefused, framesDropped, inFlightCount);
+        printf("loss:        %lu (%.2f%%)\n", lost, framesOffered == 0 ? 0.0 : 100.0 * (double)lost / (double)framesOffered);
+        printf("latency ms:  p50 %lu, p90 %lu, p99 %lu, max %lu (%lu samples)\n", latency.Percentile(50), latency.Percentile(90),
+            latency.Percentile(99), latency.GetMax(), latency.GetCount());
+        printf("wire bytes:  %lu sent, %lu delivered (%.1f per delivered frame)\n", bytesSent, bytesReceived,
+            framesReceived == 0 ? 0.0 : (double)bytesSent / (double)framesReceived);
+        printf("connection:  %lu connects, %lu disconnects, %lu pings, %lu hellos\n", connections, disconnections, pingsReceived,
+            hellosReceived);
+        if (commandCount > 0)
+        {
+            printf("commands:    %lu sent, %lu undelivered, %lu ok, %lu failed\n", commandsSent, commandsUndelivered, resultsOk,
+                resultsFailed);
+            printf("command ms:  p50 %lu, p90 %lu, p99 %lu, max %lu (%lu results)\n", commandLatency.Percentile(50),
+                commandLatency.Percentile(90), commandLatency.Percentile(99), commandLatency.GetMax(), commandLatency.GetCount());
+        }
+    }
+
+    // ---- TLS ----
+
+    TLSServerStandIn::TLSServerStandIn()
+    {
+        for (int i = 0; i < NATIVE_TLS_FINGERPRINT_SIZE; i++)
+            fingerprint[i] = (uint8_t)(0x5A + i * 37);
+    }
+
+    bool TLSServerStandIn::Accepts(const char* host, uint16_t port)
+    {
+        if (isEnabled && port == this->port && strcmp(host, this->host) == 0)
+            return true;
+        refused++;
+        return false;
+    }
+
+    bool TLSServerStandIn::Handshake(const uint8_t* pinnedFingerprint, size_t receiveBufferSize, unsigned long* session)
+    {
+        if (supportsResumption && session != nullptr && *session == sessionEpoch)
+        {
+            delay(NATIVE_TLS_RESUMED_HANDSHAKE_MS);
+            handshakeTime += NATIVE_TLS_RESUMED_HANDSHAKE_MS;
+            resumedHandshakes++;
+            return true;
+        }
+
+        // The certificate chain alone is bigger than a 512 byte record
+        if (!supportsFragmentLength && receiveBufferSize < NATIVE_TLS_MAX_RECORD)
+        {
+            delay(NATIVE_TLS_PROBE_MS);
+            handshakeTime += NATIVE_TLS_PROBE_MS;
+            recordOverflows++;
+            return false;
+        }
+
+        delay(NATIVE_TLS_FULL_HANDSHAKE_MS);
+        handshakeTime += NATIVE_TLS_FULL_HANDSHAKE_MS;
+        if (pinnedFingerprint != nullptr && memcmp(pinnedFingerprint, fingerprint, sizeof(fingerprint)) != 0)
+        {
+            pinFailures++;
+            return false;
+        }
+
+        fullHandshakes++;
+        if (session != nullptr)
+            *session = sessionEpoch;
+        return true;
+    }
+
+    void TLSServerStandIn::PrintReport()
+    {
+        printf("---- tls report ----\n");
+        printf("handshakes:  %lu full, %lu resumed, %lu ms spent\n", fullHandshakes, resumedHandshakes, handshakeTime);
+        printf("failures:    %lu refused, %lu pin mismatches, %lu record overflows\n", refused, pinFailures, recordOverflows);
+        printf("mfln probes: %lu (%s)\n", fragmentProbes, supportsFragmentLength ? "supported" : "not supported");
+    }
+
+    // ---- Sensor traces ----
+
+    enum class TraceKind { None, File, Bursty, Noisy };
+
+    static TraceKind traceKind = TraceKind::None;
+    static FILE* traceFile = nullptr;
+    static TraceSample traceCurrent;
+    static TraceSample traceNext;
+    static unsigned long traceNextAt = 0;
+    static bool traceHasNext = false;
+
+    static float ParseTraceField(const char*& cursor)
+    {
+        while (*cursor == ' ')
+            cursor++;
+
+        float value = NAN;
+        if (*cursor != ',' && *cursor != '\0' && *cursor != '\r' && *cursor != '\n')
+            value = strtof(cursor, nullptr);
+
+        const char* comma = strchr(cursor, ',');
+        cursor = comma == nullptr ? cursor + strlen(cursor) : comma + 1;
+        return value;
+    }
+
+    // Skips blank lines and the header (anything that doesn't start with a digit)
+    static bool ReadTraceRow(unsigned long& ms, TraceSample& sample)
+    {
+        char line[NATIVE_TRACE_LINE_SIZE];
+        while (fgets(line, sizeof(line), traceFile) != nullptr)
+        {
+            if (line[0] < '0' || line[0] > '9')
+                continue;
+
+            char* cursor = line;
+            ms = strtoul(line, &cursor, 10);
+            const char* field = *cursor == ',' ? cursor + 1 : cursor;
+            sample.temperature = ParseTraceField(field);
+            sample.humidity = ParseTraceField(field);
+            sample.soilMoisture = ParseTraceField(field);
+            sample.lightLevel = ParseTraceField(field);
+            return true;
+        }
+        return false;
+    }
+
+    // Deterministic noise in [0, 1), so synthetic runs are repeatable
+    static float Noise(unsigned long n)
+    {
+        uint32_t x = (uint32_t)n * 2654435761u;
+        x ^= x >> 15;
+        x *= 2246822519u;
+        x ^= x >> 13;
+        return (float)(x & 0xFFFFFF) / (float)0x1000000;
+    }
+
+    static void SyntheticSample(unsigned long ms, TraceSample& sample)
+    {
+        float day = (float)(ms % 86400000UL) / 86400000.0f;
+        sample.temperature = 22.0f;
+        sample.humidity = 55.0f;
+        sample.soilMoisture = 60.0f - 20.0f * (float)(ms % 3600000UL) / 3600000.0f;
+        sample.lightLevel = 50.0f + 40.0f * sinf(day * 2.0f * (float)M_PI);
+
+        if (traceKind == TraceKind::Bursty)
+        {
+            // About a third of the minutes start with a few seconds of soil readings jumping around
+            unsigned long minute = ms / 60000UL;
+            if (Noise(minute) < 0.33f && ms % 60000UL < 5000UL)
+                sample.soilMoisture = constrain(sample.soilMoisture + 50.0f * (Noise(ms / 500UL) - 0.5f), 0.0f, 100.0f);
+        }
+        else if (traceKind == TraceKind::Noisy)
+        {
+            sample.temperature += 3.0f * (Noise(ms / 1000UL) - 0.5f);
+            sample.humidity += 6.0f * (Noise(ms / 1000UL + 1) - 0.5f);
+            sample.soilMoisture += 4.0f * (Noise(ms / 500UL + 2) - 0.5f);
+            sample.lightLevel += 4.0f * (Noise(ms / 500UL + 3) - 0.5f);
+            if (Noise(ms / 1000UL + 4) < 0.05f)
+                sample.temperature = NAN;
+        }
+    }
+
+    bool UseTrace(const char* source)
+    {
+        if (strcmp(source, "synthetic:bursty") == 0)
+            traceKind = TraceKind::Bursty;
+        else if (strcmp(source, "synthetic:noisy") == 0)
+            traceKind = TraceKind::Noisy;
+        else
+        {
+            traceFile = fopen(source, "r");
+            unsigned long firstAt;
+            if (traceFile == nullptr || !ReadTraceRow(firstAt, traceCurrent))
+                return false;
+
+            traceKind = TraceKind::File;
+            traceHasNext = ReadTraceRow(traceNextAt, traceNext);
+        }
+        return true;
+    }
+
+    bool GetTraceSample(TraceSample& sample)
+    {
+        switch (traceKind)
+        {
+            case TraceKind::None:
+                return false;
+
+            case TraceKind::File:
+                // Each row holds until the clock reaches the next one; the last row holds forever
+                while (traceHasNext && millis() >= traceNextAt)
+                {
+                    traceCurrent = traceNext;
+                    traceHasNext = ReadTraceRow(traceNextAt, traceNext);
+                }
+                sample = traceCurrent;
+                return true;
+
+            default:
+                SyntheticSample(millis(), sample);
+                return true;
+        }
+    }
+
+    // ---- Firmware images ----
+
+    static char latestFirmware[NATIVE_FIRMWARE_VERSION_SIZE] = "";
+    static size_t firmwareSize = 0;
+    static unsigned int firmwareFailEvery = 0;
+    static unsigned long firmwareImageRequests = 0;
+
+    static uint32_t FirmwareSeed(const char* version)
+    {
+        uint32_t seed = 2166136261u;
+        for (; *version != '\0'; version++)
+            seed = (seed ^ (uint8_t)*version) * 16777619u;
+        return seed;
+    }
+
+    static uint8_t FirmwareByte(uint32_t seed, size_t offset)
+    {
+        static const uint8_t gzipHeader[] = { 0x1f, 0x8b, 0x08 };
+        if (offset < sizeof(gzipHeader))
+            return gzipHeader[offset];
+        return (uint8_t)(Noise(seed ^ (uint32_t)offset) * 256.0f);
+    }
+
+    static void FirmwareDigest(const char* version, uint8_t* digest)
+    {
+        static char cachedVersion[NATIVE_FIRMWARE_VERSION_SIZE] = "";
+        static uint8_t cachedDigest[br_sha256_SIZE];
+
+        if (strcmp(cachedVersion, version) != 0)
+        {
+            uint32_t seed = FirmwareSeed(version);
+            uint8_t block[256];
+            br_sha256_context context;
+            br_sha256_init(&context);
+            for (size_t offset = 0; offset < firmwareSize; offset += sizeof(block))
+            {
+                size_t length = min(sizeof(block), firmwareSize - offset);
+                for (size_t i = 0; i < length; i++)
+                    block[i] = FirmwareByte(seed, offset + i);
+                br_sha256_update(&context, block, length);
+            }
+            br_sha256_out(&context, cachedDigest);
+            snprintf(cachedVersion, sizeof(cachedVersion), "%s", version);
+        }
+        memcpy(digest, cachedDigest, br_sha256_SIZE);
+    }
+
+    void UseFirmwareImage(const char* latestVersion, size_t size, unsigned int failEvery)
+    {
+        snprintf(latestFirmware, sizeof(latestFirmware), "%s", latestVersion);
+        firmwareSize = size;
+        firmwareFailEvery = failEvery;
+    }
+
+    static bool HandleFirmwareRequest(const HTTPRequest& request, const char* path, HTTPResponse& response, int& code)
+    {
+        const char* prefix = "/api/firmware/";
+        if (firmwareSize == 0 || strcmp(request.method, "GET") != 0 || strncmp(path, prefix, strlen(prefix)) != 0)
+            return false;
+
+        char version[NATIVE_FIRMWARE_VERSION_SIZE];
+        const char* versionStart = path + strlen(prefix);
+        const char* versionEnd = strchr(versionStart, '/');
+        if (versionEnd == nullptr || versionEnd == versionStart || (size_t)(versionEnd - versionStart) >= sizeof(version))
+            return false;
+        memcpy(version, versionStart, versionEnd - versionStart);
+        version[versionEnd - versionStart] = '\0';
+        if (strcmp(version, "latest") == 0)
+            strcpy(version, latestFirmware);
+
+        if (strcmp(versionEnd, "/") == 0)
+        {
+            uint8_t digest[br_sha256_SIZE];
+            char digestText[br_sha256_SIZE * 2 + 1];
+            FirmwareDigest(version, digest);
+            for (int i = 0; i < br_sha256_SIZE; i++)
+                snprintf(digestText + i * 2, 3, "%02x", digest[i]);
+
+            char body[256];
+            snprintf(body, sizeof(body), "{\"version\":\"%s\",\"url\":\"/api/firmware/%s/image/\",\"size\":%zu,\"sha256\":\"%s\"}",
+                version, version, firmwareSize, digestText);
+            response.Set(body);
+            code = 200;
+            return true;
+        }
+
+        if (strcmp(versionEnd, "/image/") != 0)
+            return false;
+
+        size_t first = 0;
+        size_t last = firmwareSize - 1;
+        const char* range = request.headers == nullptr ? nullptr : strstr(request.headers, "Range: bytes=");
+        if (range != nullptr)
+        {
+            char* end;
+            first = strtoul(range + strlen("Range: bytes="), &end, 10);
+            if (*end == '-' && end[1] >= '0' && end[1] <= '9')
+                last = min((size_t)strtoul(end + 1, nullptr, 10), firmwareSize - 1);
+        }
+
+        if (first >= firmwareSize || last < first)
+        {
+            code = 416;
+            return true;
+        }
+
+        size_t length = min(last - first + 1, sizeof(response.body));
+        response.contentLength = (long)length;
+        if (firmwareFailEvery > 0 && ++firmwareImageRequests % firmwareFailEvery == 0)
+            length /= 2;
+
+        uint32_t seed = FirmwareSeed(version);
+        for (size_t i = 0; i < length; i++)
+            response.body[i] = FirmwareByte(seed, first + i);
+        response.length = length;
+        code = range != nullptr ? HTTP_CODE_PARTIAL_CONTENT : HTTP_CODE_OK;
+        return true;
+    }
+
+    // ---- Runner ----
+
+    int Run(int argc, char** argv, void (*setup)(), void (*loop)())
+    {
+        unsigned long duration = 0;
+        unsigned long step = 0;
+        bool report = false;
+        bool auditAllocations = false;
+        unsigned long auditWarmup = 0;
+
+        struct ScheduledLine
+        {
+            unsigned long at;
+            const char* text;
+        };
+        ScheduledLine scheduledLines[NATIVE_MAX_SCHEDULED_LINES];
+        unsigned int scheduledCount = 0;
+
+        for (int i = 1; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+                duration = strtoul(argv[++i], nullptr, 10);
+            else if (strcmp(argv[i], "--step") == 0 && i + 1 < argc)
+                step = strtoul(argv[++i], nullptr, 10);
+            else if (strcmp(argv[i], "--exec") == 0 && i + 1 < argc)
+            {
+                Serial.Inject(argv[++i]);
+                Serial.Inject("\n");
+            }
+            else if (strcmp(argv[i], "--exec-at") == 0 && i + 2 < argc && scheduledCount < NATIVE_MAX_SCHEDULED_LINES)
+            {
+                scheduledLines[scheduledCount].at = strtoul(argv[++i], nullptr, 10);
+                scheduledLines[scheduledCount++].text = argv[++i];
+            }
+            else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            {
+                if (!UseTrace(argv[++i]))
+                {
+                    fprintf(stderr, "Can't read trace %s\n", argv[i]);
+                    return 2;
+                }
+            }
+            else if (strcmp(argv[i], "--fault") == 0 && i + 1 < argc)
+            {
+                if (!webSocketServer.ScheduleFault(argv[++i]))
+                {
+                    fprintf(stderr, "Bad fault %s\n", argv[i]);
+                    return 2;
+                }
+            }
+            else if (strcmp(argv[i], "--firmware") == 0 && i + 1 < argc)
+            {
+                char version[NATIVE_FIRMWARE_VERSION_SIZE] = "";
+                unsigned long size = 0;
+                unsigned int failEvery = 0;
+                if (sscanf(argv[++i], "%15[^:]:%lu:%u", version, &size, &failEvery) < 2 || size == 0)
+                {
+                    fprintf(stderr, "Bad firmware %s\n", argv[i]);
+                    return 2;
+                }
+                UseFirmwareImage(version, size, failEvery);
+            }
+            else if (strcmp(argv[i], "--hello") == 0 && i + 1 < argc)
+            {
+                if (!webSocketServer.SetHelloReply(argv[++i]))
+                {
+                    fprintf(stderr, "Bad hello reply %s\n", argv[i]);
+                    return 2;
+                }
+            }
+            else if (strcmp(argv[i], "--command-at") == 0 && i + 2 < argc)
+            {
+                unsigned long at = strtoul(argv[++i], nullptr, 10);
+                if (!webSocketServer.ScheduleCommand(at, argv[++i]))
+                {
+                    fprintf(stderr, "Bad command %s\n", argv[i]);
+                    return 2;
+                }
+            }
+            else if (strcmp(argv[i], "--tls") == 0)
+                tlsServer.isEnabled = true;
+            else if (strcmp(argv[i], "--tls-no-mfln") == 0)
+                tlsServer.supportsFragmentLength = false;
+            else if (strcmp(argv[i], "--tls-no-resume") == 0)
+                tlsServer.supportsResumption = false;
+            else if (strcmp(argv[i], "--report") == 0)
+                report = true;
+            else if (strcmp(argv[i], "--alloc-audit") == 0 && i + 1 < argc)
+            {
+                auditAllocations = true;
+                auditWarmup = strtoul(argv[++i], nullptr, 10);
+            }
+        }
+
+        if (step > 0)
+            UseManualClock(true);
+
+        if (!httpServer.handler)
+            UseDefaultServer("192.168.1.10");
+
+        if (tlsServer.isEnabled)
+        {
+            printf("TLS fingerprint: ");
+            for (int i = 0; i < NATIVE_TLS_FINGERPRINT_SIZE; i++)
+                printf(i == 0 ? "%02x" : ":%02x", tlsServer.fingerprint[i]);
+            printf("\n");
+        }
+
+        setup();
+
+        unsigned long auditedPasses = 0;
+        unsigned long allocatingPasses = 0;
+
+        while ((duration == 0 || millis() < duration) && !restartRequested)
+        {
+            for (unsigned int i = 0; i < scheduledCount; i++)
+            {
+                if (scheduledLines[i].text != nullptr && millis() >= scheduledLines[i].at)
+                {
+                    Serial.Inject(scheduledLines[i].text);
+                    Serial.Inject("\n");
+                    scheduledLines[i].text = nullptr;
+                }
+            }
+
+            unsigned long allocationsBefore = allocationStats.allocations;
+            bool isWarm = auditAllocations && millis() >= auditWarmup;
+
+            loop();
+            webSocketServer.Update();
+
+            if (isWarm)
+            {
+                auditedPasses++;
+                if (allocationStats.allocations != allocationsBefore)
+                    allocatingPasses++;
+            }
+
+            if (isManualClock)
+                AdvanceMillis(step);
+            else
+                usleep(500);
+        }
+
+        Serial.flush();
+
+        if (report)
+        {
+            webSocketServer.PrintReport();
+            if (tlsServer.isEnabled)
+                tlsServer.PrintReport();
+        }
+
+        if (auditAllocations)
+        {
+            printf("alloc-audit: %lu of %lu loop passes allocated after %lu ms\n", allocatingPasses, auditedPasses, auditWarmup);
+            if (allocatingPasses > 0)
+                return 1;
+        }
+
+        return 0;
+    }
+}
+
+using namespace NativeHAL;
+
+unsigned long micros()
+{
+    if (isManualClock)
+        return (unsigned long)manualMicros;
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long millis()
+{
+    if (isManualClock)
+        return (unsigned long)(manualMicros / 1000ULL);
+    return micros() / 1000UL;
+}
+
+void delay(unsigned long ms)
+{
+    if (isManualClock)
+        AdvanceMillis(ms);
+    else
+        usleep(ms * 1000);
+}
+
+void yield() { }
+
+int snprintf_P(char* buffer, size_t size, PGM_P format, ...)
+{
+    // Formats longer than this have no %S in this firmware, and are used as they are
+    char converted[256];
+    const char* native = format;
+    size_t length = strnlen(format, sizeof(converted));
+    if (length < sizeof(converted))
+    {
+        bool isAfterPercent = false;
+        for (size_t i = 0; i <= length; i++)
+        {
+            converted[i] = isAfterPercent && format[i] == 'S' ? 's' : format[i];
+            isAfterPercent = !isAfterPercent && format[i] == '%';
+        }
+        native = converted;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer, size, native, args);
+    va_end(args);
+    return written;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) { }
+void digitalWrite(uint8_t pin, uint8_t value) { }
+int digitalRead(uint8_t pin) { return LOW; }
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    readStdin = true;
+}
+
+void HardwareSerial::PollStdin()
+{
+    if (!readStdin)
+        return;
+
+    struct pollfd descriptor = { STDIN_FILENO, POLLIN, 0 };
+    while (poll(&descriptor, 1, 0) > 0 && (descriptor.revents & POLLIN) && (inputTail + 1) % sizeof(input) != inputHead)
+    {
+        char c;
+        if (::read(STDIN_FILENO, &c, 1) != 1)
+        {
+            readStdin = false;
+            return;
+        }
+        input[inputTail] = c;
+        inputTail = (inputTail + 1) % sizeof(input);
+    }
+}
+
+int HardwareSerial::available()
+{
+    PollStdin();
+    return (int)((inputTail + sizeof(input) - inputHead) % sizeof(input));
+}
+
+int HardwareSerial::read()
+{
+    if (available() == 0)
+        return -1;
+    char c = input[inputHead];
+    inputHead = (inputHead + 1) % sizeof(input);
+    return (uint8_t)c;
+}
+
+int HardwareSerial::peek()
+{
+    return available() == 0 ? -1 : (uint8_t)input[inputHead];
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+    if (echo)
+        fwrite(buffer, 1, size, stdout);
+    return size;
+}
+
+void HardwareSerial::Inject(const char* text)
+{
+    for (; *text != '\0' && (inputTail + 1) % sizeof(input) != inputHead; text++)
+    {
+        input[inputTail] = *text;
+        inputTail = (inputTail + 1) % sizeof(input);
+    }
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    size_t used = allocationStats.liveBytes;
+    return used >= NATIVE_HEAP_SIZE ? 0 : (uint32_t)(NATIVE_HEAP_SIZE - used);
+}
+
+uint32_t EspClass::getMaxFreeBlockSize()
+{
+    return getFreeHeap();
+}
+
+void EspClass::restart()
+{
+    restartRequested = true;
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size)
+{
+    if (offset * 4 + size > NATIVE_RTC_USER_MEMORY_SIZE)
+        return false;
+    memcpy(data, (uint8_t*)rtcUserMemory + offset * 4, size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size)
+{
+    if (offset * 4 + size > NATIVE_RTC_USER_MEMORY_SIZE)
+        return false;
+    memcpy((uint8_t*)rtcUserMemory + offset * 4, data, size);
+    return true;
+}
+
+// Allocation accounting. The wraps only see calls made from our own objects, so the global
+// operator new/delete are replaced to route C++ allocations through them as well.
+extern "C"
+{
+    void* __real_malloc(size_t size);
+    void* __real_calloc(size_t count, size_t size);
+    void* __real_realloc(void* pointer, size_t size);
+    void __real_free(void* pointer);
+
+    static void CountAllocation(void* pointer)
+    {
+        if (pointer == nullptr)
+            return;
+        allocationStats.allocations++;
+        allocationStats.liveBytes += malloc_usable_size(pointer);
+        allocationStats.peakBytes = max(allocationStats.peakBytes, allocationStats.liveBytes);
+    }
+
+    static void CountFree(void* pointer)
+    {
+        if (pointer == nullptr)
+            return;
+        allocationStats.frees++;
+        allocationStats.liveBytes -= min(allocationStats.liveBytes, malloc_usable_size(pointer));
+    }
+
+    void* __wrap_malloc(size_t size)
+    {
+        void* pointer = __real_malloc(size);
+        CountAllocation(pointer);
+        return pointer;
+    }
+
+    void* __wrap_calloc(size_t count, size_t size)
+    {
+        void* pointer = __real_calloc(count, size);
+        CountAllocation(pointer);
+        return pointer;
+    }
+
+    void* __wrap_realloc(void* pointer, size_t size)
+    {
+        CountFree(pointer);
+        void* result = __real_realloc(pointer, size);
+        CountAllocation(result);
+        return result;
+    }
+
+    void __wrap_free(void* pointer)
+    {
+        CountFree(pointer);
+        __real_free(pointer);
+    }
+}
+
+void* operator new(size_t size)
+{
+    void* pointer = malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr)
+        abort();
+    return pointer;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return malloc(size == 0 ? 1 : size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return malloc(size == 0 ? 1 : size); }
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
@@ -0,0 +1,305 @@
+#ifndef NATIVE_HAL_HPP
+#define NATIVE_HAL_HPP
+
+#include <Arduino.h>
+#include <functional>
+
+#define NATIVE_HTTP_URL_SIZE 128
+#define NATIVE_HTTP_HEADER_SIZE 256
+#define NATIVE_HTTP_BODY_SIZE 8192
+
+#define NATIVE_WS_FRAME_SIZE 512
+#define NATIVE_WS_IN_FLIGHT 4096
+#define NATIVE_WS_RECEIVE_WINDOW 5840
+#define NATIVE_WS_HELLO_SIZE 96
+#define NATIVE_WS_MAX_CLIENTS 4096
+#define NATIVE_WS_COMMAND_SIZE 160
+#define NATIVE_MAX_FAULTS 32
+#define NATIVE_MAX_REMOTE_COMMANDS 32
+#define NATIVE_LATENCY_EXACT_MS 1000
+#define NATIVE_LATENCY_BUCKETS 7000
+#define NATIVE_TLS_PORT 8443
+#define NATIVE_TLS_FINGERPRINT_SIZE 20
+#define NATIVE_TLS_FULL_HANDSHAKE_MS 1600      // RSA-2048 key exchange at 80 MHz
+#define NATIVE_TLS_RESUMED_HANDSHAKE_MS 60
+#define NATIVE_TLS_PROBE_MS 120                 // One ClientHello round trip
+#define NATIVE_TLS_ENGINE_SIZE 6144             // BearSSL context, X.509 state and its second stack
+#define NATIVE_TLS_MAX_RECORD 16384
+
+class WebSocketsClient;
+
+namespace NativeHAL
+{
+    // Clock: real time by default. A manual clock only moves through AdvanceMillis() (and delay()).
+    void UseManualClock(bool manual);
+    bool IsManualClock();
+    void AdvanceMillis(unsigned long ms);
+
+    // Counted through -Wl,--wrap=malloc/calloc/realloc/free plus the global operator new/delete
+    struct AllocationStats
+    {
+        unsigned long allocations;
+        unsigned long frees;
+        size_t liveBytes;
+        size_t peakBytes;
+    };
+
+    AllocationStats GetAllocationStats();
+    void ResetAllocationStats();
+
+    struct HTTPRequest
+    {
+        const char* method;
+        const char* url;
+        const char* headers;
+        const uint8_t* body;
+        size_t bodyLength;
+    };
+
+    struct HTTPResponse
+    {
+        uint8_t body[NATIVE_HTTP_BODY_SIZE];
+        size_t length = 0;
+        long contentLength = -1;     // What the headers promise; set it above length to drop the connection early
+
+        void Set(const char* text)
+        {
+            length = min(strlen(text), sizeof(body));
+            memcpy(body, text, length);
+        }
+    };
+
+    // Answers HTTPClient requests in-process. Returns an HTTP status, or a negative HTTPC_ERROR_* code.
+    class HTTPServerStandIn
+    {
+    public:
+        typedef std::function<int(const HTTPRequest& request, HTTPResponse& response)> Handler;
+
+        Handler handler;
+        unsigned long requestCount = 0;
+
+        int Handle(const HTTPRequest& request, HTTPResponse& response)
+        {
+            requestCount++;
+            if (!handler)
+                return -1;
+            return handler(request, response);
+        }
+    };
+
+    struct Fault
+    {
+        enum Type { Disconnect, Restart, SlowReads };
+
+        Type type;
+        unsigned long at;
+        unsigned long duration;     // Restart: downtime. SlowReads: how long reads stay slow.
+        unsigned long readDelay;    // SlowReads only
+        bool started;
+        bool finished;
+    };
+
+    // A command line the server sends every connected client at a given time, with its index + 1
+    // as the id
+    struct RemoteCommandSchedule
+    {
+        unsigned long at;
+        char line[NATIVE_WS_COMMAND_SIZE];
+        bool isSent;
+        unsigned long sentAt;
+    };
+
+    // Acquisition-to-delivery latency with 1 ms resolution below NATIVE_LATENCY_EXACT_MS and 10 ms
+    // above it. Fixed buckets, so recording never allocates and doesn't show up in the heap numbers.
+    class LatencyHistogram
+    {
+    private:
+        unsigned long buckets[NATIVE_LATENCY_BUCKETS] = { };
+        unsigned long count = 0;
+        unsigned long maximum = 0;
+
+        static unsigned long BucketOf(unsigned long ms);
+        static unsigned long LowerBoundOf(unsigned long bucket);
+
+    public:
+        void Add(unsigned long ms);
+        unsigned long Percentile(float percent) const;
+        unsigned long GetCount() const { return count; }
+        unsigned long GetMax() const { return maximum; }
+    };
+
+    // Frames written by a client sit in flight for readDelay ms before the server reads them. Once
+    // a client has more than receiveWindow bytes in flight, its sends fail the way they do on a
+    // full TCP window. Frames still in flight when the connection drops are lost.
+    class WebSocketServerStandIn
+    {
+    public:
+        typedef std::function<void(WebSocketsClient& client, const uint8_t* payload, size_t length, bool isBinary)> FrameHandler;
+
+    private:
+        struct InFlightFrame
+        {
+            WebSocketsClient* client;
+            unsigned long deliverAt;
+            size_t length;
+            bool isBinary;
+            uint8_t payload[NATIVE_WS_FRAME_SIZE];
+        };
+
+        InFlightFrame inFlight[NATIVE_WS_IN_FLIGHT];
+        unsigned int inFlightHead = 0;
+        unsigned int inFlightCount = 0;
+
+        Fault faults[NATIVE_MAX_FAULTS];
+        unsigned int faultCount = 0;
+        WebSocketsClient* clients[NATIVE_WS_MAX_CLIENTS];
+        unsigned int clientCount = 0;
+        RemoteCommandSchedule commands[NATIVE_MAX_REMOTE_COMMANDS];
+        unsigned int commandCount = 0;
+        unsigned long restartAt = 0;
+        bool isRestarting = false;
+        bool isDelivering = false;
+
+        void Deliver(InFlightFrame& frame);
+        void ApplyFaults();
+        void SendCommands();
+        void CountResult(const char* payload);
+
+    public:
+        bool isUp = true;
+        unsigned long readDelay = 0;
+        size_t receiveWindow = NATIVE_WS_RECEIVE_WINDOW;
+        unsigned long connectionEpoch = 0;     // Bumped whenever the server drops every connection
+        FrameHandler onFrame;
+        char helloReply[NATIVE_WS_HELLO_SIZE] = "";     // Empty plays an old server that ignores the hello
+
+        unsigned long connections = 0;
+        unsigned long disconnections = 0;
+        unsigned long framesOffered = 0;        // sendTXT/sendBIN calls, connected or not
+        unsigned long framesRefused = 0;        // Not connected, or the receive window was full
+        unsigned long framesDropped = 0;        // In flight when the connection went away
+        unsigned long framesReceived = 0;
+        unsigned long bytesSent = 0;            // Everything the window accepted, delivered or not
+        unsigned long bytesReceived = 0;
+        unsigned long pingsReceived = 0;
+        unsigned long hellosReceived = 0;
+        unsigned long commandsSent = 0;         // One per client the command went out to
+        unsigned long commandsUndelivered = 0;  // Connected clients whose inbox was full
+        unsigned long resultsOk = 0;
+        unsigned long resultsFailed = 0;
+        LatencyHistogram latency;
+        LatencyHistogram commandLatency;        // From the broadcast to the result being read
+
+        // Called by WebSocketsClient for every frame it sends
+        bool Accept(WebSocketsClient& client, const uint8_t* payload, size_t length, bool isBinary);
+
+        // Reads the frames that are due and applies scheduled faults; clients call it from loop()
+        void Update();
+
+        void DropConnections();
+        void Restart(unsigned long downtime);
+
+        // Clients connected to the server, for Broadcast()
+        void Register(WebSocketsClient& client);
+        void Unregister(WebSocketsClient& client);
+
+        // Sends text to every connected client; returns how many took it
+        unsigned int Broadcast(const char* text);
+
+        // Broadcasts {"type":"command","id":..,"line":..} once the clock reaches at. line isn't
+        // escaped, so it can't contain quotes.
+        bool ScheduleCommand(unsigned long at, const char* line);
+
+        // "disconnect@<ms>", "restart@<ms>+<downtime>" or "slow@<ms>+<duration>:<read delay>"
+        bool ScheduleFault(const char* spec);
+
+        // "<encoding>:<interval>:<batch>", sent back as the reply to every hello. Not checked, so
+        // the probe's own validation can be tried too.
+        bool SetHelloReply(const char* spec);
+
+        void PrintReport();
+    };
+
+    // A TLS terminator in front of the plant server. While it's enabled the server only takes TLS,
+    // on port, and plain connections are refused. Handshakes cost the probe time through delay(),
+    // less when it resumes a session the server still remembers, and the client's buffers count
+    // against the heap for as long as it's connected.
+    class TLSServerStandIn
+    {
+    public:
+        bool isEnabled = false;
+        char host[16] = "";
+        uint16_t port = NATIVE_TLS_PORT;
+        uint8_t fingerprint[NATIVE_TLS_FINGERPRINT_SIZE];
+        bool supportsFragmentLength = true;     // Max fragment length negotiation (RFC 6066)
+        bool supportsResumption = true;
+        unsigned long sessionEpoch = 1;         // Bumped when a restart empties the session cache
+
+        unsigned long fullHandshakes = 0;
+        unsigned long resumedHandshakes = 0;
+        unsigned long handshakeTime = 0;
+        unsigned long fragmentProbes = 0;
+        unsigned long refused = 0;              // Wrong host or port, or plain while TLS is on
+        unsigned long pinFailures = 0;
+        unsigned long recordOverflows = 0;      // Small buffers against a server without max fragment length
+
+        TLSServerStandIn();
+
+        bool Accepts(const char* host, uint16_t port);
+
+        // Blocks for as long as the handshake takes and returns false if the client would abort it.
+        // session is the epoch the client's cached session came from (0 for none, nullptr without a
+        // session object); it resumes if that's still current and is updated on success.
+        bool Handshake(const uint8_t* pinnedFingerprint, size_t receiveBufferSize, unsigned long* session);
+
+        void PrintReport();
+    };
+
+    extern HTTPServerStandIn httpServer;
+    extern WebSocketServerStandIn webSocketServer;
+    extern TLSServerStandIn tlsServer;
+
+    // Serves discovery and UUID requests for one plant-server at serverIP
+    void UseDefaultServer(const char* serverIP);
+
+    // Lets the default server hand out firmware: manifests at /api/firmware/latest/ (this version)
+    // and /api/firmware/<any version>/, images at /api/firmware/<version>/image/ with Range support.
+    // Images are generated from the version string and start with the gzip magic. With failEvery
+    // set, every failEvery-th image response is cut short, to exercise resuming.
+    void UseFirmwareImage(const char* latestVersion, size_t size, unsigned int failEvery = 0);
+
+    bool IsRestartRequested();
+
+    // Sensor values the DHTesp and PCF8591 fakes return instead of their synthetic drift. A trace
+    // is a CSV file of "ms,temperature,humidity,soil_moisture,light_level" rows (percent for the
+    // last three), read forward as the clock passes each row. An empty or "nan" temperature makes
+    // the DHT read time out. "synthetic:bursty" and "synthetic:noisy" generate a trace instead.
+    struct TraceSample
+    {
+        float temperature;
+        float humidity;
+        float soilMoisture;
+        float lightLevel;
+    };
+
+    bool UseTrace(const char* source);
+    bool GetTraceSample(TraceSample& sample);
+
+    // Runs setup() once and loop() until --duration elapses (forever without it).
+    //   --duration <ms>   stop after this much (simulated) time
+    //   --step <ms>       use a manual clock that advances this much per loop pass
+    //   --exec "<line>"   queue a serial command line (repeatable)
+    //   --exec-at <ms> "<line>"  type a serial command line once the clock reaches <ms> (repeatable)
+    //   --trace <source>  replay sensor values from a CSV file or a synthetic:<pattern>
+    //   --fault <spec>    schedule a WebSocket server fault, see ScheduleFault() (repeatable)
+    //   --firmware <version>:<size>[:<fail every>]  serve OTA images, see UseFirmwareImage()
+    //   --tls             make the server TLS only, see TLSServerStandIn; --tls-no-mfln and
+    //                     --tls-no-resume take those features away from it
+    //   --hello <encoding>:<interval>:<batch>  answer the probe's hello, see SetHelloReply()
+    //   --command-at <ms> "<line>"  send a command line over the WebSocket, see ScheduleCommand()
+    //   --report          print delivery latency, loss and bytes on the wire at exit
+    //   --alloc-audit <ms>  count loop passes that allocate after <ms>; any makes the exit code 1
+    int Run(int argc, char** argv, void (*setup)(), void (*loop)());
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef NATIVE_HAL_PCF8591_H
+#define NATIVE_HAL_PCF8591_H
+
+#include <Arduino.h>
+#include <NativeHAL.hpp>
+
+#define CHANNELS_4 0
+#define SINGLE_ENDED_INPUT 0
+
+// Each read is one I2C transaction on the real chip; GetReadCount() tells how many we would have done
+class PCF8591
+{
+public:
+    struct AnalogInput
+    {
+        uint8_t ain0;
+        uint8_t ain1;
+        uint8_t ain2;
+        uint8_t ain3;
+    };
+
+private:
+    // Sensors read inverted: 0 is full scale
+    static uint8_t PercentToInput(float percent) { return (uint8_t)(255 - constrain(lroundf(percent * 2.55f), 0L, 255L)); }
+
+    AnalogInput forcedInputs = { 0, 0, 0, 0 };
+    bool hasForcedInputs = false;
+    unsigned long readCount = 0;
+
+public:
+    PCF8591(uint8_t address) { }
+    PCF8591(uint8_t address, uint8_t sda, uint8_t scl) { }
+
+    void begin() { }
+
+    AnalogInput analogReadAll(uint8_t readType = CHANNELS_4)
+    {
+        readCount++;
+        if (hasForcedInputs)
+            return forcedInputs;
+
+        NativeHAL::TraceSample sample;
+        if (NativeHAL::GetTraceSample(sample))
+            return { PercentToInput(sample.lightLevel), PercentToInput(sample.soilMoisture), 0, 0 };
+
+        // Light follows a day/night cycle, soil slowly dries out and gets watered again
+        float day = (float)(millis() % 86400000UL) / 86400000.0f;
+        float light = 0.5f + 0.5f * sinf(day * 2.0f * (float)M_PI);
+        float soil = 0.3f + 0.4f * (1.0f - (float)(millis() % 3600000UL) / 3600000.0f);
+
+        AnalogInput inputs;
+        inputs.ain0 = (uint8_t)(255 - light * 255.0f);
+        inputs.ain1 = (uint8_t)(255 - soil * 255.0f);
+        inputs.ain2 = 0;
+        inputs.ain3 = 0;
+        return inputs;
+    }
+
+    uint8_t analogRead(uint8_t channel, uint8_t readType = SINGLE_ENDED_INPUT)
+    {
+        AnalogInput inputs = analogReadAll();
+        const uint8_t values[4] = { inputs.ain0, inputs.ain1, inputs.ain2, inputs.ain3 };
+        return values[channel & 3];
+    }
+
+    void SetInputs(uint8_t ain0, uint8_t ain1)
+    {
+        forcedInputs = { ain0, ain1, 0, 0 };
+        hasForcedInputs = true;
+    }
+
+    void ClearInputs() { hasForcedInputs = false; }
+    unsigned long GetReadCount() { return readCount; }
+};
+
+#endif
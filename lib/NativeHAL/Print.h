@@ -0,0 +1,6 @@
+#ifndef NATIVE_HAL_PRINT_H
+#define NATIVE_HAL_PRINT_H
+
+#include <Arduino.h>
+
+#endif
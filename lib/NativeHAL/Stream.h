@@ -0,0 +1,6 @@
+#ifndef NATIVE_HAL_STREAM_H
+#define NATIVE_HAL_STREAM_H
+
+#include <Arduino.h>
+
+#endif
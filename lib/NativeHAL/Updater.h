@@ -0,0 +1,89 @@
+#ifndef NATIVE_HAL_UPDATER_H
+#define NATIVE_HAL_UPDATER_H
+
+#include <Arduino.h>
+
+#define U_FLASH 0
+#define U_FS 100
+
+#define UPDATE_ERROR_OK 0
+#define UPDATE_ERROR_WRITE 1
+#define UPDATE_ERROR_SPACE 4
+#define UPDATE_ERROR_SIZE 5
+#define UPDATE_ERROR_STREAM 6
+
+// Counts what would be written to the staging area. Like the real one, end() only schedules the
+// copy (IsCommitted) once every promised byte arrived; otherwise it throws the update away.
+class UpdaterClass
+{
+private:
+    size_t expectedSize = 0;
+    size_t written = 0;
+    bool running = false;
+    bool isCommitted = false;
+    uint8_t error = UPDATE_ERROR_OK;
+    unsigned long commitCount = 0;
+
+public:
+    bool begin(size_t size, int command = U_FLASH)
+    {
+        if (running || size == 0)
+        {
+            error = UPDATE_ERROR_SIZE;
+            return false;
+        }
+        if (size > ESP.getFreeSketchSpace())
+        {
+            error = UPDATE_ERROR_SPACE;
+            return false;
+        }
+
+        expectedSize = size;
+        written = 0;
+        running = true;
+        isCommitted = false;
+        error = UPDATE_ERROR_OK;
+        return true;
+    }
+
+    size_t write(uint8_t* data, size_t length)
+    {
+        if (!running || written + length > expectedSize)
+        {
+            error = UPDATE_ERROR_WRITE;
+            return 0;
+        }
+        written += length;
+        return length;
+    }
+
+    bool end(bool evenIfRemaining = false)
+    {
+        if (!running)
+            return false;
+
+        running = false;
+        if (error != UPDATE_ERROR_OK || (written < expectedSize && !evenIfRemaining))
+            return false;
+
+        isCommitted = true;
+        commitCount++;
+        return true;
+    }
+
+    bool hasError() { return error != UPDATE_ERROR_OK; }
+    uint8_t getError() { return error; }
+    void clearError() { error = UPDATE_ERROR_OK; }
+    bool isRunning() { return running; }
+    bool isFinished() { return written == expectedSize; }
+    size_t size() { return expectedSize; }
+    size_t progress() { return written; }
+    size_t remaining() { return expectedSize - written; }
+
+    bool IsCommitted() { return isCommitted; }
+    unsigned long GetCommitCount() { return commitCount; }
+};
+
+extern UpdaterClass Update;
+
+#endif
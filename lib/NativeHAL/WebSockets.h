@@ -0,0 +1,33 @@
+#ifndef NATIVE_HAL_WEBSOCKETS_H
+#define NATIVE_HAL_WEBSOCKETS_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+
+#define WEBSOCKETS_MAX_HEADER_SIZE (14)
+
+typedef enum
+{
+    WStype_ERROR,
+    WStype_DISCONNECTED,
+    WStype_CONNECTED,
+    WStype_TEXT,
+    WStype_BIN,
+    WStype_FRAGMENT_TEXT_START,
+    WStype_FRAGMENT_BIN_START,
+    WStype_FRAGMENT,
+    WStype_FRAGMENT_FIN,
+    WStype_PING,
+    WStype_PONG,
+} WStype_t;
+
+// The part of the library's per-connection state a subclass gets at
+typedef struct
+{
+    bool isSSL;
+    WiFiClient* tcp;
+    WiFiClientSecure* ssl;
+} WSclient_t;
+
+#endif
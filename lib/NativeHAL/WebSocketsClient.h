@@ -0,0 +1,331 @@
+#ifndef NATIVE_HAL_WEBSOCKETSCLIENT_H
+#define NATIVE_HAL_WEBSOCKETSCLIENT_H
+
+#include <Arduino.h>
+#include <WebSockets.h>
+#include <NativeHAL.hpp>
+#include <functional>
+
+#define NATIVE_WS_INBOX_SIZE 8
+#define NATIVE_WS_MESSAGE_SIZE 512
+
+// Talks to NativeHAL::webSocketServer instead of a socket. Connection attempts, incoming
+// messages and pongs are all handled from loop(), the same place the real library does them.
+// beginSSL() goes through NativeHAL::tlsServer the way the library does: a new client with default
+// buffers and no session on every connect, unless a subclass connected one of its own first.
+class WebSocketsClient
+{
+public:
+    typedef std::function<void(WStype_t type, uint8_t* payload, size_t length)> WebSocketClientEvent;
+
+private:
+    // Plain connections; it has as much room for writes as the server's receive window has left
+    // for this client
+    class Socket : public WiFiClient
+    {
+    private:
+        WebSocketsClient& owner;
+
+    public:
+        Socket(WebSocketsClient& owner) : owner(owner) { }
+
+        int connect(const char* host, uint16_t port) override
+        {
+            return NativeHAL::webSocketServer.isUp ? WiFiClient::connect(host, port) : 0;
+        }
+
+        int availableForWrite() override
+        {
+            size_t window = NativeHAL::webSocketServer.receiveWindow;
+            return owner.connected && owner.bytesInFlight < window ? window - owner.bytesInFlight : 0;
+        }
+    };
+
+    struct Host
+    {
+        char text[64] = "";
+        const char* c_str() const { return text; }
+    };
+
+    WebSocketClientEvent onEventHandler;
+
+    char url[128] = "";
+    bool isBegin = false;
+    uint8_t fingerprint[NATIVE_TLS_FINGERPRINT_SIZE];
+    Socket socket { *this };
+
+    bool connected = false;
+    unsigned long connectionEpoch = 0;
+    size_t bytesInFlight = 0;
+
+    uint32_t pingInterval = 0;
+    unsigned long lastPingTime = 0;
+    bool pongPending = false;
+    unsigned long pongAt = 0;
+
+    struct Message
+    {
+        WStype_t type;
+        size_t length;
+        uint8_t payload[NATIVE_WS_MESSAGE_SIZE];
+    };
+
+    Message inbox[NATIVE_WS_INBOX_SIZE];
+    unsigned int inboxHead = 0;
+    unsigned int inboxCount = 0;
+
+    void Emit(WStype_t type, uint8_t* payload, size_t length)
+    {
+        if (onEventHandler)
+            onEventHandler(type, payload, length);
+    }
+
+    void SetDisconnected()
+    {
+        if (!connected)
+            return;
+        connected = false;
+        pongPending = false;
+        NativeHAL::webSocketServer.Unregister(*this);
+        NativeHAL::webSocketServer.disconnections++;
+        Emit(WStype_DISCONNECTED, nullptr, 0);
+    }
+
+protected:
+    // The library's state, as far as a subclass sees it
+    Host _host;
+    uint16_t _port = 0;
+    const uint8_t* _fingerprint = nullptr;
+    WSclient_t _client = { false, nullptr, nullptr };
+    unsigned long _lastConnectionFail = 0;
+    unsigned long _reconnectInterval = 500;
+
+    // The upgrade request; the server refusing it ends the connection the way a failed connect does
+    void connectedCb()
+    {
+        NativeHAL::WebSocketServerStandIn& server = NativeHAL::webSocketServer;
+        if (!server.isUp)
+        {
+            clientDisconnect(&_client);
+            _lastConnectionFail = millis();
+            return;
+        }
+
+        connected = true;
+        connectionEpoch = server.connectionEpoch;
+        bytesInFlight = 0;
+        inboxCount = 0;
+        server.connections++;
+        server.Register(*this);
+        Emit(WStype_CONNECTED, (uint8_t*)url, strlen(url));
+    }
+
+    void connectFailedCb() { }
+
+    // Deletes the TLS client it made; the plain socket is its own
+    virtual void clientDisconnect(WSclient_t* client)
+    {
+        if (client->isSSL && client->ssl != nullptr)
+        {
+            client->ssl->stop();
+            delete client->ssl;
+            client->ssl = nullptr;
+            client->tcp = nullptr;
+        }
+        if (client->tcp != nullptr)
+        {
+            client->tcp->stop();
+            client->tcp = nullptr;
+        }
+        SetDisconnected();
+    }
+
+    virtual bool clientIsConnected(WSclient_t* client)
+    {
+        if (connected)
+            return true;
+        if (client->tcp != nullptr)
+            clientDisconnect(client);
+        return false;
+    }
+
+private:
+    bool SendFrame(const uint8_t* payload, size_t length, bool isBinary)
+    {
+        NativeHAL::WebSocketServerStandIn& server = NativeHAL::webSocketServer;
+        server.framesOffered++;
+
+        if (!connected)
+        {
+            server.framesRefused++;
+            return false;
+        }
+
+        return server.Accept(*this, payload, length, isBinary);
+    }
+
+public:
+    void begin(const char* host, uint16_t port, const char* url = "/", const char* protocol = "arduino")
+    {
+        strncpy(_host.text, host, sizeof(_host.text) - 1);
+        strncpy(this->url, url, sizeof(this->url) - 1);
+        _port = port;
+        _fingerprint = nullptr;
+        _client.isSSL = false;
+        isBegin = true;
+    }
+
+    void beginSSL(const char* host, uint16_t port, const char* url = "/", const uint8_t* fingerprint = nullptr, const char* protocol = "arduino")
+    {
+        begin(host, port, url, protocol);
+        _client.isSSL = true;
+        if (fingerprint != nullptr)
+        {
+            memcpy(this->fingerprint, fingerprint, sizeof(this->fingerprint));
+            _fingerprint = this->fingerprint;
+        }
+    }
+
+    virtual ~WebSocketsClient()
+    {
+        onEventHandler = nullptr;
+        clientDisconnect(&_client);
+        NativeHAL::webSocketServer.Unregister(*this);
+    }
+
+    void loop()
+    {
+        NativeHAL::WebSocketServerStandIn& server = NativeHAL::webSocketServer;
+
+        server.Update();
+
+        if (!isBegin)
+            return;
+
+        if (connected && (!server.isUp || connectionEpoch != server.connectionEpoch))
+            clientDisconnect(&_client);
+
+        if (!clientIsConnected(&_client))
+        {
+            if (millis() - _lastConnectionFail < _reconnectInterval)
+                return;
+
+            if (_client.isSSL)
+            {
+                _client.ssl = new WiFiClientSecure();
+                _client.tcp = _client.ssl;
+                if (_fingerprint != nullptr)
+                    _client.ssl->setFingerprint(_fingerprint);
+                else
+                    _client.ssl->setInsecure();
+            }
+            else
+                _client.tcp = &socket;
+
+            if (_client.tcp->connect(_host.c_str(), _port))
+            {
+                _lastConnectionFail = 0;
+                connectedCb();
+            }
+            else
+            {
+                connectFailedCb();
+                clientDisconnect(&_client);
+                _lastConnectionFail = millis();
+            }
+
+            if (!connected)
+                return;
+        }
+
+        if (pingInterval > 0 && millis() - lastPingTime >= pingInterval)
+            sendPing();
+
+        // The pong waits behind whatever the server hasn't read yet
+        if (pongPending && (long)(millis() - pongAt) >= 0)
+        {
+            pongPending = false;
+            Emit(WStype_PONG, nullptr, 0);
+        }
+
+        while (inboxCount > 0 && connected)
+        {
+            Message& message = inbox[inboxHead];
+            inboxHead = (inboxHead + 1) % NATIVE_WS_INBOX_SIZE;
+            inboxCount--;
+            message.payload[min(message.length, (size_t)NATIVE_WS_MESSAGE_SIZE - 1)] = '\0';
+            Emit(message.type, message.payload, message.length);
+        }
+    }
+
+    void disconnect()
+    {
+        clientDisconnect(&_client);
+        isBegin = false;
+    }
+
+    bool isConnected() { return connected; }
+
+    void onEvent(WebSocketClientEvent handler) { onEventHandler = handler; }
+    void setReconnectInterval(unsigned long interval) { _reconnectInterval = interval; }
+
+    void enableHeartbeat(uint32_t pingInterval, uint32_t pongTimeout, uint8_t disconnectTimeoutCount)
+    {
+        this->pingInterval = pingInterval;
+    }
+
+    void disableHeartbeat() { pingInterval = 0; }
+
+    bool sendTXT(uint8_t* payload, size_t length = 0, bool headerToPayload = false)
+    {
+        if (length == 0)
+            length = strlen((const char*)payload + (headerToPayload ? WEBSOCKETS_MAX_HEADER_SIZE : 0));
+        return SendFrame(payload + (headerToPayload ? WEBSOCKETS_MAX_HEADER_SIZE : 0), length, false);
+    }
+
+    bool sendTXT(const uint8_t* payload, size_t length = 0) { return sendTXT((uint8_t*)payload, length, false); }
+    bool sendTXT(char* payload, size_t length = 0, bool headerToPayload = false) { return sendTXT((uint8_t*)payload, length, headerToPayload); }
+    bool sendTXT(const char* payload, size_t length = 0) { return sendTXT((uint8_t*)payload, length, false); }
+
+    bool sendBIN(uint8_t* payload, size_t length, bool headerToPayload = false)
+    {
+        return SendFrame(payload + (headerToPayload ? WEBSOCKETS_MAX_HEADER_SIZE : 0), length, true);
+    }
+
+    bool sendBIN(const uint8_t* payload, size_t length) { return sendBIN((uint8_t*)payload, length, false); }
+
+    bool sendPing(uint8_t* payload = nullptr, size_t length = 0)
+    {
+        if (!connected)
+            return false;
+        NativeHAL::webSocketServer.pingsReceived++;
+        lastPingTime = millis();
+        pongAt = millis() + NativeHAL::webSocketServer.readDelay;
+        pongPending = true;
+        return true;
+    }
+
+    // Server side: queue a message to be delivered on the next loop()
+    bool Deliver(WStype_t type, const uint8_t* payload, size_t length)
+    {
+        if (!connected || inboxCount == NATIVE_WS_INBOX_SIZE || length >= NATIVE_WS_MESSAGE_SIZE)
+            return false;
+
+        Message& message = inbox[(inboxHead + inboxCount) % NATIVE_WS_INBOX_SIZE];
+        message.type = type;
+        message.length = length;
+        memcpy(message.payload, payload, length);
+        inboxCount++;
+        return true;
+    }
+
+    bool DeliverText(const char* text) { return Deliver(WStype_TEXT, (const uint8_t*)text, strlen(text)); }
+
+    // Server side: bytes this client has written that the server hasn't read yet
+    size_t& BytesInFlight() { return bytesInFlight; }
+
+    const char* GetURL() { return url; }
+    const char* GetHost() { return _host.c_str(); }
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef NATIVE_HAL_WIFICLIENT_H
+#define NATIVE_HAL_WIFICLIENT_H
+
+#include <Arduino.h>
+#include <NativeHAL.hpp>
+
+#define NATIVE_CLIENT_BUFFER_SIZE 8192
+
+// Plays back whatever the stand-in server put in its receive buffer
+class WiFiClient : public Stream
+{
+private:
+    uint8_t buffer[NATIVE_CLIENT_BUFFER_SIZE];
+    size_t length = 0;
+    size_t position = 0;
+    bool isConnected = false;
+
+public:
+    virtual ~WiFiClient() { }
+
+    int available() override { return (int)(length - position); }
+    int read() override { return position < length ? buffer[position++] : -1; }
+    int peek() override { return position < length ? buffer[position] : -1; }
+
+    int read(uint8_t* data, size_t size)
+    {
+        size_t count = min(size, length - position);
+        memcpy(data, buffer + position, count);
+        position += count;
+        return (int)count;
+    }
+
+    size_t write(uint8_t) override { return isConnected ? 1 : 0; }
+    size_t write(const uint8_t*, size_t size) override { return isConnected ? size : 0; }
+    using Print::write;
+    int availableForWrite() override { return isConnected ? 1460 : 0; }
+
+    // A server behind NativeHAL::tlsServer doesn't take plain connections
+    virtual int connect(const char* host, uint16_t port)
+    {
+        isConnected = !NativeHAL::tlsServer.isEnabled;
+        if (!isConnected)
+            NativeHAL::tlsServer.refused++;
+        return isConnected ? 1 : 0;
+    }
+
+    uint8_t connected() { return isConnected || available() > 0; }
+    virtual void stop() { isConnected = false; length = position = 0; }
+    void setNoDelay(bool) { }
+
+    void SetReceived(const uint8_t* data, size_t size)
+    {
+        length = min(size, sizeof(buffer));
+        memcpy(buffer, data, length);
+        position = 0;
+    }
+
+    void SetConnected(bool connected) { isConnected = connected; }
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef NATIVE_HAL_WIFICLIENTSECURE_H
+#define NATIVE_HAL_WIFICLIENTSECURE_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <NativeHAL.hpp>
+
+#define NATIVE_TLS_DEFAULT_RECEIVE_BUFFER (NATIVE_TLS_MAX_RECORD + 325)
+#define NATIVE_TLS_DEFAULT_SEND_BUFFER 837
+
+namespace BearSSL
+{
+    // Stands for the cached session parameters; the epoch is all NativeHAL::tlsServer checks
+    class Session
+    {
+    private:
+        friend class WiFiClientSecure;
+        unsigned long epoch = 0;
+    };
+
+    // Handshakes with NativeHAL::tlsServer. The buffers and engine state are allocated for as long
+    // as the connection is up, so they show in getFreeHeap() the way they do on the chip.
+    class WiFiClientSecure : public WiFiClient
+    {
+    private:
+        uint8_t fingerprint[NATIVE_TLS_FINGERPRINT_SIZE];
+        bool isPinned = false;
+        Session* session = nullptr;
+        size_t receiveBufferSize = NATIVE_TLS_DEFAULT_RECEIVE_BUFFER;
+        size_t sendBufferSize = NATIVE_TLS_DEFAULT_SEND_BUFFER;
+        void* engine = nullptr;
+
+    public:
+        ~WiFiClientSecure() override { free(engine); }
+
+        int connect(const char* host, uint16_t port) override
+        {
+            stop();
+
+            NativeHAL::TLSServerStandIn& server = NativeHAL::tlsServer;
+            if (!server.Accepts(host, port))
+                return 0;
+
+            engine = malloc(receiveBufferSize + sendBufferSize + NATIVE_TLS_ENGINE_SIZE);
+            if (!server.Handshake(isPinned ? fingerprint : nullptr, receiveBufferSize, session == nullptr ? nullptr : &session->epoch))
+            {
+                stop();
+                return 0;
+            }
+
+            SetConnected(true);
+            return 1;
+        }
+
+        void stop() override
+        {
+            free(engine);
+            engine = nullptr;
+            WiFiClient::stop();
+        }
+
+        void setFingerprint(const uint8_t newFingerprint[NATIVE_TLS_FINGERPRINT_SIZE])
+        {
+            memcpy(fingerprint, newFingerprint, sizeof(fingerprint));
+            isPinned = true;
+        }
+
+        void setInsecure() { isPinned = false; }
+        void setSession(Session* newSession) { session = newSession; }
+
+        void setBufferSizes(int receive, int send)
+        {
+            receiveBufferSize = receive;
+            sendBufferSize = send;
+        }
+
+        static bool probeMaxFragmentLength(const char* host, uint16_t port, uint16_t length)
+        {
+            NativeHAL::TLSServerStandIn& server = NativeHAL::tlsServer;
+            if (!server.Accepts(host, port))
+                return false;
+
+            server.fragmentProbes++;
+            delay(NATIVE_TLS_PROBE_MS);
+            server.handshakeTime += NATIVE_TLS_PROBE_MS;
+            return server.supportsFragmentLength;
+        }
+    };
+}
+
+using BearSSL::WiFiClientSecure;
+
+#endif
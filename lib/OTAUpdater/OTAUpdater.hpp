@@ -0,0 +1,520 @@
+#ifndef OTA_UPDATER_HPP
+#define OTA_UPDATER_HPP
+
+#include <Arduino.h>
+#include <ESP8266HTTPClient.h>
+#include <Updater.h>
+#include <ArduinoJson.h>
+#include <bearssl/bearssl_hash.h>
+
+#include <Logger.hpp>
+#include <Preferences.hpp>
+#include <Result.hpp>
+#include <SecureTransport.hpp>
+#include <Version.h>
+
+#define OTA_VERSION_SIZE 16
+#define OTA_PATH_SIZE 64
+#define OTA_URL_SIZE 96
+#define OTA_PORT 8000
+
+#define OTA_BUFFER_SIZE 512             // Flash staging is written through this buffer only
+#define OTA_CHUNK_SIZE 8192             // One Range request; a dropped connection costs at most this much
+#define OTA_MAX_RETRIES 10
+#define OTA_RETRY_INTERVAL 5000
+#define OTA_STALL_TIMEOUT 10000
+#define OTA_RESTART_DELAY 1000
+
+#define OTA_MAX_BOOT_ATTEMPTS 3
+#define OTA_CONFIRM_TIMEOUT 300000      // From when the server was first reachable
+#define OTA_ROLLBACK_MAX_INTERVAL 300000    // Each try blocks for up to API_TIMEOUT when the server is down
+#define OTA_BOOT_RECORD_MAGIC 0x4F544131    // "OTA1"
+#define OTA_BOOT_RECORD_OFFSET 0            // In 4 byte blocks of RTC user memory
+
+enum class OTAError : uint8_t
+{
+    Busy,
+    NoServerIP,
+    ManifestFailed,
+    InvalidManifest,
+    AlreadyInstalled,
+    NoSpace,
+    DownloadFailed,
+    WriteFailed,
+    HashMismatch,
+    FinalizeFailed
+};
+
+enum class OTAState : uint8_t
+{
+    Idle,
+    Downloading,
+    WaitingToRetry,
+    Restarting
+};
+
+struct FirmwareManifest
+{
+    char version[OTA_VERSION_SIZE];
+    char path[OTA_PATH_SIZE];
+    uint32_t size;
+    uint8_t sha256[br_sha256_SIZE];
+};
+
+// Lives in RTC memory, which survives the resets a crashing image causes. After a power cut it's
+// gone, and whatever image is running is trusted.
+struct OTABootRecord
+{
+    uint32_t magic;
+    char knownGoodVersion[OTA_VERSION_SIZE];
+    char pendingVersion[OTA_VERSION_SIZE];
+    uint8_t bootAttempts;
+    bool isPending;
+    uint8_t reserved[2];
+};
+
+// Pulls gzip images from the plant server into the staging area; eboot inflates them while copying
+// over the running sketch. The last buffer is held back until the SHA-256 checks out, so end() can
+// never schedule a bad image. A new image has to get through to the server within OTA_CONFIRM_TIMEOUT
+// of it being reachable and within OTA_MAX_BOOT_ATTEMPTS boots, or the last known-good version is
+// downloaded again.
+class OTAUpdater
+{
+private:
+    PreferencesManager& preferences;
+    SecureTransport& transport;
+    HTTPClient httpClient;
+
+    uint16_t port = OTA_PORT;
+    OTAState state = OTAState::Idle;
+    FirmwareManifest manifest;
+    br_sha256_context hash;
+
+    uint8_t buffer[OTA_BUFFER_SIZE];
+    size_t buffered = 0;
+    uint32_t received = 0;
+    uint32_t chunkRemaining = 0;
+    bool isRequestOpen = false;
+    uint8_t retries = 0;
+    uint8_t loggedTenths = 0;
+    unsigned long lastActivityTime = 0;
+
+    OTABootRecord bootRecord;
+    bool isBootConfirmed = true;
+    bool needsRollback = false;
+    unsigned long lastRollbackAttempt = 0;
+    unsigned long rollbackInterval = OTA_RETRY_INTERVAL;
+    bool hasAttemptedRollback = false;
+    bool isServerReachable = false;
+    unsigned long serverReachableTime = 0;
+
+    void SaveBootRecord()
+    {
+        ESP.rtcUserMemoryWrite(OTA_BOOT_RECORD_OFFSET, (uint32_t*)&bootRecord, sizeof(bootRecord));
+    }
+
+    static bool ParseHex(const char* text, uint8_t* bytes, size_t size)
+    {
+        if (strlen(text) != size * 2)
+            return false;
+
+        for (size_t i = 0; i < size * 2; i++)
+        {
+            char c = text[i];
+            uint8_t nibble;
+            if (c >= '0' && c <= '9') nibble = c - '0';
+            else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+            else return false;
+
+            bytes[i / 2] = (i % 2 == 0) ? nibble << 4 : bytes[i / 2] | nibble;
+        }
+        return true;
+    }
+
+    bool BeginRequest(const char* path)
+    {
+        auto serverIP = preferences.GetServerIP();
+        if (serverIP.HasError())
+            return false;
+
+        char url[OTA_URL_SIZE];
+        WiFiClient& client = transport.BeginRequest(url, sizeof(url), serverIP.GetValue(), port, path);
+        httpClient.useHTTP10(true);
+        httpClient.begin(client, url);
+        return true;
+    }
+
+    bool RequestChunk()
+    {
+        if (!BeginRequest(manifest.path))
+            return false;
+
+        uint32_t last = min(received + (uint32_t)OTA_CHUNK_SIZE, manifest.size) - 1;
+        char range[32];
+        snprintf_P(range, sizeof(range), PSTR("bytes=%lu-%lu"), (unsigned long)received, (unsigned long)last);
+        httpClient.addHeader("Range", range);
+
+        int httpResponseCode = httpClient.GET();
+        if (httpResponseCode != HTTP_CODE_PARTIAL_CONTENT)
+        {
+            LOG_WARN("Firmware chunk request failed (%d)", httpResponseCode);
+            httpClient.end();
+            return false;
+        }
+
+        int size = httpClient.getSize();
+        chunkRemaining = size > 0 ? min((uint32_t)size, last - received + 1) : last - received + 1;
+        isRequestOpen = true;
+        lastActivityTime = millis();
+        return true;
+    }
+
+    void EndRequest()
+    {
+        if (isRequestOpen)
+            httpClient.end();
+        isRequestOpen = false;
+    }
+
+    bool FlushBuffer()
+    {
+        if (buffered == 0)
+            return true;
+
+        bool isComplete = ::Update.write(buffer, buffered) == buffered;
+        buffered = 0;
+        return isComplete;
+    }
+
+    void Fail(OTAError error)
+    {
+        LOG_ERROR("Firmware update to %s failed (error %d)", manifest.version, error);
+        EndRequest();
+        ::Update.end();     // Not finished, so this throws the staged data away
+        state = OTAState::Idle;
+
+        if (!isBootConfirmed)
+            needsRollback = true;
+    }
+
+    void Retry()
+    {
+        EndRequest();
+        if (++retries > OTA_MAX_RETRIES)
+        {
+            Fail(OTAError::DownloadFailed);
+            return;
+        }
+
+        LOG_WARN("Firmware download interrupted at %lu/%lu bytes, retrying (%u/%u)",
+            (unsigned long)received, (unsigned long)manifest.size, retries, OTA_MAX_RETRIES);
+        state = OTAState::WaitingToRetry;
+        lastActivityTime = millis();
+    }
+
+    void Finish()
+    {
+        EndRequest();
+
+        uint8_t digest[br_sha256_SIZE];
+        br_sha256_out(&hash, digest);
+        if (memcmp(digest, manifest.sha256, sizeof(digest)) != 0)
+        {
+            Fail(OTAError::HashMismatch);
+            return;
+        }
+
+        if (!FlushBuffer() || !::Update.end())
+        {
+            Fail(OTAError::FinalizeFailed);
+            return;
+        }
+
+        // A rollback target only changes once the running image has proven itself
+        if (isBootConfirmed)
+            strncpy(bootRecord.knownGoodVersion, FIRMWARE_VERSION, sizeof(bootRecord.knownGoodVersion) - 1);
+        strncpy(bootRecord.pendingVersion, manifest.version, sizeof(bootRecord.pendingVersion) - 1);
+        bootRecord.bootAttempts = 0;
+        bootRecord.isPending = true;
+        SaveBootRecord();
+
+        LOG_INFO("Firmware %s staged, restarting", manifest.version);
+        state = OTAState::Restarting;
+        lastActivityTime = millis();
+    }
+
+    void Download()
+    {
+        if (!isRequestOpen && !RequestChunk())
+        {
+            Retry();
+            return;
+        }
+
+        WiFiClient* stream = httpClient.getStreamPtr();
+        int available = stream == nullptr ? 0 : stream->available();
+        if (available <= 0)
+        {
+            if (!httpClient.connected() || millis() - lastActivityTime > OTA_STALL_TIMEOUT)
+                Retry();
+            return;
+        }
+
+        if (buffered == OTA_BUFFER_SIZE && !FlushBuffer())
+        {
+            Fail(OTAError::WriteFailed);
+            return;
+        }
+
+        size_t length = min(min((size_t)available, (size_t)(OTA_BUFFER_SIZE - buffered)), (size_t)chunkRemaining);
+        int count = stream->read(buffer + buffered, length);
+        if (count <= 0)
+            return;
+
+        br_sha256_update(&hash, buffer + buffered, count);
+        buffered += count;
+        received += count;
+        chunkRemaining -= count;
+        retries = 0;
+        lastActivityTime = millis();
+
+        uint8_t tenths = (uint8_t)((uint64_t)received * 10 / manifest.size);
+        if (tenths > loggedTenths)
+        {
+            loggedTenths = tenths;
+            LOG_INFO("Firmware download %u%%", tenths * 10);
+        }
+
+        if (chunkRemaining == 0)
+            EndRequest();
+
+        if (received == manifest.size)
+            Finish();
+    }
+
+    void Rollback()
+    {
+        if (hasAttemptedRollback && millis() - lastRollbackAttempt < rollbackInterval)
+            return;
+        hasAttemptedRollback = true;
+        lastRollbackAttempt = millis();
+
+        auto rollback = FetchManifest(bootRecord.knownGoodVersion).AndThen([this](const FirmwareManifest& knownGood) {
+            return Start(knownGood);
+        });
+
+        if (rollback.HasValue() || rollback.GetError() == OTAError::AlreadyInstalled)
+        {
+            needsRollback = false;
+            rollbackInterval = OTA_RETRY_INTERVAL;
+        }
+        else
+            rollbackInterval = min(rollbackInterval * 2, (unsigned long)OTA_ROLLBACK_MAX_INTERVAL);
+    }
+
+public:
+    OTAUpdater(PreferencesManager& preferences, SecureTransport& transport) : preferences(preferences), transport(transport)
+    {
+
+    }
+
+    // Call once per boot: counts boot attempts of an unconfirmed image
+    void Begin()
+    {
+        bool isValid = ESP.rtcUserMemoryRead(OTA_BOOT_RECORD_OFFSET, (uint32_t*)&bootRecord, sizeof(bootRecord)) &&
+            bootRecord.magic == OTA_BOOT_RECORD_MAGIC;
+
+        if (!isValid)
+        {
+            memset(&bootRecord, 0, sizeof(bootRecord));
+            bootRecord.magic = OTA_BOOT_RECORD_MAGIC;
+            strncpy(bootRecord.knownGoodVersion, FIRMWARE_VERSION, sizeof(bootRecord.knownGoodVersion) - 1);
+            SaveBootRecord();
+            return;
+        }
+
+        if (!bootRecord.isPending)
+            return;
+
+        if (strcmp(bootRecord.pendingVersion, FIRMWARE_VERSION) != 0)
+        {
+            LOG_WARN("Update to %s didn't take, still running %s", bootRecord.pendingVersion, FIRMWARE_VERSION);
+            bootRecord.isPending = false;
+            SaveBootRecord();
+            return;
+        }
+
+        bootRecord.bootAttempts++;
+        SaveBootRecord();
+        isBootConfirmed = false;
+
+        if (bootRecord.bootAttempts > OTA_MAX_BOOT_ATTEMPTS)
+        {
+            LOG_ERROR("Firmware %s failed to start %u times, rolling back to %s", FIRMWARE_VERSION,
+                OTA_MAX_BOOT_ATTEMPTS, bootRecord.knownGoodVersion);
+            needsRollback = true;
+        }
+    }
+
+    // The server answered the running image, so it becomes the one to roll back to
+    void ConfirmBoot()
+    {
+        if (isBootConfirmed)
+            return;
+
+        isBootConfirmed = true;
+        needsRollback = false;
+        bootRecord.isPending = false;
+        strncpy(bootRecord.knownGoodVersion, FIRMWARE_VERSION, sizeof(bootRecord.knownGoodVersion) - 1);
+        SaveBootRecord();
+        LOG_INFO("Firmware %s confirmed", FIRMWARE_VERSION);
+    }
+
+    // The confirm clock starts here: a good image that boots into a server outage isn't rolled back for it
+    void MarkServerReachable()
+    {
+        if (isServerReachable)
+            return;
+
+        isServerReachable = true;
+        serverReachableTime = millis();
+    }
+
+    static Result<FirmwareManifest, OTAError> ParseManifest(JsonObjectConst json)
+    {
+        const char* version = json["version"] | "";
+        const char* path = json["url"] | "";
+        const char* sha256 = json["sha256"] | "";
+        uint32_t size = json["size"] | 0;
+
+        FirmwareManifest manifest;
+        if (version[0] == '\0' || strlen(version) >= sizeof(manifest.version) ||
+            path[0] != '/' || strlen(path) >= sizeof(manifest.path) ||
+            size == 0 || !ParseHex(sha256, manifest.sha256, sizeof(manifest.sha256)))
+            return OTAError::InvalidManifest;
+
+        strcpy(manifest.version, version);
+        strcpy(manifest.path, path);
+        manifest.size = size;
+        return manifest;
+    }
+
+    // Blocking; "latest" or a specific version
+    Result<FirmwareManifest, OTAError> FetchManifest(const char* version)
+    {
+        char path[OTA_PATH_SIZE];
+        snprintf_P(path, sizeof(path), PSTR("/api/firmware/%s/"), version);
+        if (!BeginRequest(path))
+            return OTAError::NoServerIP;
+
+        int httpResponseCode = httpClient.GET();
+        if (httpResponseCode != HTTP_CODE_OK)
+        {
+            LOG_WARN("Firmware manifest request failed (%d)", httpResponseCode);
+            httpClient.end();
+            return OTAError::ManifestFailed;
+        }
+
+        StaticJsonDocument<JSON_OBJECT_SIZE(4) + 192> json;
+        DeserializationError jsonError = deserializeJson(json, httpClient.getStream());
+        httpClient.end();
+
+        if (jsonError)
+            return OTAError::InvalidManifest;
+        return ParseManifest(json.as<JsonObjectConst>());
+    }
+
+    Result<bool, OTAError> Start(const FirmwareManifest& newManifest)
+    {
+        if (state != OTAState::Idle)
+            return OTAError::Busy;
+
+        if (strcmp(newManifest.version, FIRMWARE_VERSION) == 0)
+            return OTAError::AlreadyInstalled;
+
+        if (!::Update.begin(newManifest.size))
+            return OTAError::NoSpace;
+
+        manifest = newManifest;
+        br_sha256_init(&hash);
+        buffered = 0;
+        received = 0;
+        chunkRemaining = 0;
+        isRequestOpen = false;
+        retries = 0;
+        loggedTenths = 0;
+        state = OTAState::Downloading;
+
+        LOG_INFO("Updating firmware %s -> %s (%lu bytes)", FIRMWARE_VERSION, manifest.version, (unsigned long)manifest.size);
+        return true;
+    }
+
+    Result<bool, OTAError> CheckForUpdate()
+    {
+        if (state != OTAState::Idle)
+            return OTAError::Busy;
+
+        return FetchManifest("latest").AndThen([this](const FirmwareManifest& latest) {
+            return Start(latest);
+        });
+    }
+
+    void Update()
+    {
+        if (!isBootConfirmed && !needsRollback && isServerReachable && millis() - serverReachableTime > OTA_CONFIRM_TIMEOUT)
+        {
+            LOG_ERROR("Firmware %s never got through to the server, rolling back to %s", FIRMWARE_VERSION, bootRecord.knownGoodVersion);
+            needsRollback = true;
+        }
+
+        switch (state)
+        {
+            case OTAState::Idle:
+                if (needsRollback)
+                    Rollback();
+                break;
+
+            case OTAState::Downloading:
+                Download();
+                break;
+
+            case OTAState::WaitingToRetry:
+                if (millis() - lastActivityTime >= OTA_RETRY_INTERVAL)
+                    state = OTAState::Downloading;
+                break;
+
+            case OTAState::Restarting:
+                if (millis() - lastActivityTime >= OTA_RESTART_DELAY)
+                {
+                    Logger::Flush();
+                    ESP.restart();
+                }
+                break;
+        }
+    }
+
+    // Takes effect from the next request
+    void SetPort(uint16_t newPort) { port = newPort; }
+
+    bool IsBusy() { return state != OTAState::Idle; }
+
+    // Also into output, for a command from the server
+    void PrintStatus(JsonObject output = JsonObject())
+    {
+        LOG_INFO("Firmware %s, known good %s%s", FIRMWARE_VERSION, bootRecord.knownGoodVersion,
+            isBootConfirmed ? "" : " (unconfirmed)");
+        output["firmware"] = FIRMWARE_VERSION;
+        output["known_good"] = bootRecord.knownGoodVersion;
+        output["confirmed"] = isBootConfirmed;
+        if (state != OTAState::Idle)
+        {
+            LOG_INFO("Updating to %s: %lu/%lu bytes", manifest.version, (unsigned long)received, (unsigned long)manifest.size);
+            output["updating_to"] = manifest.version;
+            output["received"] = (unsigned long)received;
+            output["size"] = (unsigned long)manifest.size;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef POWER_GOVERNOR_HPP
+#define POWER_GOVERNOR_HPP
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#define POWER_BEACON_INTERVAL 102           // ms, the usual 100 TU
+#define POWER_MAX_LISTEN_INTERVAL 10        // The most beacons the SDK lets the radio skip
+#define POWER_LIGHT_SLEEP_MIN 500           // Below this until the next send, light sleep isn't worth waking from
+#define POWER_MAX_IDLE 200                  // Longest Idle(), so serial input and server messages still get through
+
+// Typical ESP-12 draw per state, in µA. Light sleep wakes for the beacons it listens to, which is most
+// of its average; transmit bursts aren't modelled and come out of the awake figure.
+#define POWER_AWAKE_CURRENT 70000
+#define POWER_MODEM_SLEEP_CURRENT 15000
+#define POWER_LIGHT_SLEEP_CURRENT 2000
+
+enum class PowerPolicy : uint8_t
+{
+    AlwaysOn,       // The radio never sleeps, as before the governor
+    ModemSleep,     // The radio dozes between sends, the CPU keeps running; for mains-powered probes
+    Auto            // Light sleep when the next send is far enough off, modem sleep otherwise
+};
+
+// What the chip was doing, for the current estimate
+enum class PowerState : uint8_t
+{
+    Awake,          // Radio listening all the time
+    ModemSleep,     // Radio dozing, CPU running
+    LightSleep,     // Radio dozing, CPU suspended in Idle()
+    Count
+};
+
+// Keeps the radio awake while the probe has something to send or is waiting for an answer, and lets
+// it sleep otherwise. The access point only learns the listen interval when the probe associates, so
+// it's tuned from the send cycle rather than from the time to each send.
+class PowerGovernor
+{
+private:
+    ESP8266WiFiClass& wifi;
+
+    PowerPolicy policy = PowerPolicy::Auto;
+    WiFiSleepType_t sleepType = WIFI_NONE_SLEEP;
+    uint8_t listenInterval = 1;
+    bool isApplied = false;
+    unsigned long modeChanges = 0;
+
+    unsigned long stateTime[(size_t)PowerState::Count] = { };
+    unsigned long lastAccountTime = 0;
+
+    void Account(PowerState state, unsigned long until)
+    {
+        stateTime[(size_t)state] += until - lastAccountTime;
+        lastAccountTime = until;
+    }
+
+    PowerState GetActiveState() { return sleepType == WIFI_NONE_SLEEP ? PowerState::Awake : PowerState::ModemSleep; }
+
+    void SetSleepType(WiFiSleepType_t type)
+    {
+        if (isApplied && type == sleepType)
+            return;
+
+        wifi.setSleepMode(type, type == WIFI_NONE_SLEEP ? 0 : listenInterval);
+        sleepType = type;
+        isApplied = true;
+        modeChanges++;
+    }
+
+public:
+    PowerGovernor(ESP8266WiFiClass& wifi) : wifi(wifi) { }
+
+    void Begin()
+    {
+        lastAccountTime = millis();
+        SetSleepType(WIFI_NONE_SLEEP);
+    }
+
+    void SetPolicy(PowerPolicy newPolicy) { policy = newPolicy; }
+    PowerPolicy GetPolicy() { return policy; }
+
+    // The radio should still hear the server a couple of times per cycle
+    void SetCycle(unsigned long cycle)
+    {
+        listenInterval = constrain(cycle / POWER_BEACON_INTERVAL / 2, 1UL, (unsigned long)POWER_MAX_LISTEN_INTERVAL);
+    }
+
+    // isBusy: something is queued or an answer is expected. untilNextSend: ms until the next thing
+    // the probe sends on its own.
+    void Update(bool isBusy, unsigned long untilNextSend)
+    {
+        Account(GetActiveState(), millis());
+
+        if (isBusy || policy == PowerPolicy::AlwaysOn)
+            SetSleepType(WIFI_NONE_SLEEP);
+        else if (policy == PowerPolicy::Auto && untilNextSend >= POWER_LIGHT_SLEEP_MIN)
+            SetSleepType(WIFI_LIGHT_SLEEP);
+        else
+            SetSleepType(WIFI_MODEM_SLEEP);
+    }
+
+    // Gives the CPU up for at most ms, never past POWER_MAX_IDLE; in light sleep the SDK suspends it
+    // during the delay. Does nothing while the radio is kept awake.
+    void Idle(unsigned long ms)
+    {
+        if (sleepType == WIFI_NONE_SLEEP || ms == 0)
+            return;
+
+        Account(GetActiveState(), millis());
+        delay(min(ms, (unsigned long)POWER_MAX_IDLE));
+        Account(sleepType == WIFI_LIGHT_SLEEP ? PowerState::LightSleep : PowerState::ModemSleep, millis());
+    }
+
+    bool IsAsleep() { return sleepType != WIFI_NONE_SLEEP; }
+    WiFiSleepType_t GetSleepType() { return sleepType; }
+    uint8_t GetListenInterval() { return listenInterval; }
+    unsigned long GetModeChanges() { return modeChanges; }
+    unsigned long GetTime(PowerState state) { return stateTime[(size_t)state]; }
+
+    // Time-weighted over everything accounted so far, in µA
+    uint32_t GetMeanCurrent()
+    {
+        unsigned long total = 0;
+        for (unsigned long time : stateTime)
+            total += time;
+        if (total == 0)
+            return POWER_AWAKE_CURRENT;
+
+        uint64_t charge = (uint64_t)stateTime[(size_t)PowerState::Awake] * POWER_AWAKE_CURRENT +
+            (uint64_t)stateTime[(size_t)PowerState::ModemSleep] * POWER_MODEM_SLEEP_CURRENT +
+            (uint64_t)stateTime[(size_t)PowerState::LightSleep] * POWER_LIGHT_SLEEP_CURRENT;
+        return charge / total;
+    }
+};
+
+#endif
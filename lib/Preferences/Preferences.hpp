@@ -2,12 +2,33 @@
 #define PREFERENCES_HPP
 
 #include <Arduino.h>
+#include <EEPROM.h>
 #include <WiFiCredentials.hpp>
 #include <HTTPCredentials.hpp>
+#include <AlertRule.hpp>
+#include <TLSSettings.hpp>
+#include <ConfigOverlay.hpp>
+#include <MeshSettings.hpp>
+#include <Result.hpp>
 
 #define WIFI_CREDENTIALS_SAVED      0b10000000
 #define SERVER_IP_SAVED             0b01000000
 #define PROBE_UUID_SAVED            0b00100000
+#define AGGREGATION_WINDOW_SAVED    0b00010000
+#define ALERT_RULES_SAVED           0b00001000
+#define TLS_SETTINGS_SAVED          0b00000100
+#define CONFIG_SAVED                0b00000010
+
+// Second flags byte, since the first must never read as ERASED_EEPROM_BYTE
+#define MESH_SETTINGS_SAVED         0b00000001
+
+#define ERASED_EEPROM_BYTE          0xFF
+
+enum class PreferencesError : uint8_t
+{
+    NotSet,
+    Uninitialized
+};
 
 struct Preferences 
 {
@@ -16,19 +37,53 @@ struct Preferences
 
     bool autoConnectToWiFi;
     bool autoConnectToServer;
+
+    unsigned long aggregationWindow;    // Milliseconds per summary, 0 sends every reading
+
+    AlertRule alertRules[ALERT_MAX_RULES];
+
+    TLSSettings tlsSettings;
+
+    ConfigOverlay config;
+
+    MeshSettings meshSettings;
 };
 
+// The first flags byte, Preferences right after it, and the second flags byte in the last byte, where
+// it stays however Preferences grows. Chips saved with a smaller image have that byte erased.
+#define PREFERENCES_STORAGE_SIZE 512
+#define MORE_SAVE_FLAGS_ADDRESS (PREFERENCES_STORAGE_SIZE - 1)
+
+static_assert(1 + sizeof(Preferences) <= MORE_SAVE_FLAGS_ADDRESS, "Preferences no longer fit PREFERENCES_STORAGE_SIZE");
+
 class PreferencesManager
 {
 private:
+    EEPROMClass& eeprom;
     Preferences preferences;
     unsigned char saveFlags = 0b00000000;
+    unsigned char moreSaveFlags = 0b00000000;
 
 public:
-    WiFiCredentials GetWiFiCredentials() { return preferences.wifiCredentials; }
-    HTTPCredentials GetHTTPCredentials() { return preferences.httpCredentials; }
-    String GetServerIP() { return GetHTTPCredentials().ip; }
-    String GetProbeUUID() { return GetHTTPCredentials().uuid; }
+    PreferencesManager(EEPROMClass& eeprom) : eeprom(eeprom) { }
+
+    const WiFiCredentials& GetWiFiCredentials() { return preferences.wifiCredentials; }
+    const HTTPCredentials& GetHTTPCredentials() { return preferences.httpCredentials; }
+
+    Result<const char*, PreferencesError> GetServerIP()
+    {
+        if (!IsServerIPSet())
+            return PreferencesError::NotSet;
+        return (const char*)preferences.httpCredentials.ip;
+    }
+
+    Result<const char*, PreferencesError> GetProbeUUID()
+    {
+        if (!IsProbeUUIDSet())
+            return PreferencesError::NotSet;
+        return (const char*)preferences.httpCredentials.uuid;
+    }
+
 
     bool GetAutoConnectToWiFi() { return preferences.autoConnectToWiFi; }
     bool GetAutoConnectToServer() { return preferences.autoConnectToServer; }
@@ -36,30 +91,122 @@ public:
     void SetAutoConnectToWiFi(bool value) { preferences.autoConnectToWiFi = value; }
     void SetAutoConnectToServer(bool value) { preferences.autoConnectToServer = value; }
 
-    void SetWiFiCredentials(WiFiCredentials credentials)
+    // Chips saved before this setting existed don't have the flag, so they keep sending raw readings
+    unsigned long GetAggregationWindow() { return IsAggregationWindowSet() ? preferences.aggregationWindow : 0; }
+
+    void SetAggregationWindow(unsigned long window)
+    {
+        preferences.aggregationWindow = window;
+        saveFlags |= AGGREGATION_WINDOW_SAVED;
+    }
+
+    // A chip that never saved rules has none enabled
+    AlertRule GetAlertRule(uint8_t index)
+    {
+        if (!AreAlertRulesSet() || index >= ALERT_MAX_RULES)
+            return AlertRule();
+        return preferences.alertRules[index];
+    }
+
+    void SetAlertRule(uint8_t index, const AlertRule& rule)
+    {
+        if (index >= ALERT_MAX_RULES)
+            return;
+
+        // The other slots hold whatever was in the EEPROM until rules are saved for the first time
+        if (!AreAlertRulesSet())
+        {
+            for (AlertRule& other : preferences.alertRules)
+                other = AlertRule();
+            saveFlags |= ALERT_RULES_SAVED;
+        }
+        preferences.alertRules[index] = rule;
+    }
+
+    // Plain HTTP and ws:// until TLS is turned on
+    TLSSettings GetTLSSettings()
+    {
+        if (!AreTLSSettingsSet())
+            return TLSSettings();
+        return preferences.tlsSettings;
+    }
+
+    void SetTLSSettings(const TLSSettings& settings)
+    {
+        preferences.tlsSettings = settings;
+        saveFlags |= TLS_SETTINGS_SAVED;
+    }
+
+    // Only values that were set are stored; the others follow the firmware's defaults
+    bool GetConfigValue(uint8_t index, uint32_t& value)
+    {
+        if (!IsConfigSet() || index >= CONFIG_MAX_VALUES || (preferences.config.setMask & (1 << index)) == 0)
+            return false;
+        value = preferences.config.values[index];
+        return true;
+    }
+
+    void SetConfigValue(uint8_t index, uint32_t value)
+    {
+        if (index >= CONFIG_MAX_VALUES)
+            return;
+
+        // The overlay holds whatever was in the EEPROM until something is set for the first time
+        if (!IsConfigSet())
+        {
+            preferences.config = ConfigOverlay();
+            saveFlags |= CONFIG_SAVED;
+        }
+        preferences.config.values[index] = value;
+        preferences.config.setMask |= 1 << index;
+    }
+
+    void ClearConfigValue(uint8_t index)
+    {
+        if (IsConfigSet() && index < CONFIG_MAX_VALUES)
+            preferences.config.setMask &= ~(1 << index);
+    }
+
+    // Not part of a mesh until a role is set
+    MeshSettings GetMeshSettings()
+    {
+        if (!AreMeshSettingsSet())
+            return MeshSettings();
+        return preferences.meshSettings;
+    }
+
+    void SetMeshSettings(const MeshSettings& settings)
+    {
+        preferences.meshSettings = settings;
+        moreSaveFlags |= MESH_SETTINGS_SAVED;
+    }
+
+    void SetWiFiCredentials(const WiFiCredentials& credentials)
     {
         preferences.wifiCredentials = credentials;
         saveFlags |= WIFI_CREDENTIALS_SAVED;
     }
 
-    void SetServerIP(String ip)
+    void SetServerIP(const char* ip)
     {
-        strncpy(preferences.httpCredentials.ip, ip.c_str(), 32);
+        strncpy(preferences.httpCredentials.ip, ip, sizeof(preferences.httpCredentials.ip) - 1);
+        preferences.httpCredentials.ip[sizeof(preferences.httpCredentials.ip) - 1] = '\0';
         saveFlags |= SERVER_IP_SAVED;
     }
 
-    void SetProbeUUID(String uuid)
+    void SetProbeUUID(const char* uuid)
     {
-        strncpy(preferences.httpCredentials.uuid, uuid.c_str(), 64);
+        strncpy(preferences.httpCredentials.uuid, uuid, sizeof(preferences.httpCredentials.uuid) - 1);
+        preferences.httpCredentials.uuid[sizeof(preferences.httpCredentials.uuid) - 1] = '\0';
         saveFlags |= PROBE_UUID_SAVED;
     }
 
-    void SetHTTPCredentials(HTTPCredentials credentials)
+    void SetHTTPCredentials(const HTTPCredentials& credentials)
     {
         SetHTTPCredentials(credentials.ip, credentials.uuid);
     }
     
-    void SetHTTPCredentials(String ip = "", String uuid = "") 
+    void SetHTTPCredentials(const char* ip = "", const char* uuid = "") 
     {
         SetServerIP(ip);
         SetProbeUUID(uuid);
@@ -86,28 +233,47 @@ public:
         ClearProbeUUID();
     }
 
-    Preferences Load() 
+    Result<Preferences, PreferencesError> Load() 
     {
-        EEPROM.begin(sizeof(Preferences) + 1);
-        saveFlags = EEPROM.read(0);
-        EEPROM.get(1, preferences);
-        EEPROM.end();
+        eeprom.begin(PREFERENCES_STORAGE_SIZE);
+        saveFlags = eeprom.read(0);
+        eeprom.get(1, preferences);
+        moreSaveFlags = eeprom.read(MORE_SAVE_FLAGS_ADDRESS);
+        eeprom.end();
+
+        // Chips saved before the second byte existed have it erased
+        if (moreSaveFlags == ERASED_EEPROM_BYTE)
+            moreSaveFlags = 0;
+
+        // Nothing was ever saved on this chip
+        if (saveFlags == ERASED_EEPROM_BYTE)
+        {
+            saveFlags = 0;
+            moreSaveFlags = 0;
+            preferences = Preferences();
+            return PreferencesError::Uninitialized;
+        }
+
         return preferences;
     }
 
     void Save() 
     {
-        EEPROM.begin(sizeof(Preferences) + 1);
-        EEPROM.write(0, saveFlags);
-        EEPROM.put(1, preferences);
-        EEPROM.end();
+        eeprom.begin(PREFERENCES_STORAGE_SIZE);
+        eeprom.write(0, saveFlags);
+        eeprom.put(1, preferences);
+        eeprom.write(MORE_SAVE_FLAGS_ADDRESS, moreSaveFlags);
+        eeprom.end();
     }
 
     bool AreWiFiCredentialsSet() { return (saveFlags & WIFI_CREDENTIALS_SAVED) != 0; }
     bool IsServerIPSet() { return (saveFlags & SERVER_IP_SAVED) != 0; }
     bool IsProbeUUIDSet() { return (saveFlags & PROBE_UUID_SAVED) != 0; }
+    bool IsAggregationWindowSet() { return (saveFlags & AGGREGATION_WINDOW_SAVED) != 0; }
+    bool AreAlertRulesSet() { return (saveFlags & ALERT_RULES_SAVED) != 0; }
+    bool AreTLSSettingsSet() { return (saveFlags & TLS_SETTINGS_SAVED) != 0; }
+    bool IsConfigSet() { return (saveFlags & CONFIG_SAVED) != 0; }
+    bool AreMeshSettingsSet() { return (moreSaveFlags & MESH_SETTINGS_SAVED) != 0; }
 };
 
-static PreferencesManager preferences;
-
 #endif
\ No newline at end of file
@@ -0,0 +1,1344 @@
+#ifndef PROBE_HPP
+#define PROBE_HPP
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <ESP8266WiFi.h>
+
+#include <Command.hpp>
+#include <RemoteCommandQueue.hpp>
+#include <Logger.hpp>
+#include <Preferences.hpp>
+#include <WiFiManager.hpp>
+#include <SensorReader.hpp>
+#include <Aggregator.hpp>
+#include <HistoryBuffer.hpp>
+#include <LinkTelemetry.hpp>
+#include <AlertEngine.hpp>
+#include <SecureTransport.hpp>
+#include <Sender.hpp>
+#include <MyHTTPClient.hpp>
+#include <OTAUpdater.hpp>
+#include <PowerGovernor.hpp>
+#include <MeshTransport.hpp>
+#include <MeshLeaf.hpp>
+#include <MeshGateway.hpp>
+#include <ProbeConfig.hpp>
+#include <BootTrace.hpp>
+#include <Version.h>
+
+#define PROBE_MAX_COMMANDS 48
+#define COMMAND_BUFFER_SIZE 128
+#define SAMPLE_MAX_AGE 250      // How old a reading may be when it's sent or aggregated
+#define LINK_SIGNAL_INTERVAL 5000
+#define SERVER_MESSAGE_JSON_SIZE (JSON_OBJECT_SIZE(6) + 256)
+#define SERVER_RETRY_INTERVAL 30000     // After a discovery sweep or UUID request that failed
+#define IDLE_WAKE_LEAD (DHT_READ_LEAD + 10)     // Idle() ends before the DHT has to be read for the next sample
+
+// Everything a probe talks to outside of itself. On the board these are the EEPROM, WiFi and
+// Serial globals; the fleet simulator gives every probe its own.
+struct ProbePlatform
+{
+    EEPROMClass& eeprom;
+    ESP8266WiFiClass& wifi;
+    Stream& serial;
+    MeshTransport& mesh;
+};
+
+class Probe
+{
+private:
+    ProbePlatform platform;
+
+    PreferencesManager preferences;
+    ConfigRegistry<ConfigKey> config;
+    WiFiManager wifiManager;
+    SecureTransport transport;
+    Sender sender;
+    MyHTTPClient http;
+    SensorReader sensors;
+    WindowedAggregator aggregator;
+    HistoryBuffer history;
+    SignalStats signal;
+    AlertEngine alerts;
+    OTAUpdater ota;
+    PowerGovernor power;
+    MeshLeaf leaf;
+    MeshGateway gateway;
+    MeshRole meshRole = MeshRole::Off;
+
+    CommandExecutor<PROBE_MAX_COMMANDS, Probe> commandExecutor;
+    char commandBuffer[COMMAND_BUFFER_SIZE];
+    int commandBufferIndex = 0;
+    RemoteCommandQueue remoteCommands;
+    CommandSource commandSource = CommandSource::Serial;    // Of the command that's running
+    JsonObject commandOutput;       // What a command from the server reports; null for the serial port, so writes to it go nowhere
+
+    unsigned long lastUpdateTime = 0;
+    bool hasSampled = false;        // The first sample is taken as soon as the sensors have one
+    unsigned long lastSignalTime = 0;
+    unsigned long lastLinkReportTime = 0;
+    unsigned long linkReportInterval = LINK_REPORT_INTERVAL;
+    unsigned long lastAlertUpdateCount = 0;
+    unsigned long suppressedSamples = 0;
+    bool isSamplingOnDemand = true;
+    bool autoSet = false;
+    unsigned long lastServerFailureTime = 0;
+    bool isServerRetryPending = false;
+
+    BootTrace bootTrace;
+    bool isBootReported = false;
+
+    void AddBuiltInCommands()
+    {
+        AddCommand(Command<Probe>(PSTR("wifi-set"), 2, [](Probe& probe, int argc, char** argv) {
+            probe.wifiManager.SetCredentials(argv[0], argv[1]);
+            LOG_INFO("Credentials updated");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("wifi-connect"), 0, [](Probe& probe, int argc, char** argv) {
+            if (!probe.wifiManager.Connect())
+                return ERR("No credentials set. Use wifi-set <SSID> <password> to set credentials.");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("wifi-disconnect"), 0, [](Probe& probe, int argc, char** argv) {
+            probe.wifiManager.Disconnect();
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("wifi-clear"), 0, [](Probe& probe, int argc, char** argv) {
+            probe.wifiManager.ClearStoredCredentials();
+            LOG_INFO("Cleared stored credentials");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("get-temperature"), 0, [](Probe& probe, int argc, char** argv) {
+            auto temperature = probe.sensors.GetTemperature();
+            if (temperature.HasError() && temperature.GetError() == SensorError::NotReady)
+                return ERR("No read from DHT yet");
+            if (temperature.HasError())
+                return ERR("DHT reading isn't usable, see sensor-stats");
+
+            LOG_INFO("Temperature: %f oC", temperature.GetValue());
+            probe.commandOutput["temperature"] = temperature.GetValue();
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("get-humidity"), 0, [](Probe& probe, int argc, char** argv) {
+            auto humidity = probe.sensors.GetHumidity();
+            if (humidity.HasError() && humidity.GetError() == SensorError::NotReady)
+                return ERR("No read from DHT yet");
+            if (humidity.HasError())
+                return ERR("DHT reading isn't usable, see sensor-stats");
+
+            LOG_INFO("Humidity: %f%%", humidity.GetValue());
+            probe.commandOutput["humidity"] = humidity.GetValue();
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("get-soil-moisture"), 0, [](Probe& probe, int argc, char** argv) {
+            auto soilMoisture = probe.sensors.GetSoilMoisture();
+            if (soilMoisture.HasError() && soilMoisture.GetError() == SensorError::NotReady)
+                return ERR("No read from soil/light yet");
+            if (soilMoisture.HasError())
+                return ERR("Soil/light reading isn't usable, see sensor-stats");
+
+            LOG_INFO("Soil moisture: %f%%", soilMoisture.GetValue());
+            probe.commandOutput["soil_moisture"] = soilMoisture.GetValue();
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("get-light-level"), 0, [](Probe& probe, int argc, char** argv) {
+            auto lightLevel = probe.sensors.GetLightLevel();
+            if (lightLevel.HasError() && lightLevel.GetError() == SensorError::NotReady)
+                return ERR("No read from soil/light yet");
+            if (lightLevel.HasError())
+                return ERR("Soil/light reading isn't usable, see sensor-stats");
+
+            LOG_INFO("Light level: %f%%", lightLevel.GetValue());
+            probe.commandOutput["light_level"] = lightLevel.GetValue();
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("sensor-stats"), 0, [](Probe& probe, int argc, char** argv) {
+            probe.PrintSensorHealth("DHT11", probe.sensors.GetDHTHealth());
+            probe.PrintSensorHealth("Soil", probe.sensors.GetSoilHealth());
+            probe.PrintSensorHealth("Light", probe.sensors.GetLightHealth());
+            LOG_INFO("Samples suppressed: %lu", probe.suppressedSamples);
+            probe.commandOutput["dht_failing"] = probe.sensors.GetDHTHealth().consecutiveFailures;
+            probe.commandOutput["soil_failing"] = probe.sensors.GetSoilHealth().consecutiveFailures;
+            probe.commandOutput["light_failing"] = probe.sensors.GetLightHealth().consecutiveFailures;
+            probe.commandOutput["suppressed"] = probe.suppressedSamples;
+
+            auto readings = probe.sensors.GetReadings();
+            if (readings.HasValue())
+            {
+                const SensorReadings& sample = readings.GetValue();
+                LOG_INFO("Quality: temperature %s, humidity %s", QualityName(sample.temperatureQuality), QualityName(sample.humidityQuality));
+                LOG_INFO("Quality: soil moisture %s, light level %s", QualityName(sample.soilMoistureQuality), QualityName(sample.lightLevelQuality));
+                probe.commandOutput["temperature"] = QualityName(sample.temperatureQuality);
+                probe.commandOutput["humidity"] = QualityName(sample.humidityQuality);
+                probe.commandOutput["soil_moisture"] = QualityName(sample.soilMoistureQuality);
+                probe.commandOutput["light_level"] = QualityName(sample.lightLevelQuality);
+            }
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("server-info"), 2, [](Probe& probe, int argc, char** argv) {
+            HTTPCredentials credentials;
+            strncpy(credentials.ip, argv[0], sizeof(credentials.ip) - 1);
+            credentials.ip[sizeof(credentials.ip) - 1] = '\0';
+            strncpy(credentials.uuid, argv[1], sizeof(credentials.uuid) - 1);
+            credentials.uuid[sizeof(credentials.uuid) - 1] = '\0';
+            probe.preferences.SetHTTPCredentials(credentials);
+            probe.preferences.Save();
+
+            LOG_INFO("Server info set");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("send-begin"), 0, [](Probe& probe, int argc, char** argv) {
+            if(!probe.wifiManager.IsConnected())
+                return ERR("Wifi not connected");
+            if(!probe.sender.IsReadyToBegin())
+                return ERR("No info about destination. Use server-info <IP> <UUID>");
+            probe.sender.Begin();
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("test-eeprom"), 0, [](Probe& probe, int argc, char** argv) {
+            EEPROMClass& eeprom = probe.platform.eeprom;
+            char row[33];
+            eeprom.begin(PREFERENCES_STORAGE_SIZE);
+            for (unsigned int i = 0; i < PREFERENCES_STORAGE_SIZE; i += 16)
+            {
+                unsigned int rowLength = 0;
+                for (unsigned int j = i; j < i + 16 && j < PREFERENCES_STORAGE_SIZE; j++)
+                    rowLength += sprintf(row + rowLength, "%02x", eeprom.read(j));
+                LOG_INFO("%04x: %s", i, row);
+            }
+            eeprom.end();
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("http-clear"), 0, [](Probe& probe, int argc, char** argv) {
+            probe.http.ClearStoredCredentials();
+            LOG_INFO("Cleared stored credentials");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("ip-clear"), 0, [](Probe& probe, int argc, char** argv) {
+            probe.preferences.ClearServerIP();
+            probe.preferences.Save();
+            LOG_INFO("Server IP cleared");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("uuid-clear"), 0, [](Probe& probe, int argc, char** argv) {
+            probe.preferences.ClearProbeUUID();
+            probe.preferences.Save();
+            LOG_INFO("Probe UUID cleared");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("ip-set"), 1, [](Probe& probe, int argc, char** argv) {
+            probe.preferences.SetServerIP(argv[0]);
+            probe.preferences.Save();
+            LOG_INFO("Server IP set");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("uuid-set"), 1, [](Probe& probe, int argc, char** argv) {
+            probe.preferences.SetProbeUUID(argv[0]);
+            probe.preferences.Save();
+            LOG_INFO("Probe UUID set");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("wifi-autoconnect"), 1, [](Probe& probe, int argc, char** argv) {
+            if (strcmp_P(argv[0], PSTR("on")) == 0)
+                probe.preferences.SetAutoConnectToWiFi(true);
+            else if (strcmp_P(argv[0], PSTR("off")) == 0)
+                probe.preferences.SetAutoConnectToWiFi(false);
+            else
+                return ERR("wifi-autoconnect takes 1 argument: on / off");
+
+            probe.preferences.Save();
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("aggregate"), 1, [](Probe& probe, int argc, char** argv) {
+            unsigned long window = 0;
+            if (strcmp_P(argv[0], PSTR("off")) != 0)
+            {
+                char* end;
+                window = strtoul(argv[0], &end, 10) * 1000;
+                if (*end != '\0' || window == 0 || !WindowedAggregator::IsValidWindow(window))
+                    return ERR("aggregate takes 1 argument: seconds (10 to 3600) / off");
+            }
+
+            probe.aggregator.SetWindowLength(window);
+            probe.preferences.SetAggregationWindow(window);
+            probe.preferences.Save();
+
+            if (window == 0)
+                LOG_INFO("Sending every reading");
+            else
+                LOG_INFO("Sending one summary every %lu s", window / 1000);
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("sampling"), 1, [](Probe& probe, int argc, char** argv) {
+            if (strcmp_P(argv[0], PSTR("on-demand")) == 0)
+                probe.isSamplingOnDemand = true;
+            else if (strcmp_P(argv[0], PSTR("free")) == 0)
+            {
+                probe.isSamplingOnDemand = false;
+                probe.sensors.FreeRun();
+            }
+            else
+                return ERR("sampling takes 1 argument: on-demand / free");
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("alert-set"), 6, [](Probe& probe, int argc, char** argv) {
+            char* end;
+            AlertRule rule;
+            rule.isEnabled = true;
+
+            unsigned long index = strtoul(argv[0], &end, 10);
+            if (*end != '\0' || index >= ALERT_MAX_RULES)
+                return ERR("Rule index goes from 0 to 7");
+
+            if (!AlertEngine::ParseChannel(argv[1], rule.channel))
+                return ERR("Channel is temperature/humidity/soil-moisture/light-level");
+
+            if (strcmp_P(argv[2], PSTR("above")) == 0)
+                rule.condition = AlertCondition::Above;
+            else if (strcmp_P(argv[2], PSTR("below")) == 0)
+                rule.condition = AlertCondition::Below;
+            else
+                return ERR("Condition is above / below");
+
+            rule.threshold = strtof(argv[3], &end);
+            if (*end != '\0')
+                return ERR("Threshold isn't a number");
+
+            rule.hysteresis = strtof(argv[4], &end);
+            if (*end != '\0' || rule.hysteresis < 0.0f)
+                return ERR("Hysteresis isn't a positive number");
+
+            unsigned long duration = strtoul(argv[5], &end, 10);
+            if (*end != '\0' || duration > UINT16_MAX)
+                return ERR("Duration is in seconds, up to 65535");
+            rule.minDuration = duration;
+
+            probe.preferences.SetAlertRule(index, rule);
+            probe.preferences.Save();
+            probe.alerts.Reset(index);
+            LOG_INFO("Alert %lu set", index);
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("alert-clear"), 1, [](Probe& probe, int argc, char** argv) {
+            char* end;
+            unsigned long index = strtoul(argv[0], &end, 10);
+            if (*end != '\0' || index >= ALERT_MAX_RULES)
+                return ERR("Rule index goes from 0 to 7");
+
+            probe.preferences.SetAlertRule(index, AlertRule());
+            probe.preferences.Save();
+            probe.alerts.Reset(index);
+            LOG_INFO("Alert %lu cleared", index);
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("alert-list"), 0, [](Probe& probe, int argc, char** argv) {
+            for (uint8_t i = 0; i < ALERT_MAX_RULES; i++)
+            {
+                AlertRule rule = probe.preferences.GetAlertRule(i);
+                if (!rule.isEnabled)
+                    continue;
+
+                char condition[48];
+                snprintf_P(condition, sizeof(condition), PSTR("%s %s %.2f"), AlertEngine::ChannelName(rule.channel),
+                    rule.condition == AlertCondition::Above ? "above" : "below", rule.threshold);
+                LOG_INFO("%d: %s for %d s, hysteresis %f", i, condition, rule.minDuration, rule.hysteresis);
+
+                char index[4];
+                snprintf_P(index, sizeof(index), PSTR("%d"), i);
+                if (probe.alerts.IsFiring(i))
+                {
+                    LOG_WARN("%d: firing", i);
+                    size_t length = strlen(condition);
+                    snprintf_P(condition + length, sizeof(condition) - length, PSTR(", firing"));
+                }
+                probe.commandOutput[index] = condition;
+            }
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("link-stats"), 0, [](Probe& probe, int argc, char** argv) {
+            LinkReport report = probe.GetLinkReport();
+            if (report.signal->HasSamples())
+                LOG_INFO("RSSI: %d dBm (mean %f, min %d, max %d)", report.signal->GetLast(), report.signal->GetAverage(),
+                    report.signal->GetMin(), report.signal->GetMax());
+            LOG_INFO("RTT: mean %f ms, p50 %lu, p90 %lu, p99 %lu", report.roundTrip->GetAverage(), report.roundTrip->Percentile(50),
+                report.roundTrip->Percentile(90), report.roundTrip->Percentile(99));
+            LOG_INFO("Pings: %lu answered, %lu lost, slowest %lu ms", report.roundTrip->GetSampleCount(),
+                report.roundTrip->GetLostCount(), report.roundTrip->GetMax());
+            LOG_INFO("Connects: %lu WiFi, %lu WebSocket", report.wifiConnects, report.webSocketConnects);
+            LOG_INFO("WiFi ms: %lu disconnected, %lu connecting, %lu connected", report.wifiDisconnectedTime,
+                report.wifiConnectingTime, report.wifiConnectedTime);
+            LOG_INFO("Pending samples: %lu", report.pendingSamples);
+
+            if (report.signal->HasSamples())
+                probe.commandOutput["rssi"] = report.signal->GetLast();
+            probe.commandOutput["rtt_p50"] = report.roundTrip->Percentile(50);
+            probe.commandOutput["rtt_p99"] = report.roundTrip->Percentile(99);
+            probe.commandOutput["pings_lost"] = report.roundTrip->GetLostCount();
+            probe.commandOutput["wifi_connects"] = report.wifiConnects;
+            probe.commandOutput["ws_connects"] = report.webSocketConnects;
+            probe.commandOutput["pending"] = report.pendingSamples;
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("ota-update"), 0, [](Probe& probe, int argc, char** argv) {
+            if (probe.commandSource == CommandSource::Server && !probe.IsServerVerified())
+                return COMMAND_ERROR(CommandErrorCode::NotAllowed);
+            auto update = probe.ota.CheckForUpdate();
+            if (update.HasError())
+            {
+                if (update.GetError() == OTAError::AlreadyInstalled)
+                    return ERR("Already running the latest firmware");
+                return ERR("Couldn't start the update. Check the server connection and ota-status.");
+            }
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("ota-status"), 0, [](Probe& probe, int argc, char** argv) {
+            probe.ota.PrintStatus(probe.commandOutput);
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("tls"), 1, [](Probe& probe, int argc, char** argv) {
+            TLSSettings settings = probe.preferences.GetTLSSettings();
+            if (strcmp_P(argv[0], PSTR("on")) == 0)
+                settings.isEnabled = true;
+            else if (strcmp_P(argv[0], PSTR("off")) == 0)
+                settings.isEnabled = false;
+            else
+                return ERR("tls takes 1 argument: on / off");
+
+            probe.preferences.SetTLSSettings(settings);
+            probe.preferences.Save();
+            if (settings.isEnabled && !settings.isPinned)
+                LOG_WARN("No fingerprint pinned, the server isn't verified. Use tls-pin <SHA-1 fingerprint>");
+            probe.ReconnectToServer();
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("tls-pin"), 1, [](Probe& probe, int argc, char** argv) {
+            TLSSettings settings = probe.preferences.GetTLSSettings();
+            if (strcmp_P(argv[0], PSTR("off")) == 0)
+                settings.isPinned = false;
+            else if (SecureTransport::ParseFingerprint(argv[0], settings.fingerprint))
+                settings.isPinned = true;
+            else
+                return ERR("tls-pin takes a SHA-1 fingerprint (40 hex) / off");
+
+            probe.preferences.SetTLSSettings(settings);
+            probe.preferences.Save();
+            if (settings.isPinned)
+                LOG_INFO("Fingerprint pinned");
+            else
+                LOG_INFO("Fingerprint cleared");
+            probe.ReconnectToServer();
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("tls-stats"), 0, [](Probe& probe, int argc, char** argv) {
+            probe.transport.PrintStats();
+            probe.sender.PrintTLSStats();
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("protocol-info"), 0, [](Probe& probe, int argc, char** argv) {
+            const ProtocolSettings& protocol = probe.sender.GetProtocol();
+            if (protocol.encoding == Encoding::TimeSeries)
+                LOG_INFO("Encoding: time series, %d readings per block", protocol.batchSize);
+            else
+                LOG_INFO("Encoding: JSON");
+            LOG_INFO("Sample interval: %lu ms", protocol.sampleInterval);
+            probe.commandOutput["encoding"] = protocol.encoding == Encoding::TimeSeries ? "timeseries" : "json";
+            probe.commandOutput["batch"] = protocol.batchSize;
+            probe.commandOutput["interval"] = protocol.sampleInterval;
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("outbox"), 1, [](Probe& probe, int argc, char** argv) {
+            Outbox& outbox = probe.sender.GetOutbox();
+            if (strcmp_P(argv[0], PSTR("drop-oldest")) == 0)
+                outbox.SetPolicy(OutboxPolicy::DropOldest);
+            else if (strcmp_P(argv[0], PSTR("latest")) == 0)
+                outbox.SetPolicy(OutboxPolicy::KeepLatest);
+            else if (strcmp_P(argv[0], PSTR("spill")) == 0)
+                outbox.SetPolicy(OutboxPolicy::Spill);
+            else
+                return ERR("outbox takes 1 argument: drop-oldest / latest / spill");
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("outbox-stats"), 0, [](Probe& probe, int argc, char** argv) {
+            Outbox& outbox = probe.sender.GetOutbox();
+            const OutboxStats& stats = outbox.GetStats();
+            LOG_INFO("Outbox: %d of %d queued, at most %d, longest wait %lu ms", outbox.GetDepth(), OUTBOX_SLOTS, stats.maxDepth, stats.maxWait);
+            LOG_INFO("Queued %lu, sent %lu, socket full on %lu passes", stats.queued, stats.sent, stats.blocked);
+            LOG_INFO("Dropped %lu (%lu expired), coalesced %lu, spilled %lu", stats.dropped, stats.expired, stats.coalesced, stats.spilled);
+            LOG_INFO("Refused %lu, %lu too long for a slot", stats.refused, stats.oversized);
+            probe.commandOutput["depth"] = outbox.GetDepth();
+            probe.commandOutput["max_wait"] = stats.maxWait;
+            probe.commandOutput["queued"] = stats.queued;
+            probe.commandOutput["sent"] = stats.sent;
+            probe.commandOutput["dropped"] = stats.dropped;
+            probe.commandOutput["spilled"] = stats.spilled;
+            probe.commandOutput["refused"] = stats.refused;
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("config"), 1, 3, [](Probe& probe, int argc, char** argv) {
+            bool isList = strcmp_P(argv[0], PSTR("list")) == 0;
+            bool isGet = strcmp_P(argv[0], PSTR("get")) == 0;
+            bool isSet = strcmp_P(argv[0], PSTR("set")) == 0;
+            bool isReset = strcmp_P(argv[0], PSTR("reset")) == 0;
+            if (!isList && !isGet && !isSet && !isReset)
+                return ERR("Expected list, get, set or reset");
+            if (isList && argc != 1)
+                return ERR("list takes no arguments");
+            if (isSet && argc != 3)
+                return ERR("set needs <name> <value>");
+            if ((isGet || isReset) && argc != 2)
+                return ERR("get and reset need <name>");
+
+            if (isList)
+            {
+                for (uint8_t i = 0; i < probe.config.GetCount(); i++)
+                    probe.PrintConfig((ConfigKey)i);
+                return OK;
+            }
+
+            auto key = probe.config.Find(argv[1]);
+            if (key.HasError())
+                return ERR("No such setting, see config list");
+
+            if (isGet)
+            {
+                const ConfigEntry& entry = probe.config.GetEntry(key.GetValue());
+                probe.PrintConfig(key.GetValue());
+                LOG_INFO("Default %lu, from %lu to %lu", (unsigned long)entry.defaultValue, (unsigned long)entry.min, (unsigned long)entry.max);
+                return OK;
+            }
+
+            if (!probe.IsConfigAllowed(key.GetValue()))
+                return COMMAND_ERROR(CommandErrorCode::NotAllowed);
+
+            if (isSet)
+            {
+                char* end;
+                unsigned long value = strtoul(argv[2], &end, 10);
+                if (*end != '\0' || probe.config.Set(key.GetValue(), value).HasError())
+                    return ERR("Value out of range, see config get <name>");
+            }
+            else
+                probe.config.Reset(key.GetValue());
+
+            probe.preferences.Save();
+            probe.ApplyConfig();
+            probe.PrintConfig(key.GetValue());
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("boot-stats"), 0, [](Probe& probe, int argc, char** argv) {
+            for (uint8_t i = 0; i < (uint8_t)BootPhase::Count; i++)
+            {
+                BootPhase phase = (BootPhase)i;
+                if (probe.bootTrace.IsReached(phase))
+                {
+                    LOG_INFO("%s: %lu ms", BootTrace::PhaseName(phase), probe.bootTrace.GetTime(phase));
+                    probe.commandOutput[BootTrace::PhaseName(phase)] = probe.bootTrace.GetTime(phase);
+                }
+                else
+                    LOG_INFO("%s: not yet", BootTrace::PhaseName(phase));
+            }
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("power"), 1, [](Probe& probe, int argc, char** argv) {
+            if (strcmp_P(argv[0], PSTR("on")) == 0)
+                probe.power.SetPolicy(PowerPolicy::AlwaysOn);
+            else if (strcmp_P(argv[0], PSTR("modem")) == 0)
+                probe.power.SetPolicy(PowerPolicy::ModemSleep);
+            else if (strcmp_P(argv[0], PSTR("auto")) == 0)
+                probe.power.SetPolicy(PowerPolicy::Auto);
+            else
+                return ERR("power takes 1 argument: on / modem / auto");
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("power-stats"), 0, [](Probe& probe, int argc, char** argv) {
+            PowerGovernor& power = probe.power;
+            LOG_INFO("Radio %s, listen interval %d, %lu mode changes", power.IsAsleep() ? "sleeping" : "awake", power.GetListenInterval(),
+                power.GetModeChanges());
+            LOG_INFO("Awake %lu ms, modem sleep %lu ms, light sleep %lu ms", power.GetTime(PowerState::Awake),
+                power.GetTime(PowerState::ModemSleep), power.GetTime(PowerState::LightSleep));
+            LOG_INFO("Estimated mean draw %lu uA", (unsigned long)power.GetMeanCurrent());
+            probe.commandOutput["asleep"] = power.IsAsleep();
+            probe.commandOutput["awake_ms"] = power.GetTime(PowerState::Awake);
+            probe.commandOutput["modem_sleep_ms"] = power.GetTime(PowerState::ModemSleep);
+            probe.commandOutput["light_sleep_ms"] = power.GetTime(PowerState::LightSleep);
+            probe.commandOutput["mean_ua"] = (unsigned long)power.GetMeanCurrent();
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("mesh"), 1, [](Probe& probe, int argc, char** argv) {
+            MeshSettings settings = probe.preferences.GetMeshSettings();
+            if (strcmp_P(argv[0], PSTR("off")) == 0)
+                settings.role = MeshRole::Off;
+            else if (strcmp_P(argv[0], PSTR("gateway")) == 0)
+                settings.role = MeshRole::Gateway;
+            else
+                return ERR("mesh takes off / gateway / leaf <MAC> <channel>");
+
+            probe.preferences.SetMeshSettings(settings);
+            probe.preferences.Save();
+            if (!probe.ApplyMeshSettings())
+                return ERR("Couldn't start the mesh, see the log");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("mesh"), 3, [](Probe& probe, int argc, char** argv) {
+            if (strcmp_P(argv[0], PSTR("leaf")) != 0)
+                return ERR("mesh takes off / gateway / leaf <MAC> <channel>");
+            MeshSettings settings = probe.preferences.GetMeshSettings();
+            settings.role = MeshRole::Leaf;
+            if (!MeshTransport::ParseMAC(argv[1], settings.gatewayMAC))
+                return ERR("MAC is six hex bytes, like 5c:cf:7f:01:02:03");
+
+            char* end;
+            unsigned long channel = strtoul(argv[2], &end, 10);
+            if (*end != '\0' || channel < 1 || channel > 13)
+                return ERR("Channel is 1 to 13, the same as the gateway's");
+            settings.channel = channel;
+            if (!probe.preferences.IsProbeUUIDSet())
+                return ERR("Set this probe's UUID first, see uuid-set");
+
+            probe.preferences.SetMeshSettings(settings);
+            probe.preferences.Save();
+            if (!probe.ApplyMeshSettings())
+                return ERR("Couldn't start the mesh, see the log");
+            return OK;
+        }));
+
+        // The key is serial only and never printed
+        AddCommand(Command<Probe>(PSTR("mesh"), 2, [](Probe& probe, int argc, char** argv) {
+            MeshSettings settings = probe.preferences.GetMeshSettings();
+            if (strcmp_P(argv[0], PSTR("key")) == 0)
+            {
+                settings.hasKey = strcmp_P(argv[1], PSTR("off")) != 0;
+                if (settings.hasKey && !MeshTransport::ParseKey(argv[1], settings.key))
+                    return ERR("Key is 32 hex digits, the same on every probe");
+            }
+            else
+            {
+                uint8_t mac[MESH_MAC_SIZE];
+                bool isAllow = strcmp_P(argv[0], PSTR("allow")) == 0;
+                if (!isAllow && strcmp_P(argv[0], PSTR("deny")) != 0)
+                    return ERR("mesh takes allow / deny <MAC> or key <hex>");
+                if (!MeshTransport::ParseMAC(argv[1], mac))
+                    return ERR("MAC is six hex bytes, like 5c:cf:7f:01:02:03");
+                if (!isAllow)
+                    settings.Deny(mac);
+                else if (!settings.Allow(mac))
+                    return ERR("No room for another leaf, deny one first");
+            }
+
+            probe.preferences.SetMeshSettings(settings);
+            probe.preferences.Save();
+            if (!probe.ApplyMeshSettings())
+                return ERR("Couldn't start the mesh, see the log");
+            return OK;
+        }));
+
+        AddCommand(Command<Probe>(PSTR("mesh-stats"), 0, [](Probe& probe, int argc, char** argv) {
+            char mac[18];
+            uint8_t address[MESH_MAC_SIZE];
+            probe.platform.mesh.GetMAC(address);
+            MeshTransport::FormatMAC(address, mac);
+            LOG_INFO("Mesh %s, MAC %s, channel %d, %lu frames lost", MeshRoleName(probe.meshRole), mac, probe.platform.mesh.GetChannel(),
+                probe.platform.mesh.GetOverflows());
+            LOG_INFO("Frames %s", probe.preferences.GetMeshSettings().hasKey ? "encrypted" : "in the clear");
+            probe.commandOutput["role"] = MeshRoleName(probe.meshRole);
+            probe.commandOutput["lost"] = probe.platform.mesh.GetOverflows();
+
+            if (probe.meshRole == MeshRole::Leaf)
+            {
+                const MeshLeafStats& stats = probe.leaf.GetStats();
+                MeshTransport::FormatMAC(probe.leaf.GetGateway(), mac);
+                LOG_INFO("Gateway %s, %s", mac, probe.leaf.IsGatewayReachable() ? "reachable" : "not answering");
+                LOG_INFO("Sent %lu, delivered %lu, missed %lu, refused %lu", stats.sent, stats.delivered, stats.missed, stats.refused);
+                probe.commandOutput["reachable"] = probe.leaf.IsGatewayReachable();
+                probe.commandOutput["sent"] = stats.sent;
+                probe.commandOutput["delivered"] = stats.delivered;
+                probe.commandOutput["missed"] = stats.missed;
+            }
+            else if (probe.meshRole == MeshRole::Gateway)
+            {
+                const MeshGatewayStats& stats = probe.gateway.GetStats();
+                LOG_INFO("%u of %u allowed leaves heard, %u readings waiting", probe.gateway.GetLeafCount(),
+                    probe.gateway.GetAllowedCount(), probe.gateway.GetPendingCount());
+                LOG_INFO("Received %lu, relayed %lu in %lu messages", stats.received, stats.relayed, stats.batches);
+                LOG_INFO("Duplicates %lu, invalid %lu, strangers %lu, dropped %lu", stats.duplicates, stats.invalid, stats.strangers, stats.dropped);
+                probe.commandOutput["leaves"] = probe.gateway.GetLeafCount();
+                probe.commandOutput["allowed"] = probe.gateway.GetAllowedCount();
+                probe.commandOutput["pending"] = probe.gateway.GetPendingCount();
+                probe.commandOutput["received"] = stats.received;
+                probe.commandOutput["relayed"] = stats.relayed;
+                probe.commandOutput["strangers"] = stats.strangers;
+                probe.commandOutput["dropped"] = stats.dropped;
+                for (unsigned int i = 0; i < probe.gateway.GetLeafCount(); i++)
+                {
+                    const MeshLeafEntry& entry = probe.gateway.GetLeaf(i);
+                    MeshTransport::FormatMAC(entry.mac, mac);
+                    LOG_INFO("%s (%s): %lu readings, last %lu ms ago", entry.uuid, mac, entry.received, millis() - entry.lastSeen);
+                }
+            }
+            return OK;
+        }, CommandAccess::Remote));
+
+        AddCommand(Command<Probe>(PSTR("server-autoconnect"), 1, [](Probe& probe, int argc, char** argv) {
+            if (strcmp_P(argv[0], PSTR("on")) == 0)
+                probe.preferences.SetAutoConnectToServer(true);
+            else if (strcmp_P(argv[0], PSTR("off")) == 0)
+                probe.preferences.SetAutoConnectToServer(false);
+            else
+                return ERR("server-autoconnect takes 1 argument: on / off");
+
+            probe.preferences.Save();
+            return OK;
+        }));
+    }
+
+    static void PrintSensorHealth(const char* name, const SensorHealth& health)
+    {
+        LOG_INFO("%s: %lu reads, %lu timeouts, %lu checksum errors", name, health.reads, health.timeouts, health.checksumErrors);
+        LOG_INFO("%s: %lu out of range, %lu times stuck, %d failing in a row", name, health.outOfRange, health.stuck, health.consecutiveFailures);
+    }
+
+    void HandleServerMessage(const char* message, size_t length)
+    {
+        StaticJsonDocument<SERVER_MESSAGE_JSON_SIZE> json;
+        if (deserializeJson(json, message, length))
+        {
+            LOG_WARN("Ignoring malformed server message");
+            return;
+        }
+
+        const char* type = json["type"] | "";
+        if (strcmp_P(type, PSTR("ota")) == 0)
+        {
+            if (!IsServerVerified())
+            {
+                LOG_WARN("Ignoring a pushed update, it needs tls and tls-pin");
+                return;
+            }
+
+            auto update = OTAUpdater::ParseManifest(json.as<JsonObjectConst>()).AndThen([this](const FirmwareManifest& manifest) {
+                return ota.Start(manifest);
+            });
+            if (update.HasError() && update.GetError() != OTAError::AlreadyInstalled)
+                LOG_ERROR("Server requested an update, but it couldn't start (error %d)", update.GetError());
+        }
+        else if (strcmp_P(type, PSTR("hello")) == 0)
+        {
+            if (!sender.ApplyHello(json.as<JsonObjectConst>()))
+                LOG_WARN("Server asked for a protocol this probe can't do, staying on what it had");
+        }
+        else if (strcmp_P(type, PSTR("command")) == 0)
+        {
+            const char* id = json["id"] | "";
+            const char* line = json["line"] | "";
+            if (remoteCommands.Push(id, line))
+                return;
+
+            // Answered straight away, so the server can retry instead of waiting for a timeout
+            RemoteCommand refused = {};
+            strncpy(refused.id, id, sizeof(refused.id) - 1);
+            refused.isDone = true;
+            if (remoteCommands.GetCount() == REMOTE_COMMAND_SLOTS)
+                refused.error = CommandError { CommandErrorCode::Busy, nullptr, 0, 0 };
+            else
+                refused.error = CommandError { CommandErrorCode::Failed, PSTR("Id or command too long"), 0, 0 };
+            if (!sender.SendCommandResult(refused))
+                LOG_WARN("Dropped a command from the server, and couldn't say so");
+        }
+    }
+
+    // The server can't change what could cut the probe off from it
+    bool IsConfigAllowed(ConfigKey key)
+    {
+        return commandSource == CommandSource::Serial || config.GetEntry(key).isRemote;
+    }
+
+    // The image and its hash come from the server, so only a server the probe has verified may start an
+    // update. Someone at the serial port can always.
+    bool IsServerVerified()
+    {
+        TLSSettings settings = preferences.GetTLSSettings();
+        return settings.isEnabled && settings.isPinned;
+    }
+
+    // Runs one command from the server per pass, the same way as one typed in, and keeps its result
+    // until the Sender takes it
+    void HandleRemoteCommands()
+    {
+        RemoteCommand* command = remoteCommands.Peek();
+        if (command == nullptr)
+            return;
+
+        if (!command->isDone)
+        {
+            commandSource = CommandSource::Server;
+            commandOutput = remoteCommands.BeginOutput();
+            auto result = commandExecutor.ExecuteCommand(*this, command->line, CommandSource::Server);
+            commandOutput = JsonObject();
+            commandSource = CommandSource::Serial;
+
+            command->isDone = true;
+            command->isOk = result.HasValue();
+            if (result.HasError())
+                command->error = result.GetError();
+            command->took = millis() - command->receivedAt;
+
+            if (command->isOk)
+                LOG_INFO("Server ran: %s", command->line);
+            else
+                LOG_WARN("Server ran: %s, which failed", command->line);
+        }
+
+        if (sender.SendCommandResult(*command))
+            remoteCommands.Pop();
+    }
+
+    // Takes everything that has arrived, since Idle() can leave a pass waiting, but runs at most one
+    // command per pass
+    void HandleCommands()
+    {
+        Stream& serial = platform.serial;
+        while (serial.available() > 0)
+        {
+            char receivedChar = serial.read();
+
+            if (receivedChar == '\r') continue;   // Ignore carriage return
+
+            if (receivedChar == '\x08')     // Backspace
+            {
+                if (commandBufferIndex > 0) commandBufferIndex--;
+            }
+            else if (receivedChar != '\n')  // Any character
+            {
+                if (commandBufferIndex < COMMAND_BUFFER_SIZE - 1) commandBuffer[commandBufferIndex++] = receivedChar;
+            }
+            else    // Enter
+            {
+                commandBuffer[commandBufferIndex] = '\0';
+
+                auto result = commandExecutor.ExecuteCommand(*this, commandBuffer);
+                if (result.HasError())
+                {
+                    char error[64];
+                    result.GetError().Describe(error, sizeof(error));
+                    LOG_ERROR("Error: %s", error);
+                }
+                else
+                    LOG_INFO("OK");
+
+                commandBufferIndex = 0;
+                break;
+            }
+        }
+    }
+
+    // Once the server has been set up, readings that can't go out are kept in the history, which drains
+    // one block per pass when they can. If the server picked time series, every reading goes into the
+    // history and a block goes out once it holds a batch.
+    void SendReadings()
+    {
+        bool isOnline = wifiManager.IsConnected() && sender.IsReady();
+        const ProtocolSettings& protocol = sender.GetProtocol();
+        bool isBatched = protocol.encoding == Encoding::TimeSeries;
+
+        size_t length = 0;
+        const uint8_t* block = history.PeekBlock(length);
+        bool isBatchReady = !isBatched || history.GetBlockCount() > 1 || history.GetPendingSamples() >= protocol.batchSize;
+        if (isOnline && block != nullptr && isBatchReady && sender.IsConnected() && sender.SendHistory(block, length))
+        {
+            history.PopBlock();
+            bootTrace.Mark(BootPhase::FirstSample);
+        }
+
+        if (IsSampleDue())
+        {
+            auto readings = sensors.GetReadings();
+            if (readings.HasValue() && !readings.GetValue().IsAnyUsable())
+            {
+                suppressedSamples++;
+                MarkSampled();
+            }
+            else if (readings.HasValue())
+            {
+                if (isOnline && !isBatched && sender.SendMessage(readings.GetValue()))
+                    bootTrace.Mark(BootPhase::FirstSample);
+                else if (sender.IsReady() || preferences.GetAutoConnectToServer())    // Kept while the probe boots
+                    history.Add(readings.GetValue());
+                MarkSampled();
+            }
+        }
+    }
+
+    bool IsSampleDue() { return !hasSampled || millis() - lastUpdateTime > sender.GetProtocol().sampleInterval; }
+
+    void MarkSampled()
+    {
+        hasSampled = true;
+        lastUpdateTime = millis();
+    }
+
+    // Samples keep going into the window while the server is unreachable; only the summary waits for it
+    void AggregateReadings()
+    {
+        if (IsSampleDue())
+        {
+            auto readings = sensors.GetReadings();
+            if (readings.HasValue())
+            {
+                if (!readings.GetValue().IsAnyUsable())
+                    suppressedSamples++;
+                aggregator.Add(readings.GetValue());
+                MarkSampled();
+            }
+        }
+
+        aggregator.Update();
+
+        if (aggregator.HasSummary() && wifiManager.IsConnected() && sender.IsReady())
+        {
+            if (sender.SendSummary(aggregator.GetSummary()))
+            {
+                aggregator.ClearSummary();
+                bootTrace.Mark(BootPhase::FirstSample);
+            }
+        }
+    }
+
+    // A leaf has nowhere to keep what the gateway didn't take, so that's only counted
+    void SendToGateway()
+    {
+        if (!IsSampleDue())
+            return;
+
+        auto readings = sensors.GetReadings();
+        if (!readings.HasValue())
+            return;
+
+        if (!readings.GetValue().IsAnyUsable())
+            suppressedSamples++;
+        else if (leaf.Send(readings.GetValue()))
+            bootTrace.Mark(BootPhase::FirstSample);
+        MarkSampled();
+    }
+
+    // One upstream message per pass, once the gateway's own connection is up
+    void RelayLeafReadings()
+    {
+        MeshRelayBatch batch;
+        if (sender.IsConnected() && gateway.PeekBatch(batch) && sender.SendRelay(batch))
+            gateway.PopBatch(batch);
+    }
+
+    // Alerts skip the aggregation and history: checked on every new reading, sent as soon as they change
+    void UpdateAlerts()
+    {
+        if (sensors.GetUpdateCount() != lastAlertUpdateCount)
+        {
+            lastAlertUpdateCount = sensors.GetUpdateCount();
+            auto readings = sensors.GetReadings();
+            if (readings.HasValue())
+                alerts.Evaluate(readings.GetValue());
+        }
+
+        AlertEvent event;
+        while (wifiManager.IsConnected() && sender.IsConnected() && alerts.GetUnsent(event))
+        {
+            if (!sender.SendAlert(event))
+                break;
+            alerts.MarkSent(event.index);
+        }
+    }
+
+    LinkReport GetLinkReport()
+    {
+        return LinkReport {
+            millis(),
+            &signal,
+            &sender.GetRoundTrip(),
+            sender.GetConnectCount(),
+            wifiManager.GetConnectCount(),
+            wifiManager.GetTimeInState(WiFiManagerState::Disconnected),
+            wifiManager.GetTimeInState(WiFiManagerState::Connecting),
+            wifiManager.GetTimeInState(WiFiManagerState::Connected),
+            history.GetPendingSamples(),
+            power.GetTime(PowerState::Awake),
+            power.GetTime(PowerState::ModemSleep),
+            power.GetTime(PowerState::LightSleep),
+            power.GetMeanCurrent()
+        };
+    }
+
+    // A few hundred bytes every few minutes, next to a reading every couple of seconds
+    void UpdateLinkTelemetry()
+    {
+        if (wifiManager.IsConnected() && millis() - lastSignalTime >= LINK_SIGNAL_INTERVAL)
+        {
+            signal.Add(wifiManager.GetRSSI());
+            lastSignalTime = millis();
+        }
+
+        if (millis() - lastLinkReportTime >= linkReportInterval && sender.IsConnected())
+        {
+            if (sender.SendLinkReport(GetLinkReport()))
+            {
+                signal.ResetPeriod();
+                sender.GetRoundTrip().ResetPeriod();
+            }
+            lastLinkReportTime = millis();
+        }
+    }
+
+    static unsigned long TimeUntil(unsigned long time)
+    {
+        long left = (long)(time - millis());
+        return left > 0 ? left : 0;
+    }
+
+    unsigned long GetTimeToNextSend()
+    {
+        unsigned long untilSample = hasSampled ? TimeUntil(lastUpdateTime + sender.GetProtocol().sampleInterval) : 0;
+        unsigned long untilReport = TimeUntil(lastLinkReportTime + linkReportInterval);
+        return min(min(untilSample, untilReport), sender.GetTimeToNextPing());
+    }
+
+    // The radio stays up while the probe connects, finds the server, updates or has anything in flight.
+    // A gateway never sleeps, or it would miss its leaves.
+    void UpdatePower()
+    {
+        bool isBusy = !wifiManager.IsConnected() || (preferences.GetAutoConnectToServer() && !autoSet) || sender.IsBusy() ||
+            !remoteCommands.IsEmpty() || ota.IsBusy() || meshRole == MeshRole::Gateway;
+        power.SetCycle(sender.GetProtocol().sampleInterval);
+        power.Update(isBusy, GetTimeToNextSend());
+    }
+
+    // Hands the settings to whatever uses them, at boot and after every change
+    void ApplyConfig()
+    {
+        sender.SetDefaultInterval(config.Get(ConfigKey::SampleInterval));
+        sender.SetPingInterval(config.Get(ConfigKey::PingInterval));
+        sensors.SetSoilLightInterval(config.Get(ConfigKey::SoilLightInterval));
+        wifiManager.SetConnectTimeout(config.Get(ConfigKey::WiFiConnectTimeout));
+        wifiManager.SetUpdateInterval(config.Get(ConfigKey::WiFiUpdateInterval));
+        http.SetPort(config.Get(ConfigKey::ApiPort));
+        ota.SetPort(config.Get(ConfigKey::ApiPort));
+        transport.SetSecurePort(config.Get(ConfigKey::TLSPort));
+        linkReportInterval = config.Get(ConfigKey::LinkReportInterval);
+
+        bool isPortChanged = sender.SetPort(config.Get(ConfigKey::WebSocketPort));
+        if (sender.SetSecurePort(config.Get(ConfigKey::TLSPort)) || isPortChanged)
+            ReconnectToServer();
+    }
+
+    void PrintConfig(ConfigKey key)
+    {
+        const ConfigEntry& entry = config.GetEntry(key);
+        commandOutput[FPSTR(entry.name)] = (unsigned long)config.Get(key);
+        if (config.IsSet(key))
+            LOG_INFO("%s = %lu%s", FPSTR(entry.name), (unsigned long)config.Get(key), FPSTR(entry.unit));
+        else
+            LOG_INFO("%s = %lu%s (default)", FPSTR(entry.name), (unsigned long)config.Get(key), FPSTR(entry.unit));
+    }
+
+    // Takes the probe into or out of the mesh, at boot and after a mesh command. A leaf leaves the WiFi
+    // and stays off it.
+    bool ApplyMeshSettings()
+    {
+        MeshSettings settings = preferences.GetMeshSettings();
+        platform.mesh.End();
+        meshRole = MeshRole::Off;
+
+        if (settings.role == MeshRole::Leaf)
+        {
+            auto uuid = preferences.GetProbeUUID();
+            if (uuid.HasError() || !leaf.Begin(settings.gatewayMAC, uuid.GetValue()))
+            {
+                LOG_ERROR("A leaf needs the UUID the server gave this probe, see uuid-set");
+                return false;
+            }
+            wifiManager.Disconnect();
+        }
+
+        platform.mesh.SetKey(settings.hasKey ? settings.key : nullptr);
+        if (settings.role != MeshRole::Off && !platform.mesh.Begin(settings.role == MeshRole::Leaf ? settings.channel : 0))
+        {
+            LOG_ERROR("The radio wouldn't start ESP-NOW");
+            return false;
+        }
+
+        if (settings.role == MeshRole::Gateway)
+        {
+            gateway.SetAllowed(settings.allowed, settings.allowedCount);
+            for (unsigned int i = 0; i < gateway.GetAllowedCount(); i++)
+            {
+                if (!platform.mesh.AddPeer(settings.allowed[i]))
+                    LOG_WARN("Couldn't add leaf %d as a peer", i);
+            }
+            if (gateway.GetAllowedCount() == 0)
+                LOG_WARN("No leaves allowed yet, see mesh allow");
+        }
+
+        meshRole = settings.role;
+        if (meshRole != MeshRole::Off)
+            LOG_INFO("Mesh %s on channel %d", MeshRoleName(meshRole), platform.mesh.GetChannel());
+        return true;
+    }
+
+    // The WebSocket picks up transport changes on a fresh Begin()
+    void ReconnectToServer()
+    {
+        if (sender.IsReady())
+            sender.Begin();
+    }
+
+    // One step per pass: a discovery request, a UUID request or the Begin(). Sampling, commands and the
+    // WiFi carry on between them, and a step that failed waits SERVER_RETRY_INTERVAL before the next try.
+    void ConnectToServer()
+    {
+        if (autoSet || !wifiManager.IsConnected())
+            return;
+        if (isServerRetryPending && millis() - lastServerFailureTime < SERVER_RETRY_INTERVAL)
+            return;
+        isServerRetryPending = false;
+
+        auto storedIP = preferences.GetServerIP();
+        if (storedIP.HasError())
+        {
+            if (!http.IsDiscovering())
+                LOG_INFO("Looking for plant-server in this subnet. This could take a while.");
+            auto server = http.FindServer(wifiManager.GetLocalIP());
+
+            if (server.HasError() && server.GetError() == HTTPError::InProgress)
+                return;
+
+            if (server.HasError())
+            {
+                LOG_ERROR("Could not find plant-server in this subnet. Is the server running and connected to the network?");
+                DeferServerRetry();
+            }
+            else
+            {
+                preferences.SetServerIP(server.GetValue().ip);
+                preferences.Save();
+            }
+            return;
+        }
+
+        auto storedUUID = preferences.GetProbeUUID();
+        if (storedUUID.HasError())
+        {
+            bootTrace.Mark(BootPhase::ServerFound);
+            LOG_INFO("Requesting probe UUID from server...");
+            auto uuid = http.RequestUUID();
+
+            if (uuid.HasError())
+            {
+                LOG_ERROR("Could not request UUID (error %d). Is the server running and connected to the network?", uuid.GetError());
+                DeferServerRetry();
+            }
+            else
+            {
+                preferences.SetProbeUUID(uuid.GetValue().uuid);
+                preferences.Save();
+            }
+            return;
+        }
+
+        LOG_INFO("Using stored IP: %s", storedIP.GetValue());
+        LOG_INFO("Using stored UUID: %s", storedUUID.GetValue());
+        sender.SetIP(storedIP.GetValue());
+        sender.SetUUID(storedUUID.GetValue());
+        bootTrace.Mark(BootPhase::ServerFound);
+        bootTrace.Mark(BootPhase::UUIDReady);
+
+        if (!sender.IsReadyToBegin())
+            return;
+        sender.Begin();
+        autoSet = true;
+    }
+
+    void DeferServerRetry()
+    {
+        isServerRetryPending = true;
+        lastServerFailureTime = millis();
+    }
+
+    // Marks the phases that are states rather than events, and reports the boot once the first sample
+    // is on its way
+    void TraceBoot()
+    {
+        if (sensors.GetReadings().HasValue())
+            bootTrace.Mark(BootPhase::SensorsReady);
+        if (wifiManager.IsConnected())
+            bootTrace.Mark(BootPhase::WiFiConnected);
+        if (sender.IsConnected())
+            bootTrace.Mark(BootPhase::WebSocketConnected);
+
+        // A leaf has no connection of its own to report it over
+        bool canReport = bootTrace.IsReached(BootPhase::FirstSample) && sender.IsConnected();
+        if (!isBootReported && canReport && sender.SendBootReport(bootTrace))
+        {
+            isBootReported = true;
+            LOG_INFO("First sample queued %lu ms after boot, see boot-stats", bootTrace.GetTime(BootPhase::FirstSample));
+        }
+    }
+
+public:
+    Probe(const ProbePlatform& platform, int dhtPin, int sdaPin, int sclPin)
+        : platform(platform),
+          preferences(platform.eeprom),
+          config(preferences, configEntries, (uint8_t)ConfigKey::Count),
+          wifiManager(platform.wifi, preferences),
+          transport(preferences),
+          sender(preferences),
+          http(preferences, transport),
+          sensors(dhtPin, sdaPin, sclPin),
+          alerts(preferences),
+          ota(preferences, transport),
+          power(platform.wifi),
+          leaf(platform.mesh)
+    {
+        AddBuiltInCommands();
+        sender.SetMessageHandler([this](const char* message, size_t length) {
+            HandleServerMessage(message, length);
+        });
+        sender.GetOutbox().SetSpillHandler([this](const SensorReadings& readings) {
+            history.Add(readings);
+        });
+        platform.mesh.SetReceiveHandler([this](const uint8_t* mac, const uint8_t* data, size_t length) {
+            if (meshRole == MeshRole::Gateway)
+                gateway.Receive(mac, data, length);
+        });
+        platform.mesh.SetSentHandler([this](const uint8_t* mac, bool isDelivered) {
+            if (meshRole == MeshRole::Leaf)
+                leaf.OnSent(mac, isDelivered);
+        });
+    }
+
+    Probe(const Probe&) = delete;
+    Probe& operator=(const Probe&) = delete;
+
+    void AddCommand(Command<Probe>&& command)
+    {
+        commandExecutor.AddCommand(std::move(command));
+    }
+
+    const BootTrace& GetBootTrace() { return bootTrace; }
+
+    void Begin()
+    {
+        bootTrace.Begin();
+        LOG_INFO("Starting firmware %s!", FIRMWARE_VERSION);
+        if (preferences.Load().HasError())
+            LOG_WARN("No stored preferences, using defaults");
+
+        ApplyConfig();
+        sensors.Begin();
+        unsigned long window = preferences.GetAggregationWindow();
+        aggregator.SetWindowLength(WindowedAggregator::IsValidWindow(window) ? window : 0);
+        ota.Begin();
+        power.Begin();
+        ApplyMeshSettings();
+
+        if (!preferences.AreWiFiCredentialsSet())
+            LOG_WARN("No stored WiFi credentials");
+
+        if (!preferences.IsServerIPSet())
+            LOG_WARN("No stored server IP");
+
+        if (!preferences.IsProbeUUIDSet())
+            LOG_WARN("No stored probe UUID");
+    }
+
+    void Update()
+    {
+        bool isLeaf = meshRole == MeshRole::Leaf;
+        if (!isLeaf && preferences.GetAutoConnectToWiFi() && wifiManager.IsDisconnected())
+            wifiManager.Connect();
+
+        if (!isLeaf && preferences.GetAutoConnectToServer())
+            ConnectToServer();
+
+        sender.Update();
+        HandleCommands();
+        HandleRemoteCommands();
+
+        wifiManager.Update();
+        if (meshRole != MeshRole::Off)
+            platform.mesh.Update();
+
+        // The next reading is due one sample interval after the last, so that's when the sensors are read
+        if (isSamplingOnDemand)
+            sensors.RequestBy(lastUpdateTime + sender.GetProtocol().sampleInterval, SAMPLE_MAX_AGE);
+        sensors.Update();
+        TraceBoot();
+        UpdateAlerts();
+        if (sender.IsConnected())
+            ota.MarkServerReachable();
+        if (sender.HasServerAnswered())
+            ota.ConfirmBoot();
+        ota.Update();
+        UpdateLinkTelemetry();
+
+        if (isLeaf)
+            SendToGateway();
+        else if (aggregator.IsEnabled())
+            AggregateReadings();
+        else
+            SendReadings();
+
+        if (meshRole == MeshRole::Gateway)
+        {
+            gateway.Expire();
+            RelayLeafReadings();
+        }
+
+        UpdatePower();
+    }
+
+    // Lets the chip sleep until shortly before the next sample, ping or report, if nothing is in flight
+    void Idle()
+    {
+        unsigned long untilNextSend = GetTimeToNextSend();
+        power.Idle(untilNextSend > IDLE_WAKE_LEAD ? untilNextSend - IDLE_WAKE_LEAD : 0);
+    }
+};
+
+#endif
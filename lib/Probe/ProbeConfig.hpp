@@ -0,0 +1,57 @@
+#ifndef PROBE_CONFIG_HPP
+#define PROBE_CONFIG_HPP
+
+#include <ConfigRegistry.hpp>
+#include <SoilLightReader.hpp>
+#include <WiFiManager.hpp>
+#include <MyHTTPClient.hpp>
+#include <Sender.hpp>
+
+#define LINK_REPORT_INTERVAL 300000
+
+// The position of a setting is where its value is saved: add new ones at the end, never reorder
+enum class ConfigKey : uint8_t
+{
+    SampleInterval,
+    SoilLightInterval,
+    WiFiConnectTimeout,
+    WiFiUpdateInterval,
+    ApiPort,
+    WebSocketPort,
+    PingInterval,
+    LinkReportInterval,
+    TLSPort,
+    Count
+};
+
+// Names and units stay in flash; the table itself is defined once for the whole program
+inline constexpr char configUnitNone[] PROGMEM = "";
+inline constexpr char configUnitMs[] PROGMEM = " ms";
+
+inline constexpr char configSampleInterval[] PROGMEM = "sample-interval";
+inline constexpr char configSoilLightInterval[] PROGMEM = "soil-light-interval";
+inline constexpr char configWiFiConnectTimeout[] PROGMEM = "wifi-connect-timeout";
+inline constexpr char configWiFiUpdateInterval[] PROGMEM = "wifi-update-interval";
+inline constexpr char configApiPort[] PROGMEM = "api-port";
+inline constexpr char configWebSocketPort[] PROGMEM = "ws-port";
+inline constexpr char configPingInterval[] PROGMEM = "ping-interval";
+inline constexpr char configLinkReportInterval[] PROGMEM = "link-report-interval";
+inline constexpr char configTLSPort[] PROGMEM = "tls-port";
+
+inline constexpr ConfigEntry configEntries[] =
+{
+    { configSampleInterval, configUnitMs, PROTOCOL_MIN_INTERVAL, PROTOCOL_MAX_INTERVAL, PROTOCOL_DEFAULT_INTERVAL, true },   // The server's hello reply wins
+    { configSoilLightInterval, configUnitMs, 50, 60000, SOIL_LIGHT_UPDATE_INTERVAL, true },                               // Only while sampling free-runs
+    { configWiFiConnectTimeout, configUnitMs, 5000, 120000, WIFI_CONNECT_TIMEOUT, false },
+    { configWiFiUpdateInterval, configUnitMs, 10, 5000, WIFI_UPDATE_INTERVAL, false },
+    { configApiPort, configUnitNone, 1, 65535, API_PORT, false },
+    { configWebSocketPort, configUnitNone, 1, 65535, WEBSOCKET_PORT, false },
+    { configPingInterval, configUnitMs, 1000, 600000, SENDER_PING_INTERVAL, true },
+    { configLinkReportInterval, configUnitMs, 10000, 86400000, LINK_REPORT_INTERVAL, true },
+    { configTLSPort, configUnitNone, 1, 65535, SECURE_TRANSPORT_PORT, false }               // HTTPS and the WebSocket, with tls on
+};
+
+static_assert(sizeof(configEntries) / sizeof(configEntries[0]) == (size_t)ConfigKey::Count, "Every ConfigKey needs an entry");
+static_assert((size_t)ConfigKey::Count <= CONFIG_MAX_VALUES, "The overlay in Preferences is full");
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef SECURE_TRANSPORT_HPP
+#define SECURE_TRANSPORT_HPP
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+
+#include <Logger.hpp>
+#include <Preferences.hpp>
+#include <TLSSettings.hpp>
+
+#define SECURE_TRANSPORT_PORT 8443              // Where the TLS terminator in front of the plant server usually is
+#define SECURE_TRANSPORT_FRAGMENT_LENGTH 512
+#define SECURE_TRANSPORT_MAX_RECORD 16384       // What the server may send when it can't do smaller fragments
+#define SECURE_TRANSPORT_HOST_SIZE 32
+
+struct HandshakeStats
+{
+    unsigned long count = 0;
+    unsigned long totalTime = 0;
+    unsigned long maxTime = 0;
+    unsigned long maxHeap = 0;      // Heap the connection was holding once it was up
+
+    void Add(unsigned long time, unsigned long heap)
+    {
+        count++;
+        totalTime += time;
+        maxTime = max(maxTime, time);
+        maxHeap = max(maxHeap, heap);
+    }
+
+    unsigned long GetAverageTime() const { return count == 0 ? 0 : totalTime / count; }
+};
+
+// A TLS client that times every handshake. Prepare() before each connect keeps the session of the
+// last server it reached, so reconnects resume it instead of repeating the key exchange, and shrinks
+// the receive buffer to 512 bytes once that server has shown it can do max fragment length
+// negotiation.
+class MeasuredSecureClient : public BearSSL::WiFiClientSecure
+{
+private:
+    BearSSL::Session session;
+    char host[SECURE_TRANSPORT_HOST_SIZE] = "";     // The server the session and the probe result belong to
+    uint16_t port = 0;
+    bool isFragmentLengthProbed = false;
+    bool isFragmentLengthSupported = false;
+
+    void SelectServer(const char* newHost, uint16_t newPort)
+    {
+        if (strcmp(host, newHost) == 0 && port == newPort)
+            return;
+
+        strncpy(host, newHost, sizeof(host) - 1);
+        host[sizeof(host) - 1] = '\0';
+        port = newPort;
+        session = BearSSL::Session();
+        hasSession = false;
+        isFragmentLengthProbed = false;
+        isFragmentLengthSupported = false;
+    }
+
+public:
+    HandshakeStats full;
+    HandshakeStats resumed;     // A session was offered; the times show whether the server took it
+    unsigned long failures = 0;
+    bool hasSession = false;
+
+    using BearSSL::WiFiClientSecure::connect;
+
+    // fingerprint nullptr doesn't check the server
+    void Prepare(const char* server, uint16_t serverPort, const uint8_t* fingerprint)
+    {
+        SelectServer(server, serverPort);
+
+        if (fingerprint != nullptr)
+            setFingerprint(fingerprint);
+        else
+            setInsecure();
+
+        // Only once the server has answered, so discovery doesn't pay for a probe on every address
+        if (hasSession && !isFragmentLengthProbed)
+        {
+            isFragmentLengthProbed = true;
+            isFragmentLengthSupported = probeMaxFragmentLength(server, serverPort, SECURE_TRANSPORT_FRAGMENT_LENGTH);
+            if (!isFragmentLengthSupported)
+                LOG_WARN("%s can't do max fragment length, TLS keeps a 16 KB receive buffer", server);
+        }
+
+        setBufferSizes(isFragmentLengthSupported ? SECURE_TRANSPORT_FRAGMENT_LENGTH : SECURE_TRANSPORT_MAX_RECORD,
+            SECURE_TRANSPORT_FRAGMENT_LENGTH);
+        setSession(&session);
+    }
+
+    int connect(const char* host, uint16_t port) override
+    {
+        uint32_t freeHeap = ESP.getFreeHeap();
+        unsigned long start = millis();
+        int result = BearSSL::WiFiClientSecure::connect(host, port);
+        unsigned long time = millis() - start;
+
+        if (!result)
+        {
+            failures++;
+            return result;
+        }
+
+        uint32_t freeHeapAfter = ESP.getFreeHeap();
+        (hasSession ? resumed : full).Add(time, freeHeap > freeHeapAfter ? freeHeap - freeHeapAfter : 0);
+        hasSession = true;
+        return result;
+    }
+
+    void PrintStats()
+    {
+        LOG_INFO("Full handshakes: %lu, mean %lu ms, max %lu ms, %lu B heap", full.count, full.GetAverageTime(), full.maxTime, full.maxHeap);
+        LOG_INFO("Resumed: %lu, mean %lu ms, max %lu ms, %lu B heap", resumed.count, resumed.GetAverageTime(), resumed.maxTime, resumed.maxHeap);
+        LOG_INFO("Failed connects: %lu", failures);
+        if (isFragmentLengthProbed)
+            LOG_INFO("Max fragment length: %s", isFragmentLengthSupported ? "512 B" : "not supported");
+    }
+};
+
+// Picks the client and URL for HTTP requests to the plant server. One request at a time:
+// MyHTTPClient and OTAUpdater share it.
+class SecureTransport
+{
+private:
+    PreferencesManager& preferences;
+    WiFiClient plainClient;
+    MeasuredSecureClient secureClient;
+    uint16_t securePort = SECURE_TRANSPORT_PORT;
+
+public:
+    SecureTransport(PreferencesManager& preferences) : preferences(preferences)
+    {
+
+    }
+
+    // Writes the URL for path on the server and returns the client to begin() the request with.
+    // plainPort is where the server takes plain HTTP.
+    WiFiClient& BeginRequest(char* url, size_t size, const char* server, uint16_t plainPort, const char* path)
+    {
+        TLSSettings settings = preferences.GetTLSSettings();
+        if (!settings.isEnabled)
+        {
+            snprintf_P(url, size, PSTR("http://%s:%d%s"), server, plainPort, path);
+            return plainClient;
+        }
+
+        snprintf_P(url, size, PSTR("https://%s:%d%s"), server, securePort, path);
+        secureClient.Prepare(server, securePort, settings.isPinned ? settings.fingerprint : nullptr);
+        return secureClient;
+    }
+
+    void SetSecurePort(uint16_t newPort) { securePort = newPort; }
+
+    // 40 hex digits, optionally split into pairs by colons like browsers and openssl print them
+    static bool ParseFingerprint(const char* text, uint8_t (&fingerprint)[TLS_FINGERPRINT_SIZE])
+    {
+        size_t digits = 0;
+        for (; *text != '\0'; text++)
+        {
+            char c = *text;
+            if (c == ':')
+                continue;
+
+            uint8_t nibble;
+            if (c >= '0' && c <= '9') nibble = c - '0';
+            else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+            else return false;
+
+            if (digits == TLS_FINGERPRINT_SIZE * 2)
+                return false;
+            fingerprint[digits / 2] = (digits % 2 == 0) ? nibble << 4 : fingerprint[digits / 2] | nibble;
+            digits++;
+        }
+        return digits == TLS_FINGERPRINT_SIZE * 2;
+    }
+
+    void PrintStats()
+    {
+        TLSSettings settings = preferences.GetTLSSettings();
+        LOG_INFO("TLS: %s, %s", settings.isEnabled ? "on" : "off", settings.isPinned ? "fingerprint pinned" : "server not verified");
+        LOG_INFO("HTTPS:");
+        secureClient.PrintStats();
+    }
+};
+
+#endif
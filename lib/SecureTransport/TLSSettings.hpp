@@ -0,0 +1,15 @@
+#ifndef TLSSETTINGS_HPP
+#define TLSSETTINGS_HPP
+
+#include <stdint.h>
+
+#define TLS_FINGERPRINT_SIZE 20     // SHA-1 of the server certificate, what BearSSL pins against
+
+struct TLSSettings
+{
+    bool isEnabled;
+    bool isPinned;          // Otherwise the connection is encrypted but the server isn't checked
+    uint8_t fingerprint[TLS_FINGERPRINT_SIZE];
+};
+
+#endif
@@ -0,0 +1,240 @@
+#ifndef OUTBOX_HPP
+#define OUTBOX_HPP
+
+#include <Arduino.h>
+#include <WebSockets.h>
+#include <SensorReader.hpp>
+#include <functional>
+
+#define OUTBOX_SLOTS 6
+#define OUTBOX_MESSAGE_SIZE 480     // Fits a window summary or a link report; a raw reading takes about 140
+#define OUTBOX_MAX_WAIT 15000       // Readings, summaries and link and load reports older than this are given up on
+
+// What happens to a message of the outbox when a new one doesn't fit, or when it has waited too long.
+// Only readings, summaries and link and load reports make room; alerts, hellos, command results, boot reports,
+// relayed readings and history blocks are refused instead, and the probe keeps them until there's space.
+enum class OutboxPolicy : uint8_t
+{
+    DropOldest,
+    KeepLatest,     // The new message replaces every queued one of its kind
+    Spill           // Readings go back to the probe's history, the rest are dropped
+};
+
+enum class MessageKind : uint8_t
+{
+    Reading,
+    Summary,
+    Link,
+    Load,
+    Alert,
+    Hello,
+    Result,
+    Boot,
+    Relay,
+    History
+};
+
+struct OutboxStats
+{
+    unsigned long queued = 0;
+    unsigned long sent = 0;
+    unsigned long dropped = 0;
+    unsigned long expired = 0;      // Dropped or spilled for waiting too long; counted there as well
+    unsigned long coalesced = 0;
+    unsigned long spilled = 0;
+    unsigned long refused = 0;
+    unsigned long oversized = 0;    // Longer than a slot; never queued, and not counted as refused
+    unsigned long blocked = 0;      // Passes that ended with the socket too full for the next frame
+    unsigned long maxWait = 0;
+    unsigned int maxDepth = 0;
+};
+
+// Frames waiting for the WebSocket, in fixed slots. Messages are serialized straight into a slot with
+// room for the WebSocket header in front, so they go out without a copy.
+class Outbox
+{
+public:
+    typedef std::function<void(const SensorReadings& readings)> SpillHandler;
+
+private:
+    struct Slot
+    {
+        MessageKind kind;
+        bool isBinary;
+        size_t length;
+        unsigned long queuedAt;
+        SensorReadings readings;        // Readings only, to spill them
+        uint8_t frame[WEBSOCKETS_MAX_HEADER_SIZE + OUTBOX_MESSAGE_SIZE];
+    };
+
+    Slot slots[OUTBOX_SLOTS];
+    uint8_t order[OUTBOX_SLOTS];        // Queued slots in sending order, then the free ones
+    unsigned int count = 0;
+
+    OutboxPolicy policy = OutboxPolicy::Spill;
+    SpillHandler spillHandler;
+    OutboxStats stats;
+
+    static bool IsExpendable(MessageKind kind)
+    {
+        return kind == MessageKind::Reading || kind == MessageKind::Summary || kind == MessageKind::Link || kind == MessageKind::Load;
+    }
+
+    // Alerts and command results don't wait behind readings, summaries and reports
+    static bool IsUrgent(MessageKind kind) { return kind == MessageKind::Alert || kind == MessageKind::Result; }
+
+    // Moves the frame at position ahead of the expendable ones right before it
+    void Promote(unsigned int position)
+    {
+        uint8_t index = order[position];
+        for (; position > 0 && IsExpendable(slots[order[position - 1]].kind); position--)
+            order[position] = order[position - 1];
+        order[position] = index;
+    }
+
+    void Remove(unsigned int position)
+    {
+        uint8_t index = order[position];
+        for (unsigned int i = position; i + 1 < count; i++)
+            order[i] = order[i + 1];
+        order[--count] = index;
+    }
+
+    void Evict(unsigned int position)
+    {
+        Slot& slot = slots[order[position]];
+        if (policy == OutboxPolicy::Spill && slot.kind == MessageKind::Reading && spillHandler)
+        {
+            spillHandler(slot.readings);
+            stats.spilled++;
+        }
+        else
+            stats.dropped++;
+        Remove(position);
+    }
+
+    bool MakeRoom(MessageKind kind)
+    {
+        if (policy == OutboxPolicy::KeepLatest && IsExpendable(kind))
+        {
+            unsigned int coalesced = 0;
+            for (unsigned int i = count; i-- > 0; )
+            {
+                if (slots[order[i]].kind == kind)
+                {
+                    Remove(i);
+                    coalesced++;
+                }
+            }
+            stats.coalesced += coalesced;
+            if (coalesced > 0)
+                return true;
+        }
+
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (IsExpendable(slots[order[i]].kind))
+            {
+                Evict(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    Outbox()
+    {
+        for (unsigned int i = 0; i < OUTBOX_SLOTS; i++)
+            order[i] = i;
+    }
+
+    void SetPolicy(OutboxPolicy newPolicy) { policy = newPolicy; }
+    OutboxPolicy GetPolicy() { return policy; }
+    void SetSpillHandler(SpillHandler handler) { spillHandler = handler; }
+
+    // Where to write length bytes of a message of kind, with WEBSOCKETS_MAX_HEADER_SIZE bytes free in
+    // front of them. Nothing is queued until Commit(). nullptr when it's longer than a slot or the policy
+    // can't make room. A history block only takes a free slot: a reading spilled for it would be
+    // appended to the history it's copied from.
+    uint8_t* Claim(MessageKind kind, size_t length)
+    {
+        if (length > OUTBOX_MESSAGE_SIZE)
+        {
+            stats.oversized++;
+            return nullptr;
+        }
+
+        if (count == OUTBOX_SLOTS && (kind == MessageKind::History || !MakeRoom(kind)))
+        {
+            stats.refused++;
+            return nullptr;
+        }
+
+        Slot& slot = slots[order[count]];
+        slot.kind = kind;
+        return slot.frame + WEBSOCKETS_MAX_HEADER_SIZE;
+    }
+
+    void Commit(size_t length, bool isBinary, const SensorReadings* readings = nullptr)
+    {
+        Slot& slot = slots[order[count++]];
+        slot.length = length;
+        slot.isBinary = isBinary;
+        slot.queuedAt = millis();
+        if (readings != nullptr)
+            slot.readings = *readings;
+
+        if (IsUrgent(slot.kind))
+            Promote(count - 1);
+
+        stats.queued++;
+        stats.maxDepth = max(stats.maxDepth, count);
+    }
+
+    void Expire()
+    {
+        for (unsigned int i = 0; i < count; )
+        {
+            const Slot& slot = slots[order[i]];
+            if (IsExpendable(slot.kind) && millis() - slot.queuedAt > OUTBOX_MAX_WAIT)
+            {
+                stats.expired++;
+                Evict(i);
+            }
+            else
+                i++;
+        }
+    }
+
+    // The next frame to send; the payload starts WEBSOCKETS_MAX_HEADER_SIZE bytes in
+    uint8_t* Peek(size_t& length, bool& isBinary)
+    {
+        if (count == 0)
+            return nullptr;
+
+        Slot& slot = slots[order[0]];
+        length = slot.length;
+        isBinary = slot.isBinary;
+        return slot.frame;
+    }
+
+    void Pop()
+    {
+        if (count == 0)
+            return;
+
+        stats.sent++;
+        stats.maxWait = max(stats.maxWait, millis() - slots[order[0]].queuedAt);
+        Remove(0);
+    }
+
+    void MarkBlocked() { stats.blocked++; }
+
+    bool IsEmpty() { return count == 0; }
+    bool HasRoom() { return count < OUTBOX_SLOTS; }
+    unsigned int GetDepth() { return count; }
+    const OutboxStats& GetStats() { return stats; }
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <stdint.h>
+
+#define PROTOCOL_VERSION 1
+#define PROTOCOL_DEFAULT_INTERVAL 2000
+#define PROTOCOL_MIN_INTERVAL 1000          // The DHT11 can't be read any faster
+#define PROTOCOL_MAX_INTERVAL 600000
+#define PROTOCOL_MAX_BATCH 250              // A history block fills up around here on slow-moving data
+
+// How readings go out. A server that never answers the hello gets Json, which is all old servers know.
+enum class Encoding : uint8_t
+{
+    Json,           // A text frame per reading, values as strings
+    TimeSeries      // TimeSeriesCodec blocks of batchSize readings, the same as history blocks
+};
+
+// What the server picked in its reply to the hello; back to the defaults on every new connection
+struct ProtocolSettings
+{
+    Encoding encoding = Encoding::Json;
+    unsigned long sampleInterval = PROTOCOL_DEFAULT_INTERVAL;
+    uint16_t batchSize = 1;
+};
+
+#endif
@@ -4,55 +4,546 @@
 #include <WebSockets.h>
 #include <WebSocketsClient.h>
 #include <ArduinoJson.h>
-#include <iostream>
 #include <HTTPCredentials.hpp>
+#include <Preferences.hpp>
+#include <SensorReader.hpp>
+#include <Aggregator.hpp>
+#include <LinkTelemetry.hpp>
+#include <AlertEngine.hpp>
+#include <SecureTransport.hpp>
+#include <HistoryBuffer.hpp>
+#include <Protocol.hpp>
+#include <Outbox.hpp>
+#include <RemoteCommandQueue.hpp>
+#include <BootTrace.hpp>
+#include <MeshGateway.hpp>
+#include <Version.h>
 
-class Sender 
+#define WEBSOCKET_PORT 8000
+#define SENDER_PATH_SIZE 96
+#define SENDER_MESSAGE_SIZE OUTBOX_MESSAGE_SIZE
+#define SENDER_VALUE_SIZE 16
+#define SENDER_PING_INTERVAL 5000
+#define SENDER_PONG_TIMEOUT 5000
+#define SENDER_REPLY_WINDOW 100     // After a frame goes out, for its ACK and whatever the server says back
+
+// The library writes a frame in one go and waits, for up to WEBSOCKETS_TCP_TIMEOUT, when the socket
+// can't take it all. Asking the socket first lets the Sender keep the frame for the next pass instead.
+class WritableWebSocketsClient : public WebSocketsClient
+{
+public:
+    size_t AvailableForWrite() { return _client.tcp != nullptr && _client.tcp->connected() ? _client.tcp->availableForWrite() : 0; }
+};
+
+// The library makes a new TLS client for every connect: a full handshake each time, and 16 KB
+// buffers that an OTA download over HTTPS would have to fit next to. This one connects a
+// MeasuredSecureClient of its own before the library tries, so reconnects resume its session and
+// it keeps the small buffers once the server has shown it can do them.
+class SecureWebSocketsClient : public WritableWebSocketsClient
+{
+private:
+    MeasuredSecureClient secureClient;
+
+    void ConnectSecure()
+    {
+        secureClient.Prepare(_host.c_str(), _port, _fingerprint);
+        _client.ssl = &secureClient;
+        _client.tcp = &secureClient;
+        if (secureClient.connect(_host.c_str(), _port))
+        {
+            _lastConnectionFail = 0;
+            connectedCb();
+        }
+        else
+        {
+            connectFailedCb();
+            clientDisconnect(&_client);
+            _lastConnectionFail = millis();
+        }
+    }
+
+protected:
+    // The library deletes the clients it made, so this one is taken back first
+    void clientDisconnect(WSclient_t* client) override
+    {
+        if (client->ssl == &secureClient)
+        {
+            secureClient.stop();
+            client->ssl = nullptr;
+            client->tcp = nullptr;
+        }
+        WritableWebSocketsClient::clientDisconnect(client);
+    }
+
+public:
+    ~SecureWebSocketsClient() { disconnect(); }
+
+    // Instead of loop()
+    void Loop()
+    {
+        if (_client.isSSL && _port != 0 && !clientIsConnected(&_client) && millis() - _lastConnectionFail >= _reconnectInterval)
+            ConnectSecure();
+        loop();
+    }
+
+    void PrintStats() { secureClient.PrintStats(); }
+};
+
+class Sender
 {
+public:
+    typedef std::function<void(const char* message, size_t length)> MessageHandler;
+
 private:
-    WebSocketsClient webSockets;
-    String ip = "";
-    String uuid = "";
+    PreferencesManager& preferences;
+    SecureWebSocketsClient webSockets;
+    char ip[sizeof(HTTPCredentials::ip)] = "";
+    char uuid[sizeof(HTTPCredentials::uuid)] = "";
     bool isBegin = false;
+    MessageHandler messageHandler;
+    uint8_t fingerprint[TLS_FINGERPRINT_SIZE];     // The library keeps the pointer for its reconnects
+
+    RoundTripStats roundTrip;
+    unsigned long lastPingTime = 0;
+    bool isPingPending = false;
+    unsigned long connectCount = 0;
+    bool hasServerAnswered = false;     // On this connection: a text frame or a pong came back
+
+    ProtocolSettings protocol;
+    bool isHelloPending = false;
+    bool isProtocolFromServer = false;
+    unsigned long defaultInterval = PROTOCOL_DEFAULT_INTERVAL;     // Until the server picks one
+
+    uint16_t port = WEBSOCKET_PORT;
+    uint16_t securePort = SECURE_TRANSPORT_PORT;
+    unsigned long pingInterval = SENDER_PING_INTERVAL;
+
+    Outbox outbox;
+    unsigned long lastSendTime = 0;
+
+    static void AddChannel(JsonDocument& json, const char* name, const ChannelStats& stats)
+    {
+        if (stats.count == 0)
+            return;
+
+        JsonObject channel = json.createNestedObject(name);
+        channel["min"] = stats.min;
+        channel["max"] = stats.max;
+        channel["mean"] = stats.mean;
+        channel["stddev"] = stats.GetStdDev();
+        channel["samples"] = stats.count;
+    }
+
+    // Values that can't be used go out as null, with the reason under "quality"
+    static void AddValue(JsonDocument& json, JsonObject quality, const char* name, const char* value, SampleQuality valueQuality)
+    {
+        if (IsUsable(valueQuality))
+            json[name] = value;
+        else
+            json[name] = (const char*)nullptr;
+
+        if (valueQuality != SampleQuality::Ok)
+            quality[name] = QualityName(valueQuality);
+    }
+
+    // Hundredths as a double, which prints without a float's trailing digits
+    static void AddRelayValue(JsonArray reading, float value, SampleQuality quality)
+    {
+        if (IsUsable(quality))
+            reading.add(lroundf(value * 100.0f) / 100.0);
+        else
+            reading.add((const char*)nullptr);
+    }
+
+    bool Queue(MessageKind kind, const JsonDocument& json, const SensorReadings* readings = nullptr)
+    {
+        if (!IsConnected())
+            return false;
+
+        // A document that doesn't fit would go out cut short, as invalid JSON
+        size_t length = measureJson(json);
+        char* message = (char*)outbox.Claim(kind, length + 1);
+        if (message == nullptr)
+        {
+            if (length >= SENDER_MESSAGE_SIZE)
+                LOG_WARN("A %u byte message doesn't fit the outbox, not sent", (unsigned int)length);
+            return false;
+        }
+
+        outbox.Commit(serializeJson(json, message, SENDER_MESSAGE_SIZE), false, readings);
+        Drain();
+        return true;
+    }
+
+    // The rest of a link report: what the probe has waiting, and where its time awake went
+    bool SendLoadReport(const LinkReport& report)
+    {
+        StaticJsonDocument<JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(6) + JSON_OBJECT_SIZE(4)> json;
+        json["type"] = "load";
+        json["uptime"] = report.uptime;
+        json["pending"] = report.pendingSamples;
+
+        const OutboxStats& stats = outbox.GetStats();
+        JsonObject queue = json.createNestedObject("outbox");
+        queue["depth"] = outbox.GetDepth();
+        queue["max_depth"] = stats.maxDepth;
+        queue["max_wait"] = stats.maxWait;
+        queue["dropped"] = stats.dropped;
+        queue["spilled"] = stats.spilled;
+        queue["oversized"] = stats.oversized;
+
+        JsonObject power = json.createNestedObject("power");
+        power["awake"] = report.awakeTime;
+        power["modem_sleep"] = report.modemSleepTime;
+        power["light_sleep"] = report.lightSleepTime;
+        power["mean_ua"] = report.meanCurrent;
+
+        return Queue(MessageKind::Load, json);
+    }
 
 public:
-    Sender()
+    Sender(PreferencesManager& preferences) : preferences(preferences)
     {
-        
+
     }
 
     void Begin()
     {
+        char path[SENDER_PATH_SIZE];
+        snprintf_P(path, sizeof(path), PSTR("/ws/probe/%s/"), uuid);
+
+        if (isBegin)
+            webSockets.disconnect();
         isBegin = true;
-        webSockets.begin(ip, 8000, "/ws/probe/" + uuid + "/");
+
+        TLSSettings tls = preferences.GetTLSSettings();
+        if (tls.isEnabled)
+        {
+            memcpy(fingerprint, tls.fingerprint, sizeof(fingerprint));
+            webSockets.beginSSL(ip, securePort, path, tls.isPinned ? fingerprint : nullptr);
+        }
+        else
+            webSockets.begin(ip, port, path);
+        webSockets.onEvent([this](WStype_t type, uint8_t* payload, size_t length) {
+            if (type == WStype_TEXT)
+            {
+                hasServerAnswered = true;
+                if (messageHandler)
+                    messageHandler((const char*)payload, length);
+            }
+            else if (type == WStype_CONNECTED)
+            {
+                connectCount++;
+                isPingPending = false;
+                hasServerAnswered = false;
+                protocol = ProtocolSettings();
+                protocol.sampleInterval = defaultInterval;
+                isProtocolFromServer = false;
+                isHelloPending = true;
+            }
+            else if (type == WStype_PONG && isPingPending)
+            {
+                hasServerAnswered = true;
+                roundTrip.Add(millis() - lastPingTime);
+                isPingPending = false;
+            }
+        });
     }
 
     void Update()
     {
-        webSockets.loop();
+        webSockets.Loop();
+        UpdatePing();
+        Drain();
+
+        if (isHelloPending && webSockets.isConnected())
+            isHelloPending = !SendHello();
+    }
+
+    // What this probe can do, so the server can pick how it wants the readings. A server that doesn't
+    // know about the hello ignores it and the probe stays on the JSON it has always sent.
+    // sampled_at in the frames that follow is millis() on the probe, as is uptime here: the server
+    // places them on its own clock by when the hello arrived.
+    bool SendHello()
+    {
+        StaticJsonDocument<JSON_OBJECT_SIZE(13) + JSON_ARRAY_SIZE(4) + JSON_ARRAY_SIZE(2)> json;
+        json["type"] = "hello";
+        json["protocol"] = PROTOCOL_VERSION;
+        json["firmware"] = FIRMWARE_VERSION;
+
+        JsonArray channels = json.createNestedArray("channels");
+        channels.add("temperature");
+        channels.add("humidity");
+        channels.add("soil_moisture");
+        channels.add("light_level");
+
+        JsonArray encodings = json.createNestedArray("encodings");
+        encodings.add("json");
+        encodings.add("timeseries");
+
+        json["block_size"] = HISTORY_BLOCK_SIZE;
+        json["history_size"] = HISTORY_BLOCK_SIZE * HISTORY_BLOCK_COUNT;
+        json["max_message"] = SENDER_MESSAGE_SIZE;
+        json["max_batch"] = PROTOCOL_MAX_BATCH;
+        json["min_interval"] = PROTOCOL_MIN_INTERVAL;
+        json["max_interval"] = PROTOCOL_MAX_INTERVAL;
+        json["interval"] = protocol.sampleInterval;
+        json["uptime"] = millis();
+
+        return Queue(MessageKind::Hello, json);
+    }
+
+    // The server's reply to the hello. Anything outside what the hello offered is refused as a whole,
+    // and the probe carries on with what it had.
+    bool ApplyHello(JsonObjectConst json)
+    {
+        ProtocolSettings settings;
+
+        const char* encoding = json["encoding"] | "json";
+        if (strcmp_P(encoding, PSTR("timeseries")) == 0)
+            settings.encoding = Encoding::TimeSeries;
+        else if (strcmp_P(encoding, PSTR("json")) != 0)
+            return false;
+
+        settings.sampleInterval = json["interval"] | defaultInterval;
+        if (settings.sampleInterval < PROTOCOL_MIN_INTERVAL || settings.sampleInterval > PROTOCOL_MAX_INTERVAL)
+            return false;
+
+        // A JSON frame carries one reading, so only blocks batch
+        unsigned long batchSize = json["batch"] | 1UL;
+        if (batchSize < 1 || batchSize > PROTOCOL_MAX_BATCH)
+            return false;
+        settings.batchSize = settings.encoding == Encoding::TimeSeries ? batchSize : 1;
+
+        protocol = settings;
+        isProtocolFromServer = true;
+        if (protocol.encoding == Encoding::TimeSeries)
+            LOG_INFO("Server picked time series blocks of %d readings, one every %lu ms", protocol.batchSize, protocol.sampleInterval);
+        else
+            LOG_INFO("Server picked JSON, one reading every %lu ms", protocol.sampleInterval);
+        return true;
+    }
+
+    // As many queued frames as the socket takes without blocking
+    void Drain()
+    {
+        outbox.Expire();
+
+        size_t length;
+        bool isBinary;
+        uint8_t* frame;
+        while (IsConnected() && (frame = outbox.Peek(length, isBinary)) != nullptr)
+        {
+            // Binary frames are history blocks, which say when they went out so their timestamps can
+            // be placed on the server's clock
+            if (isBinary)
+                TimeSeries::StampSentAt(frame + WEBSOCKETS_MAX_HEADER_SIZE, millis());
+
+            bool isSent = webSockets.AvailableForWrite() >= length + WEBSOCKETS_MAX_HEADER_SIZE &&
+                (isBinary ? webSockets.sendBIN(frame, length, true) : webSockets.sendTXT(frame, length, true));
+            if (!isSent)
+            {
+                outbox.MarkBlocked();
+                break;
+            }
+            outbox.Pop();
+            lastSendTime = millis();
+        }
+    }
+
+    // One ping in flight at a time, so a pong always belongs to the last ping
+    void UpdatePing()
+    {
+        if (isPingPending && millis() - lastPingTime > SENDER_PONG_TIMEOUT)
+        {
+            roundTrip.AddLost();
+            isPingPending = false;
+        }
+
+        if (!isPingPending && webSockets.isConnected() && millis() - lastPingTime >= pingInterval)
+        {
+            lastPingTime = millis();
+            isPingPending = webSockets.sendPing();
+        }
+    }
+
+    bool SendMessage(const SensorReadings& readings)
+    {
+        // Values are sent as strings to keep the wire format the server expects
+        char values[4][SENDER_VALUE_SIZE];
+        snprintf_P(values[0], SENDER_VALUE_SIZE, PSTR("%f"), readings.temperature);
+        snprintf_P(values[1], SENDER_VALUE_SIZE, PSTR("%f"), readings.humidity);
+        snprintf_P(values[2], SENDER_VALUE_SIZE, PSTR("%f"), readings.soilMoisture);
+        snprintf_P(values[3], SENDER_VALUE_SIZE, PSTR("%f"), readings.lightLevel);
+
+        StaticJsonDocument<JSON_OBJECT_SIZE(6) + JSON_OBJECT_SIZE(4)> json;
+        bool isAllOk = readings.temperatureQuality == SampleQuality::Ok && readings.humidityQuality == SampleQuality::Ok &&
+            readings.soilMoistureQuality == SampleQuality::Ok && readings.lightLevelQuality == SampleQuality::Ok;
+        JsonObject quality = isAllOk ? JsonObject() : json.createNestedObject("quality");
+        AddValue(json, quality, "temperature", values[0], readings.temperatureQuality);
+        AddValue(json, quality, "humidity", values[1], readings.humidityQuality);
+        AddValue(json, quality, "soil_moisture", values[2], readings.soilMoistureQuality);
+        AddValue(json, quality, "light_level", values[3], readings.lightLevelQuality);
+        json["sampled_at"] = readings.sampledAt;
+
+        return Queue(MessageKind::Reading, json, &readings);
+    }
+
+    bool SendSummary(const WindowSummary& summary)
+    {
+        StaticJsonDocument<JSON_OBJECT_SIZE(8) + 4 * JSON_OBJECT_SIZE(4)> json;
+        json["type"] = "summary";
+        json["sampled_at"] = summary.start;
+        json["window"] = summary.length;
+        json["samples"] = summary.GetSampleCount();
+        AddChannel(json, "temperature", summary.temperature);
+        AddChannel(json, "humidity", summary.humidity);
+        AddChannel(json, "soil_moisture", summary.soilMoisture);
+        AddChannel(json, "light_level", summary.lightLevel);
+
+        return Queue(MessageKind::Summary, json);
+    }
+
+    bool SendAlert(const AlertEvent& event)
+    {
+        StaticJsonDocument<JSON_OBJECT_SIZE(8)> json;
+        json["type"] = "alert";
+        json["rule"] = event.index;
+        json["channel"] = AlertEngine::ChannelName(event.rule.channel);
+        json["condition"] = event.rule.condition == AlertCondition::Above ? "above" : "below";
+        json["state"] = event.isFiring ? "firing" : "cleared";
+        json["value"] = event.value;
+        json["threshold"] = event.rule.threshold;
+        json["sampled_at"] = event.at;
+
+        return Queue(MessageKind::Alert, json);
     }
 
-    void SendMessage(String temperature, String humidity, String soilMoisture, String lightLevel)
+    // Goes out as two frames, "link" for the connection and "load" for the history, the outbox and power,
+    // as with every counter near its limit the whole of it would be longer than a slot
+    bool SendLinkReport(const LinkReport& report)
     {
-        DynamicJsonDocument json(1024);
-        json["temperature"] = temperature;
-        json["humidity"] = humidity;
-        json["soil_moisture"] = soilMoisture;
-        json["light_level"] = lightLevel;
+        StaticJsonDocument<JSON_OBJECT_SIZE(7) + JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(7) + JSON_OBJECT_SIZE(3)> json;
+        json["type"] = "link";
+        json["uptime"] = report.uptime;
 
-        char message[1024];
-        serializeJson(json, message);
+        if (report.signal->HasSamples())
+        {
+            JsonObject rssi = json.createNestedObject("rssi");
+            rssi["last"] = report.signal->GetLast();
+            rssi["mean"] = report.signal->GetAverage();
+            rssi["min"] = report.signal->GetMin();
+            rssi["max"] = report.signal->GetMax();
+        }
 
-        webSockets.sendTXT(message);
+        JsonObject rtt = json.createNestedObject("rtt");
+        rtt["mean"] = report.roundTrip->GetAverage();
+        rtt["p50"] = report.roundTrip->Percentile(50);
+        rtt["p90"] = report.roundTrip->Percentile(90);
+        rtt["p99"] = report.roundTrip->Percentile(99);
+        rtt["max"] = report.roundTrip->GetMax();
+        rtt["samples"] = report.roundTrip->GetSampleCount();
+        rtt["lost"] = report.roundTrip->GetLostCount();
+
+        json["ws_connects"] = report.webSocketConnects;
+        json["wifi_connects"] = report.wifiConnects;
+        JsonObject wifiTime = json.createNestedObject("wifi_ms");
+        wifiTime["disconnected"] = report.wifiDisconnectedTime;
+        wifiTime["connecting"] = report.wifiConnectingTime;
+        wifiTime["connected"] = report.wifiConnectedTime;
+
+        if (!Queue(MessageKind::Link, json))
+            return false;
+        SendLoadReport(report);
+        return true;
     }
 
-    // void StoreUUID(String newUuid) 
-    // {
-    //     HTTPCredentials credentials;
-    //     newUuid.toCharArray(credentials.uuid, sizeof(credentials.uuid));
-    //     preferences.SaveHTTPCredentials(credentials);
-    //     preferences.Save();
-    // }
+    // Sent once per boot, so the server can tell how long a site was dark after a power cut
+    bool SendBootReport(const BootTrace& trace)
+    {
+        StaticJsonDocument<JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE((size_t)BootPhase::Count)> json;
+        json["type"] = "boot";
+        json["firmware"] = FIRMWARE_VERSION;
+
+        JsonObject phases = json.createNestedObject("phases");
+        for (uint8_t i = 0; i < (uint8_t)BootPhase::Count; i++)
+        {
+            if (trace.IsReached((BootPhase)i))
+                phases[BootTrace::PhaseName((BootPhase)i)] = trace.GetTime((BootPhase)i);
+        }
+
+        return Queue(MessageKind::Boot, json);
+    }
+
+    // The answer to a command from the server, matched to it by id, with whatever the command reported.
+    // Output that would make the frame too long is left out and the result says so.
+    bool SendCommandResult(const RemoteCommand& command)
+    {
+        char message[64];
+        StaticJsonDocument<JSON_OBJECT_SIZE(7) + REMOTE_COMMAND_OUTPUT_SIZE> json;
+        json["type"] = "result";
+        json["id"] = (const char*)command.id;
+        json["ok"] = command.isOk;
+        if (!command.isOk)
+        {
+            command.error.Describe(message, sizeof(message));
+            json["error"] = command.error.GetCodeName();
+            json["message"] = (const char*)message;
+        }
+        json["took"] = command.took;
+        if (command.output.size() > 0)
+        {
+            if (measureJson(json) + sizeof(",\"output\":") + measureJson(command.output) < SENDER_MESSAGE_SIZE)
+                json["output"] = command.output;
+            else
+                json["truncated"] = true;
+        }
+
+        return Queue(MessageKind::Result, json);
+    }
+
+    // Readings a gateway collected from one of its leaves, each [sampled_at, temperature, humidity,
+    // soil_moisture, light_level] with null for what isn't usable
+    bool SendRelay(const MeshRelayBatch& batch)
+    {
+        StaticJsonDocument<JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(MESH_RELAY_BATCH) + MESH_RELAY_BATCH * JSON_ARRAY_SIZE(5)> json;
+        json["type"] = "relay";
+        json["probe"] = batch.uuid;
+
+        JsonArray readings = json.createNestedArray("readings");
+        for (unsigned int i = 0; i < batch.count; i++)
+        {
+            const SensorReadings& sample = batch.readings[i];
+            JsonArray reading = readings.createNestedArray();
+            reading.add(sample.sampledAt);
+            AddRelayValue(reading, sample.temperature, sample.temperatureQuality);
+            AddRelayValue(reading, sample.humidity, sample.humidityQuality);
+            AddRelayValue(reading, sample.soilMoisture, sample.soilMoistureQuality);
+            AddRelayValue(reading, sample.lightLevel, sample.lightLevelQuality);
+        }
+
+        return Queue(MessageKind::Relay, json);
+    }
+
+    // A TimeSeriesCodec block: a batch of readings, or ones that couldn't be sent when they were taken
+    bool SendHistory(const uint8_t* block, size_t length)
+    {
+        // Blocks wait in the history until there's a free slot, rather than pushing readings out
+        if (!IsConnected() || !outbox.HasRoom() || length > SENDER_MESSAGE_SIZE)
+            return false;
+
+        uint8_t* payload = outbox.Claim(MessageKind::History, length);
+        if (payload == nullptr)
+            return false;
+
+        memcpy(payload, block, length);
+        outbox.Commit(length, true);
+        Drain();
+        return true;
+    }
+
+    // Text frames from the server; set once, before Begin()
+    void SetMessageHandler(MessageHandler handler) { messageHandler = handler; }
 
     bool HasStoredUUID() { return preferences.IsProbeUUIDSet(); }
 
@@ -62,25 +553,90 @@ public:
         preferences.Save();
     }
 
-    void SetIP(String newIP)
+    void SetIP(const char* newIP)
     {
-        ip = newIP;
+        strncpy(ip, newIP, sizeof(ip) - 1);
+        ip[sizeof(ip) - 1] = '\0';
     }
 
-    void SetUUID(String newUUID)
+    void SetUUID(const char* newUUID)
     {
-        uuid = newUUID;
+        strncpy(uuid, newUUID, sizeof(uuid) - 1);
+        uuid[sizeof(uuid) - 1] = '\0';
     }
 
     bool IsReady()
     {
-        return !(ip.equals("") || uuid.equals("") || !isBegin);
+        return IsReadyToBegin() && isBegin;
+    }
+
+    // A new port takes a Begin() to be used; returns whether it changed
+    bool SetPort(uint16_t newPort)
+    {
+        bool isChanged = newPort != port;
+        port = newPort;
+        return isChanged;
+    }
+
+    // With tls on
+    bool SetSecurePort(uint16_t newPort)
+    {
+        bool isChanged = newPort != securePort;
+        securePort = newPort;
+        return isChanged;
+    }
+
+    void SetPingInterval(unsigned long interval) { pingInterval = interval; }
+
+    // Applies at once unless the server has picked an interval for this connection
+    void SetDefaultInterval(unsigned long interval)
+    {
+        defaultInterval = interval;
+        if (!isProtocolFromServer)
+            protocol.sampleInterval = interval;
+    }
+
+    const ProtocolSettings& GetProtocol() { return protocol; }
+    Outbox& GetOutbox() { return outbox; }
+    RoundTripStats& GetRoundTrip() { return roundTrip; }
+    unsigned long GetConnectCount() { return connectCount; }
+
+    // Something came back from the server, rather than frames only having been queued for it. A server
+    // that ignores the hello still answers the pings.
+    bool HasServerAnswered() { return IsConnected() && hasServerAnswered; }
+
+    // Whether the radio has to stay awake for this connection: frames are queued, a pong is due or
+    // something was just sent. Connecting counts too.
+    bool IsBusy()
+    {
+        if (!isBegin)
+            return false;
+        if (!webSockets.isConnected())
+            return true;
+        return !outbox.IsEmpty() || isPingPending || isHelloPending || millis() - lastSendTime < SENDER_REPLY_WINDOW;
+    }
+
+    unsigned long GetTimeToNextPing()
+    {
+        unsigned long sincePing = millis() - lastPingTime;
+        return sincePing >= pingInterval ? 0 : pingInterval - sincePing;
+    }
+
+    bool IsConnected()
+    {
+        return isBegin && webSockets.isConnected();
+    }
+
+    void PrintTLSStats()
+    {
+        LOG_INFO("WebSocket:");
+        webSockets.PrintStats();
     }
 
     bool IsReadyToBegin()
     {
-        return !(ip.equals("") || uuid.equals(""));
+        return ip[0] != '\0' && uuid[0] != '\0';
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -3,6 +3,29 @@
 
 #include <DHT11Reader.hpp>
 #include <SoilLightReader.hpp>
+#include <Result.hpp>
+#include <SensorError.hpp>
+#include <SensorHealth.hpp>
+
+struct SensorReadings
+{
+    float temperature;
+    float humidity;
+    float soilMoisture;
+    float lightLevel;
+    unsigned long sampledAt;    // millis() of the oldest reading that went into this sample
+
+    // Values that aren't usable are NaN
+    SampleQuality temperatureQuality;
+    SampleQuality humidityQuality;
+    SampleQuality soilMoistureQuality;
+    SampleQuality lightLevelQuality;
+
+    bool IsAnyUsable() const
+    {
+        return IsUsable(temperatureQuality) || IsUsable(humidityQuality) || IsUsable(soilMoistureQuality) || IsUsable(lightLevelQuality);
+    }
+};
 
 class SensorReader
 {
@@ -10,6 +33,8 @@ private:
     DHT11Reader dht11Reader;
     SoilLightReader soilLightReader;
 
+    unsigned long updateCount = 0;
+
 public:
     SensorReader(int dht11Pin, int sdaPin, int sclPin)
     {
@@ -25,18 +50,69 @@ public:
 
     void Update()
     {
+        unsigned long dhtTime = dht11Reader.GetLastUpdateTime();
+        unsigned long soilLightTime = soilLightReader.GetLastUpdateTime();
+
         dht11Reader.Update();
         soilLightReader.Update();
+
+        if (dht11Reader.GetLastUpdateTime() != dhtTime || soilLightReader.GetLastUpdateTime() != soilLightTime)
+            updateCount++;
+    }
+
+    // Readings are wanted at deadline, and ones taken up to maxAge before it will do. The sensors are
+    // then read just in time for it rather than on their own timers, whose reads mostly went unused.
+    void RequestBy(unsigned long deadline, unsigned long maxAge)
+    {
+        dht11Reader.RequestBy(deadline, maxAge);
+        soilLightReader.RequestBy(deadline, maxAge);
+    }
+
+    void FreeRun()
+    {
+        dht11Reader.FreeRun();
+        soilLightReader.FreeRun();
     }
 
+    // How often the soil and light sensor is read while free-running
+    void SetSoilLightInterval(unsigned long interval) { soilLightReader.SetUpdateInterval(interval); }
+
     bool IsDHTReady() { return dht11Reader.IsReady(); }
     bool IsSoilLightReady() { return soilLightReader.IsReady(); }
     bool IsAllReady() { return (dht11Reader.IsReady() && soilLightReader.IsReady());}
 
-    float GetTemperature() { return dht11Reader.GetTemperature(); }                                 // From 0 to 60 (Celsius)
-    float GetHumidity() { return dht11Reader.GetHumidity(); }                                       // From 0% to 100%
-    float GetSoilMoisture() { return (float)soilLightReader.GetSoilMoisture() / 255.0f * 100.0f; }  // From 0% to 100%
-    float GetLightLevel() { return (float)soilLightReader.GetLightLevel() / 255.0f * 100.0f; }      // From 0% to 100%
+    const SensorHealth& GetDHTHealth() { return dht11Reader.GetHealth(); }
+    const SensorHealth& GetSoilHealth() { return soilLightReader.GetSoilHealth(); }
+    const SensorHealth& GetLightHealth() { return soilLightReader.GetLightHealth(); }
+
+    // Goes up whenever either sensor has been read, so callers can tell new readings from old ones
+    unsigned long GetUpdateCount() { return updateCount; }
+
+    static float RawToPercent(int raw) { return (float)raw / 255.0f * 100.0f; }
+
+    Result<float, SensorError> GetTemperature() { return dht11Reader.GetTemperature(); }                 // From 0 to 60 (Celsius)
+    Result<float, SensorError> GetHumidity() { return dht11Reader.GetHumidity(); }                       // From 0% to 100%
+    Result<float, SensorError> GetSoilMoisture() { return soilLightReader.GetSoilMoisture().Map(RawToPercent); }  // From 0% to 100%
+    Result<float, SensorError> GetLightLevel() { return soilLightReader.GetLightLevel().Map(RawToPercent); }      // From 0% to 100%
+
+    Result<SensorReadings, SensorError> GetReadings()
+    {
+        if (!IsAllReady())
+            return SensorError::NotReady;
+
+        SampleQuality dhtQuality = dht11Reader.GetQuality();
+        return SensorReadings {
+            GetTemperature().ValueOr(NAN),
+            GetHumidity().ValueOr(NAN),
+            GetSoilMoisture().ValueOr(NAN),
+            GetLightLevel().ValueOr(NAN),
+            min(dht11Reader.GetLastUpdateTime(), soilLightReader.GetLastUpdateTime()),
+            dhtQuality,
+            dhtQuality,
+            soilLightReader.GetSoilQuality(),
+            soilLightReader.GetLightQuality()
+        };
+    }
 };
 
 #endif
\ No newline at end of file
@@ -4,24 +4,94 @@
 #define PCF8591_I2C_ADDRESS 0x48
 
 #include <PCF8591.h>
+#include <Logger.hpp>
+#include <Result.hpp>
+#include <SensorError.hpp>
+#include <SensorHealth.hpp>
+#include <SampleDemand.hpp>
+
+#define SOIL_LIGHT_STUCK_TIMEOUT 1800000UL     // A live input has a count or two of noise on the 8 bit ADC
+#define SOIL_LIGHT_RAIL_LOW 0                  // A disconnected or shorted sensor pins its input to a rail
+#define SOIL_LIGHT_RAIL_HIGH 255
+#define SOIL_LIGHT_RAIL_JUMP 64                // So do dry soil and a saturated LDR, but they drift there
+#define SOIL_LIGHT_RAIL_READS 3                // Railed reads after such a jump before the input counts as gone
+#define SOIL_LIGHT_UPDATE_INTERVAL 500
+#define SOIL_LIGHT_READ_LEAD 10UL             // One I2C transaction for all four inputs
 
 class SoilLightReader
 {
 private:
+    struct RailWatch
+    {
+        int last = -1;              // No read yet
+        uint8_t railedReads = 0;
+        bool isJump = false;
+    };
+
     PCF8591 pcf8591 = PCF8591(PCF8591_I2C_ADDRESS);
 
     unsigned long updateInterval;
-    unsigned long lastUpdateTime;
+    unsigned long lastUpdateTime = 0;
 
     int soilMoisture;
     int lightLevel;
 
     bool isReady = false;
 
+    SampleQuality soilQuality = SampleQuality::Ok;
+    SampleQuality lightQuality = SampleQuality::Ok;
+    SensorHealth soilHealth;
+    SensorHealth lightHealth;
+    RailWatch soilRail;
+    RailWatch lightRail;
+    StuckDetector stuck = StuckDetector(SOIL_LIGHT_STUCK_TIMEOUT);
+    SampleDemand demand;
+
+    // There's no failed read on this ADC. A rail is a real reading unless the input landed on it from
+    // mid-scale and stayed. One that was there from the start or drifted there could be a dry pot or a
+    // dark room as well as a loose wire, so it's sent as it is.
+    static SampleQuality Check(uint8_t input, RailWatch& rail, SensorHealth& health, const char* name)
+    {
+        health.reads++;
+        if (input != SOIL_LIGHT_RAIL_LOW && input != SOIL_LIGHT_RAIL_HIGH)
+        {
+            if (health.consecutiveFailures > 0)
+                LOG_INFO("%s back after %d railed reads", name, health.consecutiveFailures);
+            health.consecutiveFailures = 0;
+            rail.railedReads = 0;
+            rail.last = input;
+            return SampleQuality::Ok;
+        }
+
+        if (rail.railedReads == 0 || input != rail.last)
+        {
+            rail.isJump = rail.last >= 0 && abs(input - rail.last) >= SOIL_LIGHT_RAIL_JUMP;
+            rail.railedReads = 0;
+        }
+        if (rail.railedReads < UINT8_MAX)
+            rail.railedReads++;
+        rail.last = input;
+
+        if (!rail.isJump || rail.railedReads < SOIL_LIGHT_RAIL_READS)
+            return SampleQuality::Ok;
+
+        health.AddFailure(SampleQuality::OutOfRange);
+        if (health.consecutiveFailures == 1)
+            LOG_WARN("%s jumped to %d, is it connected?", name, input);
+        return SampleQuality::OutOfRange;
+    }
+
+    bool IsDue()
+    {
+        if (demand.IsRequested())
+            return !isReady || demand.IsDue(lastUpdateTime, SOIL_LIGHT_READ_LEAD);
+        return millis() - lastUpdateTime > updateInterval;
+    }
+
 public:
     SoilLightReader() { }
     
-    SoilLightReader(int sda, int scl, unsigned long updateInterval = 500)
+    SoilLightReader(int sda, int scl, unsigned long updateInterval = SOIL_LIGHT_UPDATE_INTERVAL)
     {
         pcf8591 = PCF8591(PCF8591_I2C_ADDRESS, sda, scl);
         this->updateInterval = updateInterval;
@@ -34,21 +104,57 @@ public:
 
     void Update()
     {
-        if (millis() - lastUpdateTime > updateInterval)
+        if (IsDue())
         {
             auto inputs = pcf8591.analogReadAll();
             lightLevel = 255 - inputs.ain0;
             soilMoisture = 255 - inputs.ain1;
 
+            lightQuality = Check(inputs.ain0, lightRail, lightHealth, "Light sensor");
+            soilQuality = Check(inputs.ain1, soilRail, soilHealth, "Soil probe");
+            if (stuck.Add(inputs.ain0, inputs.ain1))
+            {
+                soilHealth.stuck++;
+                lightHealth.stuck++;
+                LOG_INFO("Soil and light haven't changed in %lu min", SOIL_LIGHT_STUCK_TIMEOUT / 60000);
+            }
+
             isReady = true;
             lastUpdateTime = millis();
         }
     }
 
+    void SetUpdateInterval(unsigned long interval) { updateInterval = interval; }
+
+    // Read once, just before deadline, instead of every updateInterval
+    void RequestBy(unsigned long deadline, unsigned long maxAge) { demand.Request(deadline, maxAge); }
+    void FreeRun() { demand.Release(); }
+
     bool IsReady() { return isReady; }
+    unsigned long GetLastUpdateTime() { return lastUpdateTime; }
 
-    int GetLightLevel() { return lightLevel; }
-    int GetSoilMoisture() { return soilMoisture; }
+    SampleQuality GetLightQuality() { return lightQuality; }
+    SampleQuality GetSoilQuality() { return soilQuality; }
+    const SensorHealth& GetLightHealth() { return lightHealth; }
+    const SensorHealth& GetSoilHealth() { return soilHealth; }
+
+    Result<int, SensorError> GetLightLevel()
+    {
+        if (!isReady)
+            return SensorError::NotReady;
+        if (!IsUsable(GetLightQuality()))
+            return ErrorOf(GetLightQuality());
+        return lightLevel;
+    }
+
+    Result<int, SensorError> GetSoilMoisture()
+    {
+        if (!isReady)
+            return SensorError::NotReady;
+        if (!IsUsable(GetSoilQuality()))
+            return ErrorOf(GetSoilQuality());
+        return soilMoisture;
+    }
 };
 
 #endif
\ No newline at end of file
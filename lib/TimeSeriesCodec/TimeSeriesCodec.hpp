@@ -0,0 +1,384 @@
+#ifndef TIME_SERIES_CODEC_HPP
+#define TIME_SERIES_CODEC_HPP
+
+#include <Arduino.h>
+#include <SensorReader.hpp>
+
+// Compresses readings into self-contained blocks, in the spirit of Facebook's Gorilla:
+//   header      magic, version, sample count, sent at (little endian)
+//   1st sample  32 bit timestamp, then each channel as a 32 bit value, then each channel's quality
+//   later ones  delta-of-delta of the timestamp, then each channel's change from the previous sample,
+//               then a bit that says whether any quality changed, and if so for each channel a bit and
+//               the new quality when it did
+// Values are stored as fixed point hundredths, finer than anything the sensors resolve. Both the
+// timestamp and value deltas are zig-zag encoded and written with a short prefix that says how many
+// bits follow, so a channel that didn't move costs one bit. Timestamps are the probe's millis(); the
+// sender stamps its millis() into the header as the block goes out, which is what ties them to a
+// clock on the other end.
+
+#define TIMESERIES_BLOCK_MAGIC 0xD5
+#define TIMESERIES_BLOCK_VERSION 2
+#define TIMESERIES_HEADER_SIZE 8
+#define TIMESERIES_SENT_AT_OFFSET 4
+#define TIMESERIES_QUALITY_BITS 4
+#define TIMESERIES_CHANNELS 4
+#define TIMESERIES_VALUE_SCALE 100.0f
+#define TIMESERIES_MISSING_VALUE INT32_MIN     // A failed read (NaN) survives the round trip
+
+class BitWriter
+{
+private:
+    uint8_t* data = nullptr;
+    size_t capacity = 0;        // In bits
+    size_t position = 0;
+    bool isOverflowed = false;
+
+public:
+    BitWriter() { }
+    BitWriter(uint8_t* data, size_t size) : data(data), capacity(size * 8) { }
+
+    // Most significant bit first. Bits past the end are dropped and make IsOverflowed() true.
+    void Write(uint32_t value, uint8_t bits)
+    {
+        if (position + bits > capacity)
+        {
+            isOverflowed = true;
+            return;
+        }
+
+        while (bits > 0)
+        {
+            uint8_t offset = position & 7;
+            uint8_t room = 8 - offset;
+            uint8_t take = bits < room ? bits : room;
+            uint8_t chunk = (value >> (bits - take)) & ((1u << take) - 1);
+
+            // Clearing what follows the write position lets a rewound writer write over old bits
+            uint8_t& byte = data[position >> 3];
+            byte = (byte & (uint8_t)(0xFF << room)) | (uint8_t)(chunk << (room - take));
+
+            bits -= take;
+            position += take;
+        }
+    }
+
+    size_t GetPosition() { return position; }
+    bool IsOverflowed() { return isOverflowed; }
+
+    void Rewind(size_t newPosition)
+    {
+        position = newPosition;
+        isOverflowed = false;
+    }
+};
+
+class BitReader
+{
+private:
+    const uint8_t* data = nullptr;
+    size_t capacity = 0;
+    size_t position = 0;
+    bool isOverflowed = false;
+
+public:
+    BitReader() { }
+    BitReader(const uint8_t* data, size_t size) : data(data), capacity(size * 8) { }
+
+    uint32_t Read(uint8_t bits)
+    {
+        if (position + bits > capacity)
+        {
+            isOverflowed = true;
+            return 0;
+        }
+
+        uint32_t value = 0;
+        while (bits > 0)
+        {
+            uint8_t offset = position & 7;
+            uint8_t room = 8 - offset;
+            uint8_t take = bits < room ? bits : room;
+            uint8_t chunk = (data[position >> 3] >> (room - take)) & ((1u << take) - 1);
+
+            value = (value << take) | chunk;
+            bits -= take;
+            position += take;
+        }
+        return value;
+    }
+
+    bool IsOverflowed() { return isOverflowed; }
+};
+
+namespace TimeSeries
+{
+    inline uint32_t ZigZag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+    inline int32_t UnZigZag(uint32_t value) { return (int32_t)(value >> 1) ^ -(int32_t)(value & 1); }
+
+    inline int32_t Quantize(float value)
+    {
+        if (isnan(value))
+            return TIMESERIES_MISSING_VALUE;
+        return (int32_t)lroundf(value * TIMESERIES_VALUE_SCALE);
+    }
+
+    inline float Dequantize(int32_t value)
+    {
+        if (value == TIMESERIES_MISSING_VALUE)
+            return NAN;
+        return (float)value / TIMESERIES_VALUE_SCALE;
+    }
+
+    // A prefix of 0, 10, 110, 1110 or 1111 says whether none, widths[0], [1], [2] or 32 bits of the value follow
+    inline void WriteVarBits(BitWriter& writer, uint32_t value, const uint8_t (&widths)[3])
+    {
+        if (value == 0)
+            writer.Write(0b0, 1);
+        else if (value < (1UL << widths[0]))
+        {
+            writer.Write(0b10, 2);
+            writer.Write(value, widths[0]);
+        }
+        else if (value < (1UL << widths[1]))
+        {
+            writer.Write(0b110, 3);
+            writer.Write(value, widths[1]);
+        }
+        else if (value < (1UL << widths[2]))
+        {
+            writer.Write(0b1110, 4);
+            writer.Write(value, widths[2]);
+        }
+        else
+        {
+            writer.Write(0b1111, 4);
+            writer.Write(value, 32);
+        }
+    }
+
+    inline uint32_t ReadVarBits(BitReader& reader, const uint8_t (&widths)[3])
+    {
+        if (reader.Read(1) == 0)
+            return 0;
+        if (reader.Read(1) == 0)
+            return reader.Read(widths[0]);
+        if (reader.Read(1) == 0)
+            return reader.Read(widths[1]);
+        if (reader.Read(1) == 0)
+            return reader.Read(widths[2]);
+        return reader.Read(32);
+    }
+
+    inline void StampSentAt(uint8_t* block, uint32_t now)
+    {
+        for (int i = 0; i < 4; i++)
+            block[TIMESERIES_SENT_AT_OFFSET + i] = now >> (i * 8);
+    }
+
+    inline uint32_t GetSentAt(const uint8_t* block)
+    {
+        uint32_t sentAt = 0;
+        for (int i = 0; i < 4; i++)
+            sentAt |= (uint32_t)block[TIMESERIES_SENT_AT_OFFSET + i] << (i * 8);
+        return sentAt;
+    }
+
+    inline void UnpackQuality(const SensorReadings& readings, uint8_t (&quality)[TIMESERIES_CHANNELS])
+    {
+        quality[0] = (uint8_t)readings.temperatureQuality;
+        quality[1] = (uint8_t)readings.humidityQuality;
+        quality[2] = (uint8_t)readings.soilMoistureQuality;
+        quality[3] = (uint8_t)readings.lightLevelQuality;
+    }
+
+    // Timestamps: jitter of a loop pass or two, then a missed sample or two, then anything
+    static const uint8_t TIMESTAMP_WIDTHS[3] = { 7, 9, 12 };
+    // Values in hundredths: noise, one step of a DHT11 or the 8 bit ADC, then a jump
+    static const uint8_t VALUE_WIDTHS[3] = { 4, 8, 12 };
+}
+
+class TimeSeriesEncoder
+{
+private:
+    uint8_t* block = nullptr;
+    BitWriter writer;
+    uint16_t count = 0;
+
+    uint32_t lastTimestamp = 0;
+    int32_t lastDelta = 0;
+    int32_t lastValues[TIMESERIES_CHANNELS];
+    uint8_t lastQuality[TIMESERIES_CHANNELS];
+
+    static void Unpack(const SensorReadings& readings, int32_t (&values)[TIMESERIES_CHANNELS])
+    {
+        values[0] = TimeSeries::Quantize(readings.temperature);
+        values[1] = TimeSeries::Quantize(readings.humidity);
+        values[2] = TimeSeries::Quantize(readings.soilMoisture);
+        values[3] = TimeSeries::Quantize(readings.lightLevel);
+    }
+
+public:
+    TimeSeriesEncoder() { }
+
+    void Begin(uint8_t* newBlock, size_t size)
+    {
+        block = newBlock;
+        count = 0;
+        lastDelta = 0;
+
+        block[0] = TIMESERIES_BLOCK_MAGIC;
+        block[1] = TIMESERIES_BLOCK_VERSION;
+        block[2] = 0;
+        block[3] = 0;
+        TimeSeries::StampSentAt(block, 0);
+        writer = BitWriter(block + TIMESERIES_HEADER_SIZE, size - TIMESERIES_HEADER_SIZE);
+    }
+
+    // Returns false, leaving the block as it was, once the sample doesn't fit
+    bool Append(const SensorReadings& readings)
+    {
+        if (count == UINT16_MAX)
+            return false;
+
+        int32_t values[TIMESERIES_CHANNELS];
+        uint8_t quality[TIMESERIES_CHANNELS];
+        Unpack(readings, values);
+        TimeSeries::UnpackQuality(readings, quality);
+        uint32_t timestamp = readings.sampledAt;
+        int32_t delta = (int32_t)(timestamp - lastTimestamp);
+
+        size_t start = writer.GetPosition();
+        if (count == 0)
+        {
+            writer.Write(timestamp, 32);
+            for (int i = 0; i < TIMESERIES_CHANNELS; i++)
+                writer.Write((uint32_t)values[i], 32);
+            for (int i = 0; i < TIMESERIES_CHANNELS; i++)
+                writer.Write(quality[i], TIMESERIES_QUALITY_BITS);
+        }
+        else
+        {
+            TimeSeries::WriteVarBits(writer, TimeSeries::ZigZag((int32_t)((uint32_t)delta - (uint32_t)lastDelta)), TimeSeries::TIMESTAMP_WIDTHS);
+            for (int i = 0; i < TIMESERIES_CHANNELS; i++)
+                TimeSeries::WriteVarBits(writer, TimeSeries::ZigZag((int32_t)((uint32_t)values[i] - (uint32_t)lastValues[i])), TimeSeries::VALUE_WIDTHS);
+
+            bool isQualityChanged = memcmp(quality, lastQuality, sizeof(quality)) != 0;
+            writer.Write(isQualityChanged, 1);
+            for (int i = 0; isQualityChanged && i < TIMESERIES_CHANNELS; i++)
+            {
+                writer.Write(quality[i] != lastQuality[i], 1);
+                if (quality[i] != lastQuality[i])
+                    writer.Write(quality[i], TIMESERIES_QUALITY_BITS);
+            }
+        }
+
+        if (writer.IsOverflowed())
+        {
+            writer.Rewind(start);
+            return false;
+        }
+
+        lastDelta = count == 0 ? 0 : delta;
+        lastTimestamp = timestamp;
+        memcpy(lastValues, values, sizeof(values));
+        memcpy(lastQuality, quality, sizeof(quality));
+
+        count++;
+        block[2] = count & 0xFF;
+        block[3] = count >> 8;
+        return true;
+    }
+
+    uint16_t GetCount() { return count; }
+    size_t GetSize() { return TIMESERIES_HEADER_SIZE + (writer.GetPosition() + 7) / 8; }
+};
+
+class TimeSeriesDecoder
+{
+private:
+    BitReader reader;
+    uint16_t count = 0;
+    uint16_t decoded = 0;
+
+    uint32_t lastTimestamp = 0;
+    int32_t lastDelta = 0;
+    int32_t lastValues[TIMESERIES_CHANNELS];
+    uint8_t lastQuality[TIMESERIES_CHANNELS];
+    uint32_t sentAt = 0;
+
+public:
+    TimeSeriesDecoder() { }
+
+    bool Begin(const uint8_t* block, size_t length)
+    {
+        if (length < TIMESERIES_HEADER_SIZE || block[0] != TIMESERIES_BLOCK_MAGIC || block[1] != TIMESERIES_BLOCK_VERSION)
+            return false;
+
+        count = block[2] | (block[3] << 8);
+        sentAt = TimeSeries::GetSentAt(block);
+        decoded = 0;
+        lastDelta = 0;
+        reader = BitReader(block + TIMESERIES_HEADER_SIZE, length - TIMESERIES_HEADER_SIZE);
+        return true;
+    }
+
+    uint16_t GetCount() { return count; }
+
+    // The sender's millis() when the block went out, 0 if it never did. Now on the receiving clock
+    // minus this, plus a timestamp, puts the sample on the receiving clock.
+    uint32_t GetSentAt() { return sentAt; }
+
+    bool Next(SensorReadings& readings)
+    {
+        if (decoded == count)
+            return false;
+
+        if (decoded == 0)
+        {
+            lastTimestamp = reader.Read(32);
+            for (int i = 0; i < TIMESERIES_CHANNELS; i++)
+                lastValues[i] = (int32_t)reader.Read(32);
+            for (int i = 0; i < TIMESERIES_CHANNELS; i++)
+                lastQuality[i] = reader.Read(TIMESERIES_QUALITY_BITS);
+        }
+        else
+        {
+            lastDelta = (int32_t)((uint32_t)lastDelta + (uint32_t)TimeSeries::UnZigZag(TimeSeries::ReadVarBits(reader, TimeSeries::TIMESTAMP_WIDTHS)));
+            lastTimestamp += lastDelta;
+            for (int i = 0; i < TIMESERIES_CHANNELS; i++)
+                lastValues[i] = (int32_t)((uint32_t)lastValues[i] + (uint32_t)TimeSeries::UnZigZag(TimeSeries::ReadVarBits(reader, TimeSeries::VALUE_WIDTHS)));
+
+            if (reader.Read(1) == 1)
+            {
+                for (int i = 0; i < TIMESERIES_CHANNELS; i++)
+                {
+                    if (reader.Read(1) == 1)
+                        lastQuality[i] = reader.Read(TIMESERIES_QUALITY_BITS);
+                }
+            }
+        }
+
+        if (reader.IsOverflowed())
+            return false;
+        for (uint8_t quality : lastQuality)
+        {
+            if (quality > (uint8_t)SampleQuality::Stuck)
+                return false;
+        }
+
+        readings.temperature = TimeSeries::Dequantize(lastValues[0]);
+        readings.humidity = TimeSeries::Dequantize(lastValues[1]);
+        readings.soilMoisture = TimeSeries::Dequantize(lastValues[2]);
+        readings.lightLevel = TimeSeries::Dequantize(lastValues[3]);
+        readings.temperatureQuality = (SampleQuality)lastQuality[0];
+        readings.humidityQuality = (SampleQuality)lastQuality[1];
+        readings.soilMoistureQuality = (SampleQuality)lastQuality[2];
+        readings.lightLevelQuality = (SampleQuality)lastQuality[3];
+        readings.sampledAt = lastTimestamp;
+
+        decoded++;
+        return true;
+    }
+};
+
+#endif
@@ -7,8 +7,12 @@
 #include <EEPROM.h>
 #include <ESP8266WiFi.h>
 #include <Preferences.hpp>
+#include <Logger.hpp>
 #include <stdlib.h>
 
+#define WIFI_CONNECT_TIMEOUT 20000
+#define WIFI_UPDATE_INTERVAL 100
+
 enum WiFiManagerState {
     Disconnected,
     Connecting,
@@ -19,6 +23,9 @@ enum WiFiManagerState {
 class WiFiManager
 {
 private:
+    ESP8266WiFiClass& wifi;
+    PreferencesManager& preferences;
+
     wl_status_t wifiStatus;
 
     WiFiManagerState state = WiFiManagerState::Disconnected;
@@ -28,17 +35,36 @@ private:
     unsigned long lastDotTime;
     unsigned long lastConnectTime;
 
-    unsigned long connectTimeout = 20000;
+    unsigned long connectTimeout = WIFI_CONNECT_TIMEOUT;
 
     unsigned long updateInterval;
 
+    // Time spent in each state, for link telemetry. ConnectionTimedOut never outlasts an Update().
+    unsigned long stateTime[ConnectionTimedOut + 1] = { };
+    WiFiManagerState accountedState = WiFiManagerState::Disconnected;
+    unsigned long stateEnteredAt = 0;
+    unsigned long connectCount = 0;
+
+    void AccountStateTime()
+    {
+        if (state == accountedState)
+            return;
+
+        stateTime[accountedState] += millis() - stateEnteredAt;
+        accountedState = state;
+        stateEnteredAt = millis();
+
+        if (state == WiFiManagerState::Connected)
+            connectCount++;
+    }
+
     void HandleStates()
     {
         if (state == WiFiManagerState::Connecting)
         {
             if (millis() - lastDotTime >= 1000)
             {
-                Serial.print(".");
+                LOG_DEBUG("Connecting... (%lu ms)", millis() - lastConnectTime);
                 lastDotTime = millis();
             }
 
@@ -70,32 +96,40 @@ private:
     {
         if (state == WiFiManagerState::Connected && prevState == WiFiManagerState::Connecting)
         {
-            Serial.printf("\nConnected to %s! Local IP: %s\n", WiFi.SSID().c_str(), WiFi.localIP().toString().c_str());
+            IPAddress localIP = wifi.localIP();
+            char localIPText[16];
+            snprintf_P(localIPText, sizeof(localIPText), PSTR("%u.%u.%u.%u"), localIP[0], localIP[1], localIP[2], localIP[3]);
+            LOG_INFO("Connected to %s! Local IP: %s", preferences.GetWiFiCredentials().ssid, localIPText);
         }
 
         if (state == WiFiManagerState::Disconnected && prevState == WiFiManagerState::Connecting)
         {
-            Serial.printf("\nConnection error!\n");
+            LOG_ERROR("Connection error!");
         }
 
         if (state == WiFiManagerState::Disconnected && prevState == WiFiManagerState::Connected)
         {
-            Serial.println("Disconnected!");
+            LOG_WARN("Disconnected!");
         }
 
         if (state == WiFiManagerState::ConnectionTimedOut)
         {
-            Serial.println("\nCouldn't connect - timed out");
+            LOG_ERROR("Couldn't connect - timed out");
             state = WiFiManagerState::Disconnected;
         }
     }
 
 public:
-    WiFiManager(unsigned long updateInterval = 100)
+    WiFiManager(ESP8266WiFiClass& wifi, PreferencesManager& preferences, unsigned long updateInterval = WIFI_UPDATE_INTERVAL)
+        : wifi(wifi), preferences(preferences)
     {
         this->updateInterval = updateInterval;
     }
 
+    // Both take effect from the next Update(), including on a connection attempt already under way
+    void SetConnectTimeout(unsigned long timeout) { connectTimeout = timeout; }
+    void SetUpdateInterval(unsigned long interval) { updateInterval = interval; }
+
     void SetCredentials(const char* ssid, const char* password)
     {
         WiFiCredentials credentials;
@@ -114,7 +148,8 @@ public:
     void PrintCredentials()
     {
         auto credentials = preferences.GetWiFiCredentials();
-        Serial.printf("SSID: %s\nPassword: %s\n", credentials.ssid, credentials.password);
+        LOG_INFO("SSID: %s", credentials.ssid);
+        LOG_INFO("Password: %s", credentials.password);
     }
 
     bool Connect()
@@ -123,12 +158,13 @@ public:
 
         auto credentials = preferences.GetWiFiCredentials();
 
-        Serial.printf("Connecting to %s...\n", credentials.ssid);
+        LOG_INFO("Connecting to %s...", credentials.ssid);
 
         state = WiFiManagerState::Connecting;
-        WiFi.begin(credentials.ssid, credentials.password);
+        wifi.begin(credentials.ssid, credentials.password);
 
         lastConnectTime = millis();
+        AccountStateTime();
 
         return true;
     }
@@ -136,8 +172,8 @@ public:
     void Disconnect()
     {
         auto credentials = preferences.GetWiFiCredentials();
-        Serial.printf("Disconnecting from %s...\n", credentials.ssid);
-        WiFi.disconnect();
+        LOG_INFO("Disconnecting from %s...", credentials.ssid);
+        wifi.disconnect();
     }
 
     bool IsConnected()
@@ -154,18 +190,29 @@ public:
     {
         if (millis() - lastUpdateTime < updateInterval) return;
         
-        wifiStatus = WiFi.status();
+        wifiStatus = wifi.status();
 
         HandleStates();
         HandleStateTransitions();
 
         lastUpdateTime = millis();
         prevState = state;
+        AccountStateTime();
     }
 
-    String GetLocalIP()
+    IPAddress GetLocalIP()
+    {
+        return wifi.localIP();
+    }
+
+    int32_t GetRSSI() { return wifi.RSSI(); }
+
+    WiFiManagerState GetState() { return state; }
+    unsigned long GetConnectCount() { return connectCount; }
+
+    unsigned long GetTimeInState(WiFiManagerState inState)
     {
-        return WiFi.localIP().toString();
+        return stateTime[inState] + (inState == accountedState ? millis() - stateEnteredAt : 0);
     }
 };
 
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Builds the fleet simulator and the native firmware, then runs the unit tests and the checks that
+# guard boot time and steady-state allocations. Exits non-zero if any of them fails:
+#   ./scripts/regression-check.sh
+#   BOOT_BUDGET   ms from boot to the first sample that no probe may exceed (1000)
+#   PIO           the PlatformIO command (pio)
+
+BOOT_BUDGET=${BOOT_BUDGET:-1000}
+PIO=${PIO:-pio}
+
+cd "$(dirname "$0")/.." || exit 1
+
+failed=0
+
+check()
+{
+    name=$1
+    shift
+    echo "==== $name"
+    if "$@"; then
+        echo "==== $name: ok"
+    else
+        echo "==== $name: FAILED with exit code $?"
+        failed=1
+    fi
+}
+
+# Before the build: the tests are built into the native environment's directory as well
+check "unit tests" "$PIO" test -e native
+
+"$PIO" run -e native -e fleet || exit 1
+
+# Discovery and a UUID request on every probe
+check "boot budget, fresh fleet" .pio/build/fleet/program --probes 200 --boot-budget "$BOOT_BUDGET"
+
+# Gateways relaying for their leaves
+check "boot budget, provisioned mesh" .pio/build/fleet/program --probes 200 --mesh 10 --provisioned --boot-budget "$BOOT_BUDGET"
+
+# Connected, sampling and relaying as a gateway once warm; any allocating loop pass fails
+check "alloc audit" .pio/build/native/program --step 10 --duration 65000 --exec "wifi-set net pass" \
+    --exec "server-autoconnect on" --exec "wifi-autoconnect on" --exec "mesh gateway" --alloc-audit 30000
+
+exit $failed
@@ -0,0 +1,353 @@
+// Host-side micro-benchmarks for the probe's hot paths: pio run -e bench && .pio/build/bench/program
+//   --trace <source>   also measure history compression on a recorded trace (CSV, see NativeHAL::UseTrace)
+
+#include <Arduino.h>
+#include <NativeHAL.hpp>
+#include <Pins.h>
+
+#include <Aggregator.hpp>
+#include <Command.hpp>
+#include <HistoryBuffer.hpp>
+#include <Logger.hpp>
+#include <Preferences.hpp>
+#include <Sender.hpp>
+#include <SensorReader.hpp>
+#include <TimeSeriesCodec.hpp>
+
+#include <chrono>
+
+#define BENCH_MIN_TIME_NS 200000000ULL
+#define BENCH_MAX_ITERATIONS (1UL << 26)
+#define BENCH_CODEC_SAMPLES 4096
+#define BENCH_SAMPLE_INTERVAL 2000
+#define BENCH_RAW_SAMPLE_BITS (32 + 4 * 32)     // sampledAt and four floats, uncompressed
+
+template <typename T>
+static void Consume(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+template <typename F>
+static void Benchmark(const char* name, F&& body)
+{
+    body();     // Warm-up, so one-off allocations don't count
+
+    for (unsigned long iterations = 1; ; iterations *= 2)
+    {
+        NativeHAL::ResetAllocationStats();
+        auto start = std::chrono::steady_clock::now();
+
+        for (unsigned long i = 0; i < iterations; i++)
+            body();
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if ((unsigned long long)elapsed < BENCH_MIN_TIME_NS && iterations < BENCH_MAX_ITERATIONS)
+            continue;
+
+        NativeHAL::AllocationStats allocations = NativeHAL::GetAllocationStats();
+        printf("%-32s %12.1f ns/op %10.3f allocs/op %12lu iterations\n", name,
+            (double)elapsed / (double)iterations, (double)allocations.allocations / (double)iterations, iterations);
+        return;
+    }
+}
+
+struct BenchContext { };
+
+static CommandResult NoOp(BenchContext& context, int argc, char** argv)
+{
+    return OK;
+}
+
+static PreferencesManager preferences(EEPROM);
+
+static void BenchmarkSender()
+{
+    static Sender sender(preferences);
+    sender.SetIP("192.168.1.10");
+    sender.SetUUID("00000000-0000-4000-8000-000000000001");
+    sender.Begin();
+    sender.Update();
+
+    SensorReadings readings { 21.0f, 54.0f, 37.6f, 81.2f, 0,
+        SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok };
+    Benchmark("sender/send-message", [&]() {
+        readings.temperature += 0.01f;
+        sender.SendMessage(readings);
+    });
+
+    static WindowSummary summary;
+    summary.start = 0;
+    summary.length = 60000;
+    for (int i = 0; i < 30; i++)
+    {
+        summary.temperature.Add(21.0f + i * 0.05f);
+        summary.humidity.Add(54.0f - i * 0.1f);
+        summary.soilMoisture.Add(37.6f);
+        summary.lightLevel.Add(81.2f + (i & 3));
+    }
+
+    Benchmark("sender/send-summary", []() {
+        sender.SendSummary(summary);
+    });
+}
+
+static void BenchmarkAggregator()
+{
+    static WindowedAggregator aggregator;
+    aggregator.SetWindowLength(60000);
+
+    SensorReadings readings { 21.0f, 54.0f, 37.6f, 81.2f, 0,
+        SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok };
+    Benchmark("aggregator/add", [&]() {
+        readings.temperature += 0.01f;
+        aggregator.Add(readings);
+    });
+
+    Benchmark("aggregator/update", []() {
+        NativeHAL::AdvanceMillis(2000);
+        aggregator.Update();
+        aggregator.ClearSummary();
+    });
+}
+
+static void BenchmarkCommands()
+{
+    static CommandExecutor<20, BenchContext> executor;
+    static BenchContext context;
+    static const char* const names[] = {
+        "wifi-set", "wifi-connect", "wifi-disconnect", "wifi-clear", "get-temperature", "get-humidity",
+        "get-soil-moisture", "get-light-level", "server-info", "send-begin", "test-eeprom", "http-clear",
+        "ip-clear", "uuid-clear", "ip-set", "uuid-set", "wifi-autoconnect", "server-autoconnect", "heap-stats"
+    };
+
+    for (const char* name : names)
+        executor.AddCommand(Command<BenchContext>(name, 0, NoOp));
+
+    Benchmark("command/dispatch-first", []() {
+        auto result = executor.ExecuteCommand(context, "wifi-set");
+        Consume(result);
+    });
+
+    Benchmark("command/dispatch-last", []() {
+        auto result = executor.ExecuteCommand(context, "heap-stats");
+        Consume(result);
+    });
+
+    Benchmark("command/dispatch-with-args", []() {
+        auto result = executor.ExecuteCommand(context, "server-info 192.168.1.10 00000000-0000-4000-8000-000000000001");
+        Consume(result);
+    });
+
+    Benchmark("command/unknown", []() {
+        auto result = executor.ExecuteCommand(context, "does-not-exist");
+        Consume(result);
+    });
+}
+
+static void BenchmarkPreferences()
+{
+    preferences.SetServerIP("192.168.1.10");
+    preferences.SetProbeUUID("00000000-0000-4000-8000-000000000001");
+
+    Benchmark("preferences/save", []() {
+        preferences.Save();
+    });
+
+    Benchmark("preferences/load", []() {
+        auto loaded = preferences.Load();
+        Consume(loaded);
+    });
+}
+
+static void BenchmarkSensors()
+{
+    static SensorReader sensors(PIN_DHT, PIN_SDA, PIN_SCL);
+    sensors.Begin();
+    NativeHAL::AdvanceMillis(5000);
+    sensors.Update();
+
+    Benchmark("sensors/update", []() {
+        sensors.Update();
+    });
+
+    Benchmark("sensors/get-readings", []() {
+        auto readings = sensors.GetReadings();
+        Consume(readings);
+    });
+
+    int raw = 0;
+    Benchmark("sensors/raw-to-percent", [&]() {
+        float percent = SensorReader::RawToPercent(raw++ & 0xFF);
+        Consume(percent);
+    });
+}
+
+// Readings as the probe takes them: sensors polled every 10 ms and sampled every couple of seconds
+static void RecordReadings(SensorReadings* samples, unsigned int count)
+{
+    SensorReader sensors(PIN_DHT, PIN_SDA, PIN_SCL);
+    sensors.Begin();
+
+    unsigned long lastSampleTime = millis();
+    for (unsigned int recorded = 0; recorded < count; )
+    {
+        NativeHAL::AdvanceMillis(10);
+        sensors.Update();
+
+        if (millis() - lastSampleTime > BENCH_SAMPLE_INTERVAL)
+        {
+            auto readings = sensors.GetReadings();
+            if (readings.HasValue())
+                samples[recorded++] = readings.GetValue();
+            lastSampleTime = millis();
+        }
+    }
+}
+
+static bool IsSameReading(float original, float decoded)
+{
+    return isnan(original) ? isnan(decoded) : fabsf(original - decoded) <= 0.5f / TIMESERIES_VALUE_SCALE + 1e-4f;
+}
+
+static void BenchmarkCodec(const char* name)
+{
+    static SensorReadings samples[BENCH_CODEC_SAMPLES];
+    static uint8_t blocks[BENCH_CODEC_SAMPLES][HISTORY_BLOCK_SIZE];     // Far more than the samples need
+    static size_t lengths[BENCH_CODEC_SAMPLES];
+    RecordReadings(samples, BENCH_CODEC_SAMPLES);
+
+    // Size and round trip, in the history's block size
+    TimeSeriesEncoder encoder;
+    unsigned int blockCount = 0;
+    size_t totalBytes = 0;
+    encoder.Begin(blocks[0], HISTORY_BLOCK_SIZE);
+    for (unsigned int i = 0; i < BENCH_CODEC_SAMPLES; i++)
+    {
+        if (!encoder.Append(samples[i]))
+        {
+            lengths[blockCount] = encoder.GetSize();
+            totalBytes += lengths[blockCount++];
+            encoder.Begin(blocks[blockCount], HISTORY_BLOCK_SIZE);
+            encoder.Append(samples[i]);
+        }
+    }
+    lengths[blockCount] = encoder.GetSize();
+    totalBytes += lengths[blockCount++];
+
+    unsigned int mismatches = 0;
+    unsigned int decodedCount = 0;
+    for (unsigned int block = 0; block < blockCount; block++)
+    {
+        TimeSeriesDecoder decoder;
+        SensorReadings decoded;
+        decoder.Begin(blocks[block], lengths[block]);
+        while (decoder.Next(decoded))
+        {
+            const SensorReadings& original = samples[decodedCount++];
+            if (decoded.sampledAt != (uint32_t)original.sampledAt ||     // millis() is 32 bits on the board
+                !IsSameReading(original.temperature, decoded.temperature) ||
+                !IsSameReading(original.humidity, decoded.humidity) ||
+                !IsSameReading(original.soilMoisture, decoded.soilMoisture) ||
+                !IsSameReading(original.lightLevel, decoded.lightLevel) ||
+                original.temperatureQuality != decoded.temperatureQuality || original.humidityQuality != decoded.humidityQuality ||
+                original.soilMoistureQuality != decoded.soilMoistureQuality || original.lightLevelQuality != decoded.lightLevelQuality)
+                mismatches++;
+        }
+    }
+
+    double bitsPerSample = (double)totalBytes * 8.0 / (double)BENCH_CODEC_SAMPLES;
+    printf("%-32s %12.1f bits/sample %8.1fx vs raw %10u blocks %s\n", name, bitsPerSample,
+        (double)BENCH_RAW_SAMPLE_BITS / bitsPerSample, blockCount,
+        decodedCount == BENCH_CODEC_SAMPLES && mismatches == 0 ? "round trip ok" : "ROUND TRIP FAILED");
+
+    // Speed, one sample per op
+    static unsigned int next;
+    static uint8_t scratch[HISTORY_BLOCK_SIZE];
+    static TimeSeriesEncoder benchEncoder;
+    next = 0;
+    benchEncoder.Begin(scratch, sizeof(scratch));
+
+    char label[48];
+    snprintf(label, sizeof(label), "%s/encode", name);
+    Benchmark(label, []() {
+        if (!benchEncoder.Append(samples[next]))
+        {
+            benchEncoder.Begin(scratch, sizeof(scratch));
+            benchEncoder.Append(samples[next]);
+        }
+        next = (next + 1) % BENCH_CODEC_SAMPLES;
+    });
+
+    static TimeSeriesDecoder benchDecoder;
+    static unsigned int block;
+    block = 0;
+    benchDecoder.Begin(blocks[0], lengths[0]);
+    snprintf(label, sizeof(label), "%s/decode", name);
+    Benchmark(label, [blockCount]() {
+        SensorReadings decoded;
+        if (!benchDecoder.Next(decoded))
+        {
+            block = (block + 1) % blockCount;
+            benchDecoder.Begin(blocks[block], lengths[block]);
+            benchDecoder.Next(decoded);
+        }
+        Consume(decoded);
+    });
+}
+
+static void BenchmarkLogger()
+{
+    Serial.SetEcho(false);
+
+    Benchmark("logger/write", []() {
+        LOG_INFO("Temperature: %f oC, light %d%%", 21.5f, 42);
+        if (Logger::GetQueuedCount() == LOG_QUEUE_SIZE)
+            Logger::Flush();
+    });
+
+    Benchmark("logger/write-and-format", []() {
+        LOG_INFO("Using stored UUID: %s", "00000000-0000-4000-8000-000000000001");
+        Logger::Update();
+    });
+
+    Serial.SetEcho(true);
+}
+
+int main(int argc, char** argv)
+{
+    const char* trace = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            trace = argv[++i];
+    }
+
+    NativeHAL::UseManualClock(true);
+    NativeHAL::UseDefaultServer("192.168.1.10");
+
+    BenchmarkSender();
+    BenchmarkAggregator();
+    BenchmarkCommands();
+    BenchmarkPreferences();
+    BenchmarkSensors();
+    BenchmarkLogger();
+
+    // The fakes' own slow drift first, since a trace can't be switched off again
+    BenchmarkCodec("codec/drift");
+    NativeHAL::UseTrace("synthetic:bursty");
+    BenchmarkCodec("codec/bursty");
+    NativeHAL::UseTrace("synthetic:noisy");
+    BenchmarkCodec("codec/noisy");
+    if (trace != nullptr)
+    {
+        if (!NativeHAL::UseTrace(trace))
+        {
+            fprintf(stderr, "Can't read trace %s\n", trace);
+            return 2;
+        }
+        BenchmarkCodec("codec/trace");
+    }
+
+    return 0;
+}
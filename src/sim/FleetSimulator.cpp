@@ -0,0 +1,334 @@
+// Runs many probes in one process against the NativeHAL server stand-ins: pio run -e fleet && .pio/build/fleet/program
+//   --probes <n>         how many probes (100)
+//   --duration <ms>      simulated time to run for (60000)
+//   --step <ms>          simulated time per pass over the fleet (10)
+//   --boot-spread <ms>   spread power-on evenly over this long; 0 boots everyone at once (0)
+//   --provisioned        probes already know the server IP and their UUID, so no discovery
+//   --aggregate <s>      probes send one summary per window of this many seconds instead of every reading
+//   --fault <spec>       WebSocket server fault, same as the native firmware (repeatable)
+//   --trace <source>     sensor trace, same as the native firmware
+//   --hello <reply>      answer hellos with <encoding>:<interval>:<batch>, same as the native firmware
+//   --command-at <ms> "<line>"  send a command line to every connected probe, same as the native firmware
+//   --boot-budget <ms>   exit with 1 if a probe takes longer than this from boot to its first sample
+//   --mesh <n>           group probes by n: the first of each group is a gateway, the others its ESP-NOW leaves
+//   --verbose            print the probes' logs
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <ESP8266WiFi.h>
+#include <NativeHAL.hpp>
+#include <Pins.h>
+
+#include <AirTransport.hpp>
+#include <Logger.hpp>
+#include <Preferences.hpp>
+#include <Probe.hpp>
+#include <TimeSeriesCodec.hpp>
+
+#define FLEET_SERVER_IP "192.168.1.10"
+#define FLEET_MESH_CHANNEL 6     // The fake WiFi's
+#define FLEET_MESH_KEY "fleet-mesh-key16"
+
+struct SimulatedProbe
+{
+    EEPROMClass eeprom;
+    ESP8266WiFiClass wifi;
+    HardwareSerial serial;
+    AirTransport mesh;
+    Probe probe;
+
+    unsigned long bootAt;
+    bool isBooted = false;
+
+    SimulatedProbe(unsigned long bootAt, const uint8_t* mac)
+        : mesh(wifi, mac), probe({ eeprom, wifi, serial, mesh }, PIN_DHT, PIN_SDA, PIN_SCL), bootAt(bootAt)
+    {
+    }
+};
+
+// Unique across the fleet, unlike the WiFi's
+static void MakeMAC(unsigned long index, uint8_t* mac)
+{
+    const uint8_t address[MESH_MAC_SIZE] = { 0x5C, 0xCF, 0x7F, (uint8_t)(index >> 16), (uint8_t)(index >> 8), (uint8_t)index };
+    memcpy(mac, address, MESH_MAC_SIZE);
+}
+
+// Busiest simulated second seen for a counter, e.g. reconnects per second during a storm
+class PeakRate
+{
+private:
+    unsigned long lastCount = 0;
+    unsigned long peak = 0;
+
+public:
+    void Sample(unsigned long count)
+    {
+        peak = max(peak, count - lastCount);
+        lastCount = count;
+    }
+
+    unsigned long GetPeak() { return peak; }
+};
+
+// With a mesh, the first probe of every group of meshSize is the gateway and the rest are its leaves.
+// Leaves need their UUID whether or not the fleet is provisioned.
+static void Provision(SimulatedProbe& simulated, unsigned long index, bool provisioned, unsigned long aggregationWindow, unsigned long meshSize)
+{
+    MeshSettings mesh = { };
+    if (meshSize > 1)
+    {
+        mesh.role = index % meshSize == 0 ? MeshRole::Gateway : MeshRole::Leaf;
+        MakeMAC(index - index % meshSize, mesh.gatewayMAC);
+        mesh.channel = FLEET_MESH_CHANNEL;
+        mesh.hasKey = true;
+        memcpy(mesh.key, FLEET_MESH_KEY, MESH_KEY_SIZE);
+
+        for (unsigned long leaf = index + 1; mesh.role == MeshRole::Gateway && leaf < index + meshSize; leaf++)
+        {
+            uint8_t mac[MESH_MAC_SIZE];
+            MakeMAC(leaf, mac);
+            mesh.Allow(mac);
+        }
+    }
+    bool isLeaf = mesh.role == MeshRole::Leaf;
+
+    PreferencesManager preferences(simulated.eeprom);
+
+    WiFiCredentials credentials;
+    strncpy(credentials.ssid, "fleet", sizeof(credentials.ssid));
+    strncpy(credentials.password, "fleet-password", sizeof(credentials.password));
+    preferences.SetWiFiCredentials(credentials);
+    preferences.SetAutoConnectToWiFi(true);
+    preferences.SetAutoConnectToServer(true);
+    preferences.SetAggregationWindow(aggregationWindow);
+
+    if (provisioned || isLeaf)
+    {
+        char uuid[sizeof(HTTPCredentials::uuid)];
+        snprintf(uuid, sizeof(uuid), "00000000-0000-4000-9000-%012lx", index);
+        preferences.SetServerIP(FLEET_SERVER_IP);
+        preferences.SetProbeUUID(uuid);
+    }
+    if (meshSize > 1)
+        preferences.SetMeshSettings(mesh);
+
+    preferences.Save();
+
+    // Everyone shares one /24 so discovery finds the server; addresses don't need to be unique
+    simulated.wifi.SetLocalIP(IPAddress(192, 168, 1, 20 + index % 230));
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long probeCount = 100;
+    unsigned long duration = 60000;
+    unsigned long step = 10;
+    unsigned long bootSpread = 0;
+    unsigned long aggregationWindow = 0;
+    bool provisioned = false;
+    bool verbose = false;
+    unsigned long bootBudget = 0;
+    unsigned long meshSize = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--probes") == 0 && i + 1 < argc)
+            probeCount = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc)
+            duration = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--step") == 0 && i + 1 < argc)
+            step = max(strtoul(argv[++i], nullptr, 10), 1UL);
+        else if (strcmp(argv[i], "--boot-spread") == 0 && i + 1 < argc)
+            bootSpread = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--aggregate") == 0 && i + 1 < argc)
+            aggregationWindow = strtoul(argv[++i], nullptr, 10) * 1000;
+        else if (strcmp(argv[i], "--provisioned") == 0)
+            provisioned = true;
+        else if (strcmp(argv[i], "--verbose") == 0)
+            verbose = true;
+        else if (strcmp(argv[i], "--boot-budget") == 0 && i + 1 < argc)
+            bootBudget = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+            meshSize = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--fault") == 0 && i + 1 < argc)
+        {
+            if (!NativeHAL::webSocketServer.ScheduleFault(argv[++i]))
+            {
+                fprintf(stderr, "Bad fault %s\n", argv[i]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "--hello") == 0 && i + 1 < argc)
+        {
+            if (!NativeHAL::webSocketServer.SetHelloReply(argv[++i]))
+            {
+                fprintf(stderr, "Bad hello reply %s\n", argv[i]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "--command-at") == 0 && i + 2 < argc)
+        {
+            unsigned long at = strtoul(argv[++i], nullptr, 10);
+            if (!NativeHAL::webSocketServer.ScheduleCommand(at, argv[++i]))
+            {
+                fprintf(stderr, "Bad command %s\n", argv[i]);
+                return 2;
+            }
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            if (!NativeHAL::UseTrace(argv[++i]))
+            {
+                fprintf(stderr, "Can't read trace %s\n", argv[i]);
+                return 2;
+            }
+        }
+    }
+
+    NativeHAL::UseManualClock(true);
+    NativeHAL::UseDefaultServer(FLEET_SERVER_IP);
+    Serial.SetEcho(verbose);
+
+    SimulatedProbe** fleet = new SimulatedProbe*[probeCount];
+    for (unsigned long i = 0; i < probeCount; i++)
+    {
+        uint8_t mac[MESH_MAC_SIZE];
+        MakeMAC(i, mac);
+        fleet[i] = new SimulatedProbe(probeCount > 1 ? bootSpread * i / (probeCount - 1) : 0, mac);
+        fleet[i]->serial.SetEcho(verbose);
+        Provision(*fleet[i], i, provisioned, aggregationWindow, meshSize);
+    }
+
+    NativeHAL::WebSocketServerStandIn& server = NativeHAL::webSocketServer;
+    unsigned long upstreamCount = meshSize > 1 ? (probeCount + meshSize - 1) / meshSize : probeCount;     // Leaves don't connect
+
+    // Binary frames are history blocks, decoded the way the server does. Every one should say when it
+    // was sent.
+    unsigned long historyBlocks = 0;
+    unsigned long historySamples = 0;
+    unsigned long historyBytes = 0;
+    unsigned long badHistoryBlocks = 0;
+    unsigned long relayMessages = 0;
+    unsigned long relayedReadings = 0;
+    server.onFrame = [&](WebSocketsClient& client, const uint8_t* payload, size_t length, bool isBinary) {
+        // Relays hold an array per reading inside the "readings" array
+        if (!isBinary && length > 15 && memcmp(payload, "{\"type\":\"relay\"", 15) == 0)
+        {
+            relayMessages++;
+            relayedReadings += std::count(payload, payload + length, '[') - 1;
+            return;
+        }
+        if (!isBinary)
+            return;
+
+        TimeSeriesDecoder decoder;
+        SensorReadings readings;
+        unsigned int decoded = 0;
+        if (decoder.Begin(payload, length))
+        {
+            while (decoder.Next(readings))
+                decoded++;
+        }
+
+        if (decoded == 0 || decoded != decoder.GetCount() || decoder.GetSentAt() == 0)
+            badHistoryBlocks++;
+        historyBlocks++;
+        historySamples += decoded;
+        historyBytes += length;
+    };
+    PeakRate httpRate;
+    PeakRate connectRate;
+    PeakRate frameRate;
+    unsigned long lastSecond = 0;
+    unsigned long allConnectedAt = 0;
+    bool allConnected = false;
+
+    while (millis() < duration)
+    {
+        for (unsigned long i = 0; i < probeCount; i++)
+        {
+            SimulatedProbe& simulated = *fleet[i];
+            if (!simulated.isBooted)
+            {
+                if (millis() < simulated.bootAt)
+                    continue;
+                simulated.probe.Begin();
+                simulated.isBooted = true;
+            }
+            simulated.probe.Update();
+        }
+
+        server.Update();
+        Logger::Update();
+
+        if (!allConnected && server.connections - server.disconnections == upstreamCount)
+        {
+            allConnected = true;
+            allConnectedAt = millis();
+        }
+
+        if (millis() - lastSecond >= 1000)
+        {
+            httpRate.Sample(NativeHAL::httpServer.requestCount);
+            connectRate.Sample(server.connections);
+            frameRate.Sample(server.framesReceived);
+            lastSecond = millis();
+        }
+
+        NativeHAL::AdvanceMillis(step);
+    }
+
+    Logger::Flush();
+
+    printf("---- fleet report: %lu probes, %lu ms ----\n", probeCount, duration);
+    printf("connected:   %lu at the end", server.connections - server.disconnections);
+    if (allConnected)
+        printf(", all of them after %lu ms\n", allConnectedAt);
+    else
+        printf(", never all at once\n");
+    printf("http:        %lu requests, peak %lu/s\n", NativeHAL::httpServer.requestCount, httpRate.GetPeak());
+    printf("websocket:   peak %lu connects/s, peak %lu frames/s\n", connectRate.GetPeak(), frameRate.GetPeak());
+    printf("history:     %lu blocks, %lu samples, %.1f bits/sample, %lu undecodable\n", historyBlocks, historySamples,
+        historySamples == 0 ? 0.0 : (double)historyBytes * 8.0 / (double)historySamples, badHistoryBlocks);
+    if (meshSize > 1)
+    {
+        printf("mesh:        %lu gateways for %lu probes, %lu of %lu ESP-NOW frames acknowledged\n", upstreamCount, probeCount,
+            AirTransport::framesDelivered, AirTransport::framesSent);
+        printf("relay:       %lu messages, %lu readings, %.1f readings/message\n", relayMessages, relayedReadings,
+            relayMessages == 0 ? 0.0 : (double)relayedReadings / (double)relayMessages);
+    }
+    server.PrintReport();
+
+    // How long each boot phase took across the fleet, and who missed the budget for the first sample
+    static NativeHAL::LatencyHistogram bootPhases[(size_t)BootPhase::Count];
+    unsigned long overBudget = 0;
+    for (unsigned long i = 0; i < probeCount; i++)
+    {
+        const BootTrace& trace = fleet[i]->probe.GetBootTrace();
+        for (uint8_t phase = 0; phase < (uint8_t)BootPhase::Count; phase++)
+        {
+            if (trace.IsReached((BootPhase)phase))
+                bootPhases[phase].Add(trace.GetTime((BootPhase)phase));
+        }
+
+        bool isLate = !trace.IsReached(BootPhase::FirstSample) || trace.GetTime(BootPhase::FirstSample) > bootBudget;
+        if (fleet[i]->isBooted && bootBudget > 0 && isLate)
+            overBudget++;
+    }
+
+    printf("---- boot phases, ms after boot ----\n");
+    for (uint8_t phase = 0; phase < (uint8_t)BootPhase::Count; phase++)
+    {
+        const NativeHAL::LatencyHistogram& times = bootPhases[phase];
+        printf("%-13s p50 %lu, p90 %lu, max %lu (%lu of %lu probes)\n", BootTrace::PhaseName((BootPhase)phase), times.Percentile(50),
+            times.Percentile(90), times.GetMax(), times.GetCount(), probeCount);
+    }
+    if (bootBudget > 0)
+        printf("boot budget: %lu of %lu probes took longer than %lu ms to their first sample\n", overBudget, probeCount, bootBudget);
+
+    for (unsigned long i = 0; i < probeCount; i++)
+        delete fleet[i];
+    delete[] fleet;
+
+    return overBudget > 0 ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+// Channel statistics and tumbling windows: pio test -e native -f test_aggregator
+
+#include <Arduino.h>
+#include <NativeHAL.hpp>
+#include <unity.h>
+
+#include <Aggregator.hpp>
+
+static SensorReadings Reading(float temperature, float humidity)
+{
+    return SensorReadings { temperature, humidity, 30.0f, 70.0f, millis(),
+        SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok };
+}
+
+// Starts the clock on a window boundary, so the tests don't depend on each other
+static void AlignTo(unsigned long length)
+{
+    NativeHAL::AdvanceMillis(length - millis() % length);
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_channel_stats_match_the_textbook()
+{
+    ChannelStats stats;
+    const float values[] = { 2.0f, 4.0f, 4.0f, 4.0f, 5.0f, 5.0f, 7.0f, 9.0f };
+    for (float value : values)
+        stats.Add(value);
+
+    TEST_ASSERT_EQUAL_UINT(8, stats.count);
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, stats.min);
+    TEST_ASSERT_EQUAL_FLOAT(9.0f, stats.max);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 5.0f, stats.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 4.0f, stats.GetVariance());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 2.0f, stats.GetStdDev());
+}
+
+void test_channel_stats_keep_precision_far_from_zero()
+{
+    ChannelStats stats;
+    for (int i = 0; i < 1000; i++)
+        stats.Add(1000.0f + (i % 2 == 0 ? 0.5f : -0.5f));
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1000.0f, stats.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.25f, stats.GetVariance());
+}
+
+void test_empty_channel_stats_have_no_variance()
+{
+    ChannelStats stats;
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, stats.GetVariance());
+
+    stats.Add(3.0f);
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, stats.min);
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, stats.max);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, stats.GetVariance());
+}
+
+void test_window_closes_on_its_boundary()
+{
+    AlignTo(10000);
+    WindowedAggregator aggregator;
+    aggregator.SetWindowLength(10000);
+    unsigned long start = millis();
+
+    for (int i = 0; i < 5; i++)
+    {
+        aggregator.Add(Reading(20.0f + i, 50.0f));
+        NativeHAL::AdvanceMillis(1999);
+        aggregator.Update();
+    }
+    TEST_ASSERT_FALSE(aggregator.HasSummary());
+
+    NativeHAL::AdvanceMillis(5);
+    aggregator.Update();
+    TEST_ASSERT_TRUE(aggregator.HasSummary());
+
+    const WindowSummary& summary = aggregator.GetSummary();
+    TEST_ASSERT_EQUAL_UINT32(start, summary.start);
+    TEST_ASSERT_EQUAL_UINT32(10000, summary.length);
+    TEST_ASSERT_EQUAL_UINT(5, summary.GetSampleCount());
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 22.0f, summary.temperature.mean);
+    TEST_ASSERT_EQUAL_UINT32(start + 10000, aggregator.GetOpenWindow().start);
+
+    aggregator.ClearSummary();
+    TEST_ASSERT_FALSE(aggregator.HasSummary());
+}
+
+void test_unusable_values_count_as_samples_but_not_in_their_channel()
+{
+    AlignTo(10000);
+    WindowedAggregator aggregator;
+    aggregator.SetWindowLength(10000);
+
+    SensorReadings failed = Reading(NAN, NAN);
+    failed.temperatureQuality = SampleQuality::Timeout;
+    failed.humidityQuality = SampleQuality::Timeout;
+    aggregator.Add(Reading(20.0f, 50.0f));
+    aggregator.Add(failed);
+    aggregator.Add(Reading(22.0f, 52.0f));
+
+    NativeHAL::AdvanceMillis(10000);
+    aggregator.Update();
+
+    const WindowSummary& summary = aggregator.GetSummary();
+    TEST_ASSERT_EQUAL_UINT(3, summary.GetSampleCount());
+    TEST_ASSERT_EQUAL_UINT(2, summary.temperature.count);
+    TEST_ASSERT_EQUAL_UINT(2, summary.humidity.count);
+    TEST_ASSERT_EQUAL_UINT(3, summary.soilMoisture.count);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 21.0f, summary.temperature.mean);
+}
+
+void test_late_update_stays_on_the_boundaries()
+{
+    AlignTo(10000);
+    WindowedAggregator aggregator;
+    aggregator.SetWindowLength(10000);
+    unsigned long start = millis();
+
+    aggregator.Add(Reading(20.0f, 50.0f));
+    NativeHAL::AdvanceMillis(25000);
+    aggregator.Update();
+
+    TEST_ASSERT_EQUAL_UINT32(start, aggregator.GetSummary().start);
+    TEST_ASSERT_EQUAL_UINT32(start + 20000, aggregator.GetOpenWindow().start);
+}
+
+void test_empty_windows_leave_no_summary()
+{
+    AlignTo(10000);
+    WindowedAggregator aggregator;
+    aggregator.SetWindowLength(10000);
+
+    NativeHAL::AdvanceMillis(30000);
+    aggregator.Update();
+    TEST_ASSERT_FALSE(aggregator.HasSummary());
+}
+
+void test_window_length_bounds()
+{
+    TEST_ASSERT_TRUE(WindowedAggregator::IsValidWindow(0));
+    TEST_ASSERT_FALSE(WindowedAggregator::IsValidWindow(AGGREGATOR_MIN_WINDOW - 1));
+    TEST_ASSERT_TRUE(WindowedAggregator::IsValidWindow(AGGREGATOR_MIN_WINDOW));
+    TEST_ASSERT_TRUE(WindowedAggregator::IsValidWindow(AGGREGATOR_MAX_WINDOW));
+    TEST_ASSERT_FALSE(WindowedAggregator::IsValidWindow(AGGREGATOR_MAX_WINDOW + 1));
+
+    WindowedAggregator aggregator;
+    TEST_ASSERT_FALSE(aggregator.IsEnabled());
+    aggregator.Add(Reading(20.0f, 50.0f));
+    NativeHAL::AdvanceMillis(AGGREGATOR_MAX_WINDOW);
+    aggregator.Update();
+    TEST_ASSERT_FALSE(aggregator.HasSummary());
+}
+
+int main(int argc, char** argv)
+{
+    NativeHAL::UseManualClock(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_channel_stats_match_the_textbook);
+    RUN_TEST(test_channel_stats_keep_precision_far_from_zero);
+    RUN_TEST(test_empty_channel_stats_have_no_variance);
+    RUN_TEST(test_window_closes_on_its_boundary);
+    RUN_TEST(test_unusable_values_count_as_samples_but_not_in_their_channel);
+    RUN_TEST(test_late_update_stays_on_the_boundaries);
+    RUN_TEST(test_empty_windows_leave_no_summary);
+    RUN_TEST(test_window_length_bounds);
+    return UNITY_END();
+}
@@ -0,0 +1,174 @@
+// Alert rules firing and clearing: pio test -e native -f test_alerts
+
+#include <Arduino.h>
+#include <NativeHAL.hpp>
+#include <unity.h>
+
+#include <AlertEngine.hpp>
+
+static SensorReadings Temperature(float value)
+{
+    return SensorReadings { value, 50.0f, 30.0f, 70.0f, millis(),
+        SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok };
+}
+
+static SensorReadings Soil(float value)
+{
+    return SensorReadings { 21.0f, 50.0f, value, 70.0f, millis(),
+        SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok };
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_fires_once_the_condition_held_for_min_duration()
+{
+    PreferencesManager preferences(EEPROM);
+    preferences.SetAlertRule(0, AlertRule { true, AlertChannel::Temperature, AlertCondition::Above, 10, 30.0f, 2.0f });
+    AlertEngine engine(preferences);
+
+    engine.Evaluate(Temperature(31.0f));
+    unsigned long since = millis();
+    TEST_ASSERT_FALSE(engine.IsFiring(0));
+
+    NativeHAL::AdvanceMillis(9999);
+    engine.Evaluate(Temperature(31.0f));
+    TEST_ASSERT_FALSE(engine.IsFiring(0));
+
+    AlertEvent event;
+    TEST_ASSERT_FALSE(engine.GetUnsent(event));
+
+    NativeHAL::AdvanceMillis(1);
+    engine.Evaluate(Temperature(32.5f));
+    TEST_ASSERT_TRUE(engine.IsFiring(0));
+
+    TEST_ASSERT_TRUE(engine.GetUnsent(event));
+    TEST_ASSERT_EQUAL_UINT8(0, event.index);
+    TEST_ASSERT_TRUE(event.isFiring);
+    TEST_ASSERT_EQUAL_FLOAT(32.5f, event.value);
+    TEST_ASSERT_EQUAL_UINT32(since + 10000, event.at);
+}
+
+void test_a_break_in_the_condition_restarts_the_wait()
+{
+    PreferencesManager preferences(EEPROM);
+    preferences.SetAlertRule(0, AlertRule { true, AlertChannel::Temperature, AlertCondition::Above, 10, 30.0f, 2.0f });
+    AlertEngine engine(preferences);
+
+    engine.Evaluate(Temperature(31.0f));
+    NativeHAL::AdvanceMillis(8000);
+    engine.Evaluate(Temperature(30.0f));
+    NativeHAL::AdvanceMillis(1000);
+    engine.Evaluate(Temperature(31.0f));
+
+    NativeHAL::AdvanceMillis(9000);
+    engine.Evaluate(Temperature(31.0f));
+    TEST_ASSERT_FALSE(engine.IsFiring(0));
+
+    NativeHAL::AdvanceMillis(1000);
+    engine.Evaluate(Temperature(31.0f));
+    TEST_ASSERT_TRUE(engine.IsFiring(0));
+}
+
+void test_clears_only_past_the_hysteresis()
+{
+    PreferencesManager preferences(EEPROM);
+    preferences.SetAlertRule(0, AlertRule { true, AlertChannel::Temperature, AlertCondition::Above, 0, 30.0f, 2.0f });
+    AlertEngine engine(preferences);
+
+    engine.Evaluate(Temperature(31.0f));
+    TEST_ASSERT_TRUE(engine.IsFiring(0));
+    engine.MarkSent(0);
+
+    engine.Evaluate(Temperature(29.0f));
+    engine.Evaluate(Temperature(28.01f));
+    TEST_ASSERT_TRUE(engine.IsFiring(0));
+
+    AlertEvent event;
+    TEST_ASSERT_FALSE(engine.GetUnsent(event));
+
+    NativeHAL::AdvanceMillis(500);
+    engine.Evaluate(Temperature(28.0f));
+    TEST_ASSERT_FALSE(engine.IsFiring(0));
+
+    TEST_ASSERT_TRUE(engine.GetUnsent(event));
+    TEST_ASSERT_FALSE(event.isFiring);
+    TEST_ASSERT_EQUAL_FLOAT(28.0f, event.value);
+    TEST_ASSERT_EQUAL_UINT32(millis(), event.at);
+
+    // Back over the threshold fires again
+    engine.Evaluate(Temperature(30.5f));
+    TEST_ASSERT_TRUE(engine.IsFiring(0));
+}
+
+void test_below_rules_clear_above_the_hysteresis()
+{
+    PreferencesManager preferences(EEPROM);
+    preferences.SetAlertRule(2, AlertRule { true, AlertChannel::SoilMoisture, AlertCondition::Below, 5, 20.0f, 5.0f });
+    AlertEngine engine(preferences);
+
+    engine.Evaluate(Soil(19.0f));
+    NativeHAL::AdvanceMillis(5000);
+    engine.Evaluate(Soil(18.0f));
+    TEST_ASSERT_TRUE(engine.IsFiring(2));
+
+    engine.Evaluate(Soil(24.9f));
+    TEST_ASSERT_TRUE(engine.IsFiring(2));
+    engine.Evaluate(Soil(25.0f));
+    TEST_ASSERT_FALSE(engine.IsFiring(2));
+}
+
+void test_missing_values_and_disabled_rules_change_nothing()
+{
+    PreferencesManager preferences(EEPROM);
+    preferences.SetAlertRule(0, AlertRule { true, AlertChannel::Temperature, AlertCondition::Above, 0, 30.0f, 2.0f });
+    preferences.SetAlertRule(1, AlertRule { false, AlertChannel::Temperature, AlertCondition::Above, 0, 10.0f, 2.0f });
+    AlertEngine engine(preferences);
+
+    engine.Evaluate(Temperature(31.0f));
+    TEST_ASSERT_TRUE(engine.IsFiring(0));
+    TEST_ASSERT_FALSE(engine.IsFiring(1));
+
+    engine.Evaluate(Temperature(NAN));
+    TEST_ASSERT_TRUE(engine.IsFiring(0));
+}
+
+void test_unsent_changes_come_out_oldest_first()
+{
+    PreferencesManager preferences(EEPROM);
+    preferences.SetAlertRule(3, AlertRule { true, AlertChannel::Temperature, AlertCondition::Above, 0, 30.0f, 2.0f });
+    preferences.SetAlertRule(1, AlertRule { true, AlertChannel::SoilMoisture, AlertCondition::Below, 0, 20.0f, 2.0f });
+    AlertEngine engine(preferences);
+
+    SensorReadings readings = Temperature(31.0f);
+    engine.Evaluate(readings);
+    NativeHAL::AdvanceMillis(100);
+    readings.soilMoisture = 10.0f;
+    engine.Evaluate(readings);
+
+    AlertEvent event;
+    TEST_ASSERT_TRUE(engine.GetUnsent(event));
+    TEST_ASSERT_EQUAL_UINT8(3, event.index);
+    engine.MarkSent(event.index);
+
+    TEST_ASSERT_TRUE(engine.GetUnsent(event));
+    TEST_ASSERT_EQUAL_UINT8(1, event.index);
+    TEST_ASSERT_TRUE(event.rule.channel == AlertChannel::SoilMoisture);
+    engine.MarkSent(event.index);
+
+    TEST_ASSERT_FALSE(engine.GetUnsent(event));
+}
+
+int main(int argc, char** argv)
+{
+    NativeHAL::UseManualClock(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_fires_once_the_condition_held_for_min_duration);
+    RUN_TEST(test_a_break_in_the_condition_restarts_the_wait);
+    RUN_TEST(test_clears_only_past_the_hysteresis);
+    RUN_TEST(test_below_rules_clear_above_the_hysteresis);
+    RUN_TEST(test_missing_values_and_disabled_rules_change_nothing);
+    RUN_TEST(test_unsent_changes_come_out_oldest_first);
+    return UNITY_END();
+}
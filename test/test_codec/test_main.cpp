@@ -0,0 +1,188 @@
+// History block encoding: pio test -e native -f test_codec
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <TimeSeriesCodec.hpp>
+
+#define TEST_BLOCK_SIZE 512
+
+static uint8_t block[TEST_BLOCK_SIZE];
+
+static SensorReadings Reading(unsigned long at, float temperature, float humidity, float soilMoisture, float lightLevel)
+{
+    return SensorReadings { temperature, humidity, soilMoisture, lightLevel, at,
+        SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok };
+}
+
+static void AssertSameReading(const SensorReadings& expected, const SensorReadings& actual)
+{
+    TEST_ASSERT_EQUAL_UINT32(expected.sampledAt, actual.sampledAt);
+
+    const float expectedValues[] = { expected.temperature, expected.humidity, expected.soilMoisture, expected.lightLevel };
+    const float actualValues[] = { actual.temperature, actual.humidity, actual.soilMoisture, actual.lightLevel };
+    for (int i = 0; i < TIMESERIES_CHANNELS; i++)
+    {
+        if (isnan(expectedValues[i]))
+            TEST_ASSERT_FLOAT_IS_NAN(actualValues[i]);
+        else
+            TEST_ASSERT_FLOAT_WITHIN(0.005f, expectedValues[i], actualValues[i]);
+    }
+
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)expected.temperatureQuality, (uint8_t)actual.temperatureQuality);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)expected.humidityQuality, (uint8_t)actual.humidityQuality);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)expected.soilMoistureQuality, (uint8_t)actual.soilMoistureQuality);
+    TEST_ASSERT_EQUAL_UINT8((uint8_t)expected.lightLevelQuality, (uint8_t)actual.lightLevelQuality);
+}
+
+void setUp() { memset(block, 0, sizeof(block)); }
+void tearDown() { }
+
+void test_round_trip_keeps_values_and_timestamps()
+{
+    SensorReadings samples[40];
+    unsigned long at = 123456;
+    for (int i = 0; i < 40; i++)
+    {
+        // Jittery intervals, drifting values and the odd jump
+        at += 2000 + (i % 3) * 7 - (i % 5 == 0 ? 300 : 0);
+        samples[i] = Reading(at, 21.0f + i * 0.01f, 55.5f - (i % 4), i == 20 ? 3.0f : 37.6f, 81.2f + (i % 2) * 0.39f);
+    }
+
+    TimeSeriesEncoder encoder;
+    encoder.Begin(block, sizeof(block));
+    for (const SensorReadings& sample : samples)
+        TEST_ASSERT_TRUE(encoder.Append(sample));
+    TEST_ASSERT_EQUAL_UINT16(40, encoder.GetCount());
+
+    TimeSeriesDecoder decoder;
+    TEST_ASSERT_TRUE(decoder.Begin(block, encoder.GetSize()));
+    TEST_ASSERT_EQUAL_UINT16(40, decoder.GetCount());
+
+    SensorReadings decoded;
+    for (const SensorReadings& sample : samples)
+    {
+        TEST_ASSERT_TRUE(decoder.Next(decoded));
+        AssertSameReading(sample, decoded);
+    }
+    TEST_ASSERT_FALSE(decoder.Next(decoded));
+}
+
+void test_round_trip_keeps_quality_and_missing_values()
+{
+    SensorReadings samples[4] = {
+        Reading(1000, 21.0f, 50.0f, 30.0f, 70.0f),
+        Reading(3000, NAN, NAN, 30.0f, 70.0f),
+        Reading(5000, 21.0f, 50.0f, 30.0f, 70.0f),
+        Reading(7000, 21.0f, 50.0f, NAN, 70.0f)
+    };
+    samples[1].temperatureQuality = SampleQuality::Timeout;
+    samples[1].humidityQuality = SampleQuality::Timeout;
+    samples[2].temperatureQuality = SampleQuality::Stale;
+    samples[2].humidityQuality = SampleQuality::Stale;
+    samples[3].soilMoistureQuality = SampleQuality::OutOfRange;
+    samples[3].lightLevelQuality = SampleQuality::Stuck;
+
+    TimeSeriesEncoder encoder;
+    encoder.Begin(block, sizeof(block));
+    for (const SensorReadings& sample : samples)
+        TEST_ASSERT_TRUE(encoder.Append(sample));
+
+    TimeSeriesDecoder decoder;
+    TEST_ASSERT_TRUE(decoder.Begin(block, encoder.GetSize()));
+
+    SensorReadings decoded;
+    for (const SensorReadings& sample : samples)
+    {
+        TEST_ASSERT_TRUE(decoder.Next(decoded));
+        AssertSameReading(sample, decoded);
+    }
+}
+
+void test_full_block_refuses_sample_and_stays_decodable()
+{
+    const size_t size = 48;
+    TimeSeriesEncoder encoder;
+    encoder.Begin(block, size);
+
+    unsigned int appended = 0;
+    while (encoder.Append(Reading(1000 + appended * 2000, 20.0f + appended * 3.7f, 50.0f, 30.0f, 70.0f)))
+        appended++;
+
+    TEST_ASSERT_TRUE(appended > 1);
+    TEST_ASSERT_EQUAL_UINT16(appended, encoder.GetCount());
+    TEST_ASSERT_LESS_OR_EQUAL(size, encoder.GetSize());
+
+    TimeSeriesDecoder decoder;
+    TEST_ASSERT_TRUE(decoder.Begin(block, encoder.GetSize()));
+
+    SensorReadings decoded;
+    for (unsigned int i = 0; i < appended; i++)
+    {
+        TEST_ASSERT_TRUE(decoder.Next(decoded));
+        AssertSameReading(Reading(1000 + i * 2000, 20.0f + i * 3.7f, 50.0f, 30.0f, 70.0f), decoded);
+    }
+    TEST_ASSERT_FALSE(decoder.Next(decoded));
+}
+
+void test_sent_at_is_zero_until_stamped()
+{
+    TimeSeriesEncoder encoder;
+    encoder.Begin(block, sizeof(block));
+    TEST_ASSERT_TRUE(encoder.Append(Reading(1000, 21.0f, 50.0f, 30.0f, 70.0f)));
+
+    TimeSeriesDecoder decoder;
+    TEST_ASSERT_TRUE(decoder.Begin(block, encoder.GetSize()));
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.GetSentAt());
+
+    TimeSeries::StampSentAt(block, 0x89ABCDEF);
+    TEST_ASSERT_TRUE(decoder.Begin(block, encoder.GetSize()));
+    TEST_ASSERT_EQUAL_UINT32(0x89ABCDEF, decoder.GetSentAt());
+
+    SensorReadings decoded;
+    TEST_ASSERT_TRUE(decoder.Next(decoded));
+    AssertSameReading(Reading(1000, 21.0f, 50.0f, 30.0f, 70.0f), decoded);
+}
+
+void test_decoder_rejects_other_blocks()
+{
+    TimeSeriesEncoder encoder;
+    encoder.Begin(block, sizeof(block));
+    TEST_ASSERT_TRUE(encoder.Append(Reading(1000, 21.0f, 50.0f, 30.0f, 70.0f)));
+
+    TimeSeriesDecoder decoder;
+    TEST_ASSERT_FALSE(decoder.Begin(block, TIMESERIES_HEADER_SIZE - 1));
+
+    block[1] = TIMESERIES_BLOCK_VERSION - 1;
+    TEST_ASSERT_FALSE(decoder.Begin(block, encoder.GetSize()));
+    block[1] = TIMESERIES_BLOCK_VERSION;
+
+    block[0] ^= 0xFF;
+    TEST_ASSERT_FALSE(decoder.Begin(block, encoder.GetSize()));
+}
+
+void test_decoder_stops_at_truncated_block()
+{
+    TimeSeriesEncoder encoder;
+    encoder.Begin(block, sizeof(block));
+    for (unsigned int i = 0; i < 10; i++)
+        TEST_ASSERT_TRUE(encoder.Append(Reading(1000 + i * 2000, 20.0f + i * 5.0f, 50.0f, 30.0f, 70.0f)));
+
+    TimeSeriesDecoder decoder;
+    TEST_ASSERT_TRUE(decoder.Begin(block, TIMESERIES_HEADER_SIZE + 4));
+
+    SensorReadings decoded;
+    TEST_ASSERT_FALSE(decoder.Next(decoded));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_keeps_values_and_timestamps);
+    RUN_TEST(test_round_trip_keeps_quality_and_missing_values);
+    RUN_TEST(test_full_block_refuses_sample_and_stays_decodable);
+    RUN_TEST(test_sent_at_is_zero_until_stamped);
+    RUN_TEST(test_decoder_rejects_other_blocks);
+    RUN_TEST(test_decoder_stops_at_truncated_block);
+    return UNITY_END();
+}
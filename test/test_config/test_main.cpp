@@ -0,0 +1,102 @@
+// Named, bounded settings: pio test -e native -f test_config
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <ConfigRegistry.hpp>
+
+enum class TestKey : uint8_t
+{
+    Interval,
+    Port,
+    Count
+};
+
+static constexpr char testInterval[] PROGMEM = "interval";
+static constexpr char testPort[] PROGMEM = "port";
+static constexpr char testUnitNone[] PROGMEM = "";
+static constexpr char testUnitMs[] PROGMEM = " ms";
+
+static constexpr ConfigEntry testEntries[] =
+{
+    { testInterval, testUnitMs, 1000, 60000, 2000, true },
+    { testPort, testUnitNone, 1, 65535, 80, false }
+};
+
+void setUp() { }
+void tearDown() { }
+
+void test_finds_settings_by_name()
+{
+    PreferencesManager preferences(EEPROM);
+    ConfigRegistry<TestKey> config(preferences, testEntries, (uint8_t)TestKey::Count);
+
+    TEST_ASSERT_EQUAL_UINT8(2, config.GetCount());
+    TEST_ASSERT_TRUE(config.Find("port").GetValue() == TestKey::Port);
+    TEST_ASSERT_TRUE(config.Find("interval").GetValue() == TestKey::Interval);
+    TEST_ASSERT_TRUE(config.Find("inter").GetError() == ConfigError::UnknownName);
+    TEST_ASSERT_TRUE(config.Find("").GetError() == ConfigError::UnknownName);
+}
+
+void test_unset_settings_follow_the_default()
+{
+    PreferencesManager preferences(EEPROM);
+    ConfigRegistry<TestKey> config(preferences, testEntries, (uint8_t)TestKey::Count);
+
+    TEST_ASSERT_FALSE(config.IsSet(TestKey::Interval));
+    TEST_ASSERT_EQUAL_UINT32(2000, config.Get(TestKey::Interval));
+    TEST_ASSERT_EQUAL_UINT32(80, config.Get(TestKey::Port));
+}
+
+void test_set_accepts_the_bounds_and_nothing_past_them()
+{
+    PreferencesManager preferences(EEPROM);
+    ConfigRegistry<TestKey> config(preferences, testEntries, (uint8_t)TestKey::Count);
+
+    TEST_ASSERT_EQUAL_UINT32(1000, config.Set(TestKey::Interval, 1000).GetValue());
+    TEST_ASSERT_EQUAL_UINT32(1000, config.Get(TestKey::Interval));
+    TEST_ASSERT_EQUAL_UINT32(60000, config.Set(TestKey::Interval, 60000).GetValue());
+    TEST_ASSERT_EQUAL_UINT32(60000, config.Get(TestKey::Interval));
+
+    TEST_ASSERT_TRUE(config.Set(TestKey::Interval, 999).GetError() == ConfigError::OutOfRange);
+    TEST_ASSERT_TRUE(config.Set(TestKey::Interval, 60001).GetError() == ConfigError::OutOfRange);
+    TEST_ASSERT_TRUE(config.Set(TestKey::Port, 0).GetError() == ConfigError::OutOfRange);
+    TEST_ASSERT_EQUAL_UINT32(60000, config.Get(TestKey::Interval));
+    TEST_ASSERT_FALSE(config.IsSet(TestKey::Port));
+}
+
+void test_reset_goes_back_to_the_default()
+{
+    PreferencesManager preferences(EEPROM);
+    ConfigRegistry<TestKey> config(preferences, testEntries, (uint8_t)TestKey::Count);
+
+    TEST_ASSERT_TRUE(config.Set(TestKey::Port, 8080).HasValue());
+    TEST_ASSERT_TRUE(config.Set(TestKey::Interval, 5000).HasValue());
+    config.Reset(TestKey::Port);
+
+    TEST_ASSERT_FALSE(config.IsSet(TestKey::Port));
+    TEST_ASSERT_EQUAL_UINT32(80, config.Get(TestKey::Port));
+    TEST_ASSERT_EQUAL_UINT32(5000, config.Get(TestKey::Interval));
+}
+
+void test_stored_values_out_of_bounds_read_as_the_default()
+{
+    PreferencesManager preferences(EEPROM);
+    ConfigRegistry<TestKey> config(preferences, testEntries, (uint8_t)TestKey::Count);
+
+    // What a build with wider bounds might have saved
+    preferences.SetConfigValue((uint8_t)TestKey::Interval, 500);
+    TEST_ASSERT_TRUE(config.IsSet(TestKey::Interval));
+    TEST_ASSERT_EQUAL_UINT32(2000, config.Get(TestKey::Interval));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_finds_settings_by_name);
+    RUN_TEST(test_unset_settings_follow_the_default);
+    RUN_TEST(test_set_accepts_the_bounds_and_nothing_past_them);
+    RUN_TEST(test_reset_goes_back_to_the_default);
+    RUN_TEST(test_stored_values_out_of_bounds_read_as_the_default);
+    return UNITY_END();
+}
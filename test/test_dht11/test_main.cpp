@@ -0,0 +1,62 @@
+// DHT11 reads through a climate-controlled night: pio test -e native -f test_dht11
+
+#include <Arduino.h>
+#include <NativeHAL.hpp>
+#include <unity.h>
+
+#include <DHT11Reader.hpp>
+#include <unistd.h>
+
+// ms,temperature,humidity,soil_moisture,light_level
+static const char* trace =
+    "0,21,50,50,50\n"
+    "3600000,22,50,50,50\n"     // One step an hour, less than the sensor's resolution in between
+    "7200000,22,51,50,50\n"
+    "14400000,22,51,50,50\n";
+
+static void StepTo(DHT11Reader& reader, unsigned long at)
+{
+    NativeHAL::AdvanceMillis(at - millis());
+    reader.Update();
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_a_slow_signal_stays_ok()
+{
+    DHT11Reader reader(0);
+    reader.Begin();
+
+    for (unsigned long at = 1000; at < 14400000; at += 60000)
+    {
+        StepTo(reader, at);
+        TEST_ASSERT_TRUE(reader.GetQuality() == SampleQuality::Ok);
+        TEST_ASSERT_EQUAL_FLOAT(at < 3600000 ? 21.0f : 22.0f, reader.GetTemperature().GetValue());
+        TEST_ASSERT_EQUAL_FLOAT(at < 7200000 ? 50.0f : 51.0f, reader.GetHumidity().GetValue());
+    }
+
+    // Flat for the last two hours: noted for the health log, nothing more
+    TEST_ASSERT_EQUAL_UINT(1, reader.GetHealth().stuck);
+    TEST_ASSERT_EQUAL_UINT(0, reader.GetHealth().timeouts);
+}
+
+int main(int argc, char** argv)
+{
+    char path[] = "/tmp/dht11-trace-XXXXXX";
+    int file = mkstemp(path);
+    if (file < 0 || write(file, trace, strlen(trace)) != (ssize_t)strlen(trace))
+        return 1;
+    close(file);
+
+    bool isTraceRead = NativeHAL::UseTrace(path);
+    unlink(path);
+    if (!isTraceRead)
+        return 1;
+
+    NativeHAL::UseManualClock(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_a_slow_signal_stays_ok);
+    return UNITY_END();
+}
@@ -0,0 +1,306 @@
+// Mesh frames, the gateway's allowlist, dedupe and batching: pio test -e native -f test_mesh
+
+#include <Arduino.h>
+#include <NativeHAL.hpp>
+#include <unity.h>
+
+#include <MeshFrame.hpp>
+#include <MeshGateway.hpp>
+#include <MeshSettings.hpp>
+
+static const char* uuidText = "0123abcd-4567-4ef0-89ab-cdef01234567";
+
+static const uint8_t leafMACs[MESH_MAX_LEAVES][MESH_MAC_SIZE] =
+{
+    { 0x02, 0, 0, 0, 0, 1 }, { 0x02, 0, 0, 0, 0, 2 }, { 0x02, 0, 0, 0, 0, 3 }, { 0x02, 0, 0, 0, 0, 4 }, { 0x02, 0, 0, 0, 0, 5 },
+    { 0x02, 0, 0, 0, 0, 6 }, { 0x02, 0, 0, 0, 0, 7 }, { 0x02, 0, 0, 0, 0, 8 }, { 0x02, 0, 0, 0, 0, 9 }, { 0x02, 0, 0, 0, 0, 10 }
+};
+
+static const uint8_t strangerMAC[MESH_MAC_SIZE] = { 0x02, 0, 0, 0, 0, 99 };
+
+static SensorReadings Reading(float temperature)
+{
+    return SensorReadings { temperature, 50.0f, 30.0f, 70.0f, millis(),
+        SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok, SampleQuality::Ok };
+}
+
+static MeshSampleFrame Frame(uint16_t sequence, float temperature)
+{
+    uint8_t uuid[MESH_UUID_SIZE];
+    MeshCodec::PackUUID(uuidText, uuid);
+
+    MeshSampleFrame frame;
+    MeshCodec::EncodeSample(Reading(temperature), uuid, sequence, frame);
+    return frame;
+}
+
+static void Receive(MeshGateway& gateway, const uint8_t* mac, uint16_t sequence, float temperature)
+{
+    MeshSampleFrame frame = Frame(sequence, temperature);
+    gateway.Receive(mac, (const uint8_t*)&frame, sizeof(frame));
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_uuid_round_trip()
+{
+    uint8_t uuid[MESH_UUID_SIZE];
+    TEST_ASSERT_TRUE(MeshCodec::PackUUID(uuidText, uuid));
+    TEST_ASSERT_EQUAL_UINT8(0x01, uuid[0]);
+    TEST_ASSERT_EQUAL_UINT8(0x67, uuid[15]);
+
+    char text[MESH_UUID_TEXT_SIZE];
+    MeshCodec::UnpackUUID(uuid, text);
+    TEST_ASSERT_EQUAL_STRING(uuidText, text);
+
+    TEST_ASSERT_TRUE(MeshCodec::PackUUID("0123ABCD-4567-4EF0-89AB-CDEF01234567", uuid));
+    MeshCodec::UnpackUUID(uuid, text);
+    TEST_ASSERT_EQUAL_STRING(uuidText, text);
+}
+
+void test_uuid_rejects_other_forms()
+{
+    uint8_t uuid[MESH_UUID_SIZE];
+    TEST_ASSERT_FALSE(MeshCodec::PackUUID("0123abcd-4567-4ef0-89ab-cdef0123456", uuid));
+    TEST_ASSERT_FALSE(MeshCodec::PackUUID("0123abcd-4567-4ef0-89ab-cdef012345678", uuid));
+    TEST_ASSERT_FALSE(MeshCodec::PackUUID("0123abcd_4567-4ef0-89ab-cdef01234567", uuid));
+    TEST_ASSERT_FALSE(MeshCodec::PackUUID("0123abcg-4567-4ef0-89ab-cdef01234567", uuid));
+    TEST_ASSERT_FALSE(MeshCodec::PackUUID("0123abcd4567-4ef0-89ab-cdef01234567-", uuid));
+}
+
+void test_sample_round_trip_in_hundredths()
+{
+    uint8_t uuid[MESH_UUID_SIZE];
+    MeshCodec::PackUUID(uuidText, uuid);
+
+    SensorReadings readings { 21.456f, -5.5f, 30.0f, NAN, millis(),
+        SampleQuality::Ok, SampleQuality::Stale, SampleQuality::Timeout, SampleQuality::Stuck };
+    NativeHAL::AdvanceMillis(600);
+
+    MeshSampleFrame frame;
+    MeshCodec::EncodeSample(readings, uuid, 42, frame);
+    TEST_ASSERT_EQUAL_size_t(37, sizeof(frame));
+    TEST_ASSERT_EQUAL_UINT32(600, frame.age);
+
+    // The gateway's clock: only the age carries over
+    NativeHAL::AdvanceMillis(50);
+
+    MeshSampleFrame decodedFrame;
+    SensorReadings decoded;
+    TEST_ASSERT_TRUE(MeshCodec::DecodeSample((const uint8_t*)&frame, sizeof(frame), decodedFrame, decoded));
+    TEST_ASSERT_EQUAL_UINT16(42, decodedFrame.sequence);
+    TEST_ASSERT_EQUAL_MEMORY(uuid, decodedFrame.uuid, MESH_UUID_SIZE);
+    TEST_ASSERT_EQUAL_UINT32(millis() - 600, decoded.sampledAt);
+
+    TEST_ASSERT_FLOAT_WITHIN(0.0051f, 21.456f, decoded.temperature);
+    TEST_ASSERT_FLOAT_WITHIN(0.0051f, -5.5f, decoded.humidity);
+    TEST_ASSERT_FLOAT_IS_NAN(decoded.soilMoisture);
+    TEST_ASSERT_FLOAT_IS_NAN(decoded.lightLevel);
+    TEST_ASSERT_TRUE(decoded.humidityQuality == SampleQuality::Stale);
+    TEST_ASSERT_TRUE(decoded.soilMoistureQuality == SampleQuality::Timeout);
+    TEST_ASSERT_TRUE(decoded.lightLevelQuality == SampleQuality::Stuck);
+}
+
+void test_decode_rejects_other_frames()
+{
+    MeshSampleFrame frame = Frame(1, 21.0f);
+    MeshSampleFrame decodedFrame;
+    SensorReadings decoded;
+
+    TEST_ASSERT_FALSE(MeshCodec::DecodeSample((const uint8_t*)&frame, sizeof(frame) - 1, decodedFrame, decoded));
+
+    frame.version = MESH_PROTOCOL_VERSION + 1;
+    TEST_ASSERT_FALSE(MeshCodec::DecodeSample((const uint8_t*)&frame, sizeof(frame), decodedFrame, decoded));
+
+    frame = Frame(1, 21.0f);
+    frame.type = 0;
+    TEST_ASSERT_FALSE(MeshCodec::DecodeSample((const uint8_t*)&frame, sizeof(frame), decodedFrame, decoded));
+
+    frame = Frame(1, 21.0f);
+    frame.quality[2] = (uint8_t)SampleQuality::Stuck + 1;
+    TEST_ASSERT_FALSE(MeshCodec::DecodeSample((const uint8_t*)&frame, sizeof(frame), decodedFrame, decoded));
+}
+
+void test_gateway_relays_only_allowed_leaves()
+{
+    MeshGateway gateway;
+    gateway.SetAllowed(leafMACs, 2);
+
+    Receive(gateway, strangerMAC, 1, 21.0f);
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetStats().strangers);
+    TEST_ASSERT_FALSE(gateway.HasPending());
+
+    Receive(gateway, leafMACs[1], 1, 21.0f);
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetStats().received);
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetLeafCount());
+    TEST_ASSERT_EQUAL_STRING(uuidText, gateway.GetLeaf(0).uuid);
+
+    const uint8_t garbage[] = { 1, 2, 3 };
+    gateway.Receive(leafMACs[0], garbage, sizeof(garbage));
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetStats().invalid);
+}
+
+void test_gateway_drops_retransmissions_but_not_restarts()
+{
+    MeshGateway gateway;
+    gateway.SetAllowed(leafMACs, 1);
+
+    Receive(gateway, leafMACs[0], 5, 21.0f);
+    Receive(gateway, leafMACs[0], 5, 21.0f);
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetStats().duplicates);
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetLeaf(0).duplicates);
+
+    Receive(gateway, leafMACs[0], 6, 21.5f);
+    Receive(gateway, leafMACs[0], 1, 22.0f);
+    TEST_ASSERT_EQUAL_UINT(3, gateway.GetStats().received);
+    TEST_ASSERT_EQUAL_UINT(3, gateway.GetPendingCount());
+}
+
+void test_gateway_batches_per_leaf_oldest_first()
+{
+    MeshGateway gateway;
+    gateway.SetAllowed(leafMACs, 2);
+
+    for (uint16_t i = 1; i <= MESH_RELAY_BATCH; i++)
+    {
+        Receive(gateway, leafMACs[0], i, 20.0f + i);
+        Receive(gateway, leafMACs[1], i, 30.0f + i);
+    }
+
+    MeshRelayBatch batch;
+    TEST_ASSERT_TRUE(gateway.PeekBatch(batch));
+    TEST_ASSERT_EQUAL_UINT(MESH_RELAY_BATCH, batch.count);
+    for (unsigned int i = 0; i < batch.count; i++)
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, 21.0f + i, batch.readings[i].temperature);
+
+    gateway.PopBatch(batch);
+    TEST_ASSERT_EQUAL_UINT(MESH_RELAY_BATCH, gateway.GetStats().relayed);
+    TEST_ASSERT_EQUAL_UINT(MESH_RELAY_BATCH, gateway.GetPendingCount());
+
+    TEST_ASSERT_TRUE(gateway.PeekBatch(batch));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 31.0f, batch.readings[0].temperature);
+    gateway.PopBatch(batch);
+    TEST_ASSERT_FALSE(gateway.HasPending());
+    TEST_ASSERT_EQUAL_UINT(2, gateway.GetStats().batches);
+}
+
+void test_gateway_holds_a_short_batch_until_the_relay_delay()
+{
+    MeshGateway gateway;
+    gateway.SetAllowed(leafMACs, 1);
+
+    Receive(gateway, leafMACs[0], 1, 21.0f);
+    Receive(gateway, leafMACs[0], 2, 22.0f);
+
+    MeshRelayBatch batch;
+    NativeHAL::AdvanceMillis(MESH_RELAY_DELAY - 1);
+    TEST_ASSERT_FALSE(gateway.PeekBatch(batch));
+    TEST_ASSERT_EQUAL_UINT(2, gateway.GetPendingCount());
+
+    NativeHAL::AdvanceMillis(1);
+    TEST_ASSERT_TRUE(gateway.PeekBatch(batch));
+    TEST_ASSERT_EQUAL_UINT(2, batch.count);
+    gateway.PopBatch(batch);
+    TEST_ASSERT_FALSE(gateway.HasPending());
+}
+
+void test_gateway_pushes_out_the_oldest_when_full()
+{
+    MeshGateway gateway;
+    gateway.SetAllowed(leafMACs, MESH_MAX_LEAVES);
+
+    for (uint16_t i = 0; i <= MESH_PENDING_SLOTS; i++)
+        Receive(gateway, leafMACs[i % 4], i / 4 + 1, (float)i);
+
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetStats().dropped);
+    TEST_ASSERT_EQUAL_UINT(MESH_PENDING_SLOTS, gateway.GetPendingCount());
+
+    // Half full is enough to relay without waiting
+    MeshRelayBatch batch;
+    TEST_ASSERT_TRUE(gateway.PeekBatch(batch));
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 1.0f, batch.readings[0].temperature);
+}
+
+void test_gateway_forgets_leaves_taken_off_the_allowlist()
+{
+    MeshGateway gateway;
+    gateway.SetAllowed(leafMACs, 3);
+
+    Receive(gateway, leafMACs[0], 1, 21.0f);
+    Receive(gateway, leafMACs[1], 1, 22.0f);
+    Receive(gateway, leafMACs[2], 1, 23.0f);
+    Receive(gateway, leafMACs[1], 2, 24.0f);
+
+    gateway.SetAllowed(leafMACs + 2, 1);
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetAllowedCount());
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetLeafCount());
+    TEST_ASSERT_EQUAL_MEMORY(leafMACs[2], gateway.GetLeaf(0).mac, MESH_MAC_SIZE);
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetPendingCount());
+
+    MeshRelayBatch batch;
+    NativeHAL::AdvanceMillis(MESH_RELAY_DELAY);
+    TEST_ASSERT_TRUE(gateway.PeekBatch(batch));
+    TEST_ASSERT_EQUAL_UINT(1, batch.count);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 23.0f, batch.readings[0].temperature);
+
+    Receive(gateway, leafMACs[0], 2, 25.0f);
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetStats().strangers);
+}
+
+void test_gateway_expires_quiet_leaves_once_relayed()
+{
+    MeshGateway gateway;
+    gateway.SetAllowed(leafMACs, 2);
+
+    Receive(gateway, leafMACs[0], 1, 21.0f);
+    NativeHAL::AdvanceMillis(MESH_LEAF_IDLE_TIMEOUT + 1);
+    Receive(gateway, leafMACs[1], 1, 22.0f);
+
+    gateway.Expire();
+    TEST_ASSERT_EQUAL_UINT(2, gateway.GetLeafCount());
+
+    MeshRelayBatch batch;
+    TEST_ASSERT_TRUE(gateway.PeekBatch(batch));
+    gateway.PopBatch(batch);
+    gateway.Expire();
+    TEST_ASSERT_EQUAL_UINT(1, gateway.GetLeafCount());
+    TEST_ASSERT_EQUAL_MEMORY(leafMACs[1], gateway.GetLeaf(0).mac, MESH_MAC_SIZE);
+}
+
+void test_allowlist_settings()
+{
+    MeshSettings settings = MeshSettings();
+    for (unsigned int i = 0; i < MESH_MAX_LEAVES; i++)
+        TEST_ASSERT_TRUE(settings.Allow(leafMACs[i]));
+    TEST_ASSERT_TRUE(settings.Allow(leafMACs[3]));
+    TEST_ASSERT_FALSE(settings.Allow(strangerMAC));
+    TEST_ASSERT_EQUAL_UINT8(MESH_MAX_LEAVES, settings.allowedCount);
+
+    settings.Deny(leafMACs[3]);
+    TEST_ASSERT_EQUAL_UINT8(MESH_MAX_LEAVES - 1, settings.allowedCount);
+    TEST_ASSERT_EQUAL_INT(-1, settings.FindAllowed(leafMACs[3]));
+    TEST_ASSERT_EQUAL_INT(3, settings.FindAllowed(leafMACs[4]));
+    TEST_ASSERT_TRUE(settings.Allow(strangerMAC));
+}
+
+int main(int argc, char** argv)
+{
+    NativeHAL::UseManualClock(true);
+    NativeHAL::AdvanceMillis(1000);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_uuid_round_trip);
+    RUN_TEST(test_uuid_rejects_other_forms);
+    RUN_TEST(test_sample_round_trip_in_hundredths);
+    RUN_TEST(test_decode_rejects_other_frames);
+    RUN_TEST(test_gateway_relays_only_allowed_leaves);
+    RUN_TEST(test_gateway_drops_retransmissions_but_not_restarts);
+    RUN_TEST(test_gateway_batches_per_leaf_oldest_first);
+    RUN_TEST(test_gateway_holds_a_short_batch_until_the_relay_delay);
+    RUN_TEST(test_gateway_pushes_out_the_oldest_when_full);
+    RUN_TEST(test_gateway_forgets_leaves_taken_off_the_allowlist);
+    RUN_TEST(test_gateway_expires_quiet_leaves_once_relayed);
+    RUN_TEST(test_allowlist_settings);
+    return UNITY_END();
+}
@@ -0,0 +1,238 @@
+// Outbox eviction, priority and expiry: pio test -e native -f test_outbox
+
+#include <Arduino.h>
+#include <NativeHAL.hpp>
+#include <unity.h>
+
+#include <Outbox.hpp>
+
+static SensorReadings spilled[OUTBOX_SLOTS * 2];
+static unsigned int spilledCount = 0;
+
+static void Spill(const SensorReadings& readings) { spilled[spilledCount++] = readings; }
+
+// The payload is one byte that says which message it was
+static bool Queue(Outbox& outbox, MessageKind kind, uint8_t tag)
+{
+    uint8_t* payload = outbox.Claim(kind, 1);
+    if (payload == nullptr)
+        return false;
+
+    payload[0] = tag;
+    SensorReadings readings { };
+    readings.sampledAt = tag;
+    outbox.Commit(1, kind == MessageKind::History, kind == MessageKind::Reading ? &readings : nullptr);
+    return true;
+}
+
+static int PopTag(Outbox& outbox)
+{
+    size_t length;
+    bool isBinary;
+    uint8_t* frame = outbox.Peek(length, isBinary);
+    if (frame == nullptr)
+        return -1;
+
+    TEST_ASSERT_EQUAL_size_t(1, length);
+    uint8_t tag = frame[WEBSOCKETS_MAX_HEADER_SIZE];
+    outbox.Pop();
+    return tag;
+}
+
+void setUp() { spilledCount = 0; }
+void tearDown() { }
+
+void test_drop_oldest_drops_the_oldest_expendable()
+{
+    Outbox outbox;
+    outbox.SetPolicy(OutboxPolicy::DropOldest);
+
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Hello, 0));
+    for (uint8_t i = 1; i < OUTBOX_SLOTS; i++)
+        TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, i));
+    TEST_ASSERT_FALSE(outbox.HasRoom());
+
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Summary, 10));
+    TEST_ASSERT_EQUAL_UINT(1, outbox.GetStats().dropped);
+    TEST_ASSERT_EQUAL_UINT(OUTBOX_SLOTS, outbox.GetDepth());
+
+    // The hello isn't expendable, so reading 1 went instead
+    TEST_ASSERT_EQUAL_INT(0, PopTag(outbox));
+    for (int i = 2; i < OUTBOX_SLOTS; i++)
+        TEST_ASSERT_EQUAL_INT(i, PopTag(outbox));
+    TEST_ASSERT_EQUAL_INT(10, PopTag(outbox));
+    TEST_ASSERT_TRUE(outbox.IsEmpty());
+}
+
+void test_keep_latest_replaces_queued_messages_of_the_kind()
+{
+    Outbox outbox;
+    outbox.SetPolicy(OutboxPolicy::KeepLatest);
+
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, 0));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Summary, 1));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, 2));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Link, 3));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, 4));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Summary, 5));
+
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, 6));
+    TEST_ASSERT_EQUAL_UINT(3, outbox.GetStats().coalesced);
+    TEST_ASSERT_EQUAL_UINT(0, outbox.GetStats().dropped);
+
+    TEST_ASSERT_EQUAL_INT(1, PopTag(outbox));
+    TEST_ASSERT_EQUAL_INT(3, PopTag(outbox));
+    TEST_ASSERT_EQUAL_INT(5, PopTag(outbox));
+    TEST_ASSERT_EQUAL_INT(6, PopTag(outbox));
+    TEST_ASSERT_TRUE(outbox.IsEmpty());
+}
+
+void test_keep_latest_drops_oldest_when_nothing_of_the_kind_is_queued()
+{
+    Outbox outbox;
+    outbox.SetPolicy(OutboxPolicy::KeepLatest);
+
+    for (uint8_t i = 0; i < OUTBOX_SLOTS; i++)
+        TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, i));
+
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Link, 10));
+    TEST_ASSERT_EQUAL_UINT(0, outbox.GetStats().coalesced);
+    TEST_ASSERT_EQUAL_UINT(1, outbox.GetStats().dropped);
+    TEST_ASSERT_EQUAL_INT(1, PopTag(outbox));
+}
+
+void test_spill_hands_readings_back_and_drops_the_rest()
+{
+    Outbox outbox;
+    outbox.SetPolicy(OutboxPolicy::Spill);
+    outbox.SetSpillHandler(Spill);
+
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Summary, 0));
+    for (uint8_t i = 1; i < OUTBOX_SLOTS; i++)
+        TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, i));
+
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, 10));
+    TEST_ASSERT_EQUAL_UINT(1, outbox.GetStats().dropped);
+    TEST_ASSERT_EQUAL_UINT(0, spilledCount);
+
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, 11));
+    TEST_ASSERT_EQUAL_UINT(1, outbox.GetStats().spilled);
+    TEST_ASSERT_EQUAL_UINT(1, spilledCount);
+    TEST_ASSERT_EQUAL_UINT32(1, spilled[0].sampledAt);
+
+    TEST_ASSERT_EQUAL_INT(2, PopTag(outbox));
+}
+
+void test_only_expendable_messages_make_room()
+{
+    const MessageKind kept[] = { MessageKind::Alert, MessageKind::Hello, MessageKind::Result, MessageKind::Boot, MessageKind::Relay, MessageKind::History };
+    const OutboxPolicy policies[] = { OutboxPolicy::DropOldest, OutboxPolicy::KeepLatest, OutboxPolicy::Spill };
+
+    for (OutboxPolicy policy : policies)
+    {
+        Outbox outbox;
+        outbox.SetPolicy(policy);
+        for (uint8_t i = 0; i < OUTBOX_SLOTS; i++)
+            TEST_ASSERT_TRUE(Queue(outbox, kept[i % 6], i));
+
+        TEST_ASSERT_FALSE(Queue(outbox, MessageKind::Reading, 10));
+        TEST_ASSERT_FALSE(Queue(outbox, MessageKind::Alert, 11));
+        TEST_ASSERT_EQUAL_UINT(2, outbox.GetStats().refused);
+        TEST_ASSERT_EQUAL_UINT(0, outbox.GetStats().dropped);
+        TEST_ASSERT_EQUAL_UINT(OUTBOX_SLOTS, outbox.GetDepth());
+    }
+}
+
+void test_history_only_takes_a_free_slot()
+{
+    Outbox outbox;
+    outbox.SetPolicy(OutboxPolicy::Spill);
+    outbox.SetSpillHandler(Spill);
+
+    for (uint8_t i = 0; i < OUTBOX_SLOTS; i++)
+        TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, i));
+
+    TEST_ASSERT_FALSE(Queue(outbox, MessageKind::History, 10));
+    TEST_ASSERT_EQUAL_UINT(0, spilledCount);
+    TEST_ASSERT_EQUAL_UINT(1, outbox.GetStats().refused);
+
+    TEST_ASSERT_EQUAL_INT(0, PopTag(outbox));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::History, 10));
+}
+
+void test_a_message_longer_than_a_slot_is_never_queued()
+{
+    Outbox outbox;
+    for (uint8_t i = 0; i < OUTBOX_SLOTS - 1; i++)
+        TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, i));
+
+    TEST_ASSERT_NOT_NULL(outbox.Claim(MessageKind::Link, OUTBOX_MESSAGE_SIZE));
+    TEST_ASSERT_NULL(outbox.Claim(MessageKind::Link, OUTBOX_MESSAGE_SIZE + 1));
+    TEST_ASSERT_EQUAL_UINT(1, outbox.GetStats().oversized);
+    TEST_ASSERT_EQUAL_UINT(0, outbox.GetStats().refused);
+    TEST_ASSERT_EQUAL_UINT(0, outbox.GetStats().dropped);
+    TEST_ASSERT_EQUAL_UINT(OUTBOX_SLOTS - 1, outbox.GetDepth());
+}
+
+void test_alerts_and_results_go_ahead_of_expendable_messages()
+{
+    Outbox outbox;
+
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, 0));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Hello, 1));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Summary, 2));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Link, 3));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Alert, 4));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Result, 5));
+
+    // Neither overtakes the hello, or each other
+    TEST_ASSERT_EQUAL_INT(0, PopTag(outbox));
+    TEST_ASSERT_EQUAL_INT(1, PopTag(outbox));
+    TEST_ASSERT_EQUAL_INT(4, PopTag(outbox));
+    TEST_ASSERT_EQUAL_INT(5, PopTag(outbox));
+    TEST_ASSERT_EQUAL_INT(2, PopTag(outbox));
+    TEST_ASSERT_EQUAL_INT(3, PopTag(outbox));
+}
+
+void test_expire_gives_up_on_old_expendable_messages()
+{
+    Outbox outbox;
+    outbox.SetPolicy(OutboxPolicy::DropOldest);
+
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Reading, 0));
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Hello, 1));
+    NativeHAL::AdvanceMillis(OUTBOX_MAX_WAIT / 2);
+    TEST_ASSERT_TRUE(Queue(outbox, MessageKind::Summary, 2));
+
+    NativeHAL::AdvanceMillis(OUTBOX_MAX_WAIT / 2);
+    outbox.Expire();
+    TEST_ASSERT_EQUAL_UINT(3, outbox.GetDepth());
+
+    NativeHAL::AdvanceMillis(1);
+    outbox.Expire();
+    TEST_ASSERT_EQUAL_UINT(1, outbox.GetStats().expired);
+    TEST_ASSERT_EQUAL_UINT(1, outbox.GetStats().dropped);
+    TEST_ASSERT_EQUAL_INT(1, PopTag(outbox));
+
+    NativeHAL::AdvanceMillis(OUTBOX_MAX_WAIT);
+    outbox.Expire();
+    TEST_ASSERT_TRUE(outbox.IsEmpty());
+    TEST_ASSERT_EQUAL_UINT(2, outbox.GetStats().expired);
+}
+
+int main(int argc, char** argv)
+{
+    NativeHAL::UseManualClock(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_drop_oldest_drops_the_oldest_expendable);
+    RUN_TEST(test_keep_latest_replaces_queued_messages_of_the_kind);
+    RUN_TEST(test_keep_latest_drops_oldest_when_nothing_of_the_kind_is_queued);
+    RUN_TEST(test_spill_hands_readings_back_and_drops_the_rest);
+    RUN_TEST(test_only_expendable_messages_make_room);
+    RUN_TEST(test_history_only_takes_a_free_slot);
+    RUN_TEST(test_a_message_longer_than_a_slot_is_never_queued);
+    RUN_TEST(test_alerts_and_results_go_ahead_of_expendable_messages);
+    RUN_TEST(test_expire_gives_up_on_old_expendable_messages);
+    return UNITY_END();
+}
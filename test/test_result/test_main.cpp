@@ -0,0 +1,123 @@
+// Result<T, E>: pio test -e native -f test_result
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <Result.hpp>
+
+enum class ParseError : uint8_t
+{
+    Empty,
+    NotANumber,
+    Negative
+};
+
+static Result<int, ParseError> Parse(const char* text)
+{
+    if (text[0] == '\0')
+        return ParseError::Empty;
+
+    char* end;
+    long value = strtol(text, &end, 10);
+    if (*end != '\0')
+        return ParseError::NotANumber;
+    return (int)value;
+}
+
+static Result<unsigned int, ParseError> NonNegative(int value)
+{
+    if (value < 0)
+        return ParseError::Negative;
+    return (unsigned int)value;
+}
+
+// Counts how many of it are alive, to see that the non-trivial storage constructs and destroys
+// exactly what it holds
+struct Tracked
+{
+    static inline int alive = 0;
+    int value;
+
+    Tracked(int value) : value(value) { alive++; }
+    Tracked(const Tracked& other) : value(other.value) { alive++; }
+    Tracked(Tracked&& other) : value(other.value) { alive++; }
+    ~Tracked() { alive--; }
+};
+
+static_assert(std::is_trivially_copyable_v<Result<int, ParseError>>, "Trivial types keep a trivial Result");
+static_assert(!std::is_trivially_copyable_v<Result<Tracked, ParseError>>, "Others get the managed storage");
+
+void setUp() { Tracked::alive = 0; }
+void tearDown() { }
+
+void test_holds_a_value_or_an_error()
+{
+    Result<int, ParseError> value = Parse("42");
+    TEST_ASSERT_TRUE(value.HasValue());
+    TEST_ASSERT_FALSE(value.HasError());
+    TEST_ASSERT_EQUAL_INT(42, value.GetValue());
+
+    Result<int, ParseError> error = Parse("4x2");
+    TEST_ASSERT_TRUE(error.HasError());
+    TEST_ASSERT_TRUE(error.GetError() == ParseError::NotANumber);
+}
+
+void test_value_or_falls_back_only_on_error()
+{
+    TEST_ASSERT_EQUAL_INT(7, Parse("7").ValueOr(-1));
+    TEST_ASSERT_EQUAL_INT(-1, Parse("").ValueOr(-1));
+}
+
+void test_map_transforms_the_value_and_keeps_the_error()
+{
+    auto doubled = Parse("21").Map([](int value) { return value * 2.5f; });
+    TEST_ASSERT_TRUE(doubled.HasValue());
+    TEST_ASSERT_EQUAL_FLOAT(52.5f, doubled.GetValue());
+
+    auto failed = Parse("").Map([](int value) { return value * 2.5f; });
+    TEST_ASSERT_TRUE(failed.GetError() == ParseError::Empty);
+}
+
+void test_and_then_chains_until_the_first_error()
+{
+    Result<unsigned int, ParseError> chained = Parse("12").AndThen(NonNegative);
+    TEST_ASSERT_EQUAL_UINT(12, chained.GetValue());
+
+    TEST_ASSERT_TRUE(Parse("-3").AndThen(NonNegative).GetError() == ParseError::Negative);
+    TEST_ASSERT_TRUE(Parse("x").AndThen(NonNegative).GetError() == ParseError::NotANumber);
+}
+
+void test_non_trivial_values_are_constructed_and_destroyed_once()
+{
+    {
+        Result<Tracked, ParseError> value = Tracked(5);
+        TEST_ASSERT_EQUAL_INT(1, Tracked::alive);
+
+        Result<Tracked, ParseError> copy = value;
+        TEST_ASSERT_EQUAL_INT(2, Tracked::alive);
+        TEST_ASSERT_EQUAL_INT(5, copy.GetValue().value);
+
+        Result<Tracked, ParseError> error = ParseError::Empty;
+        TEST_ASSERT_EQUAL_INT(2, Tracked::alive);
+
+        copy = error;
+        TEST_ASSERT_EQUAL_INT(1, Tracked::alive);
+        TEST_ASSERT_TRUE(copy.HasError());
+
+        error = std::move(value);
+        TEST_ASSERT_EQUAL_INT(2, Tracked::alive);
+        TEST_ASSERT_EQUAL_INT(5, error.GetValue().value);
+    }
+    TEST_ASSERT_EQUAL_INT(0, Tracked::alive);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_holds_a_value_or_an_error);
+    RUN_TEST(test_value_or_falls_back_only_on_error);
+    RUN_TEST(test_map_transforms_the_value_and_keeps_the_error);
+    RUN_TEST(test_and_then_chains_until_the_first_error);
+    RUN_TEST(test_non_trivial_values_are_constructed_and_destroyed_once);
+    return UNITY_END();
+}
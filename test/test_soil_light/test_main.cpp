@@ -0,0 +1,118 @@
+// Railed soil and light inputs: pio test -e native -f test_soil_light
+
+#include <Arduino.h>
+#include <NativeHAL.hpp>
+#include <unity.h>
+
+#include <SoilLightReader.hpp>
+#include <unistd.h>
+
+#define TEST_READ_INTERVAL 100
+
+// ms,temperature,humidity,soil_moisture,light_level, in percent; 0 % is input 255 and 100 % input 0
+static const char* trace =
+    "0,21,50,50,50\n"
+    "10000,21,50,0,100\n"       // Both jump from mid-scale to a rail
+    "20000,21,50,50,50\n"
+    "30000,21,50,10,90\n"
+    "31000,21,50,5,95\n"
+    "32000,21,50,0,100\n"       // Both drift onto a rail
+    "40000,21,50,45,5\n"         // A dark room with a pot that isn't drying out
+    "7240000,21,50,44,5\n";
+
+static void StepTo(SoilLightReader& reader, unsigned long at)
+{
+    NativeHAL::AdvanceMillis(at - millis());
+    reader.Update();
+}
+
+void setUp() { }
+void tearDown() { }
+
+void test_a_jump_to_the_rail_is_flagged_after_a_few_reads()
+{
+    SoilLightReader reader(0, 0, TEST_READ_INTERVAL);
+
+    StepTo(reader, 5000);
+    TEST_ASSERT_TRUE(reader.IsReady());
+    TEST_ASSERT_EQUAL_INT(128, reader.GetSoilMoisture().GetValue());
+
+    for (unsigned int i = 0; i < SOIL_LIGHT_RAIL_READS - 1; i++)
+    {
+        StepTo(reader, 10000 + i * 2 * TEST_READ_INTERVAL);
+        TEST_ASSERT_TRUE(reader.GetSoilQuality() == SampleQuality::Ok);
+        TEST_ASSERT_TRUE(reader.GetLightQuality() == SampleQuality::Ok);
+    }
+
+    StepTo(reader, 10000 + SOIL_LIGHT_RAIL_READS * 2 * TEST_READ_INTERVAL);
+    TEST_ASSERT_TRUE(reader.GetSoilQuality() == SampleQuality::OutOfRange);
+    TEST_ASSERT_TRUE(reader.GetLightQuality() == SampleQuality::OutOfRange);
+    TEST_ASSERT_TRUE(reader.GetSoilMoisture().GetError() == SensorError::OutOfRange);
+    TEST_ASSERT_EQUAL_UINT(1, reader.GetSoilHealth().outOfRange);
+
+    StepTo(reader, 11000);
+    TEST_ASSERT_EQUAL_UINT(2, reader.GetSoilHealth().outOfRange);
+
+    StepTo(reader, 20000);
+    TEST_ASSERT_TRUE(reader.GetSoilQuality() == SampleQuality::Ok);
+    TEST_ASSERT_TRUE(reader.GetLightQuality() == SampleQuality::Ok);
+    TEST_ASSERT_EQUAL_INT(128, reader.GetSoilMoisture().GetValue());
+    TEST_ASSERT_EQUAL_UINT(0, reader.GetSoilHealth().consecutiveFailures);
+}
+
+void test_a_drift_onto_the_rail_is_a_real_reading()
+{
+    SoilLightReader reader(0, 0, TEST_READ_INTERVAL);
+
+    StepTo(reader, 30000);
+    StepTo(reader, 31000);
+    for (unsigned long at = 32000; at < 34000; at += 2 * TEST_READ_INTERVAL)
+    {
+        StepTo(reader, at);
+        TEST_ASSERT_TRUE(reader.GetSoilQuality() == SampleQuality::Ok);
+        TEST_ASSERT_TRUE(reader.GetLightQuality() == SampleQuality::Ok);
+    }
+
+    TEST_ASSERT_EQUAL_INT(0, reader.GetSoilMoisture().GetValue());
+    TEST_ASSERT_EQUAL_INT(255, reader.GetLightLevel().GetValue());
+    TEST_ASSERT_EQUAL_UINT(0, reader.GetSoilHealth().outOfRange);
+}
+
+void test_a_flat_signal_is_a_real_reading()
+{
+    SoilLightReader reader(0, 0, TEST_READ_INTERVAL);
+
+    for (unsigned long at = 40000; at < 7300000; at += 60000)
+    {
+        StepTo(reader, at);
+        TEST_ASSERT_TRUE(reader.GetSoilQuality() == SampleQuality::Ok);
+        TEST_ASSERT_TRUE(reader.GetLightQuality() == SampleQuality::Ok);
+        TEST_ASSERT_EQUAL_INT(at < 7240000 ? 115 : 112, reader.GetSoilMoisture().GetValue());
+        TEST_ASSERT_EQUAL_INT(13, reader.GetLightLevel().GetValue());
+    }
+
+    // Noted for the health log, nothing more
+    TEST_ASSERT_EQUAL_UINT(1, reader.GetSoilHealth().stuck);
+}
+
+int main(int argc, char** argv)
+{
+    char path[] = "/tmp/soil-light-trace-XXXXXX";
+    int file = mkstemp(path);
+    if (file < 0 || write(file, trace, strlen(trace)) != (ssize_t)strlen(trace))
+        return 1;
+    close(file);
+
+    bool isTraceRead = NativeHAL::UseTrace(path);
+    unlink(path);
+    if (!isTraceRead)
+        return 1;
+
+    NativeHAL::UseManualClock(true);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_a_jump_to_the_rail_is_flagged_after_a_few_reads);
+    RUN_TEST(test_a_drift_onto_the_rail_is_a_real_reading);
+    RUN_TEST(test_a_flat_signal_is_a_real_reading);
+    return UNITY_END();
+}